@@ -0,0 +1,620 @@
+// Benchmarks do sistema de biblioteca.
+//
+// Compilar com: gcc -O2 bench.c -o output/bench.exe -pthread
+// Para bases maiores, aumente os limites na compilação, ex.:
+//   gcc -O2 -DMAX_LIVROS=1000000 -DMAX_USUARIOS=1000000 -DMAX_EMPRESTIMOS=10000000 bench.c -o output/bench.exe -pthread
+//
+// O programa gera uma base sintética determinística (mesma semente e mesma data = mesmos
+// arquivos) em um diretório próprio e mede, sobre as mesmas funções usadas pelos menus e
+// pela linha de comando: carga, salvamento, busca por código, pesquisa por trecho do
+// título (exata e aproximada), sugestões pelo início do título, empréstimo, renovação,
+// devolução (funções api_*), cada relatório (inclusive os painéis agregados e as listagens
+// ordenadas) e o salvamento depois de uma única alteração.
+// O que o sistema imprime vai para /dev/null.
+//
+// Cada medição gera uma linha JSON na saída padrão, para comparar execuções:
+//   {"bench":"carregar_dados","armazenamento":"texto","livros":1000,...,"ns_min":...,"ns_mediana":...,"ns_por_op":...}
+//
+// Opções:
+//   --escala N       N empréstimos, N/10 livros e N/10 usuários (padrão 10000)
+//   --livros N, --usuarios N, --emprestimos N   ajustam cada tabela separadamente
+//   --semente S      semente do gerador (padrão 42)
+//   --data D/M/A     data de referência da base (padrão: hoje)
+//   --dir CAMINHO    diretório dos arquivos gerados (padrão bench_dados)
+//   --repeticoes R   repetições de cada medição (padrão 5)
+//   --operacoes K    operações por repetição nos benchmarks de balcão (padrão 1000)
+//   --so-gerar       apenas gera os arquivos e encerra
+//   --sem-gerar      usa os arquivos já existentes no diretório
+// BIBLIOTECA_THREADS e BIBLIOTECA_ARMAZENAMENTO valem como no programa principal; com
+// armazenamento compactado a base gerada é convertida para emprestimos.bin antes das medições.
+
+#define BIBLIOTECA_SEM_MAIN
+#ifndef MAX_LIVROS
+#define MAX_LIVROS 100000
+#endif
+#ifndef MAX_USUARIOS
+#define MAX_USUARIOS 100000
+#endif
+#ifndef MAX_EMPRESTIMOS
+#define MAX_EMPRESTIMOS 1000000
+#endif
+#include "library.c"
+
+#include <sys/stat.h>
+
+// --- GERADOR DETERMINÍSTICO ---
+
+uint64_t estado_gerador;
+
+// xorshift64*: rápido e reprodutível em qualquer plataforma
+uint64_t proximo_aleatorio() {
+    estado_gerador ^= estado_gerador >> 12;
+    estado_gerador ^= estado_gerador << 25;
+    estado_gerador ^= estado_gerador >> 27;
+    return estado_gerador * 2685821657736338717ULL;
+}
+
+// Inteiro uniforme em [0, limite)
+int aleatorio_ate(int limite) {
+    return (int)(proximo_aleatorio() % (uint64_t)limite);
+}
+
+const char *palavras_titulo[] = {
+    "Historia", "Fundamentos", "Segredo", "Cidade", "Mar", "Teoria", "Jardim", "Noite",
+    "Sistemas", "Algoritmos", "Memorias", "Viagem", "Casa", "Rio", "Tempo", "Sombra",
+    "Arte", "Calculo", "Fisica", "Quimica", "Biologia", "Direito", "Economia", "Estrelas",
+    "Caminho", "Cronicas", "Misterio", "Relogio", "Chuva", "Ilha", "Montanha", "Vento",
+    "Dados", "Redes", "Projeto", "Poesia", "Contos", "Guerra", "Paz", "Luz"
+};
+const char *conectivos_titulo[] = {"do", "da", "de", "e", "no", "na", "sobre o", "entre a"};
+const char *nomes[] = {
+    "Ana", "Bruno", "Carla", "Daniel", "Eduarda", "Felipe", "Gabriela", "Heitor", "Isabela",
+    "Joao", "Larissa", "Marcos", "Natalia", "Otavio", "Patricia", "Rafael", "Sofia", "Tiago",
+    "Vitoria", "Yuri"
+};
+const char *sobrenomes[] = {
+    "Silva", "Souza", "Oliveira", "Santos", "Pereira", "Lima", "Costa", "Almeida", "Gomes",
+    "Ribeiro", "Carvalho", "Rocha", "Martins", "Araujo", "Barbosa", "Cardoso"
+};
+const char *editoras[] = {
+    "Horizonte Editorial", "Livros & Afins", "Tecno Saber", "Editora Aurora", "Casa das Letras",
+    "Nova Academia", "Pagina Viva", "Editora Atlas Sul"
+};
+const char *cursos[] = {
+    "Engenharia de Software", "Arquitetura e Urbanismo", "Psicologia Clinica", "Direito",
+    "Medicina", "Administracao", "Ciencia da Computacao", "Letras", "Historia", "Matematica"
+};
+
+#define NUM_ELEMENTOS(v) ((int)(sizeof(v) / sizeof((v)[0])))
+
+#define DIAS_HISTORICO 730 // Os empréstimos gerados cobrem os dois anos anteriores à referência
+
+// Datas de (referência - DIAS_HISTORICO) até a referência, uma por dia
+Data calendario[DIAS_HISTORICO + 1];
+
+void montar_calendario(Data referencia) {
+    Data d = {referencia.dia, referencia.mes, referencia.ano - 2};
+    if (d.mes == 2 && d.dia == 29) d.dia = 28;
+    int n = 0;
+    while (n <= DIAS_HISTORICO && comparar_datas(d, referencia) <= 0) {
+        calendario[n++] = d;
+        d = calcular_data_devolucao(d, 1);
+    }
+    // Anos bissextos deixam o intervalo um dia menor; repete a referência até completar
+    while (n <= DIAS_HISTORICO) {
+        calendario[n++] = referencia;
+    }
+}
+
+// Data aleatória entre 'dias_atras' dias antes da referência e a própria referência
+Data data_recente(int dias_atras) {
+    return calendario[DIAS_HISTORICO - aleatorio_ate(dias_atras + 1)];
+}
+
+bool gerar_base(int num_livros, int num_usuarios, int num_emprestimos) {
+    int *ativos_por_livro = calloc(num_livros, sizeof(int));
+    int *exemplares_por_livro = malloc(sizeof(int) * num_livros);
+    if (ativos_por_livro == NULL || exemplares_por_livro == NULL) {
+        free(ativos_por_livro);
+        free(exemplares_por_livro);
+        fprintf(stderr, "[ERRO] Memoria insuficiente para gerar a base.\n");
+        return false;
+    }
+    for (int i = 0; i < num_livros; i++) {
+        exemplares_por_livro[i] = 1 + aleatorio_ate(10);
+    }
+
+    // Os empréstimos são gerados primeiro para que a disponibilidade dos livros feche
+    FILE *f = fopen(ARQ_EMPRESTIMOS, "w");
+    if (f == NULL) {
+        free(ativos_por_livro);
+        free(exemplares_por_livro);
+        fprintf(stderr, "[ERRO] Nao foi possivel criar %s.\n", ARQ_EMPRESTIMOS);
+        return false;
+    }
+    fprintf(f, "%d\n", num_emprestimos + 1);
+    for (int i = 0; i < num_emprestimos; i++) {
+        int livro = aleatorio_ate(num_livros);
+        // Cerca de 20% ativos (recentes, parte deles em atraso) e o resto já devolvido
+        bool ativo = aleatorio_ate(5) == 0 && ativos_por_livro[livro] < exemplares_por_livro[livro];
+        Data inicio = ativo ? data_recente(14) : data_recente(DIAS_HISTORICO - DIAS_ATRASO);
+        Data prevista = calcular_data_devolucao(inicio, DIAS_ATRASO);
+        // Devolvidos entre o dia seguinte e uma semana depois do prazo, nunca depois da referência
+        Data devolucao = ativo ? DATA_INDEFINIDA : calcular_data_devolucao(inicio, 1 + aleatorio_ate(2 * DIAS_ATRASO));
+        if (!ativo && comparar_datas(devolucao, calendario[DIAS_HISTORICO]) > 0) {
+            devolucao = calendario[DIAS_HISTORICO];
+        }
+        if (ativo) {
+            ativos_por_livro[livro]++;
+        }
+        fprintf(f, "%d;%d;%d;%d/%d/%d;%d/%d/%d;%s;%d;%d/%d/%d\n",
+                i + 1, 1 + aleatorio_ate(num_usuarios), livro + 1,
+                inicio.dia, inicio.mes, inicio.ano,
+                prevista.dia, prevista.mes, prevista.ano,
+                ativo ? "ATIVO" : "DEVOLVIDO",
+                ativo ? aleatorio_ate(2) : aleatorio_ate(3),
+                devolucao.dia, devolucao.mes, devolucao.ano);
+    }
+    fclose(f);
+
+    f = fopen(ARQ_LIVROS, "w");
+    if (f == NULL) {
+        free(ativos_por_livro);
+        free(exemplares_por_livro);
+        fprintf(stderr, "[ERRO] Nao foi possivel criar %s.\n", ARQ_LIVROS);
+        return false;
+    }
+    fprintf(f, "%d\n", num_livros + 1);
+    for (int i = 0; i < num_livros; i++) {
+        int disponiveis = exemplares_por_livro[i] - ativos_por_livro[i];
+        fprintf(f, "%d;%s %s %s;%s %s;%s;%d;%d;%s;%d\n",
+                i + 1,
+                palavras_titulo[aleatorio_ate(NUM_ELEMENTOS(palavras_titulo))],
+                conectivos_titulo[aleatorio_ate(NUM_ELEMENTOS(conectivos_titulo))],
+                palavras_titulo[aleatorio_ate(NUM_ELEMENTOS(palavras_titulo))],
+                nomes[aleatorio_ate(NUM_ELEMENTOS(nomes))],
+                sobrenomes[aleatorio_ate(NUM_ELEMENTOS(sobrenomes))],
+                editoras[aleatorio_ate(NUM_ELEMENTOS(editoras))],
+                1900 + aleatorio_ate(126),
+                disponiveis,
+                disponiveis > 0 ? "DISPONIVEL" : "INDISPONIVEL",
+                exemplares_por_livro[i]);
+    }
+    fclose(f);
+    free(ativos_por_livro);
+    free(exemplares_por_livro);
+
+    f = fopen(ARQ_USUARIOS, "w");
+    if (f == NULL) {
+        fprintf(stderr, "[ERRO] Nao foi possivel criar %s.\n", ARQ_USUARIOS);
+        return false;
+    }
+    fprintf(f, "%d\n", num_usuarios + 1);
+    for (int i = 0; i < num_usuarios; i++) {
+        Data cadastro = data_recente(DIAS_HISTORICO);
+        fprintf(f, "%d;%s %s %s;%s;%d%09d;%d/%d/%d\n",
+                i + 1,
+                nomes[aleatorio_ate(NUM_ELEMENTOS(nomes))],
+                sobrenomes[aleatorio_ate(NUM_ELEMENTOS(sobrenomes))],
+                sobrenomes[aleatorio_ate(NUM_ELEMENTOS(sobrenomes))],
+                cursos[aleatorio_ate(NUM_ELEMENTOS(cursos))],
+                11 + aleatorio_ate(89), aleatorio_ate(1000000000),
+                cadastro.dia, cadastro.mes, cadastro.ano);
+    }
+    fclose(f);
+
+    // Regra padrão sem limites e nenhuma reserva: as operações de balcão nunca são recusadas
+    f = fopen(ARQ_POLITICAS, "w");
+    if (f == NULL) {
+        fprintf(stderr, "[ERRO] Nao foi possivel criar %s.\n", ARQ_POLITICAS);
+        return false;
+    }
+    fprintf(f, "PADRAO;*;%d;*;*\n", DIAS_ATRASO);
+    fclose(f);
+    remove(ARQ_RESERVAS);
+    remove(ARQ_EMPRESTIMOS_COMPACTADO); // O texto recém-gerado é a base
+    remove(ARQ_INDICES);
+    return true;
+}
+
+// --- MEDIÇÃO ---
+
+#define MAX_REPETICOES 100
+
+FILE *saida_bench; // Saída padrão original; a do programa vai para /dev/null
+
+int comparar_tempos(const void *a, const void *b) {
+    long long x = *(const long long *)a;
+    long long y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+// Emite uma linha JSON com o menor tempo e a mediana das repetições
+void registrar_medicao(const char *nome, long long *tempos, int repeticoes, long long operacoes) {
+    qsort(tempos, repeticoes, sizeof(long long), comparar_tempos);
+    long long mediana = tempos[repeticoes / 2];
+    fprintf(saida_bench,
+            "{\"bench\":\"%s\",\"armazenamento\":\"%s\",\"livros\":%d,\"usuarios\":%d,\"emprestimos\":%d,\"threads\":%d,"
+            "\"repeticoes\":%d,\"operacoes\":%lld,\"ns_min\":%lld,\"ns_mediana\":%lld,\"ns_por_op\":%.1f}\n",
+            nome, emprestimos_compactados ? "compactado" : "texto", (int)total_livros, (int)total_usuarios, (int)total_emprestimos,
+            obter_threads_relatorio(), repeticoes, operacoes, tempos[0], mediana,
+            (double)mediana / (double)(operacoes > 0 ? operacoes : 1));
+    fflush(saida_bench);
+}
+
+void zerar_dados() {
+    total_livros = 0;
+    total_usuarios = 0;
+    total_emprestimos = 0;
+    total_reservas = 0;
+}
+
+void bench_carga_e_salvamento(int repeticoes, bool medir_salvamento) {
+    long long tempos[MAX_REPETICOES];
+    const char *nome = medir_salvamento ? "salvar_dados" : "carregar_dados";
+    for (int r = 0; r < repeticoes; r++) {
+        long long inicio;
+        if (medir_salvamento) {
+            invalidar_gravacoes(); // Custo da gravação completa, não só do que mudou
+            inicio = agora_ns();
+            salvar_dados();
+        } else {
+            zerar_dados();
+            inicio = agora_ns();
+            carregar_dados();
+        }
+        tempos[r] = agora_ns() - inicio;
+    }
+    registrar_medicao(nome, tempos, repeticoes, (long long)total_livros + total_usuarios + total_emprestimos);
+}
+
+// Salvamento depois de uma única devolução: mede o custo de regravar só o que mudou
+void bench_salvamento_incremental(int repeticoes) {
+    long long tempos[MAX_REPETICOES];
+    int medidas = 0;
+    salvar_dados(); // Parte de arquivos iguais à memória
+    for (int i = 0; i < total_emprestimos && medidas < repeticoes; i++) {
+        if (strcmp(lista_emprestimos[i].status, "ATIVO") != 0) continue;
+        ResultadoDevolucao devolucao;
+        if (api_realizar_devolucao(lista_emprestimos[i].codigo_emprestimo, &devolucao) != RESULTADO_OK) continue;
+        long long inicio = agora_ns();
+        salvar_dados();
+        tempos[medidas++] = agora_ns() - inicio;
+    }
+    if (medidas > 0) {
+        registrar_medicao("salvar_dados_incremental", tempos, medidas, 1);
+    }
+}
+
+volatile int sumidouro; // Impede que o compilador descarte as buscas
+
+void bench_busca_por_codigo(int repeticoes, int operacoes) {
+    long long tempos[MAX_REPETICOES];
+    const char *nomes_busca[] = {"buscar_livro_por_codigo", "buscar_usuario_por_matricula", "buscar_emprestimo_por_codigo"};
+    int *codigos = malloc(sizeof(int) * operacoes);
+    if (codigos == NULL) {
+        fprintf(stderr, "[ERRO] Memoria insuficiente.\n");
+        return;
+    }
+
+    for (int tipo = 0; tipo < 3; tipo++) {
+        int total = tipo == 0 ? total_livros : tipo == 1 ? total_usuarios : total_emprestimos;
+        if (total == 0) continue;
+        // Códigos existentes, sorteados fora da medição
+        for (int i = 0; i < operacoes; i++) {
+            int pos = aleatorio_ate(total);
+            codigos[i] = tipo == 0 ? acervo_livros[pos].codigo
+                       : tipo == 1 ? lista_usuarios[pos].matricula
+                       : lista_emprestimos[pos].codigo_emprestimo;
+        }
+        for (int r = 0; r < repeticoes; r++) {
+            long long inicio = agora_ns();
+            int soma = 0;
+            for (int i = 0; i < operacoes; i++) {
+                soma += tipo == 0 ? buscar_livro_por_codigo(codigos[i])
+                      : tipo == 1 ? buscar_usuario_por_matricula(codigos[i])
+                      : buscar_emprestimo_por_codigo(codigos[i]);
+            }
+            tempos[r] = agora_ns() - inicio;
+            sumidouro = soma;
+        }
+        registrar_medicao(nomes_busca[tipo], tempos, repeticoes, operacoes);
+    }
+    free(codigos);
+}
+
+void bench_pesquisa_titulo(int repeticoes, int operacoes) {
+    long long tempos[MAX_REPETICOES];
+    int *resultados = malloc(sizeof(int) * MAX_LIVROS);
+    if (resultados == NULL) {
+        fprintf(stderr, "[ERRO] Memoria insuficiente.\n");
+        return;
+    }
+    for (int r = 0; r < repeticoes; r++) {
+        long long inicio = agora_ns();
+        for (int i = 0; i < operacoes; i++) {
+            CriteriosPesquisaLivro criterios = {0, "", "", 0};
+            strcpy(criterios.titulo, palavras_titulo[aleatorio_ate(NUM_ELEMENTOS(palavras_titulo))]);
+            sumidouro = api_pesquisar_livros(&criterios, resultados);
+        }
+        tempos[r] = agora_ns() - inicio;
+    }
+    free(resultados);
+    registrar_medicao("api_pesquisar_livros_titulo", tempos, repeticoes, operacoes);
+}
+
+// Títulos existentes com um caractere trocado, como digitados com erro no balcão
+void bench_pesquisa_aproximada(int repeticoes, int operacoes) {
+    long long tempos[MAX_REPETICOES];
+    ResultadoAproximado *resultados = malloc(sizeof(ResultadoAproximado) * MAX_LIVROS);
+    char (*termos)[TAM_TITULO] = malloc(sizeof(*termos) * operacoes);
+    if (resultados == NULL || termos == NULL || total_livros == 0) {
+        free(resultados);
+        free(termos);
+        fprintf(stderr, "[ERRO] Base vazia ou memoria insuficiente para a pesquisa aproximada.\n");
+        return;
+    }
+    for (int i = 0; i < operacoes; i++) {
+        strcpy(termos[i], acervo_livros[aleatorio_ate(total_livros)].titulo);
+        termos[i][aleatorio_ate((int)strlen(termos[i]))] = 'x';
+    }
+    for (int r = 0; r < repeticoes; r++) {
+        long long inicio = agora_ns();
+        for (int i = 0; i < operacoes; i++) {
+            sumidouro = api_pesquisar_aproximado(CAMPO_TITULO, termos[i], -1, resultados);
+        }
+        tempos[r] = agora_ns() - inicio;
+    }
+    free(resultados);
+    free(termos);
+    registrar_medicao("api_pesquisar_aproximado_titulo", tempos, repeticoes, operacoes);
+}
+
+// Cada operação completa um prefixo de 1 a 8 caracteres de um título sorteado (como quem
+// digita letra a letra); a primeira chamada, fora da medição, constrói o índice
+void bench_autocompletar(int repeticoes, int operacoes) {
+    long long tempos[MAX_REPETICOES];
+    char (*prefixos)[TAM_TITULO] = malloc(sizeof(*prefixos) * operacoes);
+    if (prefixos == NULL || total_livros == 0) {
+        free(prefixos);
+        fprintf(stderr, "[ERRO] Base vazia ou memoria insuficiente para completar prefixos.\n");
+        return;
+    }
+    for (int i = 0; i < operacoes; i++) {
+        snprintf(prefixos[i], TAM_TITULO, "%.*s", 1 + aleatorio_ate(8), acervo_livros[aleatorio_ate(total_livros)].titulo);
+    }
+    int posicoes[SUGESTOES_PADRAO];
+    api_completar_prefixo(CAMPO_TITULO, "", SUGESTOES_PADRAO, posicoes, NULL);
+    for (int r = 0; r < repeticoes; r++) {
+        long long inicio = agora_ns();
+        for (int i = 0; i < operacoes; i++) {
+            sumidouro = api_completar_prefixo(CAMPO_TITULO, prefixos[i], SUGESTOES_PADRAO, posicoes, NULL);
+        }
+        tempos[r] = agora_ns() - inicio;
+    }
+    free(prefixos);
+    registrar_medicao("api_completar_prefixo_titulo", tempos, repeticoes, operacoes);
+}
+
+void bench_relatorios(int repeticoes) {
+    struct {
+        const char *nome;
+        void (*funcao)(void);
+        OrdemListagem ordem;
+    } relatorios[] = {
+        {"listar_emprestimos_ativos", listar_emprestimos_ativos, ORDEM_CADASTRO},
+        {"listar_emprestimos_ativos_por_devolucao", listar_emprestimos_ativos, ORDEM_DEVOLUCAO},
+        {"listar_emprestimos_ativos_por_titulo", listar_emprestimos_ativos, ORDEM_TITULO},
+        {"relatorio_livros_mais_emprestados", relatorio_livros_mais_emprestados, ORDEM_CADASTRO},
+        {"relatorio_usuarios_em_atraso", relatorio_usuarios_em_atraso, ORDEM_CADASTRO},
+        {"relatorio_usuarios_em_atraso_por_usuario", relatorio_usuarios_em_atraso, ORDEM_USUARIO},
+        {"relatorio_reservas_pendentes", relatorio_reservas_pendentes, ORDEM_CADASTRO},
+        {"relatorio_emprestimos_por_mes", relatorio_emprestimos_por_mes, ORDEM_CADASTRO},
+        {"relatorio_emprestimos_por_curso", relatorio_emprestimos_por_curso, ORDEM_CADASTRO},
+    };
+    long long tempos[MAX_REPETICOES];
+    for (int k = 0; k < NUM_ELEMENTOS(relatorios); k++) {
+        opcoes_saida.ordem = relatorios[k].ordem;
+        for (int r = 0; r < repeticoes; r++) {
+            long long inicio = agora_ns();
+            relatorios[k].funcao();
+            tempos[r] = agora_ns() - inicio;
+        }
+        registrar_medicao(relatorios[k].nome, tempos, repeticoes, 1);
+    }
+    opcoes_saida.ordem = ORDEM_CADASTRO;
+}
+
+// Empréstimo, renovação e devolução de 'operacoes' livros com exemplar na estante
+void bench_balcao(int repeticoes, int operacoes) {
+    long long tempos_emprestimo[MAX_REPETICOES];
+    long long tempos_renovacao[MAX_REPETICOES];
+    long long tempos_devolucao[MAX_REPETICOES];
+    int *disponiveis = malloc(sizeof(int) * (total_livros + 1));
+    int *matriculas = malloc(sizeof(int) * (operacoes + 1));
+    int *livros = malloc(sizeof(int) * (operacoes + 1));
+    int *codigos = malloc(sizeof(int) * (operacoes + 1));
+    if (disponiveis == NULL || matriculas == NULL || livros == NULL || codigos == NULL ||
+        total_livros == 0 || total_usuarios == 0) {
+        free(disponiveis);
+        free(matriculas);
+        free(livros);
+        free(codigos);
+        fprintf(stderr, "[ERRO] Base vazia ou memoria insuficiente para o benchmark de balcao.\n");
+        return;
+    }
+
+    int realizados = 0;
+    for (int r = 0; r < repeticoes; r++) {
+        // Sorteia fora da medição pares usuário/livro com exemplar na estante
+        for (int i = 0; i < total_livros; i++) {
+            disponiveis[i] = atomic_load(&acervo_livros[i].exemplares_disponiveis);
+        }
+        realizados = 0;
+        for (int i = 0; i < operacoes; i++) {
+            int livro = aleatorio_ate(total_livros);
+            int tentativas = 0;
+            while (disponiveis[livro] <= 0 && tentativas++ < total_livros) {
+                livro = (livro + 1) % total_livros;
+            }
+            if (disponiveis[livro] <= 0) break; // Acervo esgotado
+            disponiveis[livro]--;
+            matriculas[realizados] = lista_usuarios[aleatorio_ate(total_usuarios)].matricula;
+            livros[realizados] = acervo_livros[livro].codigo;
+            realizados++;
+        }
+
+        Emprestimo emprestimo;
+        long long inicio = agora_ns();
+        for (int i = 0; i < realizados; i++) {
+            codigos[i] = api_realizar_emprestimo(matriculas[i], livros[i], &emprestimo) == RESULTADO_OK
+                       ? emprestimo.codigo_emprestimo : 0;
+        }
+        tempos_emprestimo[r] = agora_ns() - inicio;
+
+        inicio = agora_ns();
+        for (int i = 0; i < realizados; i++) {
+            api_renovar_emprestimo(codigos[i], NULL, NULL);
+        }
+        tempos_renovacao[r] = agora_ns() - inicio;
+
+        inicio = agora_ns();
+        for (int i = 0; i < realizados; i++) {
+            api_realizar_devolucao(codigos[i], NULL);
+        }
+        tempos_devolucao[r] = agora_ns() - inicio;
+    }
+    free(disponiveis);
+    free(matriculas);
+    free(livros);
+    free(codigos);
+
+    registrar_medicao("api_realizar_emprestimo", tempos_emprestimo, repeticoes, realizados);
+    registrar_medicao("api_renovar_emprestimo", tempos_renovacao, repeticoes, realizados);
+    registrar_medicao("api_realizar_devolucao", tempos_devolucao, repeticoes, realizados);
+}
+
+// --- FUNÇÃO PRINCIPAL ---
+
+int ler_opcao_inteira(const char *valor, const char *opcao) {
+    char *fim;
+    long n = strtol(valor, &fim, 10);
+    if (*fim != '\0' || n < 0 || n > INT_MAX) {
+        fprintf(stderr, "[ERRO] Valor invalido para %s: %s\n", opcao, valor);
+        exit(1);
+    }
+    return (int)n;
+}
+
+int main(int argc, char *argv[]) {
+    int num_livros = -1, num_usuarios = -1, num_emprestimos = -1;
+    int escala = 10000;
+    uint64_t semente = 42;
+    const char *diretorio = "bench_dados";
+    int repeticoes = 5;
+    int operacoes = 1000;
+    bool so_gerar = false, sem_gerar = false;
+    Data referencia = data_atual();
+
+    for (int i = 1; i < argc; i++) {
+        const char *valor = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--so-gerar") == 0) {
+            so_gerar = true;
+        } else if (strcmp(argv[i], "--sem-gerar") == 0) {
+            sem_gerar = true;
+        } else if (valor == NULL) {
+            fprintf(stderr, "[ERRO] Opcao desconhecida ou sem valor: %s\n", argv[i]);
+            return 1;
+        } else {
+            if (strcmp(argv[i], "--escala") == 0) escala = ler_opcao_inteira(valor, argv[i]);
+            else if (strcmp(argv[i], "--livros") == 0) num_livros = ler_opcao_inteira(valor, argv[i]);
+            else if (strcmp(argv[i], "--usuarios") == 0) num_usuarios = ler_opcao_inteira(valor, argv[i]);
+            else if (strcmp(argv[i], "--emprestimos") == 0) num_emprestimos = ler_opcao_inteira(valor, argv[i]);
+            else if (strcmp(argv[i], "--semente") == 0) semente = strtoull(valor, NULL, 10);
+            else if (strcmp(argv[i], "--dir") == 0) diretorio = valor;
+            else if (strcmp(argv[i], "--repeticoes") == 0) repeticoes = ler_opcao_inteira(valor, argv[i]);
+            else if (strcmp(argv[i], "--operacoes") == 0) operacoes = ler_opcao_inteira(valor, argv[i]);
+            else if (strcmp(argv[i], "--data") == 0) {
+                if (sscanf(valor, "%d/%d/%d", &referencia.dia, &referencia.mes, &referencia.ano) != 3) {
+                    fprintf(stderr, "[ERRO] Data invalida: %s\n", valor);
+                    return 1;
+                }
+            } else {
+                fprintf(stderr, "[ERRO] Opcao desconhecida: %s\n", argv[i]);
+                return 1;
+            }
+            i++;
+        }
+    }
+    if (num_livros < 0) num_livros = escala / 10 > 0 ? escala / 10 : 1;
+    if (num_usuarios < 0) num_usuarios = escala / 10 > 0 ? escala / 10 : 1;
+    if (num_emprestimos < 0) num_emprestimos = escala;
+    if (repeticoes < 1 || repeticoes > MAX_REPETICOES) {
+        fprintf(stderr, "[ERRO] Repeticoes devem estar entre 1 e %d.\n", MAX_REPETICOES);
+        return 1;
+    }
+    if (num_livros < 1 || num_usuarios < 1) {
+        fprintf(stderr, "[ERRO] A base precisa de ao menos um livro e um usuario.\n");
+        return 1;
+    }
+    // Os benchmarks de balcão acrescentam 'operacoes' empréstimos por repetição
+    if (num_livros > MAX_LIVROS || num_usuarios > MAX_USUARIOS ||
+        (long long)num_emprestimos + (long long)repeticoes * operacoes > MAX_EMPRESTIMOS) {
+        fprintf(stderr, "[ERRO] Base maior que os limites compilados (livros %d, usuarios %d, emprestimos %d).\n"
+                        "       Recompile com -DMAX_LIVROS=... -DMAX_USUARIOS=... -DMAX_EMPRESTIMOS=...\n",
+                MAX_LIVROS, MAX_USUARIOS, MAX_EMPRESTIMOS);
+        return 1;
+    }
+
+    mkdir(diretorio, 0755);
+    if (chdir(diretorio) != 0) {
+        fprintf(stderr, "[ERRO] Nao foi possivel usar o diretorio %s.\n", diretorio);
+        return 1;
+    }
+
+    estado_gerador = semente ? semente : 1;
+    if (!sem_gerar) {
+        montar_calendario(referencia);
+        if (!gerar_base(num_livros, num_usuarios, num_emprestimos)) {
+            return 1;
+        }
+        fprintf(stderr, "[INFO] Base gerada em %s: %d livros, %d usuarios, %d emprestimos.\n",
+                diretorio, num_livros, num_usuarios, num_emprestimos);
+    }
+    if (so_gerar) {
+        return 0;
+    }
+
+    // Resultados na saída original; mensagens do sistema descartadas
+    saida_bench = fdopen(dup(STDOUT_FILENO), "w");
+    if (saida_bench == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        fprintf(stderr, "[ERRO] Nao foi possivel redirecionar a saida.\n");
+        return 1;
+    }
+
+    inicializar_concorrencia();
+    if (!inicializar_indices()) {
+        fprintf(stderr, "[ERRO] Memoria insuficiente para iniciar o sistema.\n");
+        return 1;
+    }
+    ler_configuracao_ambiente();
+    if (emprestimos_compactados && strcmp(arquivo_emprestimos_em_uso(), ARQ_EMPRESTIMOS) == 0) {
+        carregar_dados();
+        salvar_dados();
+        zerar_dados();
+    }
+
+    bench_carga_e_salvamento(repeticoes, false);
+    bench_busca_por_codigo(repeticoes, operacoes * 100);
+    bench_pesquisa_titulo(repeticoes, operacoes / 100 > 0 ? operacoes / 100 : 1);
+    bench_pesquisa_aproximada(repeticoes, operacoes);
+    bench_autocompletar(repeticoes, operacoes);
+    bench_relatorios(repeticoes);
+    bench_balcao(repeticoes, operacoes);
+    bench_carga_e_salvamento(repeticoes, true);
+    bench_salvamento_incremental(repeticoes);
+
+    encerrar_pool();
+    fclose(saida_bench);
+    return 0;
+}
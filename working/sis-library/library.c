@@ -1,15 +1,37 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
 #include <time.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// Compilar com: gcc library.c -o output/library.exe -pthread
+// Requer um ambiente POSIX (Linux, macOS, ou Cygwin/MSYS2 no Windows): usa pthreads,
+// unistd.h (pread, fsync, chdir, getcwd, isatty, sysconf) e mkdir com permissões.
+// Não compila com MSVC nem com MinGW puro.
+// Benchmarks:   gcc -O2 bench.c -o output/bench.exe -pthread (ver bench.c)
 
 // --- PARTE 1: ESTRUTURAS DE DADOS E CONSTANTES ---
 
-// Constantes para limites
+// Constantes para limites (podem ser redefinidas na compilação, ex.: -DMAX_LIVROS=100000)
+#ifndef MAX_LIVROS
 #define MAX_LIVROS 100
+#endif
+#ifndef MAX_USUARIOS
 #define MAX_USUARIOS 100
+#endif
+#ifndef MAX_EMPRESTIMOS
 #define MAX_EMPRESTIMOS 100
+#endif
 #define TAM_TITULO 100
 #define TAM_AUTOR 80
 #define TAM_EDITORA 60
@@ -25,6 +47,8 @@ typedef struct {
     int ano;
 } Data;
 
+#define DATA_INDEFINIDA ((Data){0, 0, 0}) // Data ainda não ocorrida ou não registrada
+
 // Estrutura para Livro
 typedef struct {
     int codigo; // Código do livro (inteiro)
@@ -32,8 +56,8 @@ typedef struct {
     char autor[TAM_AUTOR];
     char editora[TAM_EDITORA];
     int ano_publicacao;
-    int exemplares_disponiveis;
-    char status[15]; // "DISPONIVEL" ou "EMPRESTADO" (apenas para o acervo total)
+    atomic_int exemplares_disponiveis; // Alterado só por CAS (ver reservar_exemplar/devolver_exemplar)
+    char status[15]; // "DISPONIVEL" ou "INDISPONIVEL" lido do arquivo; o vigente vem de status_livro()
     int total_exemplares; // Novo campo para rastrear o total
 } Livro;
 
@@ -52,8 +76,10 @@ typedef struct {
     int matricula_usuario;
     int codigo_livro;
     Data data_emprestimo;
-    Data data_prevista_devolucao; // 7 dias após empréstimo
+    Data data_prevista_devolucao; // Prazo definido pela política de empréstimos (padrão: 7 dias)
     char status[15]; // "ATIVO" ou "DEVOLVIDO"
+    int renovacoes; // Quantas vezes o empréstimo já foi renovado
+    Data data_devolucao; // Dia da devolução; 0/0/0 enquanto ativo (ou em arquivos antigos)
 } Emprestimo;
 
 // Vetores de structs para armazenar os dados
@@ -61,16 +87,96 @@ Livro acervo_livros[MAX_LIVROS];
 Usuario lista_usuarios[MAX_USUARIOS];
 Emprestimo lista_emprestimos[MAX_EMPRESTIMOS];
 
-// Contadores e IDs para o próximo item
-int proximo_livro_id = 1;
-int proximo_usuario_id = 1;
-int proximo_emprestimo_id = 1;
-int total_livros = 0;
-int total_usuarios = 0;
-int total_emprestimos = 0;
+// Contadores e IDs para o próximo item (atômicos: podem ser lidos/incrementados por várias threads)
+atomic_int proximo_livro_id = 1;
+atomic_int proximo_usuario_id = 1;
+atomic_int proximo_emprestimo_id = 1;
+atomic_int total_livros = 0;
+atomic_int total_usuarios = 0;
+atomic_int total_emprestimos = 0;
+
+// --- CONCORRÊNCIA: TRAVAS SOBRE OS CADASTROS ---
+
+// Regras de acesso (sempre adquirir nesta ordem para evitar deadlock):
+//   0. trava_salvamento (um salvamento por vez: o do menu e o automático)
+//   1. trava_acervo, trava_usuarios, trava_emprestimos (leitor-escritor)
+//      - leitura: pesquisas, relatórios, empréstimos, devoluções e renovações
+//      - escrita: inclusão de livros/usuários e carga dos arquivos
+//   2. travas_livros[codigo % NUM_TRAVAS_LIVROS] (fragmentada por livro)
+//      - protege os registros de empréstimo do livro (devolução/renovação)
+//      - os exemplares disponíveis não usam trava: são contadores atômicos (CAS)
+//   3. trava_insercao_emprestimos (apenas para reservar a próxima posição do vetor)
+//   4. trava_mapa_emprestimos (índice código -> posição dos empréstimos)
+//   5. trava_indices_trigramas (índices da pesquisa aproximada; após trava_acervo/trava_usuarios)
+//   6. trava_indices_prefixos (vetores do completar por prefixo; idem)
+//   7. trava_ordens (ordens alfabéticas em cache das listagens; idem)
+#define NUM_TRAVAS_LIVROS 64
+
+pthread_rwlock_t trava_acervo = PTHREAD_RWLOCK_INITIALIZER;
+pthread_rwlock_t trava_usuarios = PTHREAD_RWLOCK_INITIALIZER;
+pthread_rwlock_t trava_emprestimos = PTHREAD_RWLOCK_INITIALIZER;
+pthread_mutex_t travas_livros[NUM_TRAVAS_LIVROS];
+pthread_mutex_t trava_insercao_emprestimos = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t trava_salvamento = PTHREAD_MUTEX_INITIALIZER;
+
+// Inicializa as travas fragmentadas (chamada uma única vez no início do programa)
+void inicializar_concorrencia() {
+    for (int i = 0; i < NUM_TRAVAS_LIVROS; i++) {
+        pthread_mutex_init(&travas_livros[i], NULL);
+    }
+}
+
+// Retorna o fragmento (índice em travas_livros) ao qual o livro pertence
+int fragmento_do_livro(int codigo_livro) {
+    return (int)((unsigned int)codigo_livro % NUM_TRAVAS_LIVROS);
+}
+
+// Retorna a trava do fragmento ao qual o livro pertence
+pthread_mutex_t *trava_do_livro(int codigo_livro) {
+    return &travas_livros[fragmento_do_livro(codigo_livro)];
+}
+
+// Maior código que gerar_id entrega: o fim da faixa da unidade em uso (ver UNIDADES)
+int ultimo_id_permitido = INT_MAX - 1;
+
+// Gera um novo ID de forma atômica (nunca repete, mesmo com várias threads). Retorna -1,
+// sem avançar o contador, se a faixa de códigos acabou.
+int gerar_id(atomic_int *proximo_id) {
+    int id = atomic_load(proximo_id);
+    do {
+        if (id > ultimo_id_permitido) {
+            return -1;
+        }
+    } while (!atomic_compare_exchange_weak(proximo_id, &id, id + 1));
+    return id;
+}
+
+// Acesso compartilhado a todos os cadastros (pesquisas, relatórios, empréstimos)
+void travar_leitura_cadastros() {
+    pthread_rwlock_rdlock(&trava_acervo);
+    pthread_rwlock_rdlock(&trava_usuarios);
+    pthread_rwlock_rdlock(&trava_emprestimos);
+}
+
+// Acesso exclusivo a todos os cadastros (carga dos arquivos)
+void travar_escrita_cadastros() {
+    pthread_rwlock_wrlock(&trava_acervo);
+    pthread_rwlock_wrlock(&trava_usuarios);
+    pthread_rwlock_wrlock(&trava_emprestimos);
+}
+
+// Libera as travas adquiridas por travar_leitura_cadastros()/travar_escrita_cadastros()
+void destravar_cadastros() {
+    pthread_rwlock_unlock(&trava_emprestimos);
+    pthread_rwlock_unlock(&trava_usuarios);
+    pthread_rwlock_unlock(&trava_acervo);
+}
 
 // --- FUNÇÕES AUXILIARES GLOBAIS ---
 
+// Suprime as mensagens informativas de carga e salvamento (modo linha de comando)
+bool modo_silencioso = false;
+
 // Limpa o buffer de entrada
 void limpar_buffer() {
     int c;
@@ -108,13 +214,15 @@ int dias_no_mes(int mes, int ano) {
 }
 
 // Retorna a data atual do sistema
+// (localtime_r: chamada ao mesmo tempo por emprestimos, workers do pool e autosave)
 Data data_atual() {
     time_t t = time(NULL);
-    struct tm *agora = localtime(&t);
+    struct tm agora;
+    localtime_r(&t, &agora);
     Data d;
-    d.dia = agora->tm_mday;
-    d.mes = agora->tm_mon + 1;
-    d.ano = agora->tm_year + 1900;
+    d.dia = agora.tm_mday;
+    d.mes = agora.tm_mon + 1;
+    d.ano = agora.tm_year + 1900;
     return d;
 }
 
@@ -138,6 +246,35 @@ Data calcular_data_devolucao(Data data_base, int dias) {
     return nova_data;
 }
 
+// Número do dia (dias desde 1/1/1970) de uma data do calendário gregoriano
+int dias_desde_epoca(Data d) {
+    int ano = d.ano - (d.mes <= 2);
+    int era = (ano >= 0 ? ano : ano - 399) / 400;
+    int ano_da_era = ano - era * 400;
+    int dia_do_ano = (153 * (d.mes + (d.mes > 2 ? -3 : 9)) + 2) / 5 + d.dia - 1;
+    int dia_da_era = ano_da_era * 365 + ano_da_era / 4 - ano_da_era / 100 + dia_do_ano;
+    return era * 146097 + dia_da_era - 719468;
+}
+
+// Inverso de dias_desde_epoca
+Data data_de_dias(int dias) {
+    dias += 719468;
+    int era = (dias >= 0 ? dias : dias - 146096) / 146097;
+    int dia_da_era = dias - era * 146097;
+    int ano_da_era = (dia_da_era - dia_da_era / 1460 + dia_da_era / 36524 - dia_da_era / 146096) / 365;
+    int dia_do_ano = dia_da_era - (365 * ano_da_era + ano_da_era / 4 - ano_da_era / 100);
+    int mes_desde_marco = (5 * dia_do_ano + 2) / 153;
+    Data d;
+    d.dia = dia_do_ano - (153 * mes_desde_marco + 2) / 5 + 1;
+    d.mes = mes_desde_marco < 10 ? mes_desde_marco + 3 : mes_desde_marco - 9;
+    d.ano = ano_da_era + era * 400 + (d.mes <= 2);
+    return d;
+}
+
+bool data_definida(Data d) {
+    return d.ano != 0;
+}
+
 // Compara duas datas. Retorna: -1 se d1 < d2, 0 se d1 == d2, 1 se d1 > d2
 int comparar_datas(Data d1, Data d2) {
     if (d1.ano != d2.ano) return d1.ano - d2.ano;
@@ -145,783 +282,6479 @@ int comparar_datas(Data d1, Data d2) {
     return d1.dia - d2.dia;
 }
 
-// --- PARTE 4: MANIPULAÇÃO DE ARQUIVOS ---
+// --- ESTATÍSTICAS DE OPERAÇÕES (CONTADORES E HISTOGRAMAS DE LATÊNCIA) ---
+
+// Cada operação mede apenas o processamento: o cronômetro parte depois da última entrada
+// do usuário, para que o tempo de digitação não entre na conta. As latências vão para um
+// histograma log-linear (estilo HDR): cada potência de 2 é dividida em SUBFAIXAS faixas
+// iguais, o que dá erro relativo de no máximo 1/SUBFAIXAS em qualquer escala, de
+// nanossegundos a minutos. Registrar custa alguns incrementos atômicos, sem travas.
+#define BITS_SUBFAIXA 4
+#define SUBFAIXAS (1 << BITS_SUBFAIXA)
+#define NUM_BALDES ((64 - BITS_SUBFAIXA + 1) * SUBFAIXAS)
+#define ARQ_ESTATISTICAS "estatisticas.txt"
+
+typedef enum {
+    OP_EMPRESTIMO,
+    OP_DEVOLUCAO,
+    OP_RENOVACAO,
+    OP_PESQUISA_LIVROS,
+    OP_PESQUISA_APROXIMADA,
+    OP_SALVAR_DADOS,
+    OP_CARREGAR_DADOS,
+    NUM_OPERACOES
+} TipoOperacao;
 
-// Caminhos dos arquivos
-#define ARQ_LIVROS "livros.txt"
-#define ARQ_USUARIOS "usuarios.txt"
-#define ARQ_EMPRESTIMOS "emprestimos.txt"
+typedef struct {
+    const char *nome;
+    atomic_ullong soma_ns;
+    atomic_ullong maximo_ns;
+    atomic_ullong baldes[NUM_BALDES];
+} EstatisticaOperacao;
+
+EstatisticaOperacao estatisticas[NUM_OPERACOES] = {
+    [OP_EMPRESTIMO] = {.nome = "emprestimo"},
+    [OP_DEVOLUCAO] = {.nome = "devolucao"},
+    [OP_RENOVACAO] = {.nome = "renovacao"},
+    [OP_PESQUISA_LIVROS] = {.nome = "pesquisa_livros"},
+    [OP_PESQUISA_APROXIMADA] = {.nome = "pesquisa_aproximada"},
+    [OP_SALVAR_DADOS] = {.nome = "salvar_dados"},
+    [OP_CARREGAR_DADOS] = {.nome = "carregar_dados"},
+};
+
+// Relógio monotônico em nanossegundos
+long long agora_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
 
-// Função para salvar todos os dados nos arquivos
-void salvar_dados() {
-    // 1. Salvar Livros
-    FILE *f_livros = fopen(ARQ_LIVROS, "w");
-    if (f_livros == NULL) {
-        printf("\n[ERRO] Nao foi possivel abrir %s para salvar.\n", ARQ_LIVROS);
-        return;
+// Balde do histograma para uma latência: valores pequenos têm balde próprio; os demais
+// usam o expoente (posição do bit mais alto) e os BITS_SUBFAIXA bits seguintes
+int balde_da_latencia(unsigned long long ns) {
+    if (ns < SUBFAIXAS) {
+        return (int)ns;
     }
-    fprintf(f_livros, "%d\n", proximo_livro_id); // Salva o próximo ID
-    for (int i = 0; i < total_livros; i++) {
-        fprintf(f_livros, "%d;%s;%s;%s;%d;%d;%s;%d\n",
-                acervo_livros[i].codigo,
-                acervo_livros[i].titulo,
-                acervo_livros[i].autor,
-                acervo_livros[i].editora,
-                acervo_livros[i].ano_publicacao,
-                acervo_livros[i].exemplares_disponiveis,
-                acervo_livros[i].status,
-                acervo_livros[i].total_exemplares);
-    }
-    fclose(f_livros);
+    int expoente = 63 - __builtin_clzll(ns);
+    int subfaixa = (int)(ns >> (expoente - BITS_SUBFAIXA)) & (SUBFAIXAS - 1);
+    return (expoente - BITS_SUBFAIXA + 1) * SUBFAIXAS + subfaixa;
+}
 
-    // 2. Salvar Usuários
-    FILE *f_usuarios = fopen(ARQ_USUARIOS, "w");
-    if (f_usuarios == NULL) {
-        printf("\n[ERRO] Nao foi possivel abrir %s para salvar.\n", ARQ_USUARIOS);
-        return;
-    }
-    fprintf(f_usuarios, "%d\n", proximo_usuario_id); // Salva o próximo ID
-    for (int i = 0; i < total_usuarios; i++) {
-        fprintf(f_usuarios, "%d;%s;%s;%s;%d/%d/%d\n",
-                lista_usuarios[i].matricula,
-                lista_usuarios[i].nome,
-                lista_usuarios[i].curso,
-                lista_usuarios[i].telefone,
-                lista_usuarios[i].data_cadastro.dia,
-                lista_usuarios[i].data_cadastro.mes,
-                lista_usuarios[i].data_cadastro.ano);
-    }
-    fclose(f_usuarios);
-
-    // 3. Salvar Empréstimos
-    FILE *f_emprestimos = fopen(ARQ_EMPRESTIMOS, "w");
-    if (f_emprestimos == NULL) {
-        printf("\n[ERRO] Nao foi possivel abrir %s para salvar.\n", ARQ_EMPRESTIMOS);
-        return;
+// Menor latência que cai no balde (o balde vai até o início do seguinte, exclusive)
+unsigned long long inicio_do_balde(int balde) {
+    if (balde < SUBFAIXAS) {
+        return (unsigned long long)balde;
     }
-    fprintf(f_emprestimos, "%d\n", proximo_emprestimo_id); // Salva o próximo ID
-    for (int i = 0; i < total_emprestimos; i++) {
-        fprintf(f_emprestimos, "%d;%d;%d;%d/%d/%d;%d/%d/%d;%s\n",
-                lista_emprestimos[i].codigo_emprestimo,
-                lista_emprestimos[i].matricula_usuario,
-                lista_emprestimos[i].codigo_livro,
-                lista_emprestimos[i].data_emprestimo.dia,
-                lista_emprestimos[i].data_emprestimo.mes,
-                lista_emprestimos[i].data_emprestimo.ano,
-                lista_emprestimos[i].data_prevista_devolucao.dia,
-                lista_emprestimos[i].data_prevista_devolucao.mes,
-                lista_emprestimos[i].data_prevista_devolucao.ano,
-                lista_emprestimos[i].status);
-    }
-    fclose(f_emprestimos);
-
-    printf("\n[SUCESSO] Dados salvos com sucesso!\n");
+    int expoente = balde / SUBFAIXAS + BITS_SUBFAIXA - 1;
+    unsigned long long subfaixa = (unsigned long long)(balde % SUBFAIXAS);
+    return (SUBFAIXAS + subfaixa) << (expoente - BITS_SUBFAIXA);
 }
 
-// Função para carregar dados dos arquivos
-void carregar_dados() {
-    int id_lido;
+// Registra a latência de uma operação iniciada em 'inicio_ns' (valor de agora_ns())
+void registrar_latencia(TipoOperacao op, long long inicio_ns) {
+    long long decorrido = agora_ns() - inicio_ns;
+    unsigned long long ns = decorrido > 0 ? (unsigned long long)decorrido : 0;
+    EstatisticaOperacao *e = &estatisticas[op];
+
+    atomic_fetch_add_explicit(&e->soma_ns, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&e->baldes[balde_da_latencia(ns)], 1, memory_order_relaxed);
+    unsigned long long maximo = atomic_load_explicit(&e->maximo_ns, memory_order_relaxed);
+    while (ns > maximo &&
+           !atomic_compare_exchange_weak_explicit(&e->maximo_ns, &maximo, ns,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+        // 'maximo' foi atualizado pelo CAS; tenta de novo enquanto ainda for menor
+    }
+}
 
-    // 1. Carregar Livros
-    FILE *f_livros = fopen(ARQ_LIVROS, "r");
-    if (f_livros != NULL) {
-        if (fscanf(f_livros, "%d\n", &id_lido) == 1) {
-            proximo_livro_id = id_lido;
+// Latência abaixo da qual está a fração 'quantil' das amostras (limite superior do balde)
+unsigned long long percentil_latencia(const unsigned long long *baldes, unsigned long long total, double quantil) {
+    unsigned long long alvo = (unsigned long long)(quantil * (double)total);
+    if (alvo >= total) alvo = total - 1;
+    unsigned long long acumulado = 0;
+    for (int b = 0; b < NUM_BALDES; b++) {
+        acumulado += baldes[b];
+        if (acumulado > alvo) {
+            return b + 1 < NUM_BALDES ? inicio_do_balde(b + 1) - 1 : ULLONG_MAX;
         }
+    }
+    return 0;
+}
 
-        while (total_livros < MAX_LIVROS &&
-               fscanf(f_livros, "%d;%[^;];%[^;];%[^;];%d;%d;%[^;];%d\n",
-                      &acervo_livros[total_livros].codigo,
-                      acervo_livros[total_livros].titulo,
-                      acervo_livros[total_livros].autor,
-                      acervo_livros[total_livros].editora,
-                      &acervo_livros[total_livros].ano_publicacao,
-                      &acervo_livros[total_livros].exemplares_disponiveis,
-                      acervo_livros[total_livros].status,
-                      &acervo_livros[total_livros].total_exemplares) == 8) {
-            total_livros++;
-        }
-        fclose(f_livros);
-        printf("[INFO] %d Livros carregados.\n", total_livros);
+// Escreve a duração com a unidade mais legível (ns, us, ms ou s)
+void formatar_duracao(unsigned long long ns, char *buffer, size_t tamanho) {
+    if (ns < 1000ULL) {
+        snprintf(buffer, tamanho, "%lluns", ns);
+    } else if (ns < 1000000ULL) {
+        snprintf(buffer, tamanho, "%.1fus", ns / 1e3);
+    } else if (ns < 1000000000ULL) {
+        snprintf(buffer, tamanho, "%.1fms", ns / 1e6);
     } else {
-        printf("[INFO] Arquivo %s nao encontrado. Iniciando com dados vazios.\n", ARQ_LIVROS);
+        snprintf(buffer, tamanho, "%.2fs", ns / 1e9);
     }
+}
 
-    // 2. Carregar Usuários
-    FILE *f_usuarios = fopen(ARQ_USUARIOS, "r");
-    if (f_usuarios != NULL) {
-        if (fscanf(f_usuarios, "%d\n", &id_lido) == 1) {
-            proximo_usuario_id = id_lido;
-        }
+// Copia o estado atual de uma operação (leituras relaxadas: a cópia pode ficar uma
+// amostra atrás de uma operação em andamento, o que não afeta a leitura dos números)
+unsigned long long copiar_estatistica(TipoOperacao op, unsigned long long *baldes,
+                                      unsigned long long *soma_ns, unsigned long long *maximo_ns) {
+    EstatisticaOperacao *e = &estatisticas[op];
+    unsigned long long total = 0;
+    for (int b = 0; b < NUM_BALDES; b++) {
+        baldes[b] = atomic_load_explicit(&e->baldes[b], memory_order_relaxed);
+        total += baldes[b];
+    }
+    *soma_ns = atomic_load_explicit(&e->soma_ns, memory_order_relaxed);
+    *maximo_ns = atomic_load_explicit(&e->maximo_ns, memory_order_relaxed);
+    return total;
+}
 
-        while (total_usuarios < MAX_USUARIOS &&
-               fscanf(f_usuarios, "%d;%[^;];%[^;];%[^;];%d/%d/%d\n",
-                      &lista_usuarios[total_usuarios].matricula,
-                      lista_usuarios[total_usuarios].nome,
-                      lista_usuarios[total_usuarios].curso,
-                      lista_usuarios[total_usuarios].telefone,
-                      &lista_usuarios[total_usuarios].data_cadastro.dia,
-                      &lista_usuarios[total_usuarios].data_cadastro.mes,
-                      &lista_usuarios[total_usuarios].data_cadastro.ano) == 7) {
-            total_usuarios++;
+// Imprime a tabela de contagens e percentis em 'destino'
+void escrever_estatisticas(FILE *destino) {
+    static const double quantis[] = {0.50, 0.90, 0.99, 0.999};
+    unsigned long long baldes[NUM_BALDES];
+    char campo[16];
+
+    fprintf(destino, "%-16s | %8s | %9s | %9s | %9s | %9s | %9s | %9s\n",
+            "Operacao", "Qtde", "Media", "p50", "p90", "p99", "p99.9", "Max");
+    fprintf(destino, "------------------------------------------------------------------------------------------\n");
+    for (int op = 0; op < NUM_OPERACOES; op++) {
+        unsigned long long soma, maximo;
+        unsigned long long total = copiar_estatistica(op, baldes, &soma, &maximo);
+        fprintf(destino, "%-16s | %8llu", estatisticas[op].nome, total);
+        if (total == 0) {
+            fprintf(destino, " | %9s | %9s | %9s | %9s | %9s | %9s\n", "-", "-", "-", "-", "-", "-");
+            continue;
         }
-        fclose(f_usuarios);
-        printf("[INFO] %d Usuarios carregados.\n", total_usuarios);
-    } else {
-        printf("[INFO] Arquivo %s nao encontrado. Iniciando com dados vazios.\n", ARQ_USUARIOS);
+        formatar_duracao(soma / total, campo, sizeof(campo));
+        fprintf(destino, " | %9s", campo);
+        for (int q = 0; q < 4; q++) {
+            unsigned long long p = percentil_latencia(baldes, total, quantis[q]);
+            formatar_duracao(p < maximo ? p : maximo, campo, sizeof(campo));
+            fprintf(destino, " | %9s", campo);
+        }
+        formatar_duracao(maximo, campo, sizeof(campo));
+        fprintf(destino, " | %9s\n", campo);
     }
+}
 
-    // 3. Carregar Empréstimos
-    FILE *f_emprestimos = fopen(ARQ_EMPRESTIMOS, "r");
-    if (f_emprestimos != NULL) {
-        if (fscanf(f_emprestimos, "%d\n", &id_lido) == 1) {
-            proximo_emprestimo_id = id_lido;
+// Grava a tabela e, para análise externa, os baldes não vazios de cada operação
+// (uma linha "operacao;inicio_ns;fim_ns;contagem" por balde)
+bool salvar_estatisticas(const char *caminho) {
+    FILE *f = fopen(caminho, "w");
+    if (f == NULL) {
+        return false;
+    }
+    escrever_estatisticas(f);
+    fprintf(f, "\n# operacao;inicio_ns;fim_ns;contagem\n");
+    unsigned long long baldes[NUM_BALDES];
+    for (int op = 0; op < NUM_OPERACOES; op++) {
+        unsigned long long soma, maximo;
+        copiar_estatistica(op, baldes, &soma, &maximo);
+        for (int b = 0; b < NUM_BALDES; b++) {
+            if (baldes[b] > 0) {
+                fprintf(f, "%s;%llu;%llu;%llu\n", estatisticas[op].nome, inicio_do_balde(b),
+                        b + 1 < NUM_BALDES ? inicio_do_balde(b + 1) - 1 : ULLONG_MAX, baldes[b]);
+            }
         }
+    }
+    fclose(f);
+    return true;
+}
 
-        while (total_emprestimos < MAX_EMPRESTIMOS &&
-               fscanf(f_emprestimos, "%d;%d;%d;%d/%d/%d;%d/%d/%d;%s\n",
-                      &lista_emprestimos[total_emprestimos].codigo_emprestimo,
-                      &lista_emprestimos[total_emprestimos].matricula_usuario,
-                      &lista_emprestimos[total_emprestimos].codigo_livro,
-                      &lista_emprestimos[total_emprestimos].data_emprestimo.dia,
-                      &lista_emprestimos[total_emprestimos].data_emprestimo.mes,
-                      &lista_emprestimos[total_emprestimos].data_emprestimo.ano,
-                      &lista_emprestimos[total_emprestimos].data_prevista_devolucao.dia,
-                      &lista_emprestimos[total_emprestimos].data_prevista_devolucao.mes,
-                      &lista_emprestimos[total_emprestimos].data_prevista_devolucao.ano,
-                      lista_emprestimos[total_emprestimos].status) == 10) {
-            total_emprestimos++;
+// Zera todos os contadores (amostras registradas ao mesmo tempo podem sobreviver)
+void zerar_estatisticas() {
+    for (int op = 0; op < NUM_OPERACOES; op++) {
+        EstatisticaOperacao *e = &estatisticas[op];
+        atomic_store(&e->soma_ns, 0);
+        atomic_store(&e->maximo_ns, 0);
+        for (int b = 0; b < NUM_BALDES; b++) {
+            atomic_store(&e->baldes[b], 0);
         }
-        fclose(f_emprestimos);
-        printf("[INFO] %d Emprestimos carregados.\n", total_emprestimos);
-    } else {
-        printf("[INFO] Arquivo %s nao encontrado. Iniciando com dados vazios.\n", ARQ_EMPRESTIMOS);
     }
 }
 
-// Função para criar backup dos arquivos (cópia simples)
-void fazer_backup() {
-    char cmd[256];
-    char *arquivos[] = {ARQ_LIVROS, ARQ_USUARIOS, ARQ_EMPRESTIMOS};
+// --- MAPA DE ÍNDICES (CÓDIGO -> POSIÇÃO NO VETOR) ---
 
-    printf("\n--- Realizando Backup Automatico ---\n");
+// Tabela hash de endereçamento aberto (sondagem linear). Permite achar a posição de um
+// registro pelo código em tempo constante, em vez de percorrer o vetor inteiro.
+#define MAPA_VAZIO INT_MIN
 
-    for (int i = 0; i < 3; i++) {
-        sprintf(cmd, "cp %s %s.bak", arquivos[i], arquivos[i]); // Comando de cópia Unix/Linux
-        // Tenta executar o comando de backup. Em ambientes Windows, isso falhará, mas o requisito é atendido
-        if (system(cmd) == 0) {
-            printf("[BACKUP] Backup de %s criado em %s.bak\n", arquivos[i], arquivos[i]);
-        } else {
-            // Em sistemas que não suportam 'cp' (ex: Windows sem cygwin/WSL), tentamos com 'copy' ou avisamos
-            sprintf(cmd, "copy %s %s.bak", arquivos[i], arquivos[i]); // Comando de cópia Windows
-            if (system(cmd) == 0) {
-                printf("[BACKUP] Backup de %s criado em %s.bak (usando copy)\n", arquivos[i], arquivos[i]);
-            } else {
-                 printf("[AVISO] Nao foi possivel criar backup de %s (falha nos comandos 'cp'/'copy').\n", arquivos[i]);
-            }
-        }
+typedef struct {
+    int *chaves;
+    int *valores;
+    int capacidade; // Sempre potência de 2
+    int quantidade;
+} MapaIndice;
+
+unsigned int mapa_hash(int chave, int capacidade) {
+    return ((unsigned int)chave * 2654435761u) & (unsigned int)(capacidade - 1);
+}
+
+// Cria o mapa com espaço para 'capacidade_minima' chaves sem precisar crescer
+bool mapa_criar(MapaIndice *mapa, int capacidade_minima) {
+    int capacidade = 16;
+    while (capacidade < capacidade_minima * 2) {
+        capacidade *= 2;
     }
-    printf("--- Backup Concluido ---\n");
+    mapa->chaves = malloc(sizeof(int) * capacidade);
+    mapa->valores = malloc(sizeof(int) * capacidade);
+    if (mapa->chaves == NULL || mapa->valores == NULL) {
+        free(mapa->chaves);
+        free(mapa->valores);
+        mapa->chaves = NULL;
+        mapa->valores = NULL;
+        return false;
+    }
+    for (int i = 0; i < capacidade; i++) {
+        mapa->chaves[i] = MAPA_VAZIO;
+    }
+    mapa->capacidade = capacidade;
+    mapa->quantidade = 0;
+    return true;
 }
 
+void mapa_destruir(MapaIndice *mapa) {
+    free(mapa->chaves);
+    free(mapa->valores);
+    mapa->chaves = NULL;
+    mapa->valores = NULL;
+    mapa->capacidade = 0;
+    mapa->quantidade = 0;
+}
 
-// --- FUNÇÕES DE BUSCA (Requisito Modular) ---
+void mapa_limpar(MapaIndice *mapa) {
+    for (int i = 0; i < mapa->capacidade; i++) {
+        mapa->chaves[i] = MAPA_VAZIO;
+    }
+    mapa->quantidade = 0;
+}
 
-// Retorna o índice do livro no vetor ou -1 se não encontrado
-int buscar_livro_por_codigo(int codigo) {
-    for (int i = 0; i < total_livros; i++) {
-        if (acervo_livros[i].codigo == codigo) {
-            return i;
+// Insere ou atualiza a chave; dobra a tabela quando passa de 50% de ocupação
+bool mapa_inserir(MapaIndice *mapa, int chave, int valor) {
+    if ((mapa->quantidade + 1) * 2 > mapa->capacidade) {
+        MapaIndice maior;
+        if (!mapa_criar(&maior, mapa->capacidade)) {
+            return false;
+        }
+        for (int i = 0; i < mapa->capacidade; i++) {
+            if (mapa->chaves[i] != MAPA_VAZIO) {
+                mapa_inserir(&maior, mapa->chaves[i], mapa->valores[i]);
+            }
         }
+        mapa_destruir(mapa);
+        *mapa = maior;
     }
-    return -1;
+
+    unsigned int pos = mapa_hash(chave, mapa->capacidade);
+    while (mapa->chaves[pos] != MAPA_VAZIO && mapa->chaves[pos] != chave) {
+        pos = (pos + 1) & (unsigned int)(mapa->capacidade - 1);
+    }
+    if (mapa->chaves[pos] == MAPA_VAZIO) {
+        mapa->chaves[pos] = chave;
+        mapa->quantidade++;
+    }
+    mapa->valores[pos] = valor;
+    return true;
 }
 
-// Retorna o índice do usuário no vetor ou -1 se não encontrado
-int buscar_usuario_por_matricula(int matricula) {
-    for (int i = 0; i < total_usuarios; i++) {
-        if (lista_usuarios[i].matricula == matricula) {
-            return i;
+// Retorna o valor associado à chave ou -1 se não encontrada
+int mapa_buscar(const MapaIndice *mapa, int chave) {
+    if (mapa->capacidade == 0) {
+        return -1;
+    }
+    unsigned int pos = mapa_hash(chave, mapa->capacidade);
+    while (mapa->chaves[pos] != MAPA_VAZIO) {
+        if (mapa->chaves[pos] == chave) {
+            return mapa->valores[pos];
         }
+        pos = (pos + 1) & (unsigned int)(mapa->capacidade - 1);
     }
     return -1;
 }
 
-// --- PARTE 3: FUNÇÕES MODULARES (CADASTRO) ---
+// --- CONTROLE DE EXEMPLARES (SEM TRAVA) ---
 
-// Função para cadastrar livros
-void cadastrar_livro() {
-    if (total_livros >= MAX_LIVROS) {
-        printf("\n[ERRO] O acervo atingiu o limite maximo de %d livros.\n", MAX_LIVROS);
-        return;
+// Retira um exemplar disponível usando compare-and-swap.
+// Retorna false se não houver exemplar: dois balcões nunca levam o mesmo último exemplar.
+bool reservar_exemplar(Livro *livro) {
+    int disponiveis = atomic_load(&livro->exemplares_disponiveis);
+    while (disponiveis > 0) {
+        // Em caso de falha, 'disponiveis' recebe o valor atual e a tentativa se repete
+        if (atomic_compare_exchange_weak(&livro->exemplares_disponiveis, &disponiveis, disponiveis - 1)) {
+            return true;
+        }
     }
+    return false;
+}
 
-    Livro novo_livro;
-    novo_livro.codigo = proximo_livro_id++;
-
-    printf("\n--- Cadastro de Novo Livro ---\n");
-    printf("Codigo do livro: %d\n", novo_livro.codigo);
-
-    printf("Titulo (max %d): ", TAM_TITULO);
-    ler_string(novo_livro.titulo, TAM_TITULO);
-
-    printf("Autor (max %d): ", TAM_AUTOR);
-    ler_string(novo_livro.autor, TAM_AUTOR);
-
-    printf("Editora (max %d): ", TAM_EDITORA);
-    ler_string(novo_livro.editora, TAM_EDITORA);
-
-    // Validação de entrada: Ano de publicacao
-    do {
-        printf("Ano de publicacao (ex: 2023): ");
-        if (scanf("%d", &novo_livro.ano_publicacao) != 1 || novo_livro.ano_publicacao <= 0) {
-            printf("[ERRO] Entrada invalida. Por favor, insira um ano valido.\n");
-            limpar_buffer();
-        } else {
-            break;
+// Devoluções recusadas por já estarem todos os exemplares na estante: cada uma indica um
+// exemplar devolvido duas vezes (ou contador corrompido) e é relatada, não descartada
+atomic_int devolucoes_excedentes = 0;
+
+// Devolve um exemplar ao acervo. Retorna false (sem alterar o contador) se todos os
+// exemplares já estavam disponíveis, o que nunca deveria acontecer.
+bool devolver_exemplar(Livro *livro) {
+    int disponiveis = atomic_load(&livro->exemplares_disponiveis);
+    while (disponiveis < livro->total_exemplares) {
+        if (atomic_compare_exchange_weak(&livro->exemplares_disponiveis, &disponiveis, disponiveis + 1)) {
+            return true;
         }
-    } while (true);
+    }
+    atomic_fetch_add(&devolucoes_excedentes, 1);
+    fprintf(stderr, "[ERRO] Devolucao excede o total de exemplares do livro %d (%d de %d disponiveis).\n",
+            livro->codigo, disponiveis, livro->total_exemplares);
+    return false;
+}
 
-    // Validação de entrada: Total de exemplares
-    do {
-        printf("Numero TOTAL de exemplares: ");
-        if (scanf("%d", &novo_livro.total_exemplares) != 1 || novo_livro.total_exemplares <= 0) {
-            printf("[ERRO] Entrada invalida. Por favor, insira um numero positivo de exemplares.\n");
-            limpar_buffer();
-        } else {
-            break;
-        }
-    } while (true);
-    limpar_buffer(); // Limpar buffer após scanf final
+// Status calculado a partir do contador atômico (evita gravar texto desatualizado)
+const char *status_livro(const Livro *livro) {
+    return atomic_load(&livro->exemplares_disponiveis) > 0 ? "DISPONIVEL" : "INDISPONIVEL";
+}
 
-    novo_livro.exemplares_disponiveis = novo_livro.total_exemplares;
-    strcpy(novo_livro.status, "DISPONIVEL");
+// --- FUNÇÕES DE BUSCA (Requisito Modular) ---
 
-    acervo_livros[total_livros++] = novo_livro;
-    printf("\n[SUCESSO] Livro '%s' cadastrado com codigo %d.\n", novo_livro.titulo, novo_livro.codigo);
+// Índices código -> posição, mantidos a cada inclusão e reconstruídos na carga dos arquivos.
+// mapa_livros e mapa_usuarios são protegidos por trava_acervo/trava_usuarios; como empréstimos
+// são incluídos sob trava de leitura, mapa_emprestimos tem trava própria (adquirir por último).
+MapaIndice mapa_livros;
+MapaIndice mapa_usuarios;
+MapaIndice mapa_emprestimos;
+pthread_rwlock_t trava_mapa_emprestimos = PTHREAD_RWLOCK_INITIALIZER;
+
+bool inicializar_indices() {
+    return mapa_criar(&mapa_livros, 1024) && mapa_criar(&mapa_usuarios, 1024) &&
+           mapa_criar(&mapa_emprestimos, 1024);
 }
 
-// Função para cadastrar usuários
-void cadastrar_usuario() {
-    if (total_usuarios >= MAX_USUARIOS) {
-        printf("\n[ERRO] A lista de usuarios atingiu o limite maximo de %d usuarios.\n", MAX_USUARIOS);
-        return;
+// Reconstrói os índices a partir dos vetores (chamador deve ter trava de escrita nos cadastros)
+void reconstruir_indices() {
+    mapa_limpar(&mapa_livros);
+    mapa_limpar(&mapa_usuarios);
+    mapa_limpar(&mapa_emprestimos);
+    for (int i = 0; i < total_livros; i++) {
+        mapa_inserir(&mapa_livros, acervo_livros[i].codigo, i);
     }
+    for (int i = 0; i < total_usuarios; i++) {
+        mapa_inserir(&mapa_usuarios, lista_usuarios[i].matricula, i);
+    }
+    for (int i = 0; i < total_emprestimos; i++) {
+        mapa_inserir(&mapa_emprestimos, lista_emprestimos[i].codigo_emprestimo, i);
+    }
+}
 
-    Usuario novo_usuario;
-    novo_usuario.matricula = proximo_usuario_id++;
-    novo_usuario.data_cadastro = data_atual(); // Data de cadastro é a data atual
+// Retorna o índice do livro no vetor ou -1 se não encontrado
+int buscar_livro_por_codigo(int codigo) {
+    return mapa_buscar(&mapa_livros, codigo);
+}
 
-    printf("\n--- Cadastro de Novo Usuario ---\n");
-    printf("Matricula: %d\n", novo_usuario.matricula);
+// Retorna o índice do usuário no vetor ou -1 se não encontrado
+int buscar_usuario_por_matricula(int matricula) {
+    return mapa_buscar(&mapa_usuarios, matricula);
+}
 
-    printf("Nome completo (max %d): ", TAM_NOME);
-    ler_string(novo_usuario.nome, TAM_NOME);
+// Retorna o índice do empréstimo no vetor ou -1 se não encontrado
+int buscar_emprestimo_por_codigo(int codigo_emprestimo) {
+    pthread_rwlock_rdlock(&trava_mapa_emprestimos);
+    int idx = mapa_buscar(&mapa_emprestimos, codigo_emprestimo);
+    pthread_rwlock_unlock(&trava_mapa_emprestimos);
+    return idx;
+}
 
-    printf("Curso (max %d): ", TAM_CURSO);
-    ler_string(novo_usuario.curso, TAM_CURSO);
+// --- POLÍTICA DE EMPRÉSTIMOS ---
 
-    printf("Telefone (max %d): ", TAM_TELEFONE);
-    ler_string(novo_usuario.telefone, TAM_TELEFONE);
+// As regras vêm de politicas.txt (uma por linha, '#' inicia comentário):
+//   TIPO;CHAVE;DIAS_EMPRESTIMO;LIMITE_EMPRESTIMOS;LIMITE_RENOVACOES
+//   PADRAO;*;7;3;2                     -> vale para todos
+//   CURSO;Engenharia de Software;14;5;-  -> usuários do curso ('-' herda da regra padrão)
+//   LIVRO;3;2;-;0                      -> sobrepõe os campos informados para o livro
+// '*' significa sem limite. As regras são compiladas na carga: cada usuário recebe a regra
+// do seu curso já combinada com a padrão, e cada checkout consulta tudo em tempo constante.
+#define ARQ_POLITICAS "politicas.txt"
+#define MAX_POLITICAS 256
+#define REGRA_HERDA -1
+#define SEM_LIMITE INT_MAX
 
-    lista_usuarios[total_usuarios++] = novo_usuario;
-    printf("\n[SUCESSO] Usuario '%s' cadastrado com matricula %d em %d/%d/%d.\n",
-           novo_usuario.nome, novo_usuario.matricula,
-           novo_usuario.data_cadastro.dia, novo_usuario.data_cadastro.mes, novo_usuario.data_cadastro.ano);
+typedef struct {
+    int dias_emprestimo;
+    int limite_emprestimos; // Empréstimos ativos simultâneos por usuário
+    int limite_renovacoes;  // Renovações por empréstimo
+} RegraEmprestimo;
+
+RegraEmprestimo regra_padrao = {DIAS_ATRASO, SEM_LIMITE, SEM_LIMITE};
+char cursos_com_regra[MAX_POLITICAS][TAM_CURSO];
+RegraEmprestimo regras_curso[MAX_POLITICAS]; // Já combinadas com a regra padrão
+int total_regras_curso = 0;
+RegraEmprestimo regras_livro[MAX_POLITICAS]; // Campos REGRA_HERDA usam a regra do usuário
+int total_regras_livro = 0;
+MapaIndice mapa_regras_livro; // Código do livro -> posição em regras_livro
+
+// Pré-calculados por usuário (mesma posição de lista_usuarios)
+int regra_do_usuario[MAX_USUARIOS]; // Posição em regras_curso ou -1 para a regra padrão
+atomic_int emprestimos_ativos_usuario[MAX_USUARIOS];
+
+// Converte um campo da regra: '-' herda, '*' sem limite, caso contrário um número >= 0.
+// Retorna false para qualquer outro texto (um erro de digitação não pode virar limite 0).
+bool ler_campo_regra(const char *campo, int *valor) {
+    if (strcmp(campo, "-") == 0) {
+        *valor = REGRA_HERDA;
+        return true;
+    }
+    if (strcmp(campo, "*") == 0) {
+        *valor = SEM_LIMITE;
+        return true;
+    }
+    char *fim;
+    long n = strtol(campo, &fim, 10);
+    if (fim == campo || *fim != '\0' || n < 0 || n >= SEM_LIMITE) {
+        return false;
+    }
+    *valor = (int)n;
+    return true;
 }
 
-// --- PARTE 3: FUNÇÕES MODULARES (EMPRÉSTIMOS) ---
+// Preenche os campos herdados de 'regra' com os valores de 'base'
+RegraEmprestimo combinar_regras(RegraEmprestimo regra, RegraEmprestimo base) {
+    if (regra.dias_emprestimo == REGRA_HERDA) regra.dias_emprestimo = base.dias_emprestimo;
+    if (regra.limite_emprestimos == REGRA_HERDA) regra.limite_emprestimos = base.limite_emprestimos;
+    if (regra.limite_renovacoes == REGRA_HERDA) regra.limite_renovacoes = base.limite_renovacoes;
+    return regra;
+}
 
-// Função para realizar empréstimo
-void realizar_emprestimo() {
-    if (total_emprestimos >= MAX_EMPRESTIMOS) {
-        printf("\n[ERRO] O limite maximo de emprestimos foi atingido.\n");
-        return;
+// Lê e compila politicas.txt. Sem o arquivo vale a regra padrão (7 dias, sem limites).
+void carregar_politicas() {
+    regra_padrao = (RegraEmprestimo){DIAS_ATRASO, SEM_LIMITE, SEM_LIMITE};
+    total_regras_curso = 0;
+    total_regras_livro = 0;
+    if (mapa_regras_livro.capacidade == 0) {
+        mapa_criar(&mapa_regras_livro, MAX_POLITICAS);
+    } else {
+        mapa_limpar(&mapa_regras_livro);
     }
 
-    int mat, cod;
-    int idx_usuario, idx_livro;
-
-    printf("\n--- Realizar Emprestimo ---\n");
+    FILE *f = fopen(ARQ_POLITICAS, "r");
+    if (f == NULL) {
+        return;
+    }
 
-    // Validação de Matrícula
-    do {
-        printf("Matricula do usuario: ");
-        if (scanf("%d", &mat) != 1) {
-            printf("[ERRO] Entrada invalida. Digite um numero.\n");
-            limpar_buffer();
+    char linha[256];
+    char tipo[16], chave[TAM_CURSO], dias[16], limite[16], renovacoes[16];
+    int codigo_livro;
+    while (fgets(linha, sizeof(linha), f) != NULL) {
+        if (linha[0] == '#' || linha[0] == '\n' || linha[0] == '\r') {
             continue;
         }
-        limpar_buffer();
-
-        idx_usuario = buscar_usuario_por_matricula(mat);
-        if (idx_usuario == -1) {
-            printf("[ERRO] Usuario com matricula %d nao encontrado.\n", mat);
-        } else {
-            break;
+        if (sscanf(linha, "%15[^;];%49[^;];%15[^;];%15[^;];%15[^;\r\n]", tipo, chave, dias, limite, renovacoes) != 5) {
+            fprintf(stderr, "[AVISO] Linha ignorada em %s: %s", ARQ_POLITICAS, linha);
+            continue;
         }
-    } while (true);
-
-    // Validação de Código do Livro
-    do {
-        printf("Codigo do livro: ");
-        if (scanf("%d", &cod) != 1) {
-            printf("[ERRO] Entrada invalida. Digite um numero.\n");
-            limpar_buffer();
+        RegraEmprestimo regra;
+        if (!ler_campo_regra(dias, &regra.dias_emprestimo) || !ler_campo_regra(limite, &regra.limite_emprestimos) ||
+            !ler_campo_regra(renovacoes, &regra.limite_renovacoes)) {
+            fprintf(stderr, "[AVISO] Linha ignorada em %s (use numero, '-' ou '*'): %s", ARQ_POLITICAS, linha);
             continue;
         }
-        limpar_buffer();
 
-        idx_livro = buscar_livro_por_codigo(cod);
-        if (idx_livro == -1) {
-            printf("[ERRO] Livro com codigo %d nao encontrado.\n", cod);
-        } else if (acervo_livros[idx_livro].exemplares_disponiveis <= 0) {
-            printf("[ERRO] Todos os exemplares do livro '%s' estao emprestados.\n", acervo_livros[idx_livro].titulo);
-            idx_livro = -1; // Força a nova tentativa ou saída
+        if (strcmp(tipo, "PADRAO") == 0) {
+            regra_padrao = combinar_regras(regra, regra_padrao);
+        } else if (strcmp(tipo, "CURSO") == 0 && total_regras_curso < MAX_POLITICAS) {
+            strcpy(cursos_com_regra[total_regras_curso], chave);
+            regras_curso[total_regras_curso++] = regra;
+        } else if (strcmp(tipo, "LIVRO") == 0 && total_regras_livro < MAX_POLITICAS &&
+                   ler_campo_regra(chave, &codigo_livro) && codigo_livro != REGRA_HERDA && codigo_livro != SEM_LIMITE) {
+            mapa_inserir(&mapa_regras_livro, codigo_livro, total_regras_livro);
+            regras_livro[total_regras_livro++] = regra;
         } else {
-            break;
+            fprintf(stderr, "[AVISO] Linha ignorada em %s: %s", ARQ_POLITICAS, linha);
         }
-    } while (idx_livro == -1);
-
-    // Criação do Empréstimo
-    Emprestimo novo_emprestimo;
-    novo_emprestimo.codigo_emprestimo = proximo_emprestimo_id++;
-    novo_emprestimo.matricula_usuario = mat;
-    novo_emprestimo.codigo_livro = cod;
-    novo_emprestimo.data_emprestimo = data_atual();
-    novo_emprestimo.data_prevista_devolucao = calcular_data_devolucao(novo_emprestimo.data_emprestimo, 7);
-    strcpy(novo_emprestimo.status, "ATIVO");
-
-    // Atualiza o acervo de livros
-    acervo_livros[idx_livro].exemplares_disponiveis--;
-    if (acervo_livros[idx_livro].exemplares_disponiveis == 0) {
-        strcpy(acervo_livros[idx_livro].status, "INDISPONIVEL");
-    } else {
-        strcpy(acervo_livros[idx_livro].status, "DISPONIVEL");
     }
+    fclose(f);
 
-    lista_emprestimos[total_emprestimos++] = novo_emprestimo;
-
-    printf("\n[SUCESSO] Emprestimo %d registrado:\n", novo_emprestimo.codigo_emprestimo);
-    printf("  Livro: %s\n", acervo_livros[idx_livro].titulo);
-    printf("  Usuario: %s\n", lista_usuarios[idx_usuario].nome);
-    printf("  Data Emprestimo: %d/%d/%d\n", novo_emprestimo.data_emprestimo.dia, novo_emprestimo.data_emprestimo.mes, novo_emprestimo.data_emprestimo.ano);
-    printf("  Data Prevista Devolucao: %d/%d/%d\n", novo_emprestimo.data_prevista_devolucao.dia, novo_emprestimo.data_prevista_devolucao.mes, novo_emprestimo.data_prevista_devolucao.ano);
-}
-
-// Função para realizar devolução
-void realizar_devolucao() {
-    int cod_emp;
-    int idx_emprestimo = -1;
-
-    printf("\n--- Realizar Devolucao ---\n");
-    printf("Codigo do emprestimo a ser devolvido: ");
-    if (scanf("%d", &cod_emp) != 1) {
-        printf("[ERRO] Entrada invalida. Digite um numero.\n");
-        limpar_buffer();
-        return;
+    // Só agora a regra padrão é definitiva (a linha PADRAO pode vir depois das de curso)
+    for (int i = 0; i < total_regras_curso; i++) {
+        regras_curso[i] = combinar_regras(regras_curso[i], regra_padrao);
     }
-    limpar_buffer();
+    if (!modo_silencioso) printf("[INFO] %d Politicas de emprestimo carregadas.\n", 1 + total_regras_curso + total_regras_livro);
+}
 
-    // Busca o empréstimo ativo
-    for (int i = 0; i < total_emprestimos; i++) {
-        if (lista_emprestimos[i].codigo_emprestimo == cod_emp && strcmp(lista_emprestimos[i].status, "ATIVO") == 0) {
-            idx_emprestimo = i;
+// Associa ao usuário a regra do seu curso (feito uma vez, na carga ou no cadastro)
+void compilar_regra_usuario(int idx_usuario) {
+    regra_do_usuario[idx_usuario] = -1;
+    for (int i = 0; i < total_regras_curso; i++) {
+        if (strcmp(cursos_com_regra[i], lista_usuarios[idx_usuario].curso) == 0) {
+            regra_do_usuario[idx_usuario] = i;
             break;
         }
     }
+}
 
-    if (idx_emprestimo == -1) {
-        printf("[ERRO] Emprestimo ativo com codigo %d nao encontrado.\n", cod_emp);
-        return;
+// Regra vigente para o par usuário/livro, em tempo constante
+RegraEmprestimo regra_efetiva(int idx_usuario, int codigo_livro) {
+    RegraEmprestimo regra = regra_do_usuario[idx_usuario] >= 0 ? regras_curso[regra_do_usuario[idx_usuario]] : regra_padrao;
+    int idx_regra_livro = mapa_buscar(&mapa_regras_livro, codigo_livro);
+    if (idx_regra_livro != -1) {
+        RegraEmprestimo do_livro = regras_livro[idx_regra_livro];
+        if (do_livro.dias_emprestimo != REGRA_HERDA) regra.dias_emprestimo = do_livro.dias_emprestimo;
+        if (do_livro.limite_emprestimos != REGRA_HERDA) regra.limite_emprestimos = do_livro.limite_emprestimos;
+        if (do_livro.limite_renovacoes != REGRA_HERDA) regra.limite_renovacoes = do_livro.limite_renovacoes;
     }
+    return regra;
+}
 
-    // Marca como DEVOLVIDO
-    strcpy(lista_emprestimos[idx_emprestimo].status, "DEVOLVIDO");
-
-    // Atualiza o acervo de livros
-    int idx_livro = buscar_livro_por_codigo(lista_emprestimos[idx_emprestimo].codigo_livro);
-    if (idx_livro != -1) {
-        acervo_livros[idx_livro].exemplares_disponiveis++;
-        if (acervo_livros[idx_livro].exemplares_disponiveis > 0) {
-            strcpy(acervo_livros[idx_livro].status, "DISPONIVEL");
+// Ocupa uma vaga no limite de empréstimos do usuário (CAS, como em reservar_exemplar)
+bool reservar_vaga_usuario(int idx_usuario, int limite) {
+    int ativos = atomic_load(&emprestimos_ativos_usuario[idx_usuario]);
+    while (ativos < limite) {
+        if (atomic_compare_exchange_weak(&emprestimos_ativos_usuario[idx_usuario], &ativos, ativos + 1)) {
+            return true;
         }
     }
+    return false;
+}
 
-    // Verifica Atraso
-    Data hoje = data_atual();
-    int comparacao = comparar_datas(hoje, lista_emprestimos[idx_emprestimo].data_prevista_devolucao);
+void liberar_vaga_usuario(int idx_usuario) {
+    int ativos = atomic_load(&emprestimos_ativos_usuario[idx_usuario]);
+    while (ativos > 0) {
+        if (atomic_compare_exchange_weak(&emprestimos_ativos_usuario[idx_usuario], &ativos, ativos - 1)) {
+            return;
+        }
+    }
+}
 
-    printf("\n[SUCESSO] Devolucao do emprestimo %d registrada.\n", cod_emp);
-    if (comparacao > 0) {
-        printf("[ATENCAO] Devolucao realizada com atraso!\n");
-    } else {
-        printf("[INFO] Devolucao realizada no prazo.\n");
+// Recalcula regras e contadores de todos os usuários (após carregar os arquivos)
+void compilar_politicas_usuarios() {
+    for (int i = 0; i < total_usuarios; i++) {
+        compilar_regra_usuario(i);
+        atomic_store(&emprestimos_ativos_usuario[i], 0);
+    }
+    for (int i = 0; i < total_emprestimos; i++) {
+        if (strcmp(lista_emprestimos[i].status, "ATIVO") == 0) {
+            int idx_usuario = buscar_usuario_por_matricula(lista_emprestimos[i].matricula_usuario);
+            if (idx_usuario != -1) {
+                atomic_fetch_add(&emprestimos_ativos_usuario[idx_usuario], 1);
+            }
+        }
     }
 }
 
-// Função para renovação de empréstimos (PARTE 5)
-void renovar_emprestimo() {
-    int cod_emp;
-    int idx_emprestimo = -1;
+// --- RESERVAS (FILA DE ESPERA POR LIVRO) ---
 
-    printf("\n--- Renovar Emprestimo ---\n");
-    printf("Codigo do emprestimo a ser renovado: ");
-    if (scanf("%d", &cod_emp) != 1) {
-        printf("[ERRO] Entrada invalida. Digite um numero.\n");
-        limpar_buffer();
-        return;
+// Cada livro tem uma fila FIFO de reservas pendentes, encadeada pelo campo 'proxima'.
+// Início e fim da fila ficam indexados pela posição do livro, então entrar na fila e
+// descobrir o próximo da vez custam O(1). As filas são protegidas pela trava do livro.
+#ifndef MAX_RESERVAS
+#define MAX_RESERVAS 100
+#endif
+
+typedef struct {
+    int codigo_reserva;
+    int matricula_usuario;
+    int codigo_livro;
+    Data data_reserva;
+    char status[15]; // "PENDENTE", "ATENDIDA" ou "CANCELADA"
+    int proxima; // Posição da próxima reserva pendente do mesmo livro (-1 = fim); não é gravada
+} Reserva;
+
+Reserva lista_reservas[MAX_RESERVAS];
+atomic_int total_reservas = 0;
+atomic_int proximo_reserva_id = 1;
+int inicio_fila_reservas[MAX_LIVROS]; // Por posição do livro; -1 = fila vazia
+int fim_fila_reservas[MAX_LIVROS];
+pthread_mutex_t trava_insercao_reservas = PTHREAD_MUTEX_INITIALIZER;
+
+// Coloca a reserva de posição 'idx_reserva' no fim da fila do livro (chamador tem a trava do livro)
+void enfileirar_reserva(int idx_livro, int idx_reserva) {
+    lista_reservas[idx_reserva].proxima = -1;
+    if (fim_fila_reservas[idx_livro] == -1) {
+        inicio_fila_reservas[idx_livro] = idx_reserva;
+    } else {
+        lista_reservas[fim_fila_reservas[idx_livro]].proxima = idx_reserva;
     }
-    limpar_buffer();
+    fim_fila_reservas[idx_livro] = idx_reserva;
+}
 
-    // Busca o empréstimo ativo
-    for (int i = 0; i < total_emprestimos; i++) {
-        if (lista_emprestimos[i].codigo_emprestimo == cod_emp && strcmp(lista_emprestimos[i].status, "ATIVO") == 0) {
-            idx_emprestimo = i;
-            break;
+// Retira e retorna o primeiro da fila do livro, ou -1 se vazia (chamador tem a trava do livro)
+int desenfileirar_reserva(int idx_livro) {
+    int idx_reserva = inicio_fila_reservas[idx_livro];
+    if (idx_reserva != -1) {
+        inicio_fila_reservas[idx_livro] = lista_reservas[idx_reserva].proxima;
+        if (inicio_fila_reservas[idx_livro] == -1) {
+            fim_fila_reservas[idx_livro] = -1;
         }
+        lista_reservas[idx_reserva].proxima = -1;
     }
+    return idx_reserva;
+}
 
-    if (idx_emprestimo == -1) {
-        printf("[ERRO] Emprestimo ativo com codigo %d nao encontrado.\n", cod_emp);
-        return;
+// Remonta as filas a partir das reservas pendentes, na ordem em que foram feitas
+// (chamador deve ter trava de escrita nos cadastros e índices reconstruídos)
+void reconstruir_filas_reservas() {
+    for (int i = 0; i < MAX_LIVROS; i++) { // Inclui as posições de livros ainda não cadastrados
+        inicio_fila_reservas[i] = -1;
+        fim_fila_reservas[i] = -1;
+    }
+    for (int i = 0; i < total_reservas; i++) {
+        lista_reservas[i].proxima = -1;
+        int idx_livro = buscar_livro_por_codigo(lista_reservas[i].codigo_livro);
+        if (idx_livro != -1 && strcmp(lista_reservas[i].status, "PENDENTE") == 0) {
+            enfileirar_reserva(idx_livro, i);
+        }
     }
+}
 
-    // Calcula nova data de devolução a partir da data prevista anterior
-    Data nova_data = calcular_data_devolucao(lista_emprestimos[idx_emprestimo].data_prevista_devolucao, 7);
+// --- INSTANTÂNEOS (MVCC) PARA RELATÓRIOS ---
+
+// Os vetores são divididos em páginas de TAM_PAGINA registros. Toda alteração incrementa
+// a versão da página; um instantâneo copia apenas as páginas cuja versão mudou desde a
+// última atualização, então o custo de obtê-lo é proporcional ao que mudou, não ao total.
+#define TAM_PAGINA 64
+#define PAGINAS_LIVROS ((MAX_LIVROS + TAM_PAGINA - 1) / TAM_PAGINA)
+#define PAGINAS_USUARIOS ((MAX_USUARIOS + TAM_PAGINA - 1) / TAM_PAGINA)
+#define PAGINAS_EMPRESTIMOS ((MAX_EMPRESTIMOS + TAM_PAGINA - 1) / TAM_PAGINA)
+#define PAGINAS_RESERVAS ((MAX_RESERVAS + TAM_PAGINA - 1) / TAM_PAGINA)
+#define PAGINA_NUNCA_COPIADA 0xFFFFFFFFu
+
+atomic_uint versao_paginas_livros[PAGINAS_LIVROS];
+atomic_uint versao_paginas_usuarios[PAGINAS_USUARIOS];
+atomic_uint versao_paginas_emprestimos[PAGINAS_EMPRESTIMOS];
+atomic_uint versao_paginas_reservas[PAGINAS_RESERVAS]; // Não entram nos instantâneos, só no backup
+
+// Incrementado a cada carga dos arquivos: as posições dos registros deixam de valer
+atomic_uint geracao_carga = 0;
+
+// Registram alteração no registro de índice 'idx' (chamador deve ter trava de leitura ou escrita)
+void marcar_livro_alterado(int idx) {
+    atomic_fetch_add(&versao_paginas_livros[idx / TAM_PAGINA], 1);
+}
 
-    // Atualiza a data prevista
-    lista_emprestimos[idx_emprestimo].data_prevista_devolucao = nova_data;
+void marcar_usuario_alterado(int idx) {
+    atomic_fetch_add(&versao_paginas_usuarios[idx / TAM_PAGINA], 1);
+}
 
-    printf("\n[SUCESSO] Emprestimo %d renovado por mais 7 dias.\n", cod_emp);
-    printf("  Nova Data Prevista Devolucao: %d/%d/%d\n", nova_data.dia, nova_data.mes, nova_data.ano);
+void marcar_emprestimo_alterado(int idx) {
+    atomic_fetch_add(&versao_paginas_emprestimos[idx / TAM_PAGINA], 1);
 }
 
+void marcar_reserva_alterado(int idx) {
+    atomic_fetch_add(&versao_paginas_reservas[idx / TAM_PAGINA], 1);
+}
 
-// --- PARTE 3: FUNÇÕES MODULARES (PESQUISA) ---
+// Marca todas as páginas em uso como alteradas (após carregar os arquivos)
+void marcar_todos_alterados() {
+    for (int i = 0; i < total_livros; i += TAM_PAGINA) marcar_livro_alterado(i);
+    for (int i = 0; i < total_usuarios; i += TAM_PAGINA) marcar_usuario_alterado(i);
+    for (int i = 0; i < total_emprestimos; i += TAM_PAGINA) marcar_emprestimo_alterado(i);
+    for (int i = 0; i < total_reservas; i += TAM_PAGINA) marcar_reserva_alterado(i);
+}
 
-// Função para pesquisar livros (por código, título ou autor)
-void pesquisar_livros() {
-    int opcao;
-    printf("\n--- Pesquisar Livros ---\n");
-    printf("Buscar por:\n");
-    printf("1. Codigo\n");
-    printf("2. Titulo\n");
-    printf("3. Autor\n");
-    printf("4. Busca Avancada (Multiplos Criterios)\n"); // Parte 5
-    printf("Opcao: ");
-    if (scanf("%d", &opcao) != 1) {
-        printf("[ERRO] Opcao invalida.\n");
-        limpar_buffer();
-        return;
+// Como cada cadastro é copiado enquanto empréstimos e devoluções seguem com trava de leitura
+// (instantâneos, backup e gravação): nenhum registro pode ser lido como memória comum
+// enquanto outra thread o altera.
+//   - COPIA_LIVROS: o contador de exemplares muda por CAS e é lido com atomic_load
+//   - COPIA_DIRETA: usuários, que só mudam sob trava de escrita
+//   - COPIA_EMPRESTIMOS/COPIA_RESERVAS: alterados sob a trava do livro (devolução, renovação,
+//     fila de reservas); cada registro é copiado com a trava do seu livro
+typedef enum {
+    COPIA_DIRETA,
+    COPIA_LIVROS,
+    COPIA_EMPRESTIMOS,
+    COPIA_RESERVAS
+} ModoCopia;
+
+// Copia livros campo a campo, lendo o contador atômico com atomic_load
+void copiar_livros(Livro *destino, const Livro *origem, int quantidade) {
+    size_t antes = offsetof(Livro, exemplares_disponiveis);
+    size_t depois = antes + sizeof(atomic_int);
+    for (int i = 0; i < quantidade; i++) {
+        memcpy(&destino[i], &origem[i], antes);
+        atomic_store(&destino[i].exemplares_disponiveis, atomic_load(&origem[i].exemplares_disponiveis));
+        memcpy((char *)&destino[i] + depois, (const char *)&origem[i] + depois, sizeof(Livro) - depois);
     }
-    limpar_buffer();
-
-    Livro *resultados[MAX_LIVROS];
-    int num_resultados = 0;
+}
 
-    switch (opcao) {
-        case 1: { // Por Código
-            int cod;
-            printf("Digite o Codigo do livro: ");
-            if (scanf("%d", &cod) != 1) {
-                printf("[ERRO] Codigo invalido.\n");
-                limpar_buffer();
-                return;
-            }
-            limpar_buffer();
-            int idx = buscar_livro_por_codigo(cod);
-            if (idx != -1) {
-                resultados[num_resultados++] = &acervo_livros[idx];
-            }
-            break;
+// Registros agrupados por vez na cópia sob as travas dos livros
+#define REGISTROS_POR_LOTE 1024
+
+// Copia registros de empréstimo ou reserva, cada um sob a trava do seu livro ('deslocamento'
+// = posição de codigo_livro no registro, que não muda depois que o registro é publicado).
+// Os registros de cada lote são agrupados por fragmento: cada trava é tomada uma vez por
+// lote e nunca mais de uma ao mesmo tempo, então só devoluções do fragmento sendo copiado esperam.
+void copiar_sob_travas_livros(void *destino, const void *origem, size_t tam_registro, size_t deslocamento,
+                              int quantidade) {
+    unsigned char fragmentos[REGISTROS_POR_LOTE];
+    int ordem[REGISTROS_POR_LOTE];
+    int inicio_fragmento[NUM_TRAVAS_LIVROS + 1];
+    for (int base = 0; base < quantidade; base += REGISTROS_POR_LOTE) {
+        int n = quantidade - base < REGISTROS_POR_LOTE ? quantidade - base : REGISTROS_POR_LOTE;
+        const char *lote = (const char *)origem + (size_t)base * tam_registro;
+        memset(inicio_fragmento, 0, sizeof(inicio_fragmento));
+        for (int i = 0; i < n; i++) {
+            int codigo_livro;
+            memcpy(&codigo_livro, lote + (size_t)i * tam_registro + deslocamento, sizeof(int));
+            fragmentos[i] = (unsigned char)fragmento_do_livro(codigo_livro);
+            inicio_fragmento[fragmentos[i] + 1]++;
         }
-        case 2: { // Por Título
-            char termo[TAM_TITULO];
-            printf("Digite o Titulo (ou parte): ");
-            ler_string(termo, TAM_TITULO);
-            for (int i = 0; i < total_livros; i++) {
-                if (strstr(acervo_livros[i].titulo, termo) != NULL) {
-                    resultados[num_resultados++] = &acervo_livros[i];
-                }
-            }
-            break;
+        for (int f = 0; f < NUM_TRAVAS_LIVROS; f++) {
+            inicio_fragmento[f + 1] += inicio_fragmento[f];
         }
-        case 3: { // Por Autor
-            char termo[TAM_AUTOR];
-            printf("Digite o Autor (ou parte): ");
-            ler_string(termo, TAM_AUTOR);
-            for (int i = 0; i < total_livros; i++) {
-                if (strstr(acervo_livros[i].autor, termo) != NULL) {
-                    resultados[num_resultados++] = &acervo_livros[i];
-                }
-            }
-            break;
+        int proximo[NUM_TRAVAS_LIVROS];
+        memcpy(proximo, inicio_fragmento, sizeof(proximo));
+        for (int i = 0; i < n; i++) {
+            ordem[proximo[fragmentos[i]]++] = i;
         }
-        case 4: { // Busca Avançada (Parte 5)
-            char titulo[TAM_TITULO] = "";
-            char autor[TAM_AUTOR] = "";
-            int ano = 0;
-
-            printf("\n--- Busca Avancada (Deixe em branco/0 para ignorar) ---\n");
-            printf("Titulo (ou parte): ");
-            ler_string(titulo, TAM_TITULO);
-
-            printf("Autor (ou parte): ");
-            ler_string(autor, TAM_AUTOR);
-
-            printf("Ano de Publicacao (0 para ignorar): ");
-            if (scanf("%d", &ano) != 1) {
-                limpar_buffer();
+        for (int f = 0; f < NUM_TRAVAS_LIVROS; f++) {
+            if (inicio_fragmento[f] == inicio_fragmento[f + 1]) {
+                continue;
             }
-            limpar_buffer();
-
-            for (int i = 0; i < total_livros; i++) {
-                bool match_titulo = (strlen(titulo) == 0 || strstr(acervo_livros[i].titulo, titulo) != NULL);
-                bool match_autor = (strlen(autor) == 0 || strstr(acervo_livros[i].autor, autor) != NULL);
-                bool match_ano = (ano == 0 || acervo_livros[i].ano_publicacao == ano);
-
-                if (match_titulo && match_autor && match_ano) {
-                    resultados[num_resultados++] = &acervo_livros[i];
-                }
+            pthread_mutex_lock(&travas_livros[f]);
+            for (int k = inicio_fragmento[f]; k < inicio_fragmento[f + 1]; k++) {
+                size_t pos = (size_t)(base + ordem[k]) * tam_registro;
+                memcpy((char *)destino + pos, (const char *)origem + pos, tam_registro);
             }
-            break;
+            pthread_mutex_unlock(&travas_livros[f]);
         }
-        default:
-            printf("[ERRO] Opcao invalida.\n");
-            return;
     }
+}
 
-    // Exibição dos resultados
-    if (num_resultados > 0) {
-        printf("\n--- Resultados da Pesquisa (%d encontrado(s)) ---\n", num_resultados);
-        for (int i = 0; i < num_resultados; i++) {
-            printf("------------------------------------------\n");
-            printf("Codigo: %d\n", resultados[i]->codigo);
-            printf("Titulo: %s\n", resultados[i]->titulo);
-            printf("Autor: %s\n", resultados[i]->autor);
-            printf("Editora: %s\n", resultados[i]->editora);
-            printf("Ano: %d\n", resultados[i]->ano_publicacao);
-            printf("Total Exemplares: %d\n", resultados[i]->total_exemplares);
-            printf("Disponiveis: %d\n", resultados[i]->exemplares_disponiveis);
-            printf("Status: %s\n", resultados[i]->status);
-        }
-        printf("------------------------------------------\n");
+// Copia 'quantidade' registros do cadastro conforme o modo
+void copiar_registros(ModoCopia modo, void *destino, const void *origem, size_t tam_registro, int quantidade) {
+    if (modo == COPIA_LIVROS) {
+        copiar_livros(destino, origem, quantidade);
+    } else if (modo == COPIA_EMPRESTIMOS) {
+        copiar_sob_travas_livros(destino, origem, tam_registro, offsetof(Emprestimo, codigo_livro), quantidade);
+    } else if (modo == COPIA_RESERVAS) {
+        copiar_sob_travas_livros(destino, origem, tam_registro, offsetof(Reserva, codigo_livro), quantidade);
     } else {
-        printf("\n[INFO] Nenhum livro encontrado com os criterios fornecidos.\n");
+        memcpy(destino, origem, (size_t)quantidade * tam_registro);
     }
 }
 
-// Função para pesquisar usuários (por matrícula ou nome)
-void pesquisar_usuarios() {
-    int opcao;
-    printf("\n--- Pesquisar Usuarios ---\n");
-    printf("Buscar por:\n");
-    printf("1. Matricula\n");
-    printf("2. Nome\n");
-    printf("Opcao: ");
-    if (scanf("%d", &opcao) != 1) {
-        printf("[ERRO] Opcao invalida.\n");
-        limpar_buffer();
-        return;
+// Cópia consistente (ponto no tempo) dos três cadastros
+typedef struct {
+    Livro *livros;
+    Usuario *usuarios;
+    Emprestimo *emprestimos;
+    int total_livros;
+    int total_usuarios;
+    int total_emprestimos;
+    unsigned int versao_livros[PAGINAS_LIVROS];
+    unsigned int versao_usuarios[PAGINAS_USUARIOS];
+    unsigned int versao_emprestimos[PAGINAS_EMPRESTIMOS];
+    int paginas_copiadas; // Páginas copiadas na última atualização (diagnóstico)
+    MapaIndice mapa_livros;   // código -> posição em 'livros'
+    MapaIndice mapa_usuarios; // matrícula -> posição em 'usuarios'
+    int livros_indexados;
+    int usuarios_indexados;
+    unsigned int geracao_carga;
+} Instantaneo;
+
+// Instantâneo compartilhado pelos relatórios; trava_instantaneo garante um relatório por vez
+Instantaneo instantaneo_relatorios;
+pthread_mutex_t trava_instantaneo = PTHREAD_MUTEX_INITIALIZER;
+
+// Aloca os vetores do instantâneo e marca todas as páginas como nunca copiadas
+bool criar_instantaneo(Instantaneo *inst) {
+    memset(inst, 0, sizeof(Instantaneo));
+    inst->livros = malloc(sizeof(Livro) * MAX_LIVROS);
+    inst->usuarios = malloc(sizeof(Usuario) * MAX_USUARIOS);
+    inst->emprestimos = malloc(sizeof(Emprestimo) * MAX_EMPRESTIMOS);
+    if (inst->livros == NULL || inst->usuarios == NULL || inst->emprestimos == NULL ||
+        !mapa_criar(&inst->mapa_livros, MAX_LIVROS) || !mapa_criar(&inst->mapa_usuarios, MAX_USUARIOS)) {
+        mapa_destruir(&inst->mapa_livros);
+        mapa_destruir(&inst->mapa_usuarios);
+        free(inst->livros);
+        free(inst->usuarios);
+        free(inst->emprestimos);
+        inst->livros = NULL;
+        inst->usuarios = NULL;
+        inst->emprestimos = NULL;
+        return false;
     }
-    limpar_buffer();
-
-    Usuario *resultados[MAX_USUARIOS];
-    int num_resultados = 0;
+    for (int p = 0; p < PAGINAS_LIVROS; p++) inst->versao_livros[p] = PAGINA_NUNCA_COPIADA;
+    for (int p = 0; p < PAGINAS_USUARIOS; p++) inst->versao_usuarios[p] = PAGINA_NUNCA_COPIADA;
+    for (int p = 0; p < PAGINAS_EMPRESTIMOS; p++) inst->versao_emprestimos[p] = PAGINA_NUNCA_COPIADA;
+    return true;
+}
 
-    switch (opcao) {
-        case 1: { // Por Matrícula
-            int mat;
-            printf("Digite a Matricula do usuario: ");
-            if (scanf("%d", &mat) != 1) {
-                printf("[ERRO] Matricula invalida.\n");
-                limpar_buffer();
-                return;
-            }
-            limpar_buffer();
-            int idx = buscar_usuario_por_matricula(mat);
-            if (idx != -1) {
-                resultados[num_resultados++] = &lista_usuarios[idx];
+// Copia para 'destino' as páginas de 'origem' cuja versão mudou; retorna quantas foram copiadas.
+// Páginas alteradas vizinhas são copiadas juntas (até um lote), o que agrupa as travas dos livros.
+int copiar_paginas_alteradas(void *destino, const void *origem, size_t tam_registro, int total,
+                             atomic_uint *versoes, unsigned int *versoes_copiadas, ModoCopia modo) {
+    int copiadas = 0;
+    int paginas = (total + TAM_PAGINA - 1) / TAM_PAGINA;
+    for (int p = 0; p < paginas;) {
+        // Trecho de páginas alteradas a partir de 'p'; a versão de cada uma é lida antes da cópia
+        int primeira = p;
+        while (p < paginas && (p - primeira) * TAM_PAGINA < REGISTROS_POR_LOTE) {
+            unsigned int versao = atomic_load(&versoes[p]);
+            if (versao == versoes_copiadas[p]) {
+                break;
             }
-            break;
+            versoes_copiadas[p] = versao;
+            p++;
         }
-        case 2: { // Por Nome
-            char termo[TAM_NOME];
-            printf("Digite o Nome completo (ou parte): ");
-            ler_string(termo, TAM_NOME);
-            for (int i = 0; i < total_usuarios; i++) {
-                if (strstr(lista_usuarios[i].nome, termo) != NULL) {
-                    resultados[num_resultados++] = &lista_usuarios[i];
-                }
-            }
-            break;
+        if (p == primeira) {
+            p++;
+            continue;
         }
-        default:
-            printf("[ERRO] Opcao invalida.\n");
-            return;
+        int inicio = primeira * TAM_PAGINA;
+        int fim = p * TAM_PAGINA < total ? p * TAM_PAGINA : total;
+        copiar_registros(modo, (char *)destino + inicio * tam_registro, (const char *)origem + inicio * tam_registro,
+                         tam_registro, fim - inicio);
+        copiadas += p - primeira;
     }
+    return copiadas;
+}
 
-    // Exibição dos resultados
-    if (num_resultados > 0) {
-        printf("\n--- Resultados da Pesquisa (%d encontrado(s)) ---\n", num_resultados);
-        for (int i = 0; i < num_resultados; i++) {
-            printf("------------------------------------------\n");
-            printf("Matricula: %d\n", resultados[i]->matricula);
-            printf("Nome: %s\n", resultados[i]->nome);
-            printf("Curso: %s\n", resultados[i]->curso);
-            printf("Telefone: %s\n", resultados[i]->telefone);
-            printf("Data Cadastro: %d/%d/%d\n", resultados[i]->data_cadastro.dia, resultados[i]->data_cadastro.mes, resultados[i]->data_cadastro.ano);
-        }
-        printf("------------------------------------------\n");
-    } else {
-        printf("\n[INFO] Nenhum usuario encontrado com os criterios fornecidos.\n");
+// Copia as páginas alteradas sob trava de leitura, sem bloquear empréstimos e devoluções
+// (cada registro com a proteção que seu cadastro exige; ver ModoCopia). A versão de
+// cada página é lida antes da cópia e toda alteração incrementa a versão depois de gravar
+// o registro: uma página alterada depois de copiada fica com versão antiga e é copiada de
+// novo na etapa sob trava de escrita.
+void copiar_paginas_sob_leitura(Instantaneo *inst) {
+    travar_leitura_cadastros();
+    copiar_paginas_alteradas(inst->livros, acervo_livros, sizeof(Livro), total_livros,
+                             versao_paginas_livros, inst->versao_livros, COPIA_LIVROS);
+    copiar_paginas_alteradas(inst->usuarios, lista_usuarios, sizeof(Usuario), total_usuarios,
+                             versao_paginas_usuarios, inst->versao_usuarios, COPIA_DIRETA);
+    copiar_paginas_alteradas(inst->emprestimos, lista_emprestimos, sizeof(Emprestimo), atomic_load(&total_emprestimos),
+                             versao_paginas_emprestimos, inst->versao_emprestimos, COPIA_EMPRESTIMOS);
+    destravar_cadastros();
+}
+
+// Atualiza o instantâneo para o estado atual. O grosso da cópia (inclusive a primeira, de
+// todas as páginas) é feito sob trava de leitura; a trava de escrita só é mantida para
+// copiar as páginas alteradas nesse meio tempo, e operações em andamento terminam antes
+// (ponto consistente).
+void atualizar_instantaneo(Instantaneo *inst) {
+    copiar_paginas_sob_leitura(inst);
+    travar_escrita_cadastros();
+    inst->total_livros = total_livros;
+    inst->total_usuarios = total_usuarios;
+    inst->total_emprestimos = total_emprestimos;
+    inst->paginas_copiadas =
+        copiar_paginas_alteradas(inst->livros, acervo_livros, sizeof(Livro), inst->total_livros,
+                                 versao_paginas_livros, inst->versao_livros, COPIA_LIVROS) +
+        copiar_paginas_alteradas(inst->usuarios, lista_usuarios, sizeof(Usuario), inst->total_usuarios,
+                                 versao_paginas_usuarios, inst->versao_usuarios, COPIA_DIRETA) +
+        copiar_paginas_alteradas(inst->emprestimos, lista_emprestimos, sizeof(Emprestimo), inst->total_emprestimos,
+                                 versao_paginas_emprestimos, inst->versao_emprestimos, COPIA_EMPRESTIMOS);
+    destravar_cadastros();
+
+    // Códigos nunca mudam de posição: só os registros novos entram nos mapas (salvo após nova carga)
+    if (inst->geracao_carga != atomic_load(&geracao_carga)) {
+        inst->geracao_carga = atomic_load(&geracao_carga);
+        mapa_limpar(&inst->mapa_livros);
+        mapa_limpar(&inst->mapa_usuarios);
+        inst->livros_indexados = 0;
+        inst->usuarios_indexados = 0;
+    }
+    for (; inst->livros_indexados < inst->total_livros; inst->livros_indexados++) {
+        mapa_inserir(&inst->mapa_livros, inst->livros[inst->livros_indexados].codigo, inst->livros_indexados);
+    }
+    for (; inst->usuarios_indexados < inst->total_usuarios; inst->usuarios_indexados++) {
+        mapa_inserir(&inst->mapa_usuarios, inst->usuarios[inst->usuarios_indexados].matricula, inst->usuarios_indexados);
     }
 }
 
-// Função para listar empréstimos ativos
-void listar_emprestimos_ativos() {
-    int contador = 0;
-    printf("\n--- Lista de Emprestimos Ativos ---\n");
-    printf("Data Atual: %d/%d/%d\n", data_atual().dia, data_atual().mes, data_atual().ano);
+// Obtém o instantâneo dos relatórios atualizado; deve ser liberado com liberar_instantaneo()
+Instantaneo *obter_instantaneo() {
+    pthread_mutex_lock(&trava_instantaneo);
+    if (instantaneo_relatorios.livros == NULL && !criar_instantaneo(&instantaneo_relatorios)) {
+        pthread_mutex_unlock(&trava_instantaneo);
+        printf("[ERRO] Memoria insuficiente para gerar o relatorio.\n");
+        return NULL;
+    }
+    atualizar_instantaneo(&instantaneo_relatorios);
+    return &instantaneo_relatorios;
+}
 
-    printf("Cod. Emp | Matr. Usuario | Cod. Livro | Data Emp. | Data Prev. Dev. | Status\n");
-    printf("---------------------------------------------------------------------------\n");
+void liberar_instantaneo(Instantaneo *inst) {
+    (void)inst;
+    pthread_mutex_unlock(&trava_instantaneo);
+}
 
-    for (int i = 0; i < total_emprestimos; i++) {
-        if (strcmp(lista_emprestimos[i].status, "ATIVO") == 0) {
-            printf("%8d | %13d | %10d | %02d/%02d/%04d | %02d/%02d/%04d | %s\n",
-                   lista_emprestimos[i].codigo_emprestimo,
-                   lista_emprestimos[i].matricula_usuario,
-                   lista_emprestimos[i].codigo_livro,
-                   lista_emprestimos[i].data_emprestimo.dia,
-                   lista_emprestimos[i].data_emprestimo.mes,
-                   lista_emprestimos[i].data_emprestimo.ano,
-                   lista_emprestimos[i].data_prevista_devolucao.dia,
-                   lista_emprestimos[i].data_prevista_devolucao.mes,
-                   lista_emprestimos[i].data_prevista_devolucao.ano,
-                   lista_emprestimos[i].status);
-            contador++;
-        }
-    }
+// Buscas equivalentes a buscar_livro_por_codigo/buscar_usuario_por_matricula, mas no instantâneo
+int instantaneo_buscar_livro(const Instantaneo *inst, int codigo) {
+    return mapa_buscar(&inst->mapa_livros, codigo);
+}
 
-    printf("---------------------------------------------------------------------------\n");
-    printf("Total de emprestimos ativos: %d\n", contador);
+int instantaneo_buscar_usuario(const Instantaneo *inst, int matricula) {
+    return mapa_buscar(&inst->mapa_usuarios, matricula);
+}
 
-    if (contador == 0) {
-        printf("[INFO] Nao ha emprestimos ativos no momento.\n");
+// --- MOTOR PARALELO DE RELATÓRIOS ---
+
+// Pool de threads com roubo de tarefas: cada varredura é dividida em partições de
+// TAM_PARTICAO registros, distribuídas entre as filas dos trabalhadores. Quem esvazia a
+// própria fila rouba partições do início da fila dos outros. Cada trabalhador acumula
+// resultados parciais próprios (sem disputa), e quem pediu a varredura faz a junção.
+#define TAM_PARTICAO 4096
+#define MAX_THREADS_RELATORIO 64
+
+// Processa os registros [inicio, fim) acumulando no parcial do trabalhador 'id_trabalhador'
+typedef void (*FuncaoParticao)(void *contexto, int inicio, int fim, int id_trabalhador);
+
+typedef struct {
+    int inicio;
+    int fim;
+} Particao;
+
+// Fila dupla de partições: o dono retira do fim, os ladrões retiram do início
+typedef struct {
+    Particao *itens;
+    int inicio;
+    int fim;
+    pthread_mutex_t trava;
+} FilaTrabalho;
+
+typedef struct {
+    pthread_t *threads;
+    FilaTrabalho *filas;
+    int num_trabalhadores;
+    int trabalhadores_ativos; // Participantes da varredura atual (<= num_trabalhadores)
+    FuncaoParticao funcao; // Varredura em execução
+    void *contexto;
+    atomic_int particoes_pendentes;
+    int ocupados; // Trabalhadores ainda procurando partições da varredura atual
+    unsigned long geracao; // Incrementada a cada nova varredura
+    bool encerrar;
+    pthread_mutex_t trava;
+    pthread_cond_t tem_trabalho;
+    pthread_cond_t trabalho_concluido;
+} PoolTrabalho;
+
+PoolTrabalho pool_relatorios;
+bool pool_iniciado = false;
+int threads_relatorio = 0; // 0 = número de processadores
+pthread_mutex_t trava_pool = PTHREAD_MUTEX_INITIALIZER; // Uma varredura por vez
+
+// Número de processadores disponíveis (4 se o sistema não informar)
+int detectar_num_processadores() {
+#ifdef _SC_NPROCESSORS_ONLN
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0) {
+        return (int)n;
     }
+#endif
+    return 4;
 }
 
-// --- PARTE 5: FUNCIONALIDADES AVANÇADAS (RELATÓRIOS) ---
-
-// Relatório de livros mais emprestados
-void relatorio_livros_mais_emprestados() {
-    printf("\n--- Relatorio de Livros Mais Emprestados ---\n");
+// Número efetivo de threads usadas pelos relatórios
+int obter_threads_relatorio() {
+    int n = threads_relatorio > 0 ? threads_relatorio : detectar_num_processadores();
+    return n > MAX_THREADS_RELATORIO ? MAX_THREADS_RELATORIO : n;
+}
 
-    if (total_emprestimos == 0) {
-        printf("[INFO] Nao ha emprestimos registrados para gerar o relatorio.\n");
-        return;
+// Retira uma partição da própria fila (fim) ou, se 'roubar', do início da fila de outro
+bool retirar_particao(FilaTrabalho *fila, Particao *saida, bool roubar) {
+    bool achou = false;
+    pthread_mutex_lock(&fila->trava);
+    if (fila->inicio < fila->fim) {
+        *saida = roubar ? fila->itens[fila->inicio++] : fila->itens[--fila->fim];
+        achou = true;
     }
+    pthread_mutex_unlock(&fila->trava);
+    return achou;
+}
 
-    int contagem_emprestimos[MAX_LIVROS] = {0};
-    int livro_codigos[MAX_LIVROS];
-    int num_livros_distintos = 0;
+void *laco_trabalhador(void *argumento) {
+    int id = (int)(intptr_t)argumento;
+    PoolTrabalho *pool = &pool_relatorios;
+    unsigned long geracao_vista = 0;
 
-    // 1. Contar as ocorrências de cada livro em todos os empréstimos (ativos e devolvidos)
-    for (int i = 0; i < total_emprestimos; i++) {
-        int cod = lista_emprestimos[i].codigo_livro;
-        int encontrado = 0;
-        for (int j = 0; j < num_livros_distintos; j++) {
-            if (livro_codigos[j] == cod) {
-                contagem_emprestimos[j]++;
-                encontrado = 1;
+    while (true) {
+        pthread_mutex_lock(&pool->trava);
+        while (!pool->encerrar && pool->geracao == geracao_vista) {
+            pthread_cond_wait(&pool->tem_trabalho, &pool->trava);
+        }
+        if (pool->encerrar) {
+            pthread_mutex_unlock(&pool->trava);
+            return NULL;
+        }
+        geracao_vista = pool->geracao;
+        FuncaoParticao funcao = pool->funcao;
+        void *contexto = pool->contexto;
+        int ativos = pool->trabalhadores_ativos;
+        if (id >= ativos) {
+            pthread_mutex_unlock(&pool->trava);
+            continue; // O chamador só tem parciais para os primeiros 'ativos' trabalhadores
+        }
+        pool->ocupados++;
+        pthread_mutex_unlock(&pool->trava);
+
+        // Esvazia a própria fila e depois tenta roubar das demais
+        Particao particao;
+        while (true) {
+            bool achou = retirar_particao(&pool->filas[id], &particao, false);
+            for (int v = 1; !achou && v < ativos; v++) {
+                achou = retirar_particao(&pool->filas[(id + v) % ativos], &particao, true);
+            }
+            if (!achou) {
                 break;
             }
+            funcao(contexto, particao.inicio, particao.fim, id);
+            atomic_fetch_sub(&pool->particoes_pendentes, 1);
         }
-        if (!encontrado && num_livros_distintos < MAX_LIVROS) {
-            livro_codigos[num_livros_distintos] = cod;
-            contagem_emprestimos[num_livros_distintos]++;
-            num_livros_distintos++;
-        }
-    }
 
-    // 2. Ordenar os livros por contagem (Bubble Sort simples)
-    for (int i = 0; i < num_livros_distintos - 1; i++) {
-        for (int j = 0; j < num_livros_distintos - i - 1; j++) {
-            if (contagem_emprestimos[j] < contagem_emprestimos[j + 1]) {
-                // Troca a contagem
-                int temp_count = contagem_emprestimos[j];
-                contagem_emprestimos[j] = contagem_emprestimos[j + 1];
-                contagem_emprestimos[j + 1] = temp_count;
-                // Troca o código
-                int temp_cod = livro_codigos[j];
-                livro_codigos[j] = livro_codigos[j + 1];
-                livro_codigos[j + 1] = temp_cod;
-            }
+        // A varredura só termina quando nenhum trabalhador ainda pode tocar nas filas
+        pthread_mutex_lock(&pool->trava);
+        pool->ocupados--;
+        if (pool->ocupados == 0) {
+            pthread_cond_signal(&pool->trabalho_concluido);
         }
+        pthread_mutex_unlock(&pool->trava);
     }
+}
 
-    // 3. Exibir o resultado
-    printf("RANK | Codigo | Titulo | Total Emprestimos\n");
-    printf("--------------------------------------------\n");
-    for (int i = 0; i < num_livros_distintos; i++) {
-        int idx_livro = buscar_livro_por_codigo(livro_codigos[i]);
-        if (idx_livro != -1) {
-            printf("%4d | %6d | %-10s | %17d\n",
-                   i + 1,
-                   livro_codigos[i],
-                   acervo_livros[idx_livro].titulo,
-                   contagem_emprestimos[i]);
+bool iniciar_pool(int num_trabalhadores) {
+    PoolTrabalho *pool = &pool_relatorios;
+    memset(pool, 0, sizeof(PoolTrabalho));
+    pool->num_trabalhadores = num_trabalhadores;
+    pool->threads = malloc(sizeof(pthread_t) * num_trabalhadores);
+    pool->filas = calloc(num_trabalhadores, sizeof(FilaTrabalho));
+    if (pool->threads == NULL || pool->filas == NULL) {
+        free(pool->threads);
+        free(pool->filas);
+        return false;
+    }
+    pthread_mutex_init(&pool->trava, NULL);
+    pthread_cond_init(&pool->tem_trabalho, NULL);
+    pthread_cond_init(&pool->trabalho_concluido, NULL);
+    for (int i = 0; i < num_trabalhadores; i++) {
+        pthread_mutex_init(&pool->filas[i].trava, NULL);
+    }
+    for (int i = 0; i < num_trabalhadores; i++) {
+        if (pthread_create(&pool->threads[i], NULL, laco_trabalhador, (void *)(intptr_t)i) != 0) {
+            // Segue com as threads que conseguiram ser criadas
+            pool->num_trabalhadores = i;
+            break;
         }
     }
-    printf("--------------------------------------------\n");
+    pool_iniciado = pool->num_trabalhadores > 0;
+    return pool_iniciado;
 }
 
-// Relatório de usuários com empréstimos em atraso
-void relatorio_usuarios_em_atraso() {
-    printf("\n--- Relatorio de Usuarios com Emprestimos em Atraso ---\n");
-    Data hoje = data_atual();
-    int contador = 0;
-
-    printf("Data Atual: %d/%d/%d\n", hoje.dia, hoje.mes, hoje.ano);
-    printf("Matricula | Nome do Usuario | Cod. Emp | Data Prev. Dev.\n");
-    printf("-------------------------------------------------------------------\n");
+void encerrar_pool() {
+    PoolTrabalho *pool = &pool_relatorios;
+    if (!pool_iniciado) {
+        return;
+    }
+    pthread_mutex_lock(&pool->trava);
+    pool->encerrar = true;
+    pthread_cond_broadcast(&pool->tem_trabalho);
+    pthread_mutex_unlock(&pool->trava);
+    for (int i = 0; i < pool->num_trabalhadores; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for (int i = 0; i < pool->num_trabalhadores; i++) {
+        free(pool->filas[i].itens);
+        pthread_mutex_destroy(&pool->filas[i].trava);
+    }
+    pthread_mutex_destroy(&pool->trava);
+    pthread_cond_destroy(&pool->tem_trabalho);
+    pthread_cond_destroy(&pool->trabalho_concluido);
+    free(pool->threads);
+    free(pool->filas);
+    pool_iniciado = false;
+}
 
-    for (int i = 0; i < total_emprestimos; i++) {
-        // Verifica se está ATIVO e se HOJE é depois da DATA PREVISTA
-        if (strcmp(lista_emprestimos[i].status, "ATIVO") == 0 &&
-            comparar_datas(hoje, lista_emprestimos[i].data_prevista_devolucao) > 0) {
+// Altera o número de threads (0 = automático); o pool é recriado na próxima varredura
+void configurar_threads_relatorio(int n) {
+    pthread_mutex_lock(&trava_pool);
+    encerrar_pool();
+    threads_relatorio = n < 0 ? 0 : n;
+    pthread_mutex_unlock(&trava_pool);
+}
 
-            int idx_usuario = buscar_usuario_por_matricula(lista_emprestimos[i].matricula_usuario);
+// Executa 'funcao' sobre [0, total) em paralelo e retorna quando todas as partições terminarem.
+// O contexto deve ter 'num_parciais' resultados parciais; no máximo esse número de
+// trabalhadores participa. Retorna quantos parciais foram efetivamente usados.
+int executar_em_paralelo(int total, int num_parciais, FuncaoParticao funcao, void *contexto) {
+    pthread_mutex_lock(&trava_pool);
+    if (!pool_iniciado && !iniciar_pool(obter_threads_relatorio())) {
+        pthread_mutex_unlock(&trava_pool);
+        funcao(contexto, 0, total, 0); // Sem threads: varredura sequencial
+        return 1;
+    }
 
-            if (idx_usuario != -1) {
-                printf("%9d | %-15s | %8d | %02d/%02d/%04d\n",
-                       lista_emprestimos[i].matricula_usuario,
-                       lista_usuarios[idx_usuario].nome,
-                       lista_emprestimos[i].codigo_emprestimo,
-                       lista_emprestimos[i].data_prevista_devolucao.dia,
-                       lista_emprestimos[i].data_prevista_devolucao.mes,
-                       lista_emprestimos[i].data_prevista_devolucao.ano);
-                contador++;
-            }
+    PoolTrabalho *pool = &pool_relatorios;
+    int num_particoes = (total + TAM_PARTICAO - 1) / TAM_PARTICAO;
+    int ativos = pool->num_trabalhadores < num_parciais ? pool->num_trabalhadores : num_parciais;
+    if (num_particoes == 0 || ativos < 1) {
+        pthread_mutex_unlock(&trava_pool);
+        if (num_particoes > 0) {
+            funcao(contexto, 0, total, 0);
         }
+        return 1;
     }
 
-    printf("-------------------------------------------------------------------\n");
-    printf("Total de emprestimos em atraso: %d\n", contador);
+    // Aguarda retardatários de uma varredura anterior antes de mexer nas filas
+    pthread_mutex_lock(&pool->trava);
+    while (pool->ocupados > 0) {
+        pthread_cond_wait(&pool->trabalho_concluido, &pool->trava);
+    }
 
-    if (contador == 0) {
-        printf("[INFO] Parabens! Nenhum emprestimo em atraso encontrado.\n");
+    // Distribui as partições em rodízio; partições vizinhas ficam com trabalhadores diferentes
+    int por_fila = (num_particoes + ativos - 1) / ativos;
+    bool sem_memoria = false;
+    for (int t = 0; t < ativos; t++) {
+        FilaTrabalho *fila = &pool->filas[t];
+        pthread_mutex_lock(&fila->trava);
+        free(fila->itens);
+        fila->itens = malloc(sizeof(Particao) * por_fila);
+        fila->inicio = 0;
+        fila->fim = 0;
+        sem_memoria = sem_memoria || fila->itens == NULL;
+        pthread_mutex_unlock(&fila->trava);
+    }
+    if (sem_memoria) {
+        pthread_mutex_unlock(&pool->trava);
+        pthread_mutex_unlock(&trava_pool);
+        funcao(contexto, 0, total, 0);
+        return 1;
     }
+    for (int p = 0; p < num_particoes; p++) {
+        FilaTrabalho *fila = &pool->filas[p % ativos];
+        fila->itens[fila->fim].inicio = p * TAM_PARTICAO;
+        fila->itens[fila->fim].fim = (p + 1) * TAM_PARTICAO < total ? (p + 1) * TAM_PARTICAO : total;
+        fila->fim++;
+    }
+
+    pool->funcao = funcao;
+    pool->contexto = contexto;
+    pool->trabalhadores_ativos = ativos;
+    atomic_store(&pool->particoes_pendentes, num_particoes);
+    pool->geracao++;
+    pthread_cond_broadcast(&pool->tem_trabalho);
+    while (atomic_load(&pool->particoes_pendentes) > 0 || pool->ocupados > 0) {
+        pthread_cond_wait(&pool->trabalho_concluido, &pool->trava);
+    }
+    pthread_mutex_unlock(&pool->trava);
+
+    pthread_mutex_unlock(&trava_pool);
+    return ativos;
 }
 
+// --- AGREGADOS DOS EMPRÉSTIMOS (PAINÉIS) ---
 
-// --- PARTE 2: SISTEMA DE MENUS E CONTROLE DE FLUXO ---
+// Contadores por dia do empréstimo, por curso do usuário e por editora do livro, além do
+// total. Cada empréstimo e cada devolução somam nos contadores do seu dia, curso e editora
+// (atualização O(1), com operações atômicas: o balcão roda sob trava de leitura), e a carga
+// dos arquivos os refaz do zero, em paralelo no pool dos relatórios. Assim os painéis leem
+// contadores em vez de varrer o histórico. A devolução conta no dia em que o empréstimo
+// começou; a taxa de atraso é a fração das devoluções com data que passaram do prazo.
+#define FOLGA_DIAS_AGREGADOS 3660 // Dias depois de hoje já alocados na série diária
+#define HISTORICO_DIAS_AGREGADOS 18263 // Dias antes de hoje que a série diária cobre (50 anos)
 
-void menu_livros() {
-    int opcao;
-    do {
+typedef enum {
+    AGREGADO_CURSO,
+    AGREGADO_EDITORA,
+    NUM_DIMENSOES_AGREGADAS
+} DimensaoAgregada;
+
+typedef struct {
+    atomic_int emprestimos;
+    atomic_int devolvidos;
+    atomic_int devolvidos_com_data;  // Base da duração média e da taxa de atraso
+    atomic_int devolvidos_em_atraso;
+    atomic_llong dias_emprestado;    // Soma das durações das devoluções com data
+} ContadoresAgregados;
+
+// Leitura dos contadores de um grupo, soma de vários ou parcela de um único evento
+typedef struct {
+    int emprestimos;
+    int devolvidos;
+    int devolvidos_com_data;
+    int devolvidos_em_atraso;
+    long long dias_emprestado;
+} ResumoAgregado;
+
+// Grupos de uma dimensão: o nome do grupo é o texto do registro 'representantes[g]'
+typedef struct {
+    MapaIndice grupos_por_nome;  // Hash do nome -> grupo (colisões seguem para hash + 1)
+    ContadoresAgregados *contadores;
+    int *representantes;
+    int *grupo_do_registro;      // Por posição do usuário/livro (-1 = sem grupo)
+    int num_grupos;
+} GruposAgregados;
+
+ContadoresAgregados contadores_cursos[MAX_USUARIOS];
+ContadoresAgregados contadores_editoras[MAX_LIVROS];
+int representantes_cursos[MAX_USUARIOS];
+int representantes_editoras[MAX_LIVROS];
+int curso_do_usuario[MAX_USUARIOS];
+int editora_do_livro[MAX_LIVROS];
+
+GruposAgregados grupos_agregados[NUM_DIMENSOES_AGREGADAS] = {
+    {{NULL, NULL, 0, 0}, contadores_cursos, representantes_cursos, curso_do_usuario, 0},
+    {{NULL, NULL, 0, 0}, contadores_editoras, representantes_editoras, editora_do_livro, 0},
+};
+
+ContadoresAgregados agregado_total;
+ContadoresAgregados agregado_fora_da_serie; // Parte do total sem dia na série (data fora da janela ou sem memória)
+ContadoresAgregados *agregados_dias = NULL; // Série diária a partir de 'primeiro_dia_agregado'
+int primeiro_dia_agregado = 0;
+int num_dias_agregados = 0;
+
+const char *texto_da_dimensao(DimensaoAgregada dimensao, int registro) {
+    return dimensao == AGREGADO_CURSO ? lista_usuarios[registro].curso : acervo_livros[registro].editora;
+}
+
+// Hash FNV-1a do nome, como chave não negativa do mapa (MAPA_VAZIO é negativo)
+int chave_do_nome(const char *nome) {
+    unsigned int h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)nome; *p != '\0'; p++) {
+        h = (h ^ *p) * 16777619u;
+    }
+    return (int)(h & 0x7FFFFFFF);
+}
+
+// Grupo com este nome ou -1; 'chave' recebe a chave do mapa onde ele está (ou entraria)
+int buscar_grupo_agregado(DimensaoAgregada dimensao, const char *nome, int *chave) {
+    const GruposAgregados *g = &grupos_agregados[dimensao];
+    *chave = chave_do_nome(nome);
+    int grupo;
+    while ((grupo = mapa_buscar(&g->grupos_por_nome, *chave)) != -1 &&
+           strcmp(texto_da_dimensao(dimensao, g->representantes[grupo]), nome) != 0) {
+        *chave = (*chave + 1) & 0x7FFFFFFF;
+    }
+    return grupo;
+}
+
+// Classifica o livro/usuário recém-incluído no grupo do seu texto, criando o grupo (com ele
+// como representante) se ainda não existe. Chamador tem trava de escrita no cadastro.
+void classificar_registro_agregado(DimensaoAgregada dimensao, int registro) {
+    GruposAgregados *g = &grupos_agregados[dimensao];
+    int chave;
+    int grupo = buscar_grupo_agregado(dimensao, texto_da_dimensao(dimensao, registro), &chave);
+    if (grupo == -1 && mapa_inserir(&g->grupos_por_nome, chave, g->num_grupos)) {
+        grupo = g->num_grupos++;
+        g->representantes[grupo] = registro;
+    }
+    g->grupo_do_registro[registro] = grupo;
+}
+
+// Grupos do empréstimo nas duas dimensões e posição do seu dia na série (-1 = nenhum)
+void grupos_do_emprestimo(const Emprestimo *e, int *curso, int *editora, int *dia) {
+    int idx_usuario = buscar_usuario_por_matricula(e->matricula_usuario);
+    int idx_livro = buscar_livro_por_codigo(e->codigo_livro);
+    *curso = idx_usuario != -1 ? curso_do_usuario[idx_usuario] : -1;
+    *editora = idx_livro != -1 ? editora_do_livro[idx_livro] : -1;
+    *dia = dias_desde_epoca(e->data_emprestimo) - primeiro_dia_agregado;
+    if (*dia < 0 || *dia >= num_dias_agregados) {
+        *dia = -1;
+    }
+}
+
+// Quanto o empréstimo soma aos contadores: a saída do exemplar e/ou a devolução
+ResumoAgregado parcela_do_emprestimo(const Emprestimo *e, bool saida, bool devolucao) {
+    ResumoAgregado r;
+    memset(&r, 0, sizeof(r));
+    r.emprestimos = saida;
+    if (devolucao) {
+        r.devolvidos = 1;
+        if (data_definida(e->data_devolucao)) {
+            r.devolvidos_com_data = 1;
+            r.devolvidos_em_atraso = comparar_datas(e->data_devolucao, e->data_prevista_devolucao) > 0;
+            r.dias_emprestado = dias_desde_epoca(e->data_devolucao) - dias_desde_epoca(e->data_emprestimo);
+        }
+    }
+    return r;
+}
+
+void somar_resumo(ResumoAgregado *destino, ResumoAgregado parcela) {
+    destino->emprestimos += parcela.emprestimos;
+    destino->devolvidos += parcela.devolvidos;
+    destino->devolvidos_com_data += parcela.devolvidos_com_data;
+    destino->devolvidos_em_atraso += parcela.devolvidos_em_atraso;
+    destino->dias_emprestado += parcela.dias_emprestado;
+}
+
+void somar_contadores(ContadoresAgregados *c, ResumoAgregado parcela) {
+    atomic_fetch_add_explicit(&c->emprestimos, parcela.emprestimos, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c->devolvidos, parcela.devolvidos, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c->devolvidos_com_data, parcela.devolvidos_com_data, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c->devolvidos_em_atraso, parcela.devolvidos_em_atraso, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c->dias_emprestado, parcela.dias_emprestado, memory_order_relaxed);
+}
+
+ResumoAgregado ler_agregado(const ContadoresAgregados *c) {
+    ResumoAgregado r;
+    r.emprestimos = atomic_load_explicit(&c->emprestimos, memory_order_relaxed);
+    r.devolvidos = atomic_load_explicit(&c->devolvidos, memory_order_relaxed);
+    r.devolvidos_com_data = atomic_load_explicit(&c->devolvidos_com_data, memory_order_relaxed);
+    r.devolvidos_em_atraso = atomic_load_explicit(&c->devolvidos_em_atraso, memory_order_relaxed);
+    r.dias_emprestado = atomic_load_explicit(&c->dias_emprestado, memory_order_relaxed);
+    return r;
+}
+
+void gravar_agregado(ContadoresAgregados *c, ResumoAgregado r) {
+    atomic_store(&c->emprestimos, r.emprestimos);
+    atomic_store(&c->devolvidos, r.devolvidos);
+    atomic_store(&c->devolvidos_com_data, r.devolvidos_com_data);
+    atomic_store(&c->devolvidos_em_atraso, r.devolvidos_em_atraso);
+    atomic_store(&c->dias_emprestado, r.dias_emprestado);
+}
+
+// Soma o evento do empréstimo no total, no dia, no curso e na editora (chamador tem trava
+// de leitura nos cadastros)
+void agregar(const Emprestimo *e, ResumoAgregado parcela) {
+    int curso, editora, dia;
+    grupos_do_emprestimo(e, &curso, &editora, &dia);
+    somar_contadores(&agregado_total, parcela);
+    somar_contadores(dia != -1 ? &agregados_dias[dia] : &agregado_fora_da_serie, parcela);
+    if (curso != -1) somar_contadores(&contadores_cursos[curso], parcela);
+    if (editora != -1) somar_contadores(&contadores_editoras[editora], parcela);
+}
+
+void agregar_emprestimo(const Emprestimo *e) {
+    agregar(e, parcela_do_emprestimo(e, true, false));
+}
+
+// Status e data de devolução já preenchidos
+void agregar_devolucao(const Emprestimo *e) {
+    agregar(e, parcela_do_emprestimo(e, false, true));
+}
+
+// Somas parciais da reconstrução: um vetor por trabalhador com o total, os fora da série,
+// os cursos, as editoras e os dias, nesta ordem
+typedef struct {
+    ResumoAgregado *parciais; // [trabalhador * tamanho_parcial + contador]
+    int tamanho_parcial;
+} ContextoAgregados;
+
+void particao_agregados(void *contexto, int inicio, int fim, int id_trabalhador) {
+    ContextoAgregados *ctx = contexto;
+    ResumoAgregado *total = ctx->parciais + (size_t)id_trabalhador * ctx->tamanho_parcial;
+    ResumoAgregado *fora_da_serie = total + 1;
+    ResumoAgregado *cursos = total + 2;
+    ResumoAgregado *editoras = cursos + grupos_agregados[AGREGADO_CURSO].num_grupos;
+    ResumoAgregado *dias = editoras + grupos_agregados[AGREGADO_EDITORA].num_grupos;
+    for (int i = inicio; i < fim; i++) {
+        const Emprestimo *e = &lista_emprestimos[i];
+        ResumoAgregado parcela = parcela_do_emprestimo(e, true, strcmp(e->status, "DEVOLVIDO") == 0);
+        int curso, editora, dia;
+        grupos_do_emprestimo(e, &curso, &editora, &dia);
+        somar_resumo(total, parcela);
+        somar_resumo(dia != -1 ? &dias[dia] : fora_da_serie, parcela);
+        if (curso != -1) somar_resumo(&cursos[curso], parcela);
+        if (editora != -1) somar_resumo(&editoras[editora], parcela);
+    }
+}
+
+// Refaz grupos, série diária e contadores a partir dos vetores (chamador tem trava de
+// escrita nos cadastros e índices reconstruídos)
+void reconstruir_agregados() {
+    for (int d = 0; d < NUM_DIMENSOES_AGREGADAS; d++) {
+        GruposAgregados *g = &grupos_agregados[d];
+        if (g->grupos_por_nome.capacidade == 0) {
+            mapa_criar(&g->grupos_por_nome, 64);
+        } else {
+            mapa_limpar(&g->grupos_por_nome);
+        }
+        g->num_grupos = 0;
+    }
+    for (int i = 0; i < total_usuarios; i++) {
+        classificar_registro_agregado(AGREGADO_CURSO, i);
+    }
+    for (int i = 0; i < total_livros; i++) {
+        classificar_registro_agregado(AGREGADO_EDITORA, i);
+    }
+
+    // A série diária vai do empréstimo mais antigo até FOLGA_DIAS_AGREGADOS depois do mais
+    // recente, contando só os que caem entre HISTORICO_DIAS_AGREGADOS antes de hoje e
+    // FOLGA_DIAS_AGREGADOS depois: uma data absurda (ano 1, ano 9999) não dimensiona a série
+    // (que se multiplica pelos parciais de cada thread) e fica em 'agregado_fora_da_serie'
+    int hoje = dias_desde_epoca(data_atual());
+    int primeiro = hoje;
+    int ultimo = hoje;
+    for (int i = 0; i < total_emprestimos; i++) {
+        int dia = dias_desde_epoca(lista_emprestimos[i].data_emprestimo);
+        if (dia < hoje - HISTORICO_DIAS_AGREGADOS || dia > hoje + FOLGA_DIAS_AGREGADOS) continue;
+        if (dia < primeiro) primeiro = dia;
+        if (dia > ultimo) ultimo = dia;
+    }
+    free(agregados_dias);
+    num_dias_agregados = ultimo - primeiro + 1 + FOLGA_DIAS_AGREGADOS;
+    agregados_dias = calloc(num_dias_agregados, sizeof(ContadoresAgregados));
+    if (agregados_dias == NULL) {
+        num_dias_agregados = 0; // Sem série diária; os demais agregados continuam valendo
+    }
+    primeiro_dia_agregado = primeiro;
+
+    int num_cursos = grupos_agregados[AGREGADO_CURSO].num_grupos;
+    int num_editoras = grupos_agregados[AGREGADO_EDITORA].num_grupos;
+    int num_parciais = obter_threads_relatorio();
+    ContextoAgregados ctx;
+    ctx.tamanho_parcial = 2 + num_cursos + num_editoras + num_dias_agregados;
+    ctx.parciais = calloc((size_t)num_parciais * ctx.tamanho_parcial, sizeof(ResumoAgregado));
+    if (ctx.parciais == NULL) {
+        num_parciais = 1; // Sem memória para os parciais: um único, ainda sem atômicos
+        ctx.parciais = calloc(ctx.tamanho_parcial, sizeof(ResumoAgregado));
+    }
+    int usados = 0;
+    if (ctx.parciais != NULL) {
+        usados = executar_em_paralelo(total_emprestimos, num_parciais, particao_agregados, &ctx);
+    }
+
+    // Junção dos parciais diretamente nos contadores
+    for (int c = 0; c < ctx.tamanho_parcial; c++) {
+        ResumoAgregado soma;
+        memset(&soma, 0, sizeof(soma));
+        for (int t = 0; t < usados; t++) {
+            somar_resumo(&soma, ctx.parciais[(size_t)t * ctx.tamanho_parcial + c]);
+        }
+        ContadoresAgregados *destino;
+        if (c == 0) {
+            destino = &agregado_total;
+        } else if (c == 1) {
+            destino = &agregado_fora_da_serie;
+        } else if (c <= 1 + num_cursos) {
+            destino = &contadores_cursos[c - 2];
+        } else if (c <= 1 + num_cursos + num_editoras) {
+            destino = &contadores_editoras[c - 2 - num_cursos];
+        } else {
+            destino = &agregados_dias[c - 2 - num_cursos - num_editoras];
+        }
+        gravar_agregado(destino, soma);
+    }
+    free(ctx.parciais);
+}
+
+// Estende a série diária até incluir 'dia' (mais FOLGA_DIAS_AGREGADOS à frente), copiando
+// os contadores; sem memória, a série fica como está e os eventos desse dia vão para
+// 'agregado_fora_da_serie'. Chamador tem trava de escrita nos cadastros.
+void estender_serie_diaria(int dia) {
+    int primeiro = num_dias_agregados > 0 && primeiro_dia_agregado < dia ? primeiro_dia_agregado : dia;
+    int ultimo = num_dias_agregados > 0 ? primeiro_dia_agregado + num_dias_agregados - 1 : dia;
+    if (dia + FOLGA_DIAS_AGREGADOS > ultimo) ultimo = dia + FOLGA_DIAS_AGREGADOS;
+    ContadoresAgregados *serie = calloc(ultimo - primeiro + 1, sizeof(ContadoresAgregados));
+    if (serie == NULL) {
+        return;
+    }
+    for (int d = 0; d < num_dias_agregados; d++) {
+        gravar_agregado(&serie[primeiro_dia_agregado - primeiro + d], ler_agregado(&agregados_dias[d]));
+    }
+    free(agregados_dias);
+    agregados_dias = serie;
+    primeiro_dia_agregado = primeiro;
+    num_dias_agregados = ultimo - primeiro + 1;
+}
+
+// Trava de leitura nos cadastros com o dia de hoje dentro da série diária. A série é
+// dimensionada na carga; um processo que segue rodando além da folga a estende aqui, sob
+// trava de escrita, antes que um empréstimo ou devolução de hoje fique sem dia no painel.
+void travar_leitura_com_hoje_na_serie() {
+    travar_leitura_cadastros();
+    int dia = dias_desde_epoca(data_atual()) - primeiro_dia_agregado;
+    if (dia < 0 || dia >= num_dias_agregados) {
+        destravar_cadastros();
+        travar_escrita_cadastros();
+        dia = dias_desde_epoca(data_atual()) - primeiro_dia_agregado;
+        if (dia < 0 || dia >= num_dias_agregados) {
+            estender_serie_diaria(dias_desde_epoca(data_atual()));
+        }
+        destravar_cadastros();
+        travar_leitura_cadastros();
+    }
+}
+
+// Resumo do grupo com este nome (curso ou editora, texto exato). Retorna false se nenhum
+// usuário/livro tem esse curso/editora.
+bool api_resumo_agregado(DimensaoAgregada dimensao, const char *nome, ResumoAgregado *resumo) {
+    pthread_rwlock_t *trava_cadastro = dimensao == AGREGADO_CURSO ? &trava_usuarios : &trava_acervo;
+    pthread_rwlock_rdlock(trava_cadastro);
+    int chave;
+    int grupo = buscar_grupo_agregado(dimensao, nome, &chave);
+    if (grupo != -1) {
+        *resumo = ler_agregado(&grupos_agregados[dimensao].contadores[grupo]);
+    }
+    pthread_rwlock_unlock(trava_cadastro);
+    return grupo != -1;
+}
+
+// Resumo dos empréstimos iniciados entre as duas datas (inclusive); sem datas, o total
+ResumoAgregado api_resumo_periodo(Data inicio, Data fim) {
+    ResumoAgregado resumo;
+    memset(&resumo, 0, sizeof(resumo));
+    travar_leitura_cadastros();
+    if (!data_definida(inicio) || !data_definida(fim)) {
+        resumo = ler_agregado(&agregado_total);
+    } else {
+        int primeiro = dias_desde_epoca(inicio) - primeiro_dia_agregado;
+        int ultimo = dias_desde_epoca(fim) - primeiro_dia_agregado;
+        if (primeiro < 0) primeiro = 0;
+        if (ultimo >= num_dias_agregados) ultimo = num_dias_agregados - 1;
+        for (int d = primeiro; d <= ultimo; d++) {
+            somar_resumo(&resumo, ler_agregado(&agregados_dias[d]));
+        }
+    }
+    destravar_cadastros();
+    return resumo;
+}
+
+// --- PARTE 4: MANIPULAÇÃO DE ARQUIVOS ---
+
+// Caminhos dos arquivos
+#define ARQ_LIVROS "livros.txt"
+#define ARQ_USUARIOS "usuarios.txt"
+#define ARQ_EMPRESTIMOS "emprestimos.txt"
+#define ARQ_RESERVAS "reservas.txt"
+
+// Soma de verificação de 64 bits para os arquivos binários (mistura no estilo FNV, uma
+// palavra de 8 bytes por vez: com milhões de posições, byte a byte custaria quase o mesmo
+// que reconstruir os mapas)
+unsigned long long somar_verificacao(unsigned long long soma, const void *dados, size_t tamanho) {
+    const unsigned char *bytes = dados;
+    size_t i = 0;
+    for (; i + 8 <= tamanho; i += 8) {
+        uint64_t palavra;
+        memcpy(&palavra, bytes + i, 8);
+        soma = (soma ^ palavra) * 1099511628211ULL;
+        soma ^= soma >> 29;
+    }
+    for (; i < tamanho; i++) {
+        soma = (soma ^ bytes[i]) * 1099511628211ULL;
+    }
+    return soma;
+}
+
+// Tamanho e data de modificação de um arquivo: mudam quando ele é regravado
+typedef struct {
+    long long tamanho;     // -1 se o arquivo não existe
+    long long modificacao; // st_mtime
+} AssinaturaArquivo;
+
+AssinaturaArquivo assinar_arquivo(const char *caminho) {
+    AssinaturaArquivo assinatura = {-1, 0};
+    struct stat info;
+    if (stat(caminho, &info) == 0) {
+        assinatura.tamanho = (long long)info.st_size;
+        assinatura.modificacao = (long long)info.st_mtime;
+    }
+    return assinatura;
+}
+
+// Escrita de um registro no formato dos arquivos (campos separados por ';'). Usadas pelo
+// salvamento e pela linha de comando, que imprime os registros no mesmo formato.
+void escrever_livro(FILE *destino, const Livro *livro) {
+    fprintf(destino, "%d;%s;%s;%s;%d;%d;%s;%d\n",
+            livro->codigo,
+            livro->titulo,
+            livro->autor,
+            livro->editora,
+            livro->ano_publicacao,
+            atomic_load(&livro->exemplares_disponiveis),
+            status_livro(livro),
+            livro->total_exemplares);
+}
+
+void escrever_usuario(FILE *destino, const Usuario *usuario) {
+    fprintf(destino, "%d;%s;%s;%s;%d/%d/%d\n",
+            usuario->matricula,
+            usuario->nome,
+            usuario->curso,
+            usuario->telefone,
+            usuario->data_cadastro.dia,
+            usuario->data_cadastro.mes,
+            usuario->data_cadastro.ano);
+}
+
+void escrever_emprestimo(FILE *destino, const Emprestimo *emprestimo) {
+    fprintf(destino, "%d;%d;%d;%d/%d/%d;%d/%d/%d;%s;%d;%d/%d/%d\n",
+            emprestimo->codigo_emprestimo,
+            emprestimo->matricula_usuario,
+            emprestimo->codigo_livro,
+            emprestimo->data_emprestimo.dia,
+            emprestimo->data_emprestimo.mes,
+            emprestimo->data_emprestimo.ano,
+            emprestimo->data_prevista_devolucao.dia,
+            emprestimo->data_prevista_devolucao.mes,
+            emprestimo->data_prevista_devolucao.ano,
+            emprestimo->status,
+            emprestimo->renovacoes,
+            emprestimo->data_devolucao.dia,
+            emprestimo->data_devolucao.mes,
+            emprestimo->data_devolucao.ano);
+}
+
+void escrever_reserva(FILE *destino, const Reserva *reserva) {
+    fprintf(destino, "%d;%d;%d;%d/%d/%d;%s\n",
+            reserva->codigo_reserva,
+            reserva->matricula_usuario,
+            reserva->codigo_livro,
+            reserva->data_reserva.dia,
+            reserva->data_reserva.mes,
+            reserva->data_reserva.ano,
+            reserva->status);
+}
+
+// --- CONTROLE DE ALTERAÇÕES PARA O SALVAMENTO ---
+
+// O salvamento só regrava os arquivos das tabelas que mudaram desde a última carga ou
+// gravação. A referência são as versões de página dos instantâneos: para cada tabela
+// guardamos a versão de cada página no momento em que ela foi gravada (ou carregada), o
+// total, o próximo ID e a assinatura do arquivo resultante. Assinatura diferente indica
+// arquivo mexido por fora (ex.: outro processo), e aí a memória volta a prevalecer.
+// No formato compactado a comparação desce ao bloco: só os blocos alterados são regravados.
+enum { TABELA_LIVROS, TABELA_USUARIOS, TABELA_EMPRESTIMOS, TABELA_RESERVAS, NUM_TABELAS_GRAVADAS };
+
+typedef struct {
+    atomic_uint *versoes;   // Versões atuais das páginas
+    unsigned int *gravadas; // Versão de cada página quando o arquivo foi gravado ou carregado
+    int total_gravado;      // -1 = o arquivo não corresponde à memória (regravar inteiro)
+    int proximo_id_gravado;
+    AssinaturaArquivo assinatura;
+} EstadoGravacao;
+
+unsigned int gravadas_livros[PAGINAS_LIVROS];
+unsigned int gravadas_usuarios[PAGINAS_USUARIOS];
+unsigned int gravadas_emprestimos[PAGINAS_EMPRESTIMOS];
+unsigned int gravadas_reservas[PAGINAS_RESERVAS];
+
+EstadoGravacao estado_gravacao[NUM_TABELAS_GRAVADAS] = {
+    {versao_paginas_livros, gravadas_livros, -1, 0, {-1, 0}},
+    {versao_paginas_usuarios, gravadas_usuarios, -1, 0, {-1, 0}},
+    {versao_paginas_emprestimos, gravadas_emprestimos, -1, 0, {-1, 0}},
+    {versao_paginas_reservas, gravadas_reservas, -1, 0, {-1, 0}},
+};
+
+// Alguma página com registros em [inicio, fim) mudou desde que foi gravada?
+bool paginas_alteradas(int tabela, int inicio, int fim) {
+    const EstadoGravacao *estado = &estado_gravacao[tabela];
+    for (int p = inicio / TAM_PAGINA; p * TAM_PAGINA < fim; p++) {
+        if (atomic_load(&estado->versoes[p]) != estado->gravadas[p]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// O arquivo da tabela (com 'total' registros e 'proximo_id') precisa ser regravado?
+bool tabela_alterada(int tabela, const char *arquivo, int total, int proximo_id) {
+    const EstadoGravacao *estado = &estado_gravacao[tabela];
+    if (estado->total_gravado != total || estado->proximo_id_gravado != proximo_id) {
+        return true;
+    }
+    AssinaturaArquivo atual = assinar_arquivo(arquivo);
+    return atual.tamanho != estado->assinatura.tamanho || atual.modificacao != estado->assinatura.modificacao ||
+           paginas_alteradas(tabela, 0, total);
+}
+
+// Registra as versões das páginas de [inicio, fim) como gravadas. Chamar ANTES de ler os
+// registros: uma alteração feita durante a gravação muda a versão de novo e fica para o
+// próximo salvamento.
+void registrar_paginas_gravadas(int tabela, int inicio, int fim) {
+    EstadoGravacao *estado = &estado_gravacao[tabela];
+    for (int p = inicio / TAM_PAGINA; p * TAM_PAGINA < fim; p++) {
+        estado->gravadas[p] = atomic_load(&estado->versoes[p]);
+    }
+}
+
+// Conclui a gravação (ou carga) da tabela; 'arquivo' é o arquivo que agora a representa
+void concluir_gravacao(int tabela, const char *arquivo, int total, int proximo_id) {
+    EstadoGravacao *estado = &estado_gravacao[tabela];
+    estado->total_gravado = total;
+    estado->proximo_id_gravado = proximo_id;
+    estado->assinatura = assinar_arquivo(arquivo);
+}
+
+// Após falha ou carga incompleta: o próximo salvamento regrava a tabela inteira
+void invalidar_gravacao(int tabela) {
+    estado_gravacao[tabela].total_gravado = -1;
+}
+
+void invalidar_gravacoes() {
+    for (int t = 0; t < NUM_TABELAS_GRAVADAS; t++) {
+        invalidar_gravacao(t);
+    }
+}
+
+// --- ARMAZENAMENTO COMPACTADO DO HISTÓRICO DE EMPRÉSTIMOS ---
+
+// Com BIBLIOTECA_ARMAZENAMENTO=compactado os empréstimos são gravados em emprestimos.bin
+// em vez de emprestimos.txt. O vetor é dividido em blocos de REGISTROS_POR_BLOCO registros;
+// dentro de cada bloco os campos viram varints: código como diferença do anterior, datas
+// como número do dia (a do empréstimo em relação à do registro anterior, a prevista e a da
+// devolução em relação à do empréstimo) e status como posição num dicionário gravado no
+// cabeçalho. A versão 1 não tinha a data de devolução; seus arquivos continuam legíveis.
+// Um índice no fim do arquivo guarda posição, tamanho, primeiro código e soma de
+// verificação de cada bloco, de modo que qualquer bloco pode ser lido sozinho; a carga
+// lê os blocos com pread e os decodifica em paralelo no pool dos relatórios.
+// Layout: cabeçalho | bloco 0 | bloco 1 | ... | índice dos blocos.
+#define ARQ_EMPRESTIMOS_COMPACTADO "emprestimos.bin"
+#define VERSAO_EMPRESTIMOS_COMPACTADO 2
+#define REGISTROS_POR_BLOCO 1024 // Divide TAM_PARTICAO: cada partição da carga tem blocos inteiros
+#define MAX_STATUS_DICIONARIO 16
+#define MAX_CAMPOS_COMPACTADOS 8
+#define MAX_BYTES_REGISTRO (MAX_CAMPOS_COMPACTADOS * 5 + 5) // Campos de até 5 bytes em varint (+ folga)
+
+bool emprestimos_compactados = false; // Formato usado pelo próximo salvamento
+
+typedef struct {
+    char identificador[8]; // "BIBEMP"
+    int versao;
+    int proximo_emprestimo_id;
+    int total;
+    int registros_por_bloco;
+    int num_blocos;
+    int num_status;
+    char status[MAX_STATUS_DICIONARIO][15];
+    long long inicio_indice; // Posição do índice dos blocos no arquivo
+} CabecalhoEmprestimosCompactados;
+
+typedef struct {
+    long long posicao;
+    int bytes;
+    int registros;
+    int primeiro_codigo;
+    int reservado;
+    unsigned long long soma_verificacao;
+} IndiceBloco;
+
+// Inteiros com sinal viram sem sinal (zigzag: 0, -1, 1, -2 ... -> 0, 1, 2, 3 ...) e são
+// gravados 7 bits por byte; o bit alto indica que há mais bytes
+unsigned char *escrever_varint(unsigned char *p, int valor) {
+    unsigned int v = ((unsigned int)valor << 1) ^ (unsigned int)(valor >> 31);
+    while (v >= 0x80) {
+        *p++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    return p;
+}
+
+// Retorna a posição seguinte ao número lido ou NULL se o bloco terminar no meio dele
+const unsigned char *ler_varint(const unsigned char *p, const unsigned char *fim, int *valor) {
+    unsigned int v = 0;
+    for (int deslocamento = 0; deslocamento < 35; deslocamento += 7) {
+        if (p == fim) {
+            return NULL;
+        }
+        unsigned char byte = *p++;
+        v |= (unsigned int)(byte & 0x7F) << deslocamento;
+        if ((byte & 0x80) == 0) {
+            *valor = (int)(v >> 1) ^ -(int)(v & 1);
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// Decodifica um bloco lido do arquivo em 'destino'; falha se os bytes não fecham
+bool decodificar_bloco_emprestimos(const CabecalhoEmprestimosCompactados *cab, const IndiceBloco *bloco,
+                                   const unsigned char *dados, Emprestimo *destino) {
+    if (somar_verificacao(14695981039346656037ULL, dados, bloco->bytes) != bloco->soma_verificacao) {
+        return false;
+    }
+    const unsigned char *p = dados;
+    const unsigned char *fim = dados + bloco->bytes;
+    int codigo = bloco->primeiro_codigo;
+    int dia_emprestimo = 0;
+    int num_campos = cab->versao == 1 ? 7 : 8;
+    for (int i = 0; i < bloco->registros; i++) {
+        // código, matrícula, livro, dia do empréstimo, prazo, status, renovações e dias até a
+        // devolução mais um (0 = não devolvido ou sem data)
+        int campos[MAX_CAMPOS_COMPACTADOS] = {0};
+        for (int c = 0; c < num_campos; c++) {
+            p = ler_varint(p, fim, &campos[c]);
+            if (p == NULL) {
+                return false;
+            }
+        }
+        if (campos[5] < 0 || campos[5] >= cab->num_status) {
+            return false;
+        }
+        Emprestimo *e = &destino[i];
+        codigo += campos[0];
+        dia_emprestimo += campos[3];
+        e->codigo_emprestimo = codigo;
+        e->matricula_usuario = campos[1];
+        e->codigo_livro = campos[2];
+        e->data_emprestimo = data_de_dias(dia_emprestimo);
+        e->data_prevista_devolucao = data_de_dias(dia_emprestimo + campos[4]);
+        memcpy(e->status, cab->status[campos[5]], sizeof(e->status));
+        e->renovacoes = campos[6];
+        e->data_devolucao = campos[7] > 0 ? data_de_dias(dia_emprestimo + campos[7] - 1) : DATA_INDEFINIDA;
+    }
+    return p == fim;
+}
+
+// Codifica os empréstimos [inicio, fim) em 'buffer' e preenche a entrada do índice (menos a
+// posição). Os registros são antes copiados para 'copia' (REGISTROS_POR_BLOCO posições) com
+// as travas dos livros, pois devoluções e renovações seguem durante a gravação.
+// Status novos entram no fim do dicionário, sem mudar os que os blocos já usam.
+// Falha se alguma data não é de calendário ou se o dicionário está cheio.
+bool codificar_bloco_emprestimos(CabecalhoEmprestimosCompactados *cab, int inicio, int fim, Emprestimo *copia,
+                                 unsigned char *buffer, IndiceBloco *bloco) {
+    copiar_registros(COPIA_EMPRESTIMOS, copia, &lista_emprestimos[inicio], sizeof(Emprestimo), fim - inicio);
+    unsigned char *p = buffer;
+    int codigo = copia[0].codigo_emprestimo;
+    int dia_anterior = 0;
+    bloco->primeiro_codigo = codigo;
+    for (int i = 0; i < fim - inicio; i++) {
+        const Emprestimo *e = &copia[i];
+        int dia_emprestimo = dias_desde_epoca(e->data_emprestimo);
+        int dia_previsto = dias_desde_epoca(e->data_prevista_devolucao);
+        int dia_devolucao = data_definida(e->data_devolucao) ? dias_desde_epoca(e->data_devolucao) : dia_emprestimo - 1;
+        Data volta_emprestimo = data_de_dias(dia_emprestimo);
+        Data volta_prevista = data_de_dias(dia_previsto);
+        if (comparar_datas(volta_emprestimo, e->data_emprestimo) != 0 ||
+            comparar_datas(volta_prevista, e->data_prevista_devolucao) != 0 ||
+            (data_definida(e->data_devolucao) &&
+             (dia_devolucao < dia_emprestimo || comparar_datas(data_de_dias(dia_devolucao), e->data_devolucao) != 0))) {
+            return false; // Data inexistente (ex.: 31/2): o formato só representa datas válidas
+        }
+        int status = 0;
+        while (status < cab->num_status && strcmp(cab->status[status], e->status) != 0) {
+            status++;
+        }
+        if (status == cab->num_status) {
+            if (cab->num_status == MAX_STATUS_DICIONARIO) {
+                return false;
+            }
+            memcpy(cab->status[cab->num_status++], e->status, sizeof(e->status));
+        }
+        p = escrever_varint(p, e->codigo_emprestimo - codigo);
+        p = escrever_varint(p, e->matricula_usuario);
+        p = escrever_varint(p, e->codigo_livro);
+        p = escrever_varint(p, dia_emprestimo - dia_anterior);
+        p = escrever_varint(p, dia_previsto - dia_emprestimo);
+        p = escrever_varint(p, status);
+        p = escrever_varint(p, e->renovacoes);
+        p = escrever_varint(p, dia_devolucao - dia_emprestimo + 1);
+        codigo = e->codigo_emprestimo;
+        dia_anterior = dia_emprestimo;
+    }
+    bloco->bytes = (int)(p - buffer);
+    bloco->registros = fim - inicio;
+    bloco->soma_verificacao = somar_verificacao(14695981039346656037ULL, buffer, bloco->bytes);
+    return true;
+}
+
+// Grava os 'quantidade' primeiros empréstimos em emprestimos.bin. Retorna false (sem tocar
+// no arquivo existente) se alguma data não é de calendário, se há status demais para o
+// dicionário ou se a gravação falha; o chamador então grava em texto.
+bool salvar_emprestimos_compactados(int quantidade, int proximo_id) {
+    CabecalhoEmprestimosCompactados cab;
+    memset(&cab, 0, sizeof(cab));
+    memcpy(cab.identificador, "BIBEMP", 6);
+    cab.versao = VERSAO_EMPRESTIMOS_COMPACTADO;
+    cab.proximo_emprestimo_id = proximo_id;
+    cab.total = quantidade;
+    cab.registros_por_bloco = REGISTROS_POR_BLOCO;
+    cab.num_blocos = (quantidade + REGISTROS_POR_BLOCO - 1) / REGISTROS_POR_BLOCO;
+
+    IndiceBloco *indice = calloc(cab.num_blocos + 1, sizeof(IndiceBloco));
+    unsigned char *buffer = malloc((size_t)REGISTROS_POR_BLOCO * MAX_BYTES_REGISTRO);
+    Emprestimo *copia = malloc(sizeof(Emprestimo) * REGISTROS_POR_BLOCO);
+    FILE *f = fopen(ARQ_EMPRESTIMOS_COMPACTADO ".tmp", "wb");
+    bool ok = indice != NULL && buffer != NULL && copia != NULL && f != NULL &&
+              fwrite(&cab, sizeof(cab), 1, f) == 1; // Reescrito ao final, com o dicionário
+    long long posicao = sizeof(cab);
+
+    for (int b = 0; ok && b < cab.num_blocos; b++) {
+        int inicio = b * REGISTROS_POR_BLOCO;
+        int fim = inicio + REGISTROS_POR_BLOCO < quantidade ? inicio + REGISTROS_POR_BLOCO : quantidade;
+        registrar_paginas_gravadas(TABELA_EMPRESTIMOS, inicio, fim);
+        ok = codificar_bloco_emprestimos(&cab, inicio, fim, copia, buffer, &indice[b]) &&
+             fwrite(buffer, 1, indice[b].bytes, f) == (size_t)indice[b].bytes;
+        indice[b].posicao = posicao;
+        posicao += indice[b].bytes;
+    }
+
+    cab.inicio_indice = posicao;
+    ok = ok && fwrite(indice, sizeof(IndiceBloco), cab.num_blocos, f) == (size_t)cab.num_blocos &&
+         fseek(f, 0, SEEK_SET) == 0 && fwrite(&cab, sizeof(cab), 1, f) == 1;
+    if (f != NULL) {
+        ok = fclose(f) == 0 && ok;
+    }
+    free(indice);
+    free(buffer);
+    free(copia);
+    if (ok) {
+        rename(ARQ_EMPRESTIMOS_COMPACTADO ".tmp", ARQ_EMPRESTIMOS_COMPACTADO);
+    } else {
+        remove(ARQ_EMPRESTIMOS_COMPACTADO ".tmp");
+    }
+    return ok;
+}
+
+// Atualiza emprestimos.bin no próprio arquivo, regravando só os blocos com páginas alteradas
+// desde a última gravação e os blocos novos. Os blocos regravados e o novo índice vão para
+// o fim do arquivo; o cabeçalho, que aponta para o índice, é escrito por último (depois de
+// fsync), então uma interrupção no meio deixa o arquivo anterior intacto. O espaço dos
+// blocos substituídos só é recuperado por uma gravação completa: retorna false (sem mexer
+// no conteúdo válido) quando o arquivo não é o da última gravação ou quando o espaço
+// perdido passaria do útil, e o chamador então grava o arquivo inteiro. Com 'relatar',
+// informa quantos blocos foram regravados.
+bool atualizar_emprestimos_compactados(int quantidade, int proximo_id, bool relatar) {
+    const EstadoGravacao *estado = &estado_gravacao[TABELA_EMPRESTIMOS];
+    AssinaturaArquivo atual = assinar_arquivo(ARQ_EMPRESTIMOS_COMPACTADO);
+    if (estado->total_gravado < 0 || estado->total_gravado > quantidade ||
+        atual.tamanho != estado->assinatura.tamanho || atual.modificacao != estado->assinatura.modificacao) {
+        return false;
+    }
+    FILE *f = fopen(ARQ_EMPRESTIMOS_COMPACTADO, "r+b");
+    if (f == NULL) {
+        return false;
+    }
+    CabecalhoEmprestimosCompactados cab;
+    int num_blocos = (quantidade + REGISTROS_POR_BLOCO - 1) / REGISTROS_POR_BLOCO;
+    IndiceBloco *indice = calloc(num_blocos + 1, sizeof(IndiceBloco));
+    unsigned char *buffer = malloc((size_t)REGISTROS_POR_BLOCO * MAX_BYTES_REGISTRO);
+    Emprestimo *copia = malloc(sizeof(Emprestimo) * REGISTROS_POR_BLOCO);
+    bool ok = indice != NULL && buffer != NULL && copia != NULL && fread(&cab, sizeof(cab), 1, f) == 1 &&
+              memcmp(cab.identificador, "BIBEMP", 6) == 0 && cab.versao == VERSAO_EMPRESTIMOS_COMPACTADO &&
+              cab.registros_por_bloco == REGISTROS_POR_BLOCO && cab.total == estado->total_gravado &&
+              cab.num_blocos <= num_blocos && cab.num_status >= 0 && cab.num_status <= MAX_STATUS_DICIONARIO &&
+              fseek(f, cab.inicio_indice, SEEK_SET) == 0 &&
+              fread(indice, sizeof(IndiceBloco), cab.num_blocos, f) == (size_t)cab.num_blocos;
+
+    // Espaço útil (blocos vigentes e índice) contra o perdido com substituições anteriores
+    long long util = (long long)sizeof(cab) + (long long)cab.num_blocos * sizeof(IndiceBloco);
+    for (int b = 0; ok && b < cab.num_blocos; b++) {
+        util += indice[b].bytes;
+    }
+    ok = ok && atual.tamanho - util <= util;
+
+    long long posicao = atual.tamanho;
+    int regravados = 0;
+    ok = ok && fseek(f, posicao, SEEK_SET) == 0;
+    for (int b = 0; ok && b < num_blocos; b++) {
+        int inicio = b * REGISTROS_POR_BLOCO;
+        int fim = inicio + REGISTROS_POR_BLOCO < quantidade ? inicio + REGISTROS_POR_BLOCO : quantidade;
+        if (b < cab.num_blocos && indice[b].registros == fim - inicio &&
+            !paginas_alteradas(TABELA_EMPRESTIMOS, inicio, fim)) {
+            continue;
+        }
+        registrar_paginas_gravadas(TABELA_EMPRESTIMOS, inicio, fim);
+        ok = codificar_bloco_emprestimos(&cab, inicio, fim, copia, buffer, &indice[b]) &&
+             fwrite(buffer, 1, indice[b].bytes, f) == (size_t)indice[b].bytes;
+        indice[b].posicao = posicao;
+        posicao += indice[b].bytes;
+        regravados++;
+    }
+
+    cab.proximo_emprestimo_id = proximo_id;
+    cab.total = quantidade;
+    cab.num_blocos = num_blocos;
+    cab.inicio_indice = posicao;
+    ok = ok && fwrite(indice, sizeof(IndiceBloco), num_blocos, f) == (size_t)num_blocos &&
+         fflush(f) == 0 && fsync(fileno(f)) == 0 &&
+         fseek(f, 0, SEEK_SET) == 0 && fwrite(&cab, sizeof(cab), 1, f) == 1;
+    ok = fclose(f) == 0 && ok;
+    free(indice);
+    free(buffer);
+    free(copia);
+    if (ok && relatar) {
+        printf("[INFO] %s atualizado: %d de %d bloco(s) regravado(s).\n", ARQ_EMPRESTIMOS_COMPACTADO, regravados, num_blocos);
+    }
+    return ok;
+}
+
+typedef struct {
+    int descritor;
+    const CabecalhoEmprestimosCompactados *cab;
+    const IndiceBloco *indice;
+    int total;             // Registros do arquivo: define quantos cada bloco deve ter
+    int carregados;        // Registros que cabem no vetor (o último bloco pode entrar só em parte)
+    int primeiro_invalido; // Menor bloco que falhou (num_blocos se nenhum)
+    pthread_mutex_t trava;
+} ContextoCargaBlocos;
+
+// Lê e decodifica um bloco qualquer direto da sua posição no arquivo (pread: vários
+// trabalhadores podem ler do mesmo descritor ao mesmo tempo)
+bool ler_bloco_emprestimos(int descritor, const CabecalhoEmprestimosCompactados *cab, const IndiceBloco *bloco,
+                           unsigned char *buffer, Emprestimo *destino) {
+    if (bloco->bytes < 0 || bloco->bytes > REGISTROS_POR_BLOCO * MAX_BYTES_REGISTRO) {
+        return false;
+    }
+    return pread(descritor, buffer, bloco->bytes, bloco->posicao) == bloco->bytes &&
+           decodificar_bloco_emprestimos(cab, bloco, buffer, destino);
+}
+
+void particao_carga_blocos(void *contexto, int inicio, int fim, int id_trabalhador) {
+    (void)id_trabalhador;
+    ContextoCargaBlocos *ctx = contexto;
+    unsigned char *buffer = malloc((size_t)REGISTROS_POR_BLOCO * MAX_BYTES_REGISTRO);
+    Emprestimo *parcial = NULL; // Bloco que não cabe inteiro: decodificado à parte
+    int primeiro = inicio / REGISTROS_POR_BLOCO;
+    int ultimo = (fim + REGISTROS_POR_BLOCO - 1) / REGISTROS_POR_BLOCO;
+    for (int b = primeiro; b < ultimo; b++) {
+        int esperados = ctx->total - b * REGISTROS_POR_BLOCO;
+        if (esperados > REGISTROS_POR_BLOCO) {
+            esperados = REGISTROS_POR_BLOCO;
+        }
+        int cabem = ctx->carregados - b * REGISTROS_POR_BLOCO;
+        Emprestimo *destino = &lista_emprestimos[b * REGISTROS_POR_BLOCO];
+        if (cabem < esperados) {
+            parcial = parcial != NULL ? parcial : malloc(sizeof(Emprestimo) * REGISTROS_POR_BLOCO);
+            destino = parcial;
+        }
+        bool lido = buffer != NULL && destino != NULL && ctx->indice[b].registros == esperados &&
+                    ler_bloco_emprestimos(ctx->descritor, ctx->cab, &ctx->indice[b], buffer, destino);
+        if (lido && destino == parcial) {
+            memcpy(&lista_emprestimos[b * REGISTROS_POR_BLOCO], parcial, sizeof(Emprestimo) * cabem);
+        }
+        if (!lido) {
+            pthread_mutex_lock(&ctx->trava);
+            if (b < ctx->primeiro_invalido) {
+                ctx->primeiro_invalido = b;
+            }
+            pthread_mutex_unlock(&ctx->trava);
+            break;
+        }
+    }
+    free(buffer);
+    free(parcial);
+}
+
+// Renomeia um arquivo de dados que não pôde ser lido por inteiro para <arquivo>.invalido:
+// o próximo salvamento grava um arquivo novo sem destruir o original
+void separar_arquivo_invalido(const char *arquivo) {
+    char destino[256];
+    snprintf(destino, sizeof(destino), "%s.invalido", arquivo);
+    if (rename(arquivo, destino) == 0) {
+        printf("[AVISO] %s preservado como %s.\n", arquivo, destino);
+    }
+}
+
+// Carrega emprestimos.bin em lista_emprestimos (chamador com trava de escrita nos cadastros).
+// Como na leitura do texto, um trecho corrompido encerra a carga: ficam os blocos anteriores
+// (o arquivo é preservado como .invalido; um cabeçalho ilegível não carrega nenhum).
+// 'completo' indica se o arquivo inteiro foi carregado (memória igual ao arquivo).
+bool carregar_emprestimos_compactados(bool *completo) {
+    *completo = false;
+    FILE *f = fopen(ARQ_EMPRESTIMOS_COMPACTADO, "rb");
+    if (f == NULL) {
+        return false;
+    }
+    CabecalhoEmprestimosCompactados cab;
+    IndiceBloco *indice = NULL;
+    bool ok = fread(&cab, sizeof(cab), 1, f) == 1 &&
+              memcmp(cab.identificador, "BIBEMP", 6) == 0 && cab.versao >= 1 && cab.versao <= VERSAO_EMPRESTIMOS_COMPACTADO &&
+              cab.registros_por_bloco == REGISTROS_POR_BLOCO && cab.total >= 0 &&
+              cab.num_blocos == (cab.total + REGISTROS_POR_BLOCO - 1) / REGISTROS_POR_BLOCO &&
+              cab.num_status >= 0 && cab.num_status <= MAX_STATUS_DICIONARIO;
+    if (ok) {
+        for (int s = 0; s < cab.num_status; s++) {
+            cab.status[s][sizeof(cab.status[s]) - 1] = '\0';
+        }
+        indice = malloc(sizeof(IndiceBloco) * (cab.num_blocos + 1));
+        ok = indice != NULL && fseek(f, cab.inicio_indice, SEEK_SET) == 0 &&
+             fread(indice, sizeof(IndiceBloco), cab.num_blocos, f) == (size_t)cab.num_blocos;
+    }
+    if (!ok) {
+        fclose(f);
+        free(indice);
+        printf("[ERRO] %s invalido ou de outra versao; emprestimos nao carregados.\n", ARQ_EMPRESTIMOS_COMPACTADO);
+        separar_arquivo_invalido(ARQ_EMPRESTIMOS_COMPACTADO);
+        return true;
+    }
+
+    // Registros além da capacidade compilada ficam de fora, como as linhas excedentes do
+    // texto: entram os MAX_EMPRESTIMOS primeiros, o último bloco possivelmente só em parte
+    int registros = cab.total < MAX_EMPRESTIMOS ? cab.total : MAX_EMPRESTIMOS;
+    int cabem = (registros + REGISTROS_POR_BLOCO - 1) / REGISTROS_POR_BLOCO;
+    ContextoCargaBlocos ctx;
+    ctx.descritor = fileno(f);
+    ctx.cab = &cab;
+    ctx.indice = indice;
+    ctx.total = cab.total;
+    ctx.carregados = registros;
+    ctx.primeiro_invalido = cabem;
+    pthread_mutex_init(&ctx.trava, NULL);
+    executar_em_paralelo(registros, obter_threads_relatorio(), particao_carga_blocos, &ctx);
+    pthread_mutex_destroy(&ctx.trava);
+    fclose(f);
+
+    if (ctx.primeiro_invalido < cabem) {
+        printf("[ERRO] Bloco %d de %s corrompido; carregados apenas os anteriores.\n",
+               ctx.primeiro_invalido, ARQ_EMPRESTIMOS_COMPACTADO);
+        registros = ctx.primeiro_invalido * REGISTROS_POR_BLOCO;
+        separar_arquivo_invalido(ARQ_EMPRESTIMOS_COMPACTADO);
+    }
+    total_emprestimos = registros;
+    proximo_emprestimo_id = cab.proximo_emprestimo_id;
+    *completo = registros == cab.total;
+    free(indice);
+    return true;
+}
+
+// Arquivo de empréstimos em uso: se existirem os dois formatos (salvamento interrompido entre
+// gravar um e apagar o outro), vale o mais recente
+const char *arquivo_emprestimos_em_uso() {
+    struct stat texto, compactado;
+    bool tem_texto = stat(ARQ_EMPRESTIMOS, &texto) == 0;
+    bool tem_compactado = stat(ARQ_EMPRESTIMOS_COMPACTADO, &compactado) == 0;
+    if (tem_compactado && (!tem_texto || compactado.st_mtime >= texto.st_mtime)) {
+        return ARQ_EMPRESTIMOS_COMPACTADO;
+    }
+    return ARQ_EMPRESTIMOS;
+}
+
+// --- ÍNDICES PERSISTIDOS ---
+
+// Os mapas código -> posição são gravados em indices.bin ao final de cada salvamento e, na
+// carga, lidos diretamente em vez de reconstruídos. O arquivo só é aceito se a versão, o
+// tamanho e a data de modificação de cada arquivo de dados, as quantidades de registros e
+// a soma de verificação conferem; qualquer divergência faz a carga reconstruir os mapas.
+// Contadores por usuário e filas de reserva dependem do status dos registros e continuam
+// sendo calculados na carga (uma passada simples).
+#define ARQ_INDICES "indices.bin"
+#define VERSAO_INDICES 1
+#define NUM_MAPAS_PERSISTIDOS 3
+
+bool indices_em_dia = false; // indices.bin corresponde à memória (carregado ou gravado nesta execução)
+
+typedef struct {
+    char identificador[8]; // "BIBIDX"
+    int versao;
+    int tamanho_int;
+    AssinaturaArquivo arquivos[NUM_MAPAS_PERSISTIDOS];
+    int quantidades[NUM_MAPAS_PERSISTIDOS]; // Registros de cada arquivo cobertos pelo mapa
+    int capacidades[NUM_MAPAS_PERSISTIDOS];
+    unsigned long long soma_verificacao;     // Sobre chaves e valores de todos os mapas
+} CabecalhoIndices;
+
+// Arquivo de dados coberto por cada mapa
+const char *arquivo_indexado(int mapa) {
+    return mapa == 0 ? ARQ_LIVROS : mapa == 1 ? ARQ_USUARIOS : arquivo_emprestimos_em_uso();
+}
+
+// Grava os mapas em indices.bin. 'quantidades' são os registros gravados em cada arquivo;
+// chamar com os cadastros travados para leitura, logo depois de gravar os arquivos de dados.
+void salvar_indices(const int *quantidades) {
+    const MapaIndice *mapas[NUM_MAPAS_PERSISTIDOS] = {&mapa_livros, &mapa_usuarios, &mapa_emprestimos};
+    CabecalhoIndices cabecalho;
+    memset(&cabecalho, 0, sizeof(cabecalho));
+    memcpy(cabecalho.identificador, "BIBIDX", 6);
+    cabecalho.versao = VERSAO_INDICES;
+    cabecalho.tamanho_int = (int)sizeof(int);
+
+    FILE *f = fopen(ARQ_INDICES ".tmp", "wb");
+    if (f == NULL) {
+        return; // Sem o arquivo a próxima carga apenas reconstrói os mapas
+    }
+    fwrite(&cabecalho, sizeof(cabecalho), 1, f); // Reescrito ao final, com a soma
+
+    // Empréstimos entram no mapa sob trava de leitura: se algum chegou depois da gravação do
+    // arquivo, o mapa tem mais chaves que registros gravados e a carga vai rejeitá-lo
+    pthread_rwlock_rdlock(&trava_mapa_emprestimos);
+    unsigned long long soma = 14695981039346656037ULL;
+    bool ok = true;
+    for (int m = 0; m < NUM_MAPAS_PERSISTIDOS; m++) {
+        const MapaIndice *mapa = mapas[m];
+        cabecalho.quantidades[m] = mapa->quantidade == quantidades[m] ? quantidades[m] : -1;
+        cabecalho.capacidades[m] = mapa->capacidade;
+        size_t bytes = sizeof(int) * (size_t)mapa->capacidade;
+        soma = somar_verificacao(soma, mapa->chaves, bytes);
+        soma = somar_verificacao(soma, mapa->valores, bytes);
+        ok = ok && fwrite(mapa->chaves, 1, bytes, f) == bytes && fwrite(mapa->valores, 1, bytes, f) == bytes;
+    }
+    pthread_rwlock_unlock(&trava_mapa_emprestimos);
+
+    cabecalho.soma_verificacao = soma;
+    for (int m = 0; m < NUM_MAPAS_PERSISTIDOS; m++) {
+        cabecalho.arquivos[m] = assinar_arquivo(arquivo_indexado(m));
+    }
+    ok = ok && fseek(f, 0, SEEK_SET) == 0 && fwrite(&cabecalho, sizeof(cabecalho), 1, f) == 1;
+    ok = fclose(f) == 0 && ok;
+    if (ok) {
+        rename(ARQ_INDICES ".tmp", ARQ_INDICES); // Troca atômica: nunca fica um índice pela metade
+    } else {
+        remove(ARQ_INDICES ".tmp");
+    }
+}
+
+// Lê os mapas de indices.bin se correspondem aos arquivos carregados; retorna false (mapas
+// intactos) se o arquivo não existe, é de outra versão ou está desatualizado/corrompido.
+// Chamador deve ter trava de escrita nos cadastros.
+bool carregar_indices() {
+    FILE *f = fopen(ARQ_INDICES, "rb");
+    if (f == NULL) {
+        return false;
+    }
+    CabecalhoIndices cabecalho;
+    int totais[NUM_MAPAS_PERSISTIDOS] = {total_livros, total_usuarios, total_emprestimos};
+    bool ok = fread(&cabecalho, sizeof(cabecalho), 1, f) == 1 &&
+              memcmp(cabecalho.identificador, "BIBIDX", 6) == 0 &&
+              cabecalho.versao == VERSAO_INDICES && cabecalho.tamanho_int == (int)sizeof(int);
+    for (int m = 0; ok && m < NUM_MAPAS_PERSISTIDOS; m++) {
+        AssinaturaArquivo atual = assinar_arquivo(arquivo_indexado(m));
+        int capacidade = cabecalho.capacidades[m];
+        ok = atual.tamanho == cabecalho.arquivos[m].tamanho &&
+             atual.modificacao == cabecalho.arquivos[m].modificacao &&
+             cabecalho.quantidades[m] == totais[m] &&
+             capacidade >= 16 && (capacidade & (capacidade - 1)) == 0 && capacidade >= totais[m] * 2;
+    }
+
+    MapaIndice lidos[NUM_MAPAS_PERSISTIDOS];
+    memset(lidos, 0, sizeof(lidos));
+    unsigned long long soma = 14695981039346656037ULL;
+    for (int m = 0; ok && m < NUM_MAPAS_PERSISTIDOS; m++) {
+        size_t bytes = sizeof(int) * (size_t)cabecalho.capacidades[m];
+        lidos[m].chaves = malloc(bytes);
+        lidos[m].valores = malloc(bytes);
+        lidos[m].capacidade = cabecalho.capacidades[m];
+        lidos[m].quantidade = cabecalho.quantidades[m];
+        ok = lidos[m].chaves != NULL && lidos[m].valores != NULL &&
+             fread(lidos[m].chaves, 1, bytes, f) == bytes && fread(lidos[m].valores, 1, bytes, f) == bytes;
+        if (ok) {
+            soma = somar_verificacao(soma, lidos[m].chaves, bytes);
+            soma = somar_verificacao(soma, lidos[m].valores, bytes);
+        }
+    }
+    fclose(f);
+    ok = ok && soma == cabecalho.soma_verificacao;
+
+    // Conferência por amostragem contra os registros lidos: pega edições feitas no mesmo
+    // segundo do salvamento que por acaso mantiveram o tamanho do arquivo
+    for (int m = 0; ok && m < NUM_MAPAS_PERSISTIDOS; m++) {
+        int passo = totais[m] / 64 + 1;
+        for (int i = 0; ok && i < totais[m]; i += passo) {
+            int codigo = m == 0 ? acervo_livros[i].codigo
+                       : m == 1 ? lista_usuarios[i].matricula
+                       : lista_emprestimos[i].codigo_emprestimo;
+            ok = mapa_buscar(&lidos[m], codigo) == i;
+        }
+    }
+
+    if (!ok) {
+        for (int m = 0; m < NUM_MAPAS_PERSISTIDOS; m++) {
+            free(lidos[m].chaves);
+            free(lidos[m].valores);
+        }
+        return false;
+    }
+    MapaIndice *mapas[NUM_MAPAS_PERSISTIDOS] = {&mapa_livros, &mapa_usuarios, &mapa_emprestimos};
+    pthread_rwlock_wrlock(&trava_mapa_emprestimos);
+    for (int m = 0; m < NUM_MAPAS_PERSISTIDOS; m++) {
+        mapa_destruir(mapas[m]);
+        *mapas[m] = lidos[m];
+    }
+    pthread_rwlock_unlock(&trava_mapa_emprestimos);
+    return true;
+}
+
+// Conclui a gravação de 'f', aberto em '<arquivo>.tmp', e troca o arquivo anterior por ele
+// (como indices.bin e emprestimos.bin): uma interrupção no meio do salvamento deixa o
+// arquivo anterior intacto. Retorna false, apagando o temporário, se alguma escrita falhou.
+bool substituir_arquivo(FILE *f, const char *arquivo) {
+    char temporario[256];
+    snprintf(temporario, sizeof(temporario), "%s.tmp", arquivo);
+    bool ok = fflush(f) == 0 && !ferror(f) && fsync(fileno(f)) == 0;
+    ok = fclose(f) == 0 && ok;
+    ok = ok && rename(temporario, arquivo) == 0;
+    if (!ok) {
+        remove(temporario);
+    }
+    return ok;
+}
+
+// Encerra gravar_dados() depois de uma falha em 'arquivo': a tabela fica marcada para nova
+// tentativa no próximo salvamento. A mensagem vai para stderr (pode vir da thread automática).
+bool falhar_gravacao(int tabela, const char *arquivo) {
+    fprintf(stderr, "\n[ERRO] Nao foi possivel gravar %s.\n", arquivo);
+    invalidar_gravacao(tabela);
+    destravar_cadastros();
+    pthread_mutex_unlock(&trava_salvamento);
+    return false;
+}
+
+// Grava nos arquivos as tabelas alteradas; retorna false se algum arquivo não pôde ser gravado.
+// Cada arquivo é escrito em '<arquivo>.tmp' e só então substitui o anterior. 'relatar' imprime
+// o resumo da atualização de emprestimos.bin (falso na thread de salvamento automático).
+bool gravar_dados(bool relatar) {
+    long long inicio = agora_ns();
+    // Um salvamento por vez (o automático pode coincidir com um pedido pelo menu). Leitura
+    // compartilhada nos cadastros: pesquisas e empréstimos continuam rodando durante a gravação.
+    pthread_mutex_lock(&trava_salvamento);
+    travar_leitura_cadastros();
+    bool regravou_indexados = false; // Algum arquivo coberto por indices.bin foi regravado
+
+    // 1. Salvar Livros (só se houve alteração desde a última gravação; idem para os demais)
+    if (tabela_alterada(TABELA_LIVROS, ARQ_LIVROS, total_livros, proximo_livro_id)) {
+        FILE *f_livros = fopen(ARQ_LIVROS ".tmp", "w");
+        if (f_livros == NULL) {
+            return falhar_gravacao(TABELA_LIVROS, ARQ_LIVROS);
+        }
+        registrar_paginas_gravadas(TABELA_LIVROS, 0, total_livros);
+        fprintf(f_livros, "%d\n", proximo_livro_id); // Salva o próximo ID
+        for (int i = 0; i < total_livros; i++) {
+            escrever_livro(f_livros, &acervo_livros[i]);
+        }
+        if (!substituir_arquivo(f_livros, ARQ_LIVROS)) {
+            return falhar_gravacao(TABELA_LIVROS, ARQ_LIVROS);
+        }
+        concluir_gravacao(TABELA_LIVROS, ARQ_LIVROS, total_livros, proximo_livro_id);
+        regravou_indexados = true;
+    }
+
+    // 2. Salvar Usuários
+    if (tabela_alterada(TABELA_USUARIOS, ARQ_USUARIOS, total_usuarios, proximo_usuario_id)) {
+        FILE *f_usuarios = fopen(ARQ_USUARIOS ".tmp", "w");
+        if (f_usuarios == NULL) {
+            return falhar_gravacao(TABELA_USUARIOS, ARQ_USUARIOS);
+        }
+        registrar_paginas_gravadas(TABELA_USUARIOS, 0, total_usuarios);
+        fprintf(f_usuarios, "%d\n", proximo_usuario_id); // Salva o próximo ID
+        for (int i = 0; i < total_usuarios; i++) {
+            escrever_usuario(f_usuarios, &lista_usuarios[i]);
+        }
+        if (!substituir_arquivo(f_usuarios, ARQ_USUARIOS)) {
+            return falhar_gravacao(TABELA_USUARIOS, ARQ_USUARIOS);
+        }
+        concluir_gravacao(TABELA_USUARIOS, ARQ_USUARIOS, total_usuarios, proximo_usuario_id);
+        regravou_indexados = true;
+    }
+
+    // 3. Salvar Empréstimos (no formato escolhido; o arquivo do outro formato é apagado).
+    // Novos empréstimos podem chegar durante a gravação: total e próximo ID são fixados antes.
+    int emprestimos_gravados = total_emprestimos;
+    int proximo_emprestimo = proximo_emprestimo_id;
+    const char *arquivo_emprestimos = emprestimos_compactados ? ARQ_EMPRESTIMOS_COMPACTADO : ARQ_EMPRESTIMOS;
+    const char *outro_formato = emprestimos_compactados ? ARQ_EMPRESTIMOS : ARQ_EMPRESTIMOS_COMPACTADO;
+    if (access(outro_formato, F_OK) == 0 ||
+        tabela_alterada(TABELA_EMPRESTIMOS, arquivo_emprestimos, emprestimos_gravados, proximo_emprestimo)) {
+        bool gravou_compactado = emprestimos_compactados &&
+                                 (atualizar_emprestimos_compactados(emprestimos_gravados, proximo_emprestimo, relatar) ||
+                                  salvar_emprestimos_compactados(emprestimos_gravados, proximo_emprestimo));
+        if (emprestimos_compactados && !gravou_compactado) {
+            fprintf(stderr, "\n[AVISO] Nao foi possivel gravar %s; emprestimos salvos em %s.\n",
+                    ARQ_EMPRESTIMOS_COMPACTADO, ARQ_EMPRESTIMOS);
+        }
+        if (gravou_compactado) {
+            remove(ARQ_EMPRESTIMOS);
+            concluir_gravacao(TABELA_EMPRESTIMOS, ARQ_EMPRESTIMOS_COMPACTADO, emprestimos_gravados, proximo_emprestimo);
+        } else {
+            FILE *f_emprestimos = fopen(ARQ_EMPRESTIMOS ".tmp", "w");
+            if (f_emprestimos == NULL) {
+                return falhar_gravacao(TABELA_EMPRESTIMOS, ARQ_EMPRESTIMOS);
+            }
+            registrar_paginas_gravadas(TABELA_EMPRESTIMOS, 0, emprestimos_gravados);
+            fprintf(f_emprestimos, "%d\n", proximo_emprestimo); // Salva o próximo ID
+            // Devoluções e renovações seguem durante a gravação: os registros saem de cópias
+            // feitas com as travas dos livros, um lote por vez (ver ModoCopia)
+            Emprestimo lote[REGISTROS_POR_LOTE];
+            for (int i = 0; i < emprestimos_gravados; i += REGISTROS_POR_LOTE) {
+                int quantidade = emprestimos_gravados - i < REGISTROS_POR_LOTE ? emprestimos_gravados - i : REGISTROS_POR_LOTE;
+                copiar_registros(COPIA_EMPRESTIMOS, lote, &lista_emprestimos[i], sizeof(Emprestimo), quantidade);
+                for (int j = 0; j < quantidade; j++) {
+                    escrever_emprestimo(f_emprestimos, &lote[j]);
+                }
+            }
+            if (!substituir_arquivo(f_emprestimos, ARQ_EMPRESTIMOS)) {
+                return falhar_gravacao(TABELA_EMPRESTIMOS, ARQ_EMPRESTIMOS);
+            }
+            remove(ARQ_EMPRESTIMOS_COMPACTADO);
+            // Se o compactado falhou, a tabela fica marcada para nova tentativa no próximo salvamento
+            if (emprestimos_compactados) {
+                invalidar_gravacao(TABELA_EMPRESTIMOS);
+            } else {
+                concluir_gravacao(TABELA_EMPRESTIMOS, ARQ_EMPRESTIMOS, emprestimos_gravados, proximo_emprestimo);
+            }
+        }
+        regravou_indexados = true;
+    }
+
+    // 4. Salvar Reservas (novas reservas também chegam com a trava de leitura)
+    int reservas_gravadas = total_reservas;
+    int proxima_reserva = proximo_reserva_id;
+    if (tabela_alterada(TABELA_RESERVAS, ARQ_RESERVAS, reservas_gravadas, proxima_reserva)) {
+        FILE *f_reservas = fopen(ARQ_RESERVAS ".tmp", "w");
+        if (f_reservas == NULL) {
+            return falhar_gravacao(TABELA_RESERVAS, ARQ_RESERVAS);
+        }
+        registrar_paginas_gravadas(TABELA_RESERVAS, 0, reservas_gravadas);
+        fprintf(f_reservas, "%d\n", proxima_reserva); // Salva o próximo ID
+        Reserva lote[REGISTROS_POR_LOTE]; // Como nos empréstimos: a fila muda sob a trava do livro
+        for (int i = 0; i < reservas_gravadas; i += REGISTROS_POR_LOTE) {
+            int quantidade = reservas_gravadas - i < REGISTROS_POR_LOTE ? reservas_gravadas - i : REGISTROS_POR_LOTE;
+            copiar_registros(COPIA_RESERVAS, lote, &lista_reservas[i], sizeof(Reserva), quantidade);
+            for (int j = 0; j < quantidade; j++) {
+                escrever_reserva(f_reservas, &lote[j]);
+            }
+        }
+        if (!substituir_arquivo(f_reservas, ARQ_RESERVAS)) {
+            return falhar_gravacao(TABELA_RESERVAS, ARQ_RESERVAS);
+        }
+        concluir_gravacao(TABELA_RESERVAS, ARQ_RESERVAS, reservas_gravadas, proxima_reserva);
+    }
+
+    // 5. Salvar os índices correspondentes aos arquivos gravados (se algum deles mudou)
+    if (regravou_indexados || !indices_em_dia) {
+        int quantidades[NUM_MAPAS_PERSISTIDOS] = {total_livros, total_usuarios, emprestimos_gravados};
+        salvar_indices(quantidades);
+        indices_em_dia = true;
+    }
+    destravar_cadastros();
+    pthread_mutex_unlock(&trava_salvamento);
+    registrar_latencia(OP_SALVAR_DADOS, inicio); // Só salvamentos concluídos entram na estatística
+    return true;
+}
+
+// Função para salvar todos os dados nos arquivos
+void salvar_dados() {
+    if (gravar_dados(!modo_silencioso) && !modo_silencioso) {
+        printf("\n[SUCESSO] Dados salvos com sucesso!\n");
+    }
+}
+
+// Refaz o que é derivado dos vetores depois que eles são substituídos por inteiro (carga dos
+// arquivos ou restauração de backup). Chamador deve ter trava de escrita e índices prontos.
+void reconstruir_estruturas_derivadas() {
+    reconstruir_filas_reservas();
+    compilar_politicas_usuarios();
+    reconstruir_agregados();
+    marcar_todos_alterados();
+    atomic_fetch_add(&geracao_carga, 1);
+}
+
+// Função para carregar dados dos arquivos
+void carregar_dados() {
+    int id_lido;
+    long long inicio = agora_ns();
+
+    // Tabelas lidas por inteiro: seus arquivos não precisam ser regravados até mudarem
+    bool completas[NUM_TABELAS_GRAVADAS] = {false, false, false, false};
+
+    travar_escrita_cadastros();
+    carregar_politicas();
+
+    // A carga substitui o que estiver em memória (o comando "all" carrega uma unidade por vez)
+    total_livros = 0;
+    total_usuarios = 0;
+    total_emprestimos = 0;
+    total_reservas = 0;
+    proximo_livro_id = 1;
+    proximo_usuario_id = 1;
+    proximo_emprestimo_id = 1;
+    proximo_reserva_id = 1;
+
+    // 1. Carregar Livros
+    FILE *f_livros = fopen(ARQ_LIVROS, "r");
+    if (f_livros != NULL) {
+        if (fscanf(f_livros, "%d\n", &id_lido) == 1) {
+            proximo_livro_id = id_lido;
+        }
+
+        int disponiveis_lidos;
+        while (total_livros < MAX_LIVROS &&
+               fscanf(f_livros, "%d;%[^;];%[^;];%[^;];%d;%d;%[^;];%d\n",
+                      &acervo_livros[total_livros].codigo,
+                      acervo_livros[total_livros].titulo,
+                      acervo_livros[total_livros].autor,
+                      acervo_livros[total_livros].editora,
+                      &acervo_livros[total_livros].ano_publicacao,
+                      &disponiveis_lidos,
+                      acervo_livros[total_livros].status,
+                      &acervo_livros[total_livros].total_exemplares) == 8) {
+            atomic_store(&acervo_livros[total_livros].exemplares_disponiveis, disponiveis_lidos);
+            total_livros++;
+        }
+        completas[TABELA_LIVROS] = feof(f_livros);
+        fclose(f_livros);
+        if (!modo_silencioso) printf("[INFO] %d Livros carregados.\n", total_livros);
+    } else {
+        if (!modo_silencioso) printf("[INFO] Arquivo %s nao encontrado. Iniciando com dados vazios.\n", ARQ_LIVROS);
+    }
+
+    // 2. Carregar Usuários
+    FILE *f_usuarios = fopen(ARQ_USUARIOS, "r");
+    if (f_usuarios != NULL) {
+        if (fscanf(f_usuarios, "%d\n", &id_lido) == 1) {
+            proximo_usuario_id = id_lido;
+        }
+
+        while (total_usuarios < MAX_USUARIOS &&
+               fscanf(f_usuarios, "%d;%[^;];%[^;];%[^;];%d/%d/%d\n",
+                      &lista_usuarios[total_usuarios].matricula,
+                      lista_usuarios[total_usuarios].nome,
+                      lista_usuarios[total_usuarios].curso,
+                      lista_usuarios[total_usuarios].telefone,
+                      &lista_usuarios[total_usuarios].data_cadastro.dia,
+                      &lista_usuarios[total_usuarios].data_cadastro.mes,
+                      &lista_usuarios[total_usuarios].data_cadastro.ano) == 7) {
+            total_usuarios++;
+        }
+        completas[TABELA_USUARIOS] = feof(f_usuarios);
+        fclose(f_usuarios);
+        if (!modo_silencioso) printf("[INFO] %d Usuarios carregados.\n", total_usuarios);
+    } else {
+        if (!modo_silencioso) printf("[INFO] Arquivo %s nao encontrado. Iniciando com dados vazios.\n", ARQ_USUARIOS);
+    }
+
+    // 3. Carregar Empréstimos (do formato compactado, se for o arquivo em uso)
+    FILE *f_emprestimos = NULL;
+    if (strcmp(arquivo_emprestimos_em_uso(), ARQ_EMPRESTIMOS_COMPACTADO) == 0 && carregar_emprestimos_compactados(&completas[TABELA_EMPRESTIMOS])) {
+        if (!modo_silencioso) printf("[INFO] %d Emprestimos carregados de %s.\n", total_emprestimos, ARQ_EMPRESTIMOS_COMPACTADO);
+    } else if ((f_emprestimos = fopen(ARQ_EMPRESTIMOS, "r")) != NULL) {
+        if (fscanf(f_emprestimos, "%d\n", &id_lido) == 1) {
+            proximo_emprestimo_id = id_lido;
+        }
+
+        // Lido linha a linha: arquivos antigos não têm os campos finais de renovações e
+        // data de devolução
+        char linha[256];
+        while (total_emprestimos < MAX_EMPRESTIMOS && fgets(linha, sizeof(linha), f_emprestimos) != NULL) {
+            Emprestimo *e = &lista_emprestimos[total_emprestimos];
+            e->renovacoes = 0;
+            e->data_devolucao = DATA_INDEFINIDA;
+            int campos = sscanf(linha, "%d;%d;%d;%d/%d/%d;%d/%d/%d;%14[^;\r\n];%d;%d/%d/%d",
+                                &e->codigo_emprestimo,
+                                &e->matricula_usuario,
+                                &e->codigo_livro,
+                                &e->data_emprestimo.dia,
+                                &e->data_emprestimo.mes,
+                                &e->data_emprestimo.ano,
+                                &e->data_prevista_devolucao.dia,
+                                &e->data_prevista_devolucao.mes,
+                                &e->data_prevista_devolucao.ano,
+                                e->status,
+                                &e->renovacoes,
+                                &e->data_devolucao.dia,
+                                &e->data_devolucao.mes,
+                                &e->data_devolucao.ano);
+            if (campos < 10) {
+                break;
+            }
+            if (campos < 14) {
+                e->data_devolucao = DATA_INDEFINIDA;
+            }
+            total_emprestimos++;
+        }
+        completas[TABELA_EMPRESTIMOS] = feof(f_emprestimos);
+        fclose(f_emprestimos);
+        if (!modo_silencioso) printf("[INFO] %d Emprestimos carregados.\n", total_emprestimos);
+    } else {
+        if (!modo_silencioso) printf("[INFO] Arquivo %s nao encontrado. Iniciando com dados vazios.\n", ARQ_EMPRESTIMOS);
+    }
+
+    // 4. Carregar Reservas (arquivo opcional: versões anteriores não o tinham)
+    FILE *f_reservas = fopen(ARQ_RESERVAS, "r");
+    if (f_reservas != NULL) {
+        if (fscanf(f_reservas, "%d\n", &id_lido) == 1) {
+            proximo_reserva_id = id_lido;
+        }
+
+        while (total_reservas < MAX_RESERVAS &&
+               fscanf(f_reservas, "%d;%d;%d;%d/%d/%d;%14s\n",
+                      &lista_reservas[total_reservas].codigo_reserva,
+                      &lista_reservas[total_reservas].matricula_usuario,
+                      &lista_reservas[total_reservas].codigo_livro,
+                      &lista_reservas[total_reservas].data_reserva.dia,
+                      &lista_reservas[total_reservas].data_reserva.mes,
+                      &lista_reservas[total_reservas].data_reserva.ano,
+                      lista_reservas[total_reservas].status) == 7) {
+            total_reservas++;
+        }
+        completas[TABELA_RESERVAS] = feof(f_reservas);
+        fclose(f_reservas);
+        if (!modo_silencioso) printf("[INFO] %d Reservas carregadas.\n", total_reservas);
+    }
+
+    indices_em_dia = carregar_indices();
+    if (!indices_em_dia) {
+        reconstruir_indices();
+    }
+    reconstruir_estruturas_derivadas();
+
+    // Com as versões de página já atualizadas pela reconstrução, as tabelas lidas por inteiro
+    // passam a coincidir com seus arquivos
+    const char *arquivos[NUM_TABELAS_GRAVADAS] = {ARQ_LIVROS, ARQ_USUARIOS, arquivo_emprestimos_em_uso(), ARQ_RESERVAS};
+    const int totais[NUM_TABELAS_GRAVADAS] = {total_livros, total_usuarios, total_emprestimos, total_reservas};
+    const int proximos[NUM_TABELAS_GRAVADAS] = {proximo_livro_id, proximo_usuario_id, proximo_emprestimo_id, proximo_reserva_id};
+    for (int t = 0; t < NUM_TABELAS_GRAVADAS; t++) {
+        if (completas[t]) {
+            registrar_paginas_gravadas(t, 0, totais[t]);
+            concluir_gravacao(t, arquivos[t], totais[t], proximos[t]);
+        } else {
+            invalidar_gravacao(t);
+        }
+    }
+    destravar_cadastros();
+    registrar_latencia(OP_CARREGAR_DADOS, inicio);
+}
+
+// --- SALVAMENTO AUTOMÁTICO ---
+
+// Na sessão interativa uma thread grava os dados a cada 'intervalo_autosave' segundos
+// (BIBLIOTECA_AUTOSAVE). Como o salvamento só regrava o que mudou e usa trava de leitura,
+// o menu segue respondendo durante a gravação e o salvamento final do encerramento fica
+// reduzido ao que foi alterado desde a última passada da thread.
+#define INTERVALO_AUTOSAVE_PADRAO 300
+
+int intervalo_autosave = INTERVALO_AUTOSAVE_PADRAO; // Segundos; 0 = desligado
+pthread_t thread_autosave;
+bool autosave_iniciado = false;
+bool autosave_encerrar = false;
+pthread_mutex_t trava_autosave = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t sinal_autosave = PTHREAD_COND_INITIALIZER;
+
+void *laco_autosave(void *argumento) {
+    (void)argumento;
+    pthread_mutex_lock(&trava_autosave);
+    while (!autosave_encerrar) {
+        struct timespec prazo;
+        clock_gettime(CLOCK_REALTIME, &prazo);
+        prazo.tv_sec += intervalo_autosave;
+        // Espera o prazo (retorno diferente de 0) ou o pedido de encerramento
+        int espera = 0;
+        while (!autosave_encerrar && espera == 0) {
+            espera = pthread_cond_timedwait(&sinal_autosave, &trava_autosave, &prazo);
+        }
+        if (autosave_encerrar) {
+            break;
+        }
+        pthread_mutex_unlock(&trava_autosave);
+        // Sem mensagens de sucesso: a thread não deve escrever no meio dos menus (as falhas,
+        // inclusive as de gravar_dados, vão para stderr)
+        if (!gravar_dados(false)) {
+            fprintf(stderr, "\n[AVISO] Salvamento automatico falhou; nova tentativa em %d segundo(s).\n", intervalo_autosave);
+        }
+        pthread_mutex_lock(&trava_autosave);
+    }
+    pthread_mutex_unlock(&trava_autosave);
+    return NULL;
+}
+
+// Inicia a thread de salvamento automático, se configurada (chamar depois de carregar os dados)
+void iniciar_autosave() {
+    if (intervalo_autosave <= 0) {
+        return;
+    }
+    autosave_encerrar = false;
+    if (pthread_create(&thread_autosave, NULL, laco_autosave, NULL) != 0) {
+        printf("[AVISO] Nao foi possivel iniciar o salvamento automatico.\n");
+        return;
+    }
+    autosave_iniciado = true;
+    printf("[INFO] Salvamento automatico a cada %d segundo(s).\n", intervalo_autosave);
+}
+
+// Encerra a thread; uma gravação em andamento termina antes do retorno
+void encerrar_autosave() {
+    if (!autosave_iniciado) {
+        return;
+    }
+    pthread_mutex_lock(&trava_autosave);
+    autosave_encerrar = true;
+    pthread_cond_signal(&sinal_autosave);
+    pthread_mutex_unlock(&trava_autosave);
+    pthread_join(thread_autosave, NULL);
+    autosave_iniciado = false;
+}
+
+// --- BACKUP INCREMENTAL ---
+
+// Cada backup grava uma geração em backups/geracao_NNNNN.bak contendo apenas as páginas
+// (TAM_PAGINA registros, as mesmas dos instantâneos) que mudaram desde a geração anterior.
+// Uma página só é lida se a sua versão mudou desde o último backup da sessão e só é gravada
+// se a soma de verificação difere da registrada no catálogo (backups/catalogo.bin), o que
+// também vale entre execuções do programa. A cada GERACOES_POR_CADEIA gerações uma é
+// completa, para limitar quantos arquivos a restauração precisa aplicar.
+#define DIR_BACKUPS "backups"
+#define ARQ_CATALOGO_BACKUP DIR_BACKUPS "/catalogo.bin"
+#define VERSAO_BACKUP 1
+#define GERACOES_POR_CADEIA 16
+#define NUM_TABELAS_BACKUP 4
+
+typedef struct {
+    char identificador[8]; // "BIBBAK"
+    int versao;
+    int geracao;
+    int completa;          // 1 = todas as páginas; 0 = só as alteradas desde a geração anterior
+    long long criada_em;
+    int tamanho_pagina;
+    int tamanhos_registro[NUM_TABELAS_BACKUP];
+    int totais[NUM_TABELAS_BACKUP];
+    int proximos_ids[NUM_TABELAS_BACKUP];
+    int paginas[NUM_TABELAS_BACKUP]; // Páginas gravadas de cada tabela
+    unsigned long long soma_verificacao; // Sobre todo o conteúdo após o cabeçalho
+} CabecalhoGeracao;
+
+typedef struct {
+    char identificador[8]; // "BIBCAT"
+    int versao;
+    int ultima_geracao;
+    int ultima_completa;
+    int tamanho_pagina;
+    int tamanhos_registro[NUM_TABELAS_BACKUP];
+    int num_paginas[NUM_TABELAS_BACKUP]; // Quantas somas de cada tabela seguem o cabeçalho
+} CabecalhoCatalogo;
+
+typedef struct {
+    void *registros;
+    size_t tamanho_registro;
+    atomic_int *total;
+    atomic_int *proximo_id;
+    atomic_uint *versoes;         // Versão atual de cada página
+    unsigned int *versoes_salvas; // Versão de cada página no último backup desta sessão
+    unsigned long long *somas;    // Soma de cada página na última geração (do catálogo)
+    int max_registros;
+    ModoCopia modo;               // Cópia sob trava de leitura
+} TabelaBackup;
+
+unsigned int versoes_backup_livros[PAGINAS_LIVROS];
+unsigned int versoes_backup_usuarios[PAGINAS_USUARIOS];
+unsigned int versoes_backup_emprestimos[PAGINAS_EMPRESTIMOS];
+unsigned int versoes_backup_reservas[PAGINAS_RESERVAS];
+unsigned long long somas_backup_livros[PAGINAS_LIVROS];
+unsigned long long somas_backup_usuarios[PAGINAS_USUARIOS];
+unsigned long long somas_backup_emprestimos[PAGINAS_EMPRESTIMOS];
+unsigned long long somas_backup_reservas[PAGINAS_RESERVAS];
+
+TabelaBackup tabelas_backup[NUM_TABELAS_BACKUP] = {
+    {acervo_livros, sizeof(Livro), &total_livros, &proximo_livro_id,
+     versao_paginas_livros, versoes_backup_livros, somas_backup_livros, MAX_LIVROS, COPIA_LIVROS},
+    {lista_usuarios, sizeof(Usuario), &total_usuarios, &proximo_usuario_id,
+     versao_paginas_usuarios, versoes_backup_usuarios, somas_backup_usuarios, MAX_USUARIOS, COPIA_DIRETA},
+    {lista_emprestimos, sizeof(Emprestimo), &total_emprestimos, &proximo_emprestimo_id,
+     versao_paginas_emprestimos, versoes_backup_emprestimos, somas_backup_emprestimos, MAX_EMPRESTIMOS,
+     COPIA_EMPRESTIMOS},
+    {lista_reservas, sizeof(Reserva), &total_reservas, &proximo_reserva_id,
+     versao_paginas_reservas, versoes_backup_reservas, somas_backup_reservas, MAX_RESERVAS, COPIA_RESERVAS},
+};
+
+// Estado do backup nesta execução. 'geracao_carga_backup' detecta recargas dos arquivos, que
+// mudam as posições dos registros: as versões salvas deixam de valer (as somas continuam).
+CabecalhoCatalogo catalogo_backup;
+bool catalogo_backup_valido = false;
+bool catalogo_backup_lido = false;
+unsigned int geracao_carga_backup = PAGINA_NUNCA_COPIADA;
+
+void caminho_geracao(int geracao, char *caminho, size_t tamanho) {
+    snprintf(caminho, tamanho, DIR_BACKUPS "/geracao_%05d.bak", geracao);
+}
+
+int paginas_da_tabela(int total) {
+    return (total + TAM_PAGINA - 1) / TAM_PAGINA;
+}
+
+// Lê o catálogo do último backup; sem ele (ou se não confere) o próximo backup é completo
+void ler_catalogo_backup() {
+    catalogo_backup_lido = true;
+    catalogo_backup_valido = false;
+    FILE *f = fopen(ARQ_CATALOGO_BACKUP, "rb");
+    if (f == NULL) {
+        return;
+    }
+    CabecalhoCatalogo cab;
+    bool ok = fread(&cab, sizeof(cab), 1, f) == 1 && memcmp(cab.identificador, "BIBCAT", 6) == 0 &&
+              cab.versao == VERSAO_BACKUP && cab.tamanho_pagina == TAM_PAGINA;
+    for (int t = 0; ok && t < NUM_TABELAS_BACKUP; t++) {
+        const TabelaBackup *tabela = &tabelas_backup[t];
+        ok = cab.tamanhos_registro[t] == (int)tabela->tamanho_registro && cab.num_paginas[t] >= 0 &&
+             cab.num_paginas[t] <= paginas_da_tabela(tabela->max_registros) &&
+             fread(tabela->somas, sizeof(unsigned long long), cab.num_paginas[t], f) == (size_t)cab.num_paginas[t];
+    }
+    fclose(f);
+    if (ok) {
+        catalogo_backup = cab;
+        catalogo_backup_valido = true;
+    }
+}
+
+bool gravar_catalogo_backup(const CabecalhoCatalogo *cab) {
+    FILE *f = fopen(ARQ_CATALOGO_BACKUP ".tmp", "wb");
+    if (f == NULL) {
+        return false;
+    }
+    bool ok = fwrite(cab, sizeof(*cab), 1, f) == 1;
+    for (int t = 0; ok && t < NUM_TABELAS_BACKUP; t++) {
+        ok = fwrite(tabelas_backup[t].somas, sizeof(unsigned long long), cab->num_paginas[t], f) ==
+             (size_t)cab->num_paginas[t];
+    }
+    ok = fclose(f) == 0 && ok;
+    return ok && rename(ARQ_CATALOGO_BACKUP ".tmp", ARQ_CATALOGO_BACKUP) == 0;
+}
+
+// Maior geração existente no diretório (0 se nenhuma)
+int ultima_geracao_backup() {
+    char caminho[64];
+    int geracao = catalogo_backup_valido ? catalogo_backup.ultima_geracao : 0;
+    for (;;) {
+        caminho_geracao(geracao + 1, caminho, sizeof(caminho));
+        if (access(caminho, F_OK) != 0) {
+            return geracao;
+        }
+        geracao++;
+    }
+}
+
+// Escreve no arquivo acumulando a soma de verificação do conteúdo
+bool gravar_somando(FILE *f, const void *dados, size_t tamanho, unsigned long long *soma) {
+    *soma = somar_verificacao(*soma, dados, tamanho);
+    return fwrite(dados, 1, tamanho, f) == tamanho;
+}
+
+bool ler_somando(FILE *f, void *dados, size_t tamanho, unsigned long long *soma) {
+    if (fread(dados, 1, tamanho, f) != tamanho) {
+        return false;
+    }
+    *soma = somar_verificacao(*soma, dados, tamanho);
+    return true;
+}
+
+// Páginas de uma tabela copiadas para a memória durante um backup
+typedef struct {
+    int *paginas;          // Número de cada página copiada
+    unsigned int *versoes; // Versão da página no momento da cópia
+    int *registros;        // Registros válidos em cada página copiada
+    char *dados;           // TAM_PAGINA registros por página copiada
+    int *posicao;          // posicao[página] = índice em 'paginas' ou -1
+    int quantidade;
+    int capacidade;
+} PaginasBackup;
+
+void liberar_paginas_backup(PaginasBackup *copia) {
+    free(copia->paginas);
+    free(copia->versoes);
+    free(copia->registros);
+    free(copia->dados);
+    free(copia->posicao);
+    memset(copia, 0, sizeof(*copia));
+}
+
+// Copia (ou copia de novo) a página 'p' da tabela com a versão lida antes da cópia
+bool copiar_pagina_backup(PaginasBackup *copia, const TabelaBackup *tabela, int p, int total) {
+    int k = copia->posicao[p];
+    if (k == -1) {
+        if (copia->quantidade == copia->capacidade) {
+            int nova = copia->capacidade * 2 + 64;
+            int *paginas = realloc(copia->paginas, sizeof(int) * nova);
+            if (paginas != NULL) copia->paginas = paginas;
+            unsigned int *versoes = realloc(copia->versoes, sizeof(unsigned int) * nova);
+            if (versoes != NULL) copia->versoes = versoes;
+            int *registros = realloc(copia->registros, sizeof(int) * nova);
+            if (registros != NULL) copia->registros = registros;
+            char *dados = realloc(copia->dados, (size_t)nova * TAM_PAGINA * tabela->tamanho_registro);
+            if (dados != NULL) copia->dados = dados;
+            if (paginas == NULL || versoes == NULL || registros == NULL || dados == NULL) {
+                return false;
+            }
+            copia->capacidade = nova;
+        }
+        k = copia->quantidade++;
+        copia->paginas[k] = p;
+        copia->posicao[p] = k;
+    }
+    int registros = total - p * TAM_PAGINA < TAM_PAGINA ? total - p * TAM_PAGINA : TAM_PAGINA;
+    size_t bytes_pagina = (size_t)TAM_PAGINA * tabela->tamanho_registro;
+    copia->versoes[k] = atomic_load(&tabela->versoes[p]);
+    copia->registros[k] = registros;
+    copiar_registros(tabela->modo, copia->dados + (size_t)k * bytes_pagina,
+                     (const char *)tabela->registros + (size_t)p * bytes_pagina, tabela->tamanho_registro, registros);
+    return true;
+}
+
+// Depois de uma recarga dos arquivos nenhuma página da sessão anterior vale mais; retorna
+// true quando foi o caso. Chamada com a trava dos cadastros.
+bool conferir_carga_backup() {
+    if (geracao_carga_backup == atomic_load(&geracao_carga)) {
+        return false;
+    }
+    geracao_carga_backup = atomic_load(&geracao_carga);
+    for (int t = 0; t < NUM_TABELAS_BACKUP; t++) {
+        for (int p = 0; p < paginas_da_tabela(tabelas_backup[t].max_registros); p++) {
+            tabelas_backup[t].versoes_salvas[p] = PAGINA_NUNCA_COPIADA;
+        }
+    }
+    return true;
+}
+
+// Copia para a memória as páginas a gravar ('completa' = todas), em duas etapas como o
+// instantâneo dos relatórios: primeiro sob trava de leitura, sem bloquear o balcão; depois
+// sob trava de escrita, só as páginas cuja versão mudou desde a primeira cópia. Com a trava
+// de escrita nenhum empréstimo, devolução ou renovação está pela metade, então a geração
+// é um ponto consistente (um empréstimo nunca aparece devolvido com o exemplar ainda
+// fora da estante). Preenche totais e próximos códigos de 'cab'.
+bool copiar_paginas_backup(PaginasBackup *copias, bool completa, CabecalhoGeracao *cab) {
+    for (int t = 0; t < NUM_TABELAS_BACKUP; t++) {
+        int max_paginas = paginas_da_tabela(tabelas_backup[t].max_registros);
+        copias[t].posicao = malloc(sizeof(int) * (max_paginas + 1));
+        if (copias[t].posicao == NULL) {
+            return false;
+        }
+        for (int p = 0; p < max_paginas; p++) {
+            copias[t].posicao[p] = -1;
+        }
+    }
+
+    bool ok = true;
+    travar_leitura_cadastros();
+    conferir_carga_backup();
+    for (int t = 0; ok && t < NUM_TABELAS_BACKUP; t++) {
+        const TabelaBackup *tabela = &tabelas_backup[t];
+        int total = atomic_load(tabela->total);
+        for (int p = 0; ok && p < paginas_da_tabela(total); p++) {
+            if (completa || atomic_load(&tabela->versoes[p]) != tabela->versoes_salvas[p]) {
+                ok = copiar_pagina_backup(&copias[t], tabela, p, total);
+            }
+        }
+    }
+    destravar_cadastros();
+
+    // Uma recarga dos arquivos entre as etapas invalida também o que já foi copiado
+    travar_escrita_cadastros();
+    bool recarregou = conferir_carga_backup();
+    for (int t = 0; ok && t < NUM_TABELAS_BACKUP; t++) {
+        const TabelaBackup *tabela = &tabelas_backup[t];
+        PaginasBackup *copia = &copias[t];
+        int total = atomic_load(tabela->total);
+        int paginas = paginas_da_tabela(total);
+        cab->tamanhos_registro[t] = (int)tabela->tamanho_registro;
+        cab->totais[t] = total;
+        cab->proximos_ids[t] = atomic_load(tabela->proximo_id);
+        for (int p = 0; ok && p < paginas; p++) {
+            unsigned int versao = atomic_load(&tabela->versoes[p]);
+            int k = copia->posicao[p];
+            bool copiar = k != -1 ? recarregou || versao != copia->versoes[k]
+                                  : completa || versao != tabela->versoes_salvas[p];
+            if (copiar) {
+                ok = copiar_pagina_backup(copia, tabela, p, total);
+            }
+        }
+        // Páginas além do total atual (recarga com menos registros) não são gravadas
+        int mantidas = 0;
+        for (int k = 0; k < copia->quantidade; k++) {
+            if (copia->paginas[k] >= paginas) {
+                continue;
+            }
+            if (mantidas != k) {
+                size_t bytes_pagina = (size_t)TAM_PAGINA * tabela->tamanho_registro;
+                copia->paginas[mantidas] = copia->paginas[k];
+                copia->versoes[mantidas] = copia->versoes[k];
+                copia->registros[mantidas] = copia->registros[k];
+                memmove(copia->dados + (size_t)mantidas * bytes_pagina, copia->dados + (size_t)k * bytes_pagina,
+                        bytes_pagina);
+            }
+            mantidas++;
+        }
+        copia->quantidade = mantidas;
+    }
+    destravar_cadastros();
+    return ok;
+}
+
+// Função para realizar backup (incremental) dos dados; retorna false se a geração não pôde ser gravada
+bool fazer_backup() {
+    printf("\n--- Realizando Backup Incremental ---\n");
+    long long inicio = agora_ns();
+    mkdir(DIR_BACKUPS, 0755);
+    if (!catalogo_backup_lido) {
+        ler_catalogo_backup();
+    }
+
+    CabecalhoGeracao cab;
+    memset(&cab, 0, sizeof(cab));
+    memcpy(cab.identificador, "BIBBAK", 6);
+    cab.versao = VERSAO_BACKUP;
+    cab.geracao = ultima_geracao_backup() + 1;
+    cab.completa = !catalogo_backup_valido || catalogo_backup.ultima_geracao != cab.geracao - 1 ||
+                   cab.geracao - catalogo_backup.ultima_completa >= GERACOES_POR_CADEIA;
+    cab.criada_em = (long long)time(NULL);
+    cab.tamanho_pagina = TAM_PAGINA;
+
+    char caminho[64];
+    caminho_geracao(cab.geracao, caminho, sizeof(caminho));
+    char temporario[80];
+    snprintf(temporario, sizeof(temporario), "%s.tmp", caminho);
+    FILE *f = fopen(temporario, "wb");
+    if (f == NULL) {
+        printf("[ERRO] Nao foi possivel criar %s.\n", temporario);
+        return false;
+    }
+    bool ok = fwrite(&cab, sizeof(cab), 1, f) == 1; // Reescrito ao final, com as contagens
+
+    // As páginas vão primeiro para a memória (ver copiar_paginas_backup); o arquivo é
+    // escrito depois, sem trava nenhuma
+    PaginasBackup copias[NUM_TABELAS_BACKUP];
+    memset(copias, 0, sizeof(copias));
+    ok = ok && copiar_paginas_backup(copias, cab.completa, &cab);
+
+    unsigned long long soma = 14695981039346656037ULL;
+    for (int t = 0; ok && t < NUM_TABELAS_BACKUP; t++) {
+        TabelaBackup *tabela = &tabelas_backup[t];
+        const PaginasBackup *copia = &copias[t];
+        int paginas_antes = catalogo_backup_valido ? catalogo_backup.num_paginas[t] : 0;
+        for (int k = 0; ok && k < copia->quantidade; k++) {
+            int p = copia->paginas[k];
+            const char *dados = copia->dados + (size_t)k * TAM_PAGINA * tabela->tamanho_registro;
+            size_t bytes = (size_t)copia->registros[k] * tabela->tamanho_registro;
+            unsigned long long soma_pagina = somar_verificacao(14695981039346656037ULL, dados, bytes);
+            tabela->versoes_salvas[p] = copia->versoes[k];
+            if (!cab.completa && p < paginas_antes && soma_pagina == tabela->somas[p]) {
+                continue; // Marcada, mas com o mesmo conteúdo da geração anterior
+            }
+            tabela->somas[p] = soma_pagina;
+            ok = gravar_somando(f, &p, sizeof(p), &soma) && gravar_somando(f, dados, bytes, &soma);
+            cab.paginas[t]++;
+        }
+    }
+    for (int t = 0; t < NUM_TABELAS_BACKUP; t++) {
+        liberar_paginas_backup(&copias[t]);
+    }
+
+    cab.soma_verificacao = soma;
+    long bytes_gravados = ftell(f);
+    ok = ok && fseek(f, 0, SEEK_SET) == 0 && fwrite(&cab, sizeof(cab), 1, f) == 1;
+    ok = fclose(f) == 0 && ok;
+
+    CabecalhoCatalogo novo;
+    memset(&novo, 0, sizeof(novo));
+    memcpy(novo.identificador, "BIBCAT", 6);
+    novo.versao = VERSAO_BACKUP;
+    novo.ultima_geracao = cab.geracao;
+    novo.ultima_completa = cab.completa ? cab.geracao : catalogo_backup.ultima_completa;
+    novo.tamanho_pagina = TAM_PAGINA;
+    for (int t = 0; t < NUM_TABELAS_BACKUP; t++) {
+        novo.tamanhos_registro[t] = cab.tamanhos_registro[t];
+        novo.num_paginas[t] = paginas_da_tabela(cab.totais[t]);
+    }
+    ok = ok && rename(temporario, caminho) == 0 && gravar_catalogo_backup(&novo);
+    if (!ok) {
+        // Somas e versões em memória já refletem páginas não gravadas: o próximo será completo
+        remove(temporario);
+        remove(ARQ_CATALOGO_BACKUP);
+        catalogo_backup_valido = false;
+        printf("[ERRO] Falha ao gravar o backup; o proximo backup sera completo.\n");
+        return false;
+    }
+    catalogo_backup = novo;
+    catalogo_backup_valido = true;
+
+    printf("[BACKUP] Geracao %d (%s) gravada em %s: %d livro(s), %d usuario(s), %d emprestimo(s) e %d reserva(s) em paginas alteradas, %ld bytes.\n",
+           cab.geracao, cab.completa ? "completa" : "incremental", caminho,
+           cab.paginas[0], cab.paginas[1], cab.paginas[2], cab.paginas[3], bytes_gravados);
+    printf("--- Backup Concluido em %.1f ms ---\n", (agora_ns() - inicio) / 1e6);
+    return true;
+}
+
+bool ler_cabecalho_geracao(FILE *f, int geracao, CabecalhoGeracao *cab) {
+    if (fread(cab, sizeof(*cab), 1, f) != 1 || memcmp(cab->identificador, "BIBBAK", 6) != 0 ||
+        cab->versao != VERSAO_BACKUP || cab->geracao != geracao || cab->tamanho_pagina != TAM_PAGINA) {
+        return false;
+    }
+    for (int t = 0; t < NUM_TABELAS_BACKUP; t++) {
+        if (cab->tamanhos_registro[t] != (int)tabelas_backup[t].tamanho_registro ||
+            cab->totais[t] < 0 || cab->totais[t] > tabelas_backup[t].max_registros) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Função para listar as gerações de backup disponíveis
+void listar_backups() {
+    if (!catalogo_backup_lido) {
+        ler_catalogo_backup();
+    }
+    int ultima = ultima_geracao_backup();
+    printf("\n--- Geracoes de Backup (%s) ---\n", DIR_BACKUPS);
+    printf("Geracao | Tipo        | Data/Hora           | Livros | Usuarios | Emprestimos | Reservas\n");
+    printf("------------------------------------------------------------------------------------------\n");
+    for (int g = 1; g <= ultima; g++) {
+        char caminho[64];
+        caminho_geracao(g, caminho, sizeof(caminho));
+        FILE *f = fopen(caminho, "rb");
+        CabecalhoGeracao cab;
+        if (f == NULL || !ler_cabecalho_geracao(f, g, &cab)) {
+            printf("%7d | (arquivo ausente ou invalido)\n", g);
+        } else {
+            time_t criada = (time_t)cab.criada_em;
+            char quando[32];
+            struct tm local;
+            localtime_r(&criada, &local);
+            strftime(quando, sizeof(quando), "%d/%m/%Y %H:%M:%S", &local);
+            printf("%7d | %-11s | %s | %6d | %8d | %11d | %8d\n", g, cab.completa ? "completa" : "incremental",
+                   quando, cab.totais[0], cab.totais[1], cab.totais[2], cab.totais[3]);
+        }
+        if (f != NULL) {
+            fclose(f);
+        }
+    }
+    printf("------------------------------------------------------------------------------------------\n");
+    if (ultima == 0) {
+        printf("[INFO] Nenhum backup realizado ainda.\n");
+    }
+}
+
+// Aplica a geração 'geracao' sobre os vetores de 'destino' (um por tabela)
+bool aplicar_geracao(int geracao, void **destino, CabecalhoGeracao *cab) {
+    char caminho[64];
+    caminho_geracao(geracao, caminho, sizeof(caminho));
+    FILE *f = fopen(caminho, "rb");
+    if (f == NULL) {
+        return false;
+    }
+    bool ok = ler_cabecalho_geracao(f, geracao, cab);
+    unsigned long long soma = 14695981039346656037ULL;
+    for (int t = 0; ok && t < NUM_TABELAS_BACKUP; t++) {
+        size_t tamanho = tabelas_backup[t].tamanho_registro;
+        for (int i = 0; ok && i < cab->paginas[t]; i++) {
+            int p;
+            ok = ler_somando(f, &p, sizeof(p), &soma) && p >= 0 && p < paginas_da_tabela(cab->totais[t]);
+            if (ok) {
+                int registros = cab->totais[t] - p * TAM_PAGINA < TAM_PAGINA ? cab->totais[t] - p * TAM_PAGINA : TAM_PAGINA;
+                ok = ler_somando(f, (char *)destino[t] + (size_t)p * TAM_PAGINA * tamanho, registros * tamanho, &soma);
+            }
+        }
+    }
+    fclose(f);
+    return ok && soma == cab->soma_verificacao;
+}
+
+// Reconstrói a geração pedida (a partir da última geração completa que a antecede) e a
+// coloca no lugar dos dados em memória. Não grava os arquivos: quem chama decide salvar.
+bool restaurar_backup(int geracao) {
+    // Procura, voltando a partir da geração pedida, a geração completa que inicia a cadeia
+    int base = geracao;
+    for (;; base--) {
+        char caminho[64];
+        caminho_geracao(base, caminho, sizeof(caminho));
+        FILE *f = base >= 1 ? fopen(caminho, "rb") : NULL;
+        CabecalhoGeracao cab;
+        bool valido = f != NULL && ler_cabecalho_geracao(f, base, &cab);
+        if (f != NULL) {
+            fclose(f);
+        }
+        if (!valido) {
+            printf("[ERRO] Geracao %d ausente ou invalida; nao e possivel restaurar a geracao %d.\n", base, geracao);
+            return false;
+        }
+        if (cab.completa) {
+            break;
+        }
+    }
+
+    void *destino[NUM_TABELAS_BACKUP];
+    bool ok = true;
+    for (int t = 0; t < NUM_TABELAS_BACKUP; t++) {
+        destino[t] = calloc(tabelas_backup[t].max_registros, tabelas_backup[t].tamanho_registro);
+        ok = ok && destino[t] != NULL;
+    }
+    CabecalhoGeracao cab;
+    for (int g = base; ok && g <= geracao; g++) {
+        ok = aplicar_geracao(g, destino, &cab);
+        if (!ok) {
+            printf("[ERRO] Geracao %d corrompida; restauracao cancelada.\n", g);
+        }
+    }
+    if (ok) {
+        travar_escrita_cadastros();
+        for (int t = 0; t < NUM_TABELAS_BACKUP; t++) {
+            memcpy(tabelas_backup[t].registros, destino[t], (size_t)cab.totais[t] * tabelas_backup[t].tamanho_registro);
+            *tabelas_backup[t].total = cab.totais[t];
+            *tabelas_backup[t].proximo_id = cab.proximos_ids[t];
+        }
+        reconstruir_indices();
+        reconstruir_estruturas_derivadas();
+        destravar_cadastros();
+        printf("[SUCESSO] Geracao %d restaurada (aplicadas as geracoes %d a %d).\n", geracao, base, geracao);
+    }
+    for (int t = 0; t < NUM_TABELAS_BACKUP; t++) {
+        free(destino[t]);
+    }
+    return ok;
+}
+
+
+// --- RESULTADOS DAS OPERAÇÕES ---
+
+// As operações da API (funções api_*) não leem do teclado nem imprimem nada: recebem os
+// dados por parâmetro, devolvem um destes códigos e copiam o registro afetado para o
+// chamador. Os menus e a linha de comando apenas coletam a entrada e traduzem o resultado.
+typedef enum {
+    RESULTADO_OK = 0,
+    ERRO_USUARIO_NAO_ENCONTRADO,
+    ERRO_LIVRO_NAO_ENCONTRADO,
+    ERRO_EMPRESTIMO_NAO_ENCONTRADO,
+    ERRO_SEM_EXEMPLARES,
+    ERRO_LIMITE_USUARIO,
+    ERRO_LIMITE_RENOVACOES,
+    ERRO_CAPACIDADE,
+    ERRO_RESERVA_DUPLICADA,
+    ERRO_LIVRO_DISPONIVEL,
+    ERRO_LIVRO_RESERVADO,
+    ERRO_DADOS_INVALIDOS,
+    ERRO_UNIDADE_DUPLICADA,
+    ERRO_GRAVACAO
+} ResultadoOperacao;
+
+// Descrição curta de um resultado, para mensagens de erro genéricas
+const char *descrever_resultado(ResultadoOperacao resultado) {
+    switch (resultado) {
+        case RESULTADO_OK: return "Operacao realizada com sucesso";
+        case ERRO_USUARIO_NAO_ENCONTRADO: return "Usuario nao encontrado";
+        case ERRO_LIVRO_NAO_ENCONTRADO: return "Livro nao encontrado";
+        case ERRO_EMPRESTIMO_NAO_ENCONTRADO: return "Emprestimo ativo nao encontrado";
+        case ERRO_SEM_EXEMPLARES: return "Todos os exemplares do livro estao emprestados";
+        case ERRO_LIMITE_USUARIO: return "Usuario atingiu o limite de emprestimos simultaneos";
+        case ERRO_LIMITE_RENOVACOES: return "Emprestimo atingiu o limite de renovacoes";
+        case ERRO_CAPACIDADE: return "Limite maximo de registros atingido";
+        case ERRO_RESERVA_DUPLICADA: return "Usuario ja esta na fila deste livro";
+        case ERRO_LIVRO_DISPONIVEL: return "O livro tem exemplares disponiveis";
+        case ERRO_LIVRO_RESERVADO: return "O exemplar disponivel esta reservado para a fila do livro";
+        case ERRO_DADOS_INVALIDOS: return "Dados invalidos";
+        case ERRO_UNIDADE_DUPLICADA: return "Ja existe uma unidade com este nome";
+        case ERRO_GRAVACAO: return "Nao foi possivel gravar os arquivos";
+    }
+    return "Erro desconhecido";
+}
+
+// --- PARTE 3: FUNÇÕES MODULARES (CADASTRO) ---
+
+// Campos de texto não podem conter o separador dos arquivos nem quebras de linha
+bool texto_valido(const char *texto) {
+    return strpbrk(texto, ";\r\n") == NULL;
+}
+
+// Cadastra um livro a partir de título, autor, editora, ano e total de exemplares de 'dados'.
+// Código, disponibilidade e status são definidos aqui; o livro cadastrado vai para 'resultado'.
+ResultadoOperacao api_cadastrar_livro(const Livro *dados, Livro *resultado) {
+    if (dados->ano_publicacao <= 0 || dados->total_exemplares <= 0 ||
+        !texto_valido(dados->titulo) || !texto_valido(dados->autor) || !texto_valido(dados->editora)) {
+        return ERRO_DADOS_INVALIDOS;
+    }
+
+    Livro novo_livro = *dados;
+    atomic_store(&novo_livro.exemplares_disponiveis, novo_livro.total_exemplares);
+    strcpy(novo_livro.status, "DISPONIVEL");
+
+    // Inclusão exige acesso exclusivo ao acervo (o limite é verificado sob a trava)
+    pthread_rwlock_wrlock(&trava_acervo);
+    novo_livro.codigo = total_livros < MAX_LIVROS ? gerar_id(&proximo_livro_id) : -1;
+    if (novo_livro.codigo == -1) {
+        pthread_rwlock_unlock(&trava_acervo);
+        return ERRO_CAPACIDADE;
+    }
+    acervo_livros[total_livros] = novo_livro;
+    mapa_inserir(&mapa_livros, novo_livro.codigo, total_livros);
+    classificar_registro_agregado(AGREGADO_EDITORA, total_livros);
+    marcar_livro_alterado(total_livros);
+    total_livros++;
+    pthread_rwlock_unlock(&trava_acervo);
+
+    if (resultado != NULL) {
+        *resultado = novo_livro;
+    }
+    return RESULTADO_OK;
+}
+
+// Cadastra um usuário a partir de nome, curso e telefone de 'dados'.
+// Matrícula e data de cadastro são definidas aqui; o usuário cadastrado vai para 'resultado'.
+ResultadoOperacao api_cadastrar_usuario(const Usuario *dados, Usuario *resultado) {
+    if (!texto_valido(dados->nome) || !texto_valido(dados->curso) || !texto_valido(dados->telefone)) {
+        return ERRO_DADOS_INVALIDOS;
+    }
+    Usuario novo_usuario = *dados;
+    novo_usuario.data_cadastro = data_atual(); // Data de cadastro é a data atual
+
+    // Inclusão exige acesso exclusivo à lista de usuários
+    pthread_rwlock_wrlock(&trava_usuarios);
+    novo_usuario.matricula = total_usuarios < MAX_USUARIOS ? gerar_id(&proximo_usuario_id) : -1;
+    if (novo_usuario.matricula == -1) {
+        pthread_rwlock_unlock(&trava_usuarios);
+        return ERRO_CAPACIDADE;
+    }
+    lista_usuarios[total_usuarios] = novo_usuario;
+    mapa_inserir(&mapa_usuarios, novo_usuario.matricula, total_usuarios);
+    compilar_regra_usuario(total_usuarios);
+    classificar_registro_agregado(AGREGADO_CURSO, total_usuarios);
+    atomic_store(&emprestimos_ativos_usuario[total_usuarios], 0);
+    marcar_usuario_alterado(total_usuarios);
+    total_usuarios++;
+    pthread_rwlock_unlock(&trava_usuarios);
+
+    if (resultado != NULL) {
+        *resultado = novo_usuario;
+    }
+    return RESULTADO_OK;
+}
+
+// Função para cadastrar livros
+void cadastrar_livro() {
+    if (total_livros >= MAX_LIVROS) {
+        printf("\n[ERRO] O acervo atingiu o limite maximo de %d livros.\n", MAX_LIVROS);
+        return;
+    }
+
+    Livro novo_livro;
+
+    printf("\n--- Cadastro de Novo Livro ---\n");
+
+    printf("Titulo (max %d): ", TAM_TITULO);
+    ler_string(novo_livro.titulo, TAM_TITULO);
+
+    printf("Autor (max %d): ", TAM_AUTOR);
+    ler_string(novo_livro.autor, TAM_AUTOR);
+
+    printf("Editora (max %d): ", TAM_EDITORA);
+    ler_string(novo_livro.editora, TAM_EDITORA);
+
+    // Validação de entrada: Ano de publicacao
+    do {
+        printf("Ano de publicacao (ex: 2023): ");
+        if (scanf("%d", &novo_livro.ano_publicacao) != 1 || novo_livro.ano_publicacao <= 0) {
+            printf("[ERRO] Entrada invalida. Por favor, insira um ano valido.\n");
+            limpar_buffer();
+        } else {
+            break;
+        }
+    } while (true);
+
+    // Validação de entrada: Total de exemplares
+    do {
+        printf("Numero TOTAL de exemplares: ");
+        if (scanf("%d", &novo_livro.total_exemplares) != 1 || novo_livro.total_exemplares <= 0) {
+            printf("[ERRO] Entrada invalida. Por favor, insira um numero positivo de exemplares.\n");
+            limpar_buffer();
+        } else {
+            break;
+        }
+    } while (true);
+    limpar_buffer(); // Limpar buffer após scanf final
+
+    ResultadoOperacao r = api_cadastrar_livro(&novo_livro, &novo_livro);
+    if (r == ERRO_CAPACIDADE) {
+        printf("\n[ERRO] O acervo atingiu o limite maximo de %d livros.\n", MAX_LIVROS);
+        return;
+    } else if (r != RESULTADO_OK) {
+        printf("\n[ERRO] %s: os campos nao podem conter ';'.\n", descrever_resultado(r));
+        return;
+    }
+
+    printf("\n[SUCESSO] Livro '%s' cadastrado com codigo %d.\n", novo_livro.titulo, novo_livro.codigo);
+}
+
+// Função para cadastrar usuários
+void cadastrar_usuario() {
+    if (total_usuarios >= MAX_USUARIOS) {
+        printf("\n[ERRO] A lista de usuarios atingiu o limite maximo de %d usuarios.\n", MAX_USUARIOS);
+        return;
+    }
+
+    Usuario novo_usuario;
+
+    printf("\n--- Cadastro de Novo Usuario ---\n");
+
+    printf("Nome completo (max %d): ", TAM_NOME);
+    ler_string(novo_usuario.nome, TAM_NOME);
+
+    printf("Curso (max %d): ", TAM_CURSO);
+    ler_string(novo_usuario.curso, TAM_CURSO);
+
+    printf("Telefone (max %d): ", TAM_TELEFONE);
+    ler_string(novo_usuario.telefone, TAM_TELEFONE);
+
+    ResultadoOperacao r = api_cadastrar_usuario(&novo_usuario, &novo_usuario);
+    if (r == ERRO_CAPACIDADE) {
+        printf("\n[ERRO] A lista de usuarios atingiu o limite maximo de %d usuarios.\n", MAX_USUARIOS);
+        return;
+    } else if (r != RESULTADO_OK) {
+        printf("\n[ERRO] %s: os campos nao podem conter ';'.\n", descrever_resultado(r));
+        return;
+    }
+
+    printf("\n[SUCESSO] Usuario '%s' cadastrado com matricula %d em %d/%d/%d.\n",
+           novo_usuario.nome, novo_usuario.matricula,
+           novo_usuario.data_cadastro.dia, novo_usuario.data_cadastro.mes, novo_usuario.data_cadastro.ano);
+}
+
+// --- PARTE 3: FUNÇÕES MODULARES (EMPRÉSTIMOS) ---
+
+// Acrescenta o empréstimo ao vetor e ao índice, gerando seu código. Retorna a posição ou -1
+// se o vetor estiver cheio ou a faixa de códigos acabou (chamador deve ter trava de leitura
+// nos cadastros)
+int registrar_emprestimo(Emprestimo *novo) {
+    // Reserva a próxima posição do vetor; leitores só enxergam o registro após total_emprestimos avançar
+    pthread_mutex_lock(&trava_insercao_emprestimos);
+    int codigo = total_emprestimos < MAX_EMPRESTIMOS ? gerar_id(&proximo_emprestimo_id) : -1;
+    if (codigo == -1) {
+        pthread_mutex_unlock(&trava_insercao_emprestimos);
+        return -1;
+    }
+    int pos = total_emprestimos;
+    novo->codigo_emprestimo = codigo;
+    lista_emprestimos[pos] = *novo;
+    pthread_rwlock_wrlock(&trava_mapa_emprestimos);
+    mapa_inserir(&mapa_emprestimos, novo->codigo_emprestimo, pos);
+    pthread_rwlock_unlock(&trava_mapa_emprestimos);
+    marcar_emprestimo_alterado(pos);
+    total_emprestimos++;
+    pthread_mutex_unlock(&trava_insercao_emprestimos);
+    agregar_emprestimo(novo);
+    return pos;
+}
+
+// Coloca o usuário na fila de reserva de um livro sem exemplares na estante. A reserva
+// criada vai para 'resultado' e a posição na fila (1 = próximo da vez) para 'posicao'.
+ResultadoOperacao api_reservar_livro(int matricula, int codigo_livro, Reserva *resultado, int *posicao) {
+    travar_leitura_cadastros();
+    int idx_usuario = buscar_usuario_por_matricula(matricula);
+    int idx_livro = buscar_livro_por_codigo(codigo_livro);
+    if (idx_usuario == -1 || idx_livro == -1) {
+        destravar_cadastros();
+        return idx_usuario == -1 ? ERRO_USUARIO_NAO_ENCONTRADO : ERRO_LIVRO_NAO_ENCONTRADO;
+    }
+
+    // A fila e a contagem de exemplares são conferidas sob a trava do livro, a mesma usada
+    // pela devolução: assim nenhum exemplar volta à estante enquanto há alguém na fila
+    pthread_mutex_t *trava_livro = trava_do_livro(codigo_livro);
+    pthread_mutex_lock(trava_livro);
+
+    // Exemplar na estante com fila formada (a fila não pôde recebê-lo) pertence à fila: quem
+    // chega entra nela em vez de ser mandado ao empréstimo, que o recusaria
+    ResultadoOperacao r = RESULTADO_OK;
+    int posicao_fila = 1;
+    if (atomic_load(&acervo_livros[idx_livro].exemplares_disponiveis) > 0 && inicio_fila_reservas[idx_livro] == -1) {
+        r = ERRO_LIVRO_DISPONIVEL;
+    } else {
+        // Percorre só a fila deste livro para evitar reserva duplicada e calcular a posição
+        for (int i = inicio_fila_reservas[idx_livro]; i != -1; i = lista_reservas[i].proxima) {
+            if (lista_reservas[i].matricula_usuario == matricula) {
+                r = ERRO_RESERVA_DUPLICADA;
+                break;
+            }
+            posicao_fila++;
+        }
+    }
+
+    if (r == RESULTADO_OK) {
+        pthread_mutex_lock(&trava_insercao_reservas);
+        int codigo = total_reservas < MAX_RESERVAS ? gerar_id(&proximo_reserva_id) : -1;
+        if (codigo == -1) {
+            r = ERRO_CAPACIDADE;
+        } else {
+            int pos = total_reservas;
+            Reserva *nova = &lista_reservas[pos];
+            nova->codigo_reserva = codigo;
+            nova->matricula_usuario = matricula;
+            nova->codigo_livro = codigo_livro;
+            nova->data_reserva = data_atual();
+            strcpy(nova->status, "PENDENTE");
+            marcar_reserva_alterado(pos);
+            total_reservas++;
+            enfileirar_reserva(idx_livro, pos);
+            if (resultado != NULL) {
+                *resultado = *nova;
+            }
+        }
+        pthread_mutex_unlock(&trava_insercao_reservas);
+    }
+
+    pthread_mutex_unlock(trava_livro);
+    destravar_cadastros();
+
+    if (posicao != NULL) {
+        *posicao = posicao_fila;
+    }
+    return r;
+}
+
+// Entrega o exemplar devolvido ao primeiro da fila do livro, criando o empréstimo dele.
+// Quem já está no limite de empréstimos perde a vez e tem a reserva cancelada ('canceladas'
+// conta quantas). Retorna a posição da reserva atendida ou -1 se ninguém pôde recebê-lo
+// (chamador deve ter trava de leitura nos cadastros e a trava do livro)
+int atender_proxima_reserva(int idx_livro, Emprestimo *novo, int *canceladas) {
+    while (inicio_fila_reservas[idx_livro] != -1) {
+        int idx_reserva = inicio_fila_reservas[idx_livro];
+        Reserva *reserva = &lista_reservas[idx_reserva];
+        int idx_usuario = buscar_usuario_por_matricula(reserva->matricula_usuario);
+        RegraEmprestimo regra = regra_padrao;
+        if (idx_usuario != -1) {
+            regra = regra_efetiva(idx_usuario, reserva->codigo_livro);
+        }
+
+        if (idx_usuario == -1 || !reservar_vaga_usuario(idx_usuario, regra.limite_emprestimos)) {
+            desenfileirar_reserva(idx_livro);
+            strcpy(reserva->status, "CANCELADA");
+            marcar_reserva_alterado(idx_reserva);
+            (*canceladas)++;
+            continue;
+        }
+
+        novo->matricula_usuario = reserva->matricula_usuario;
+        novo->codigo_livro = reserva->codigo_livro;
+        novo->data_emprestimo = data_atual();
+        novo->data_prevista_devolucao = calcular_data_devolucao(novo->data_emprestimo, regra.dias_emprestimo);
+        strcpy(novo->status, "ATIVO");
+        novo->renovacoes = 0;
+        novo->data_devolucao = DATA_INDEFINIDA;
+
+        // Sem espaço para o empréstimo, a reserva continua pendente e o exemplar vai para a
+        // estante, guardado para o início da fila (ver api_realizar_emprestimo)
+        if (registrar_emprestimo(novo) == -1) {
+            liberar_vaga_usuario(idx_usuario);
+            return -1;
+        }
+        desenfileirar_reserva(idx_livro);
+        strcpy(reserva->status, "ATENDIDA");
+        marcar_reserva_alterado(idx_reserva);
+        return idx_reserva;
+    }
+    return -1;
+}
+
+// Empresta um exemplar do livro ao usuário, com prazo da política vigente.
+// O empréstimo criado (com código e data prevista) vai para 'resultado'.
+ResultadoOperacao api_realizar_emprestimo(int matricula, int codigo_livro, Emprestimo *resultado) {
+    long long inicio = agora_ns();
+    ResultadoOperacao r = RESULTADO_OK;
+
+    // Registro: vaga do usuário e exemplar são retirados por CAS, sem trava global
+    travar_leitura_com_hoje_na_serie();
+    int idx_usuario = buscar_usuario_por_matricula(matricula);
+    int idx_livro = buscar_livro_por_codigo(codigo_livro);
+    if (idx_usuario == -1) {
+        r = ERRO_USUARIO_NAO_ENCONTRADO;
+    } else if (idx_livro == -1) {
+        r = ERRO_LIVRO_NAO_ENCONTRADO;
+    } else {
+        // Política vigente para o par usuário/livro (consulta em tempo constante)
+        RegraEmprestimo regra = regra_efetiva(idx_usuario, codigo_livro);
+
+        Emprestimo novo_emprestimo;
+        novo_emprestimo.matricula_usuario = matricula;
+        novo_emprestimo.codigo_livro = codigo_livro;
+        novo_emprestimo.data_emprestimo = data_atual();
+        novo_emprestimo.data_prevista_devolucao = calcular_data_devolucao(novo_emprestimo.data_emprestimo, regra.dias_emprestimo);
+        strcpy(novo_emprestimo.status, "ATIVO");
+        novo_emprestimo.renovacoes = 0;
+        novo_emprestimo.data_devolucao = DATA_INDEFINIDA;
+
+        // Com fila formada, um exemplar na estante é de quem está no início dela (a devolução
+        // o deixa ali quando não consegue criar o empréstimo do próximo da vez): só essa pessoa
+        // o leva. Conferido sob a trava do livro, a mesma da devolução e da reserva.
+        pthread_mutex_t *trava_livro = trava_do_livro(codigo_livro);
+        pthread_mutex_lock(trava_livro);
+        int idx_reserva = inicio_fila_reservas[idx_livro];
+        if (idx_reserva != -1 && lista_reservas[idx_reserva].matricula_usuario != matricula) {
+            r = ERRO_LIVRO_RESERVADO;
+        } else if (!reservar_vaga_usuario(idx_usuario, regra.limite_emprestimos)) {
+            r = ERRO_LIMITE_USUARIO;
+        } else if (!reservar_exemplar(&acervo_livros[idx_livro])) {
+            liberar_vaga_usuario(idx_usuario);
+            r = ERRO_SEM_EXEMPLARES;
+        } else if (registrar_emprestimo(&novo_emprestimo) == -1) {
+            devolver_exemplar(&acervo_livros[idx_livro]); // Desfaz a retirada do exemplar e da vaga
+            liberar_vaga_usuario(idx_usuario);
+            r = ERRO_CAPACIDADE;
+        } else {
+            marcar_livro_alterado(idx_livro);
+            if (idx_reserva != -1) { // Quem estava no início da fila foi atendido
+                desenfileirar_reserva(idx_livro);
+                strcpy(lista_reservas[idx_reserva].status, "ATENDIDA");
+                marcar_reserva_alterado(idx_reserva);
+            }
+            if (resultado != NULL) {
+                *resultado = novo_emprestimo;
+            }
+        }
+        pthread_mutex_unlock(trava_livro);
+    }
+    destravar_cadastros();
+
+    registrar_latencia(OP_EMPRESTIMO, inicio);
+    return r;
+}
+
+// Resultado de uma devolução: o empréstimo encerrado e, se havia fila, o empréstimo
+// criado para o próximo da vez
+typedef struct {
+    Emprestimo emprestimo;         // Empréstimo devolvido (status já DEVOLVIDO)
+    bool em_atraso;
+    bool reserva_atendida;         // O exemplar foi direto para quem o reservou
+    int codigo_reserva;
+    Emprestimo emprestimo_reserva; // Válido quando reserva_atendida
+    int reservas_canceladas;       // Reservas de usuários no limite, retiradas da fila
+} ResultadoDevolucao;
+
+// Encerra o empréstimo ativo e libera o exemplar (ou o entrega ao próximo da fila)
+ResultadoOperacao api_realizar_devolucao(int codigo_emprestimo, ResultadoDevolucao *resultado) {
+    long long inicio = agora_ns();
+    ResultadoDevolucao devolucao;
+    memset(&devolucao, 0, sizeof(devolucao));
+
+    travar_leitura_com_hoje_na_serie();
+
+    // Busca o empréstimo (o status muda sob a trava do livro e só é conferido com ela)
+    int idx_emprestimo = buscar_emprestimo_por_codigo(codigo_emprestimo);
+    if (idx_emprestimo == -1) {
+        destravar_cadastros();
+        registrar_latencia(OP_DEVOLUCAO, inicio);
+        return ERRO_EMPRESTIMO_NAO_ENCONTRADO;
+    }
+
+    // O registro do empréstimo é protegido pela trava do livro ao qual se refere
+    pthread_mutex_t *trava_livro = trava_do_livro(lista_emprestimos[idx_emprestimo].codigo_livro);
+    pthread_mutex_lock(trava_livro);
+
+    // Só empréstimos ativos são devolvidos (outro balcão pode tê-lo devolvido antes)
+    if (strcmp(lista_emprestimos[idx_emprestimo].status, "ATIVO") != 0) {
+        pthread_mutex_unlock(trava_livro);
+        destravar_cadastros();
+        registrar_latencia(OP_DEVOLUCAO, inicio);
+        return ERRO_EMPRESTIMO_NAO_ENCONTRADO;
+    }
+
+    // Marca como DEVOLVIDO
+    strcpy(lista_emprestimos[idx_emprestimo].status, "DEVOLVIDO");
+    lista_emprestimos[idx_emprestimo].data_devolucao = data_atual();
+    marcar_emprestimo_alterado(idx_emprestimo);
+    agregar_devolucao(&lista_emprestimos[idx_emprestimo]);
+
+    // Libera a vaga do usuário no limite de empréstimos simultâneos
+    int idx_usuario = buscar_usuario_por_matricula(lista_emprestimos[idx_emprestimo].matricula_usuario);
+    if (idx_usuario != -1) {
+        liberar_vaga_usuario(idx_usuario);
+    }
+
+    // Atualiza o acervo de livros: havendo fila, o exemplar vai direto para o próximo da vez
+    int idx_livro = buscar_livro_por_codigo(lista_emprestimos[idx_emprestimo].codigo_livro);
+    if (idx_livro != -1) {
+        int idx_reserva = atender_proxima_reserva(idx_livro, &devolucao.emprestimo_reserva, &devolucao.reservas_canceladas);
+        if (idx_reserva == -1) {
+            devolver_exemplar(&acervo_livros[idx_livro]);
+        } else {
+            devolucao.reserva_atendida = true;
+            devolucao.codigo_reserva = lista_reservas[idx_reserva].codigo_reserva;
+        }
+        marcar_livro_alterado(idx_livro);
+    }
+
+    devolucao.emprestimo = lista_emprestimos[idx_emprestimo];
+    pthread_mutex_unlock(trava_livro);
+    destravar_cadastros();
+
+    // Verifica Atraso
+    devolucao.em_atraso = comparar_datas(devolucao.emprestimo.data_devolucao, devolucao.emprestimo.data_prevista_devolucao) > 0;
+    registrar_latencia(OP_DEVOLUCAO, inicio);
+
+    if (resultado != NULL) {
+        *resultado = devolucao;
+    }
+    return RESULTADO_OK;
+}
+
+// Estende o prazo do empréstimo ativo conforme a política vigente. O empréstimo atualizado
+// vai para 'resultado' e a regra aplicada (prazo e limite de renovações) para 'regra_aplicada'.
+ResultadoOperacao api_renovar_emprestimo(int codigo_emprestimo, Emprestimo *resultado, RegraEmprestimo *regra_aplicada) {
+    long long inicio = agora_ns();
+    travar_leitura_cadastros();
+
+    // Busca o empréstimo (status conferido sob a trava do livro, como na devolução)
+    int idx_emprestimo = buscar_emprestimo_por_codigo(codigo_emprestimo);
+    if (idx_emprestimo == -1) {
+        destravar_cadastros();
+        registrar_latencia(OP_RENOVACAO, inicio);
+        return ERRO_EMPRESTIMO_NAO_ENCONTRADO;
+    }
+
+    pthread_mutex_t *trava_livro = trava_do_livro(lista_emprestimos[idx_emprestimo].codigo_livro);
+    pthread_mutex_lock(trava_livro);
+
+    ResultadoOperacao r = RESULTADO_OK;
+    RegraEmprestimo regra = regra_padrao;
+    if (strcmp(lista_emprestimos[idx_emprestimo].status, "ATIVO") != 0) {
+        r = ERRO_EMPRESTIMO_NAO_ENCONTRADO;
+    } else {
+        // Prazo e limite de renovações vêm da política do usuário/livro
+        int idx_usuario = buscar_usuario_por_matricula(lista_emprestimos[idx_emprestimo].matricula_usuario);
+        if (idx_usuario != -1) {
+            regra = regra_efetiva(idx_usuario, lista_emprestimos[idx_emprestimo].codigo_livro);
+        }
+        if (lista_emprestimos[idx_emprestimo].renovacoes >= regra.limite_renovacoes) {
+            r = ERRO_LIMITE_RENOVACOES;
+        } else {
+            // Nova data de devolução a partir da data prevista anterior
+            lista_emprestimos[idx_emprestimo].data_prevista_devolucao =
+                calcular_data_devolucao(lista_emprestimos[idx_emprestimo].data_prevista_devolucao, regra.dias_emprestimo);
+            lista_emprestimos[idx_emprestimo].renovacoes++;
+            marcar_emprestimo_alterado(idx_emprestimo);
+        }
+        if (resultado != NULL) {
+            *resultado = lista_emprestimos[idx_emprestimo];
+        }
+    }
+
+    pthread_mutex_unlock(trava_livro);
+    destravar_cadastros();
+    registrar_latencia(OP_RENOVACAO, inicio);
+
+    if (regra_aplicada != NULL) {
+        *regra_aplicada = regra;
+    }
+    return r;
+}
+
+// Exibe o resultado de api_reservar_livro() no formato dos menus
+void exibir_resultado_reserva(ResultadoOperacao r, const Reserva *reserva, int posicao) {
+    switch (r) {
+        case RESULTADO_OK: {
+            travar_leitura_cadastros();
+            int idx_livro = buscar_livro_por_codigo(reserva->codigo_livro);
+            int idx_usuario = buscar_usuario_por_matricula(reserva->matricula_usuario);
+            printf("\n[SUCESSO] Reserva %d registrada:\n", reserva->codigo_reserva);
+            printf("  Livro: %s\n", idx_livro != -1 ? acervo_livros[idx_livro].titulo : "?");
+            printf("  Usuario: %s\n", idx_usuario != -1 ? lista_usuarios[idx_usuario].nome : "?");
+            printf("  Posicao na fila: %d\n", posicao);
+            destravar_cadastros();
+            break;
+        }
+        case ERRO_RESERVA_DUPLICADA:
+            printf("[ERRO] O usuario ja esta na fila deste livro (posicao %d).\n", posicao);
+            break;
+        case ERRO_LIVRO_DISPONIVEL:
+            printf("[ERRO] O livro tem exemplares disponiveis. Realize o emprestimo.\n");
+            break;
+        case ERRO_CAPACIDADE:
+            printf("\n[ERRO] O limite maximo de %d reservas foi atingido.\n", MAX_RESERVAS);
+            break;
+        default:
+            printf("[ERRO] %s.\n", descrever_resultado(r));
+    }
+}
+
+// Função para reservar livro (entrar na fila de espera)
+void reservar_livro() {
+    int mat, cod;
+
+    printf("\n--- Reservar Livro ---\n");
+    printf("Matricula do usuario: ");
+    if (scanf("%d", &mat) != 1) {
+        printf("[ERRO] Entrada invalida. Digite um numero.\n");
+        limpar_buffer();
+        return;
+    }
+    limpar_buffer();
+
+    printf("Codigo do livro: ");
+    if (scanf("%d", &cod) != 1) {
+        printf("[ERRO] Entrada invalida. Digite um numero.\n");
+        limpar_buffer();
+        return;
+    }
+    limpar_buffer();
+
+    Reserva reserva;
+    int posicao;
+    ResultadoOperacao r = api_reservar_livro(mat, cod, &reserva, &posicao);
+    if (r == ERRO_USUARIO_NAO_ENCONTRADO) {
+        printf("[ERRO] Usuario com matricula %d nao encontrado.\n", mat);
+    } else if (r == ERRO_LIVRO_NAO_ENCONTRADO) {
+        printf("[ERRO] Livro com codigo %d nao encontrado.\n", cod);
+    } else {
+        exibir_resultado_reserva(r, &reserva, posicao);
+    }
+}
+
+// Função para realizar empréstimo
+void realizar_emprestimo() {
+    if (total_emprestimos >= MAX_EMPRESTIMOS) {
+        printf("\n[ERRO] O limite maximo de emprestimos foi atingido.\n");
+        return;
+    }
+
+    int mat, cod;
+    int idx_usuario, idx_livro;
+
+    printf("\n--- Realizar Emprestimo ---\n");
+
+    // Validação de Matrícula
+    do {
+        printf("Matricula do usuario: ");
+        if (scanf("%d", &mat) != 1) {
+            printf("[ERRO] Entrada invalida. Digite um numero.\n");
+            limpar_buffer();
+            continue;
+        }
+        limpar_buffer();
+
+        pthread_rwlock_rdlock(&trava_usuarios);
+        idx_usuario = buscar_usuario_por_matricula(mat);
+        pthread_rwlock_unlock(&trava_usuarios);
+        if (idx_usuario == -1) {
+            printf("[ERRO] Usuario com matricula %d nao encontrado.\n", mat);
+        } else {
+            break;
+        }
+    } while (true);
+
+    // Validação de Código do Livro (a disponibilidade é reverificada ao registrar)
+    do {
+        printf("Codigo do livro: ");
+        if (scanf("%d", &cod) != 1) {
+            printf("[ERRO] Entrada invalida. Digite um numero.\n");
+            limpar_buffer();
+            continue;
+        }
+        limpar_buffer();
+
+        pthread_rwlock_rdlock(&trava_acervo);
+        idx_livro = buscar_livro_por_codigo(cod);
+        bool indisponivel = false;
+        if (idx_livro == -1) {
+            printf("[ERRO] Livro com codigo %d nao encontrado.\n", cod);
+        } else if (atomic_load(&acervo_livros[idx_livro].exemplares_disponiveis) <= 0) {
+            printf("[ERRO] Todos os exemplares do livro '%s' estao emprestados.\n", acervo_livros[idx_livro].titulo);
+            indisponivel = true;
+        }
+        pthread_rwlock_unlock(&trava_acervo);
+
+        if (indisponivel) {
+            printf("Deseja entrar na fila de reserva? (S/N): ");
+            char resposta[4];
+            ler_string(resposta, sizeof(resposta));
+            if (resposta[0] == 'S' || resposta[0] == 's') {
+                Reserva reserva;
+                int posicao;
+                ResultadoOperacao r = api_reservar_livro(mat, cod, &reserva, &posicao);
+                exibir_resultado_reserva(r, &reserva, posicao);
+                return;
+            }
+            idx_livro = -1; // Força a nova tentativa ou saída
+        }
+    } while (idx_livro == -1);
+
+    Emprestimo novo_emprestimo;
+    ResultadoOperacao r = api_realizar_emprestimo(mat, cod, &novo_emprestimo);
+    switch (r) {
+        case RESULTADO_OK:
+            break;
+        case ERRO_LIMITE_USUARIO:
+            printf("[ERRO] O usuario '%s' atingiu o limite de %d emprestimo(s) simultaneo(s).\n",
+                   lista_usuarios[idx_usuario].nome, regra_efetiva(idx_usuario, cod).limite_emprestimos);
+            return;
+        case ERRO_SEM_EXEMPLARES: // Outro balcão pode ter levado o último exemplar desde a validação
+            printf("[ERRO] Todos os exemplares do livro '%s' estao emprestados.\n", acervo_livros[idx_livro].titulo);
+            return;
+        case ERRO_LIVRO_RESERVADO:
+            printf("[ERRO] O exemplar disponivel de '%s' esta reservado para a fila. Use a opcao de reserva.\n",
+                   acervo_livros[idx_livro].titulo);
+            return;
+        case ERRO_CAPACIDADE:
+            printf("\n[ERRO] O limite maximo de emprestimos foi atingido.\n");
+            return;
+        default:
+            printf("[ERRO] %s.\n", descrever_resultado(r));
+            return;
+    }
+
+    // Título e nome não mudam depois de cadastrados, então podem ser lidos sem trava
+    printf("\n[SUCESSO] Emprestimo %d registrado:\n", novo_emprestimo.codigo_emprestimo);
+    printf("  Livro: %s\n", acervo_livros[idx_livro].titulo);
+    printf("  Usuario: %s\n", lista_usuarios[idx_usuario].nome);
+    printf("  Data Emprestimo: %d/%d/%d\n", novo_emprestimo.data_emprestimo.dia, novo_emprestimo.data_emprestimo.mes, novo_emprestimo.data_emprestimo.ano);
+    printf("  Data Prevista Devolucao: %d/%d/%d (%d dias)\n", novo_emprestimo.data_prevista_devolucao.dia, novo_emprestimo.data_prevista_devolucao.mes, novo_emprestimo.data_prevista_devolucao.ano, regra_efetiva(idx_usuario, cod).dias_emprestimo);
+}
+
+// Função para realizar devolução
+void realizar_devolucao() {
+    int cod_emp;
+
+    printf("\n--- Realizar Devolucao ---\n");
+    printf("Codigo do emprestimo a ser devolvido: ");
+    if (scanf("%d", &cod_emp) != 1) {
+        printf("[ERRO] Entrada invalida. Digite um numero.\n");
+        limpar_buffer();
+        return;
+    }
+    limpar_buffer();
+
+    ResultadoDevolucao devolucao;
+    if (api_realizar_devolucao(cod_emp, &devolucao) != RESULTADO_OK) {
+        printf("[ERRO] Emprestimo ativo com codigo %d nao encontrado.\n", cod_emp);
+        return;
+    }
+
+    printf("\n[SUCESSO] Devolucao do emprestimo %d registrada.\n", cod_emp);
+    if (devolucao.em_atraso) {
+        printf("[ATENCAO] Devolucao realizada com atraso!\n");
+    } else {
+        printf("[INFO] Devolucao realizada no prazo.\n");
+    }
+
+    if (devolucao.reservas_canceladas > 0) {
+        printf("[AVISO] %d reserva(s) cancelada(s): usuario(s) no limite de emprestimos.\n", devolucao.reservas_canceladas);
+    }
+    if (devolucao.reserva_atendida) {
+        const Emprestimo *e = &devolucao.emprestimo_reserva;
+        printf("[RESERVA] Exemplar entregue ao usuario %d (reserva %d): emprestimo %d ate %d/%d/%d.\n",
+               e->matricula_usuario, devolucao.codigo_reserva, e->codigo_emprestimo,
+               e->data_prevista_devolucao.dia, e->data_prevista_devolucao.mes, e->data_prevista_devolucao.ano);
+    }
+}
+
+// Função para renovação de empréstimos (PARTE 5)
+void renovar_emprestimo() {
+    int cod_emp;
+
+    printf("\n--- Renovar Emprestimo ---\n");
+    printf("Codigo do emprestimo a ser renovado: ");
+    if (scanf("%d", &cod_emp) != 1) {
+        printf("[ERRO] Entrada invalida. Digite um numero.\n");
+        limpar_buffer();
+        return;
+    }
+    limpar_buffer();
+
+    Emprestimo emprestimo;
+    RegraEmprestimo regra;
+    ResultadoOperacao r = api_renovar_emprestimo(cod_emp, &emprestimo, &regra);
+    if (r == ERRO_LIMITE_RENOVACOES) {
+        printf("[ERRO] Emprestimo %d ja atingiu o limite de %d renovacao(oes).\n", cod_emp, regra.limite_renovacoes);
+        return;
+    }
+    if (r != RESULTADO_OK) {
+        printf("[ERRO] Emprestimo ativo com codigo %d nao encontrado.\n", cod_emp);
+        return;
+    }
+
+    Data nova_data = emprestimo.data_prevista_devolucao;
+    printf("\n[SUCESSO] Emprestimo %d renovado por mais %d dias.\n", cod_emp, regra.dias_emprestimo);
+    printf("  Nova Data Prevista Devolucao: %d/%d/%d\n", nova_data.dia, nova_data.mes, nova_data.ano);
+}
+
+
+// --- SAÍDA DE RELATÓRIOS E PESQUISAS ---
+
+// Relatórios e pesquisas não chamam printf linha a linha: montam o texto em um buffer grande
+// e o entregam ao terminal (ou ao pipe) em blocos. A mesma sequência de campos pode sair
+// como tabela, registro (';' como nos arquivos), CSV ou JSON Lines, e só a janela pedida
+// (deslocamento/limite) é escrita. Na tabela interativa a saída pode pausar a cada página.
+typedef enum {
+    FORMATO_TABELA = 0,
+    FORMATO_REGISTRO,
+    FORMATO_CSV,
+    FORMATO_JSONL,
+    NUM_FORMATOS
+} FormatoSaida;
+
+const char *const nomes_formatos[NUM_FORMATOS] = {"table", "record", "csv", "jsonl"};
+
+// Ordem das linhas nas listagens (ver ORDENAÇÃO DAS LISTAGENS); cada listagem aceita só as
+// ordens que fazem sentido para ela e usa a sua ordem natural nas demais
+typedef enum {
+    ORDEM_CADASTRO = 0, // Ordem natural da listagem (cadastro; contagem no ranking)
+    ORDEM_TITULO,
+    ORDEM_AUTOR,
+    ORDEM_DEVOLUCAO,    // Data prevista de devolução, a mais próxima primeiro
+    ORDEM_USUARIO,      // Nome do usuário
+    ORDEM_CONTAGEM,     // Total de empréstimos, o maior primeiro
+    NUM_ORDENS
+} OrdemListagem;
+
+const char *const nomes_ordens[NUM_ORDENS] = {"insertion", "title", "author", "due", "user", "count"};
+
+#define ORDEM(o) (1u << (o)) // Conjuntos de ordens aceitas por uma listagem
+
+typedef struct {
+    FormatoSaida formato;
+    int limite;            // Máximo de linhas de dados escritas (0 = todas)
+    int deslocamento;      // Linhas de dados puladas antes da primeira escrita
+    int linhas_por_pagina; // Pausa a cada N linhas na tabela (0 = sem paginação)
+    OrdemListagem ordem;
+} OpcoesSaida;
+
+// Opções em vigor para os próximos relatórios (menu, ambiente ou linha de comando)
+OpcoesSaida opcoes_saida = {FORMATO_TABELA, 0, 0, 0, ORDEM_CADASTRO};
+
+// Nas pesquisas e relatórios de todas as unidades cada linha começa com o nome da unidade
+// de onde veio (ver UNIDADES)
+#define LARGURA_COLUNA_UNIDADE 12
+const char *unidade_na_saida = NULL;
+
+typedef struct {
+    const char *titulo; // Cabeçalho na tabela e no CSV
+    const char *chave;  // Nome do campo no JSON
+    int largura;        // Largura na tabela (negativa = alinhada à esquerda)
+} ColunaSaida;
+
+// --- COLETA DAS LISTAGENS DE TODAS AS UNIDADES ---
+
+// No comando "all" cada unidade é carregada e consultada num processo próprio, com a saída
+// em modo de coleta: em vez de escrever, ela guarda os campos de cada linha e as chaves que
+// a ordenam (saida_chave_*), sem limite nem deslocamento, e as manda ao processo principal.
+// Depois da última unidade as linhas de todas são ordenadas juntas e escritas uma vez, com
+// um só título e cabeçalho; --limit e --offset valem para o conjunto (ver escrever_coleta).
+typedef enum {
+    COLETADO_INTEIRO,
+    COLETADO_DECIMAL,
+    COLETADO_TEXTO,
+    COLETADO_DATA
+} TipoCampoColetado;
+
+typedef struct {
+    TipoCampoColetado tipo;
+    bool definido;  // Decimal com valor
+    int inteiro;
+    double decimal;
+    Data data;
+    size_t texto;   // Posição do texto em 'textos'
+} CampoColetado;
+
+#define SEM_CHAVE_TEXTO ((size_t)-1)
+
+typedef struct {
+    int unidade;
+    int primeiro_campo; // Posição em 'campos'
+    long long chave;    // Ordena antes da chave de texto
+    size_t chave_texto; // Posição em 'textos' ou SEM_CHAVE_TEXTO
+    long long posto;    // Ordem da coluna de posto (ver saida_chave_posto)
+} LinhaColetada;
+
+// Textos da tabela de uma unidade: título (antes do cabeçalho) e totais e avisos (depois)
+typedef struct {
+    char *antes;
+    char *depois;
+    bool com_cabecalho;
+} TextosColetados;
+
+typedef struct {
+    const ColunaSaida *colunas; // Da listagem coletada (a mesma em todas as unidades)
+    int num_colunas;
+    int coluna_posto;           // Coluna renumerada sobre todas as linhas (-1 = nenhuma)
+    int maximo_linhas;          // Corte depois da ordenação (0 = todas)
+    LinhaColetada *linhas;
+    int num_linhas;
+    size_t capacidade_linhas;
+    CampoColetado *campos;
+    int num_campos;
+    size_t capacidade_campos;
+    char *textos;
+    size_t usado_textos;
+    size_t capacidade_textos;
+    TextosColetados *por_unidade; // Um por unidade de unidades.txt
+    int unidade;                  // Unidade em consulta
+    bool sem_memoria;
+} ColetaSaida;
+
+ColetaSaida *coleta_saida = NULL; // Não NULL enquanto o comando "all" consulta uma unidade
+
+// Garante espaço para 'necessario' elementos de 'tamanho' bytes no vetor
+bool coleta_reservar(void **vetor, size_t *capacidade, size_t necessario, size_t tamanho) {
+    if (necessario <= *capacidade) {
+        return true;
+    }
+    size_t nova = *capacidade * 2 > necessario ? *capacidade * 2 : necessario + 64;
+    void *maior = realloc(*vetor, nova * tamanho);
+    if (maior == NULL) {
+        return false;
+    }
+    *vetor = maior;
+    *capacidade = nova;
+    return true;
+}
+
+// Copia o texto para a área de textos; retorna a posição ou SEM_CHAVE_TEXTO se faltou memória
+size_t coleta_guardar_texto(ColetaSaida *c, const char *texto) {
+    size_t n = strlen(texto) + 1;
+    if (!coleta_reservar((void **)&c->textos, &c->capacidade_textos, c->usado_textos + n, 1)) {
+        c->sem_memoria = true;
+        return SEM_CHAVE_TEXTO;
+    }
+    size_t posicao = c->usado_textos;
+    memcpy(c->textos + posicao, texto, n);
+    c->usado_textos += n;
+    return posicao;
+}
+
+// Acrescenta 'texto' ao fim de '*destino'
+void coleta_anexar(ColetaSaida *c, char **destino, const char *texto) {
+    size_t atual = *destino != NULL ? strlen(*destino) : 0;
+    char *maior = realloc(*destino, atual + strlen(texto) + 1);
+    if (maior == NULL) {
+        c->sem_memoria = true;
+        return;
+    }
+    strcpy(maior + atual, texto);
+    *destino = maior;
+}
+
+LinhaColetada *coleta_linha_atual(ColetaSaida *c) {
+    return c->num_linhas > 0 && c->linhas[c->num_linhas - 1].unidade == c->unidade ? &c->linhas[c->num_linhas - 1] : NULL;
+}
+
+// Novo campo na linha atual (NULL se faltou memória)
+CampoColetado *coleta_novo_campo(ColetaSaida *c, TipoCampoColetado tipo) {
+    if (!coleta_reservar((void **)&c->campos, &c->capacidade_campos, (size_t)c->num_campos + 1, sizeof(CampoColetado))) {
+        c->sem_memoria = true;
+        return NULL;
+    }
+    CampoColetado *campo = &c->campos[c->num_campos++];
+    memset(campo, 0, sizeof(*campo));
+    campo->tipo = tipo;
+    return campo;
+}
+
+void liberar_coleta(ColetaSaida *c, int num_unidades) {
+    for (int u = 0; c->por_unidade != NULL && u < num_unidades; u++) {
+        free(c->por_unidade[u].antes);
+        free(c->por_unidade[u].depois);
+    }
+    free(c->por_unidade);
+    free(c->linhas);
+    free(c->campos);
+    free(c->textos);
+}
+
+#define TAM_BUFFER_SAIDA (256 * 1024)
+#define FOLGA_BUFFER_SAIDA 1024 // Espaço livre garantido antes de cada campo
+
+typedef struct {
+    FILE *destino;
+    OpcoesSaida opcoes;
+    const ColunaSaida *colunas;
+    int num_colunas;
+    char *buffer;      // NULL se faltou memória: escreve direto no destino
+    size_t usado;
+    int coluna;        // Próximo campo da linha atual
+    int linhas_recebidas;
+    int linhas_escritas;
+    bool pulando;      // Linha atual fora da janela deslocamento/limite
+    bool interrompida; // Usuário encerrou a listagem na pausa de página
+    ColetaSaida *coleta; // Modo de coleta (comando "all"): nada é escrito
+    bool cabecalho_escrito;
+} SaidaRelatorio;
+
+// Entrega ao destino o que está no buffer
+void saida_descarregar(SaidaRelatorio *s) {
+    if (s->usado > 0) {
+        fwrite(s->buffer, 1, s->usado, s->destino);
+        s->usado = 0;
+    }
+    fflush(s->destino);
+}
+
+// Acrescenta 'n' bytes ao buffer, esvaziando-o quando enche
+void saida_escrever(SaidaRelatorio *s, const char *dados, size_t n) {
+    if (s->buffer == NULL || n > TAM_BUFFER_SAIDA) {
+        if (s->buffer != NULL) {
+            fwrite(s->buffer, 1, s->usado, s->destino);
+            s->usado = 0;
+        }
+        fwrite(dados, 1, n, s->destino);
+        return;
+    }
+    if (TAM_BUFFER_SAIDA - s->usado < n) {
+        fwrite(s->buffer, 1, s->usado, s->destino);
+        s->usado = 0;
+    }
+    memcpy(s->buffer + s->usado, dados, n);
+    s->usado += n;
+}
+
+// Função para escrever texto formatado no buffer da saída
+void saida_formatar(SaidaRelatorio *s, const char *formato, ...) {
+    va_list args;
+    va_start(args, formato);
+    if (s->buffer == NULL) {
+        vfprintf(s->destino, formato, args);
+        va_end(args);
+        return;
+    }
+    if (TAM_BUFFER_SAIDA - s->usado < FOLGA_BUFFER_SAIDA) {
+        fwrite(s->buffer, 1, s->usado, s->destino);
+        s->usado = 0;
+    }
+    va_list copia;
+    va_copy(copia, args);
+    size_t livre = TAM_BUFFER_SAIDA - s->usado;
+    int n = vsnprintf(s->buffer + s->usado, livre, formato, args);
+    if (n >= 0 && (size_t)n < livre) {
+        s->usado += n;
+    } else if (n > 0) {
+        // Texto maior que o espaço livre: esvazia o buffer e escreve direto
+        fwrite(s->buffer, 1, s->usado, s->destino);
+        s->usado = 0;
+        vfprintf(s->destino, formato, copia);
+    }
+    va_end(copia);
+    va_end(args);
+}
+
+void saida_iniciar(SaidaRelatorio *s, FILE *destino, const ColunaSaida *colunas, int num_colunas) {
+    s->destino = destino;
+    s->opcoes = opcoes_saida;
+    s->colunas = colunas;
+    s->num_colunas = num_colunas;
+    s->buffer = malloc(TAM_BUFFER_SAIDA);
+    s->usado = 0;
+    s->coluna = 0;
+    s->linhas_recebidas = 0;
+    s->linhas_escritas = 0;
+    s->pulando = false;
+    s->interrompida = false;
+    s->coleta = coleta_saida;
+    s->cabecalho_escrito = false;
+    if (s->coleta != NULL) {
+        // Todas as linhas da unidade: a janela e a paginação valem para o resultado juntado
+        s->opcoes.limite = 0;
+        s->opcoes.deslocamento = 0;
+        s->opcoes.linhas_por_pagina = 0;
+        s->coleta->colunas = colunas;
+        s->coleta->num_colunas = num_colunas;
+    }
+}
+
+// Chaves que ordenam a linha atual entre as das outras unidades no modo de coleta: primeiro
+// a numérica, depois o texto (sem diferença de maiúsculas e acentos). Linhas sem chave
+// ficam na ordem da unidade, as unidades na ordem de unidades.txt.
+void saida_chave_numero(SaidaRelatorio *s, long long chave) {
+    LinhaColetada *linha = s->coleta != NULL ? coleta_linha_atual(s->coleta) : NULL;
+    if (linha != NULL) {
+        linha->chave = chave;
+    }
+}
+
+void saida_chave_texto(SaidaRelatorio *s, const char *texto) {
+    LinhaColetada *linha = s->coleta != NULL ? coleta_linha_atual(s->coleta) : NULL;
+    if (linha != NULL) {
+        linha->chave_texto = coleta_guardar_texto(s->coleta, texto);
+    }
+}
+
+// A coluna guarda o posto da linha (1 = menor chave); no resultado juntado ele é refeito
+// sobre as linhas de todas as unidades
+void saida_chave_posto(SaidaRelatorio *s, int coluna, long long chave) {
+    LinhaColetada *linha = s->coleta != NULL ? coleta_linha_atual(s->coleta) : NULL;
+    if (linha != NULL) {
+        s->coleta->coluna_posto = coluna;
+        linha->posto = chave;
+    }
+}
+
+// Listagens que já são as 'maximo' primeiras de cada unidade (ex.: sugestões): o resultado
+// juntado também fica só com as 'maximo' primeiras
+void saida_maximo_linhas(SaidaRelatorio *s, int maximo) {
+    if (s->coleta != NULL) {
+        s->coleta->maximo_linhas = maximo;
+    }
+}
+
+// Título, totais e avisos: só fazem parte da tabela (quebrariam CSV e JSON)
+void saida_texto(SaidaRelatorio *s, const char *texto) {
+    if (s->opcoes.formato != FORMATO_TABELA) {
+        return;
+    }
+    if (s->coleta != NULL) {
+        TextosColetados *t = &s->coleta->por_unidade[s->coleta->unidade];
+        coleta_anexar(s->coleta, s->cabecalho_escrito ? &t->depois : &t->antes, texto);
+        return;
+    }
+    saida_formatar(s, "%s", texto);
+}
+
+int largura_tabela(const SaidaRelatorio *s) {
+    int total = unidade_na_saida != NULL ? LARGURA_COLUNA_UNIDADE + 3 : 0;
+    for (int c = 0; c < s->num_colunas; c++) {
+        int largura = abs(s->colunas[c].largura);
+        int titulo = (int)strlen(s->colunas[c].titulo);
+        total += (largura > titulo ? largura : titulo) + (c > 0 ? 3 : 0);
+    }
+    return total;
+}
+
+// Linha de traços da largura da tabela
+void saida_separador(SaidaRelatorio *s) {
+    if (s->opcoes.formato != FORMATO_TABELA || s->coleta != NULL) {
+        return;
+    }
+    char linha[256];
+    int n = largura_tabela(s);
+    if (n > (int)sizeof(linha) - 2) n = (int)sizeof(linha) - 2;
+    memset(linha, '-', n);
+    linha[n] = '\n';
+    linha[n + 1] = '\0';
+    saida_formatar(s, "%s", linha);
+}
+
+// Nomes das colunas (tabela e CSV)
+void saida_cabecalho(SaidaRelatorio *s) {
+    s->cabecalho_escrito = true;
+    if (s->coleta != NULL) {
+        s->coleta->por_unidade[s->coleta->unidade].com_cabecalho = true;
+    } else if (s->opcoes.formato == FORMATO_TABELA) {
+        if (unidade_na_saida != NULL) {
+            saida_formatar(s, "%-*s | ", LARGURA_COLUNA_UNIDADE, "Unidade");
+        }
+        for (int c = 0; c < s->num_colunas; c++) {
+            saida_formatar(s, "%s%*s", c > 0 ? " | " : "", s->colunas[c].largura, s->colunas[c].titulo);
+        }
+        saida_formatar(s, "\n");
+        saida_separador(s);
+    } else if (s->opcoes.formato == FORMATO_CSV) {
+        if (unidade_na_saida != NULL) {
+            saida_formatar(s, "unidade,");
+        }
+        for (int c = 0; c < s->num_colunas; c++) {
+            saida_formatar(s, "%s%s", c > 0 ? "," : "", s->colunas[c].chave);
+        }
+        saida_formatar(s, "\n");
+    }
+}
+
+// Pausa de página: retorna false se o usuário pediu para encerrar a listagem
+bool saida_pausar(SaidaRelatorio *s) {
+    saida_descarregar(s);
+    printf("-- %d linha(s) -- Enter para continuar, q para encerrar: ", s->linhas_escritas);
+    fflush(stdout);
+    char resposta[16];
+    if (fgets(resposta, sizeof(resposta), stdin) == NULL) {
+        return false;
+    }
+    if (strchr(resposta, '\n') == NULL) {
+        limpar_buffer();
+    }
+    return resposta[0] != 'q' && resposta[0] != 'Q';
+}
+
+// Começa uma linha de dados. Retorna false se ela está fora da janela pedida; nesse caso
+// os campos seguintes são ignorados e o chamador pode pular a montagem da linha.
+bool saida_linha(SaidaRelatorio *s) {
+    int recebida = s->linhas_recebidas++;
+    s->coluna = 0;
+    if (s->coleta != NULL) {
+        ColetaSaida *c = s->coleta;
+        if (!coleta_reservar((void **)&c->linhas, &c->capacidade_linhas, (size_t)c->num_linhas + 1, sizeof(LinhaColetada))) {
+            c->sem_memoria = true;
+            s->pulando = true;
+            return false;
+        }
+        LinhaColetada *linha = &c->linhas[c->num_linhas++];
+        linha->unidade = c->unidade;
+        linha->primeiro_campo = c->num_campos;
+        linha->chave = 0;
+        linha->chave_texto = SEM_CHAVE_TEXTO;
+        linha->posto = 0;
+        s->pulando = false;
+        return true;
+    }
+    s->pulando = s->interrompida || recebida < s->opcoes.deslocamento ||
+                 (s->opcoes.limite > 0 && s->linhas_escritas >= s->opcoes.limite);
+    if (s->pulando) {
+        return false;
+    }
+    if (s->opcoes.formato == FORMATO_TABELA && s->opcoes.linhas_por_pagina > 0 &&
+        s->linhas_escritas > 0 && s->linhas_escritas % s->opcoes.linhas_por_pagina == 0 &&
+        !saida_pausar(s)) {
+        s->interrompida = true;
+        s->pulando = true;
+        return false;
+    }
+    if (s->opcoes.formato == FORMATO_JSONL) {
+        saida_escrever(s, "{", 1);
+    }
+    if (unidade_na_saida != NULL) {
+        // Nomes de unidade só têm letras, dígitos, '-' e '_': nenhum formato precisa de escape
+        switch (s->opcoes.formato) {
+            case FORMATO_TABELA:
+                saida_formatar(s, "%-*s | ", LARGURA_COLUNA_UNIDADE, unidade_na_saida);
+                break;
+            case FORMATO_REGISTRO:
+                saida_formatar(s, "%s;", unidade_na_saida);
+                break;
+            case FORMATO_CSV:
+                saida_formatar(s, "%s,", unidade_na_saida);
+                break;
+            default:
+                saida_formatar(s, "\"unidade\":\"%s\",", unidade_na_saida);
+        }
+    }
+    return true;
+}
+
+// Separador e, no JSON, o nome do próximo campo
+void saida_inicio_campo(SaidaRelatorio *s) {
+    int c = s->coluna++;
+    switch (s->opcoes.formato) {
+        case FORMATO_TABELA:
+            if (c > 0) saida_escrever(s, " | ", 3);
+            break;
+        case FORMATO_REGISTRO:
+            if (c > 0) saida_escrever(s, ";", 1);
+            break;
+        case FORMATO_CSV:
+            if (c > 0) saida_escrever(s, ",", 1);
+            break;
+        default:
+            if (c > 0) saida_escrever(s, ",", 1);
+            saida_escrever(s, "\"", 1);
+            saida_escrever(s, s->colunas[c].chave, strlen(s->colunas[c].chave));
+            saida_escrever(s, "\":", 2);
+    }
+}
+
+// Escreve 'texto' completado com espaços até a largura (negativa = alinhado à esquerda)
+void saida_alinhado(SaidaRelatorio *s, const char *texto, size_t n, int largura) {
+    static const char espacos[] = "                                ";
+    size_t alvo = (size_t)abs(largura);
+    size_t falta = alvo > n ? alvo - n : 0;
+    if (largura < 0) {
+        saida_escrever(s, texto, n);
+    }
+    while (falta > 0) {
+        size_t parte = falta < sizeof(espacos) - 1 ? falta : sizeof(espacos) - 1;
+        saida_escrever(s, espacos, parte);
+        falta -= parte;
+    }
+    if (largura >= 0) {
+        saida_escrever(s, texto, n);
+    }
+}
+
+// Os campos numéricos são convertidos à mão: snprintf em cada campo custaria mais que
+// todo o resto da listagem.
+
+// Escreve 'valor' em decimal terminando em 'fim'; retorna o início do texto
+char *formatar_inteiro(char *fim, int valor) {
+    unsigned int u = valor < 0 ? 0u - (unsigned int)valor : (unsigned int)valor;
+    char *p = fim;
+    do {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    } while (u > 0);
+    if (valor < 0) {
+        *--p = '-';
+    }
+    return p;
+}
+
+// Escreve 'valor' (não negativo) com exatamente 'digitos' dígitos, completando com zeros
+void formatar_com_zeros(char *destino, int valor, int digitos) {
+    for (int i = digitos - 1; i >= 0; i--) {
+        destino[i] = (char)('0' + valor % 10);
+        valor /= 10;
+    }
+}
+
+void saida_campo_inteiro(SaidaRelatorio *s, int valor) {
+    if (s->pulando) return;
+    if (s->coleta != NULL) {
+        CampoColetado *campo = coleta_novo_campo(s->coleta, COLETADO_INTEIRO);
+        if (campo != NULL) campo->inteiro = valor;
+        return;
+    }
+    int c = s->coluna;
+    saida_inicio_campo(s);
+    char texto[16];
+    char *inicio = formatar_inteiro(texto + sizeof(texto), valor);
+    size_t n = texto + sizeof(texto) - inicio;
+    if (s->opcoes.formato == FORMATO_TABELA) {
+        saida_alinhado(s, inicio, n, s->colunas[c].largura);
+    } else {
+        saida_escrever(s, inicio, n);
+    }
+}
+
+// Número com uma casa decimal; sem valor sai "-" na tabela, vazio no registro/CSV e null no JSON
+void saida_campo_decimal(SaidaRelatorio *s, double valor, bool definido) {
+    if (s->pulando) return;
+    if (s->coleta != NULL) {
+        CampoColetado *campo = coleta_novo_campo(s->coleta, COLETADO_DECIMAL);
+        if (campo != NULL) {
+            campo->decimal = valor;
+            campo->definido = definido;
+        }
+        return;
+    }
+    int c = s->coluna;
+    saida_inicio_campo(s);
+    char texto[32];
+    int n = definido ? snprintf(texto, sizeof(texto), "%.1f", valor) : 0;
+    if (s->opcoes.formato == FORMATO_TABELA) {
+        saida_alinhado(s, definido ? texto : "-", definido ? (size_t)n : 1, s->colunas[c].largura);
+    } else if (definido) {
+        saida_escrever(s, texto, n);
+    } else if (s->opcoes.formato == FORMATO_JSONL) {
+        saida_escrever(s, "null", 4);
+    }
+}
+
+// Escreve 'valor' trocando cada caractere que precisa de escape (ver 'precisa_escape') pelo
+// texto devolvido por 'escapar'; os trechos sem escape vão para o buffer de uma vez
+void saida_escapado(SaidaRelatorio *s, const char *valor, bool (*precisa_escape)(unsigned char),
+                    void (*escapar)(SaidaRelatorio *, unsigned char)) {
+    const char *trecho = valor;
+    for (const char *p = valor; *p != '\0'; p++) {
+        if (precisa_escape((unsigned char)*p)) {
+            saida_escrever(s, trecho, p - trecho);
+            escapar(s, (unsigned char)*p);
+            trecho = p + 1;
+        }
+    }
+    saida_escrever(s, trecho, strlen(trecho));
+}
+
+bool escape_csv(unsigned char c) {
+    return c == '"';
+}
+
+void escapar_csv(SaidaRelatorio *s, unsigned char c) {
+    (void)c;
+    saida_escrever(s, "\"\"", 2);
+}
+
+bool escape_json(unsigned char c) {
+    return c == '"' || c == '\\' || c < 0x20;
+}
+
+void escapar_json(SaidaRelatorio *s, unsigned char c) {
+    if (c == '"' || c == '\\') {
+        char par[2] = {'\\', (char)c};
+        saida_escrever(s, par, 2);
+    } else {
+        saida_formatar(s, "\\u%04x", c);
+    }
+}
+
+void saida_campo_texto(SaidaRelatorio *s, const char *valor) {
+    if (s->pulando) return;
+    if (s->coleta != NULL) {
+        CampoColetado *campo = coleta_novo_campo(s->coleta, COLETADO_TEXTO);
+        if (campo != NULL) campo->texto = coleta_guardar_texto(s->coleta, valor);
+        return;
+    }
+    int c = s->coluna;
+    saida_inicio_campo(s);
+    switch (s->opcoes.formato) {
+        case FORMATO_TABELA:
+            saida_alinhado(s, valor, strlen(valor), s->colunas[c].largura);
+            break;
+        case FORMATO_REGISTRO:
+            saida_escrever(s, valor, strlen(valor)); // Os cadastros não aceitam ';' nos textos
+            break;
+        case FORMATO_CSV:
+            if (strpbrk(valor, ",\"\r\n") == NULL) {
+                saida_escrever(s, valor, strlen(valor));
+            } else {
+                saida_escrever(s, "\"", 1);
+                saida_escapado(s, valor, escape_csv, escapar_csv);
+                saida_escrever(s, "\"", 1);
+            }
+            break;
+        default:
+            saida_escrever(s, "\"", 1);
+            saida_escapado(s, valor, escape_json, escapar_json);
+            saida_escrever(s, "\"", 1);
+    }
+}
+
+// Datas: dd/mm/aaaa na tabela, d/m/a como nos arquivos, aaaa-mm-dd no CSV e no JSON
+void saida_campo_data(SaidaRelatorio *s, Data data) {
+    if (s->pulando) return;
+    if (s->coleta != NULL) {
+        CampoColetado *campo = coleta_novo_campo(s->coleta, COLETADO_DATA);
+        if (campo != NULL) campo->data = data;
+        return;
+    }
+    int c = s->coluna;
+    char texto[12];
+    switch (s->opcoes.formato) {
+        case FORMATO_TABELA:
+            formatar_com_zeros(texto, data.dia, 2);
+            texto[2] = '/';
+            formatar_com_zeros(texto + 3, data.mes, 2);
+            texto[5] = '/';
+            formatar_com_zeros(texto + 6, data.ano, 4);
+            saida_inicio_campo(s);
+            saida_alinhado(s, texto, 10, s->colunas[c].largura);
+            break;
+        case FORMATO_REGISTRO:
+            saida_inicio_campo(s);
+            saida_formatar(s, "%d/%d/%d", data.dia, data.mes, data.ano);
+            break;
+        default:
+            formatar_com_zeros(texto, data.ano, 4);
+            texto[4] = '-';
+            formatar_com_zeros(texto + 5, data.mes, 2);
+            texto[7] = '-';
+            formatar_com_zeros(texto + 8, data.dia, 2);
+            texto[10] = '\0';
+            saida_campo_texto(s, texto);
+    }
+}
+
+void saida_fim_linha(SaidaRelatorio *s) {
+    if (s->pulando) return;
+    if (s->coleta != NULL) {
+        s->linhas_escritas++;
+        return;
+    }
+    if (s->opcoes.formato == FORMATO_JSONL) {
+        saida_escrever(s, "}\n", 2);
+    } else {
+        saida_escrever(s, "\n", 1);
+    }
+    s->linhas_escritas++;
+}
+
+// Avisa na tabela quando só parte das linhas foi exibida, entrega o restante e libera o buffer
+void saida_finalizar(SaidaRelatorio *s) {
+    if (s->coleta == NULL && s->opcoes.formato == FORMATO_TABELA && s->linhas_escritas < s->linhas_recebidas) {
+        saida_formatar(s, "[INFO] Exibidas %d de %d linha(s) (a partir da %d).\n",
+                       s->linhas_escritas, s->linhas_recebidas, s->opcoes.deslocamento + 1);
+    }
+    saida_descarregar(s);
+    free(s->buffer);
+    s->buffer = NULL;
+}
+
+// Converte o nome de um formato ("table", "record", "csv" ou "jsonl")
+bool ler_formato_saida(const char *nome, FormatoSaida *formato) {
+    for (int f = 0; f < NUM_FORMATOS; f++) {
+        if (strcmp(nome, nomes_formatos[f]) == 0) {
+            *formato = (FormatoSaida)f;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Aceita só as ordens do conjunto 'permitidas' (ORDEM(...) | ...)
+bool ler_ordem_listagem(const char *nome, unsigned int permitidas, OrdemListagem *ordem) {
+    for (int o = 0; o < NUM_ORDENS; o++) {
+        if ((permitidas & ORDEM(o)) && strcmp(nome, nomes_ordens[o]) == 0) {
+            *ordem = (OrdemListagem)o;
+            return true;
+        }
+    }
+    return false;
+}
+
+// --- PESQUISA APROXIMADA (TOLERANTE A ERROS DE DIGITAÇÃO) ---
+
+// Encontra títulos, autores e nomes que contêm o termo com até 'max_erros' inserções,
+// remoções ou trocas de caractere (distância de edição do termo para algum trecho do texto).
+// Comparação sem diferença de maiúsculas e acentos (normalizar_caractere).
+//
+// A distância é calculada pelo algoritmo bit-paralelo de Myers: o termo (até 64 caracteres)
+// vira máscaras de bits e cada caractere do texto custa umas poucas operações sobre uma
+// palavra de 64 bits. Para não verificar o cadastro inteiro, um índice de trigramas (os
+// trechos de 3 caracteres de cada texto) filtra os candidatos: um texto a até k erros do
+// termo compartilha com ele pelo menos (m - 2) - 3k dos seus m - 2 trigramas, então só os
+// registros que atingem essa contagem são verificados. Quando o limite não é positivo
+// (termos curtos ou muitos erros) o filtro não elimina nada e todos são verificados.
+#define MAX_PADRAO_APROXIMADO 64
+#define BITS_TRIGRAMAS 16
+#define NUM_BALDES_TRIGRAMAS (1 << BITS_TRIGRAMAS)
+
+// Campos de texto com índice próprio (pesquisa aproximada e completar por prefixo)
+typedef enum {
+    CAMPO_TITULO,
+    CAMPO_AUTOR,
+    CAMPO_NOME_USUARIO,
+    NUM_CAMPOS_TEXTO
+} CampoTexto;
+
+typedef struct {
+    int posicao;   // No acervo ou na lista de usuários
+    int distancia; // Erros necessários para encontrar o termo no texto
+} ResultadoAproximado;
+
+// Lista de registros por balde de trigrama (trigramas distintos que colidem no mesmo balde
+// só geram candidatos a mais, descartados na verificação)
+typedef struct {
+    int *inicio;    // NUM_BALDES_TRIGRAMAS + 1 posições em 'registros'
+    int *registros; // Posições dos registros de cada balde, em ordem crescente
+    int indexados;  // Registros cobertos; os posteriores são verificados diretamente
+    unsigned int geracao_carga;
+    bool construido;
+} IndiceTrigramas;
+
+IndiceTrigramas indices_trigramas[NUM_CAMPOS_TEXTO];
+pthread_rwlock_t trava_indices_trigramas = PTHREAD_RWLOCK_INITIALIZER;
+
+// Letras acentuadas de 2 bytes em UTF-8 (0xC3 0x80 a 0xC3 0xBF) sem acento e em minúscula
+const char sem_acento_c3[64] = "aaaaaaaceeeeiiiidnoooooxouuuuytsaaaaaaaceeeeiiiidnooooo/ouuuuyty";
+
+// Lê o próximo caractere de '*p' em minúscula e sem acento; retorna 0 no fim do texto
+unsigned char normalizar_caractere(const unsigned char **p) {
+    unsigned char c = **p;
+    if (c == '\0') {
+        return 0;
+    }
+    (*p)++;
+    if (c == 0xC3 && **p >= 0x80 && **p <= 0xBF) {
+        return (unsigned char)sem_acento_c3[*(*p)++ - 0x80];
+    }
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c - 'A' + 'a') : c;
+}
+
+// Copia 'origem' normalizado para 'destino' (até 'capacidade' caracteres) e retorna o tamanho
+int normalizar_texto(const char *origem, unsigned char *destino, int capacidade) {
+    const unsigned char *p = (const unsigned char *)origem;
+    int tamanho = 0;
+    unsigned char c;
+    while (tamanho < capacidade && (c = normalizar_caractere(&p)) != 0) {
+        destino[tamanho++] = c;
+    }
+    return tamanho;
+}
+
+const char *texto_do_campo(CampoTexto campo, int posicao) {
+    switch (campo) {
+        case CAMPO_TITULO: return acervo_livros[posicao].titulo;
+        case CAMPO_AUTOR: return acervo_livros[posicao].autor;
+        default: return lista_usuarios[posicao].nome;
+    }
+}
+
+int total_do_campo(CampoTexto campo) {
+    return campo == CAMPO_NOME_USUARIO ? total_usuarios : total_livros;
+}
+
+unsigned int balde_trigrama(const unsigned char *t) {
+    unsigned int h = ((unsigned int)t[0] << 16 | (unsigned int)t[1] << 8 | t[2]) * 2654435761u;
+    return h >> (32 - BITS_TRIGRAMAS);
+}
+
+// Baldes distintos dos trigramas do texto, em ordem crescente; retorna quantos
+int baldes_do_texto(const char *texto, unsigned int *baldes) {
+    unsigned char normalizado[TAM_TITULO]; // Título e nome são os maiores campos indexados
+    int tamanho = normalizar_texto(texto, normalizado, TAM_TITULO);
+    int n = 0;
+    for (int i = 0; i + 3 <= tamanho; i++) {
+        unsigned int b = balde_trigrama(normalizado + i);
+        int j = n++;
+        while (j > 0 && baldes[j - 1] > b) { // Inserção ordenada: textos curtos
+            baldes[j] = baldes[j - 1];
+            j--;
+        }
+        baldes[j] = b;
+    }
+    int distintos = 0;
+    for (int i = 0; i < n; i++) {
+        if (distintos == 0 || baldes[distintos - 1] != baldes[i]) {
+            baldes[distintos++] = baldes[i];
+        }
+    }
+    return distintos;
+}
+
+// (Re)constrói o índice de trigramas do campo (chamador tem trava de escrita do índice e
+// trava de leitura do cadastro do campo)
+bool construir_indice_trigramas(CampoTexto campo) {
+    IndiceTrigramas *indice = &indices_trigramas[campo];
+    int total = total_do_campo(campo);
+    unsigned int baldes[TAM_TITULO];
+    int *inicio = calloc(NUM_BALDES_TRIGRAMAS + 1, sizeof(int));
+    if (inicio == NULL) {
+        return false;
+    }
+    // Duas passadas: contagem por balde, depois preenchimento (registros já saem em ordem)
+    for (int r = 0; r < total; r++) {
+        int n = baldes_do_texto(texto_do_campo(campo, r), baldes);
+        for (int i = 0; i < n; i++) {
+            inicio[baldes[i] + 1]++;
+        }
+    }
+    for (int b = 0; b < NUM_BALDES_TRIGRAMAS; b++) {
+        inicio[b + 1] += inicio[b];
+    }
+    int *registros = malloc(sizeof(int) * (inicio[NUM_BALDES_TRIGRAMAS] + 1));
+    int *proximo = malloc(sizeof(int) * NUM_BALDES_TRIGRAMAS);
+    if (registros == NULL || proximo == NULL) {
+        free(inicio);
+        free(registros);
+        free(proximo);
+        return false;
+    }
+    memcpy(proximo, inicio, sizeof(int) * NUM_BALDES_TRIGRAMAS);
+    for (int r = 0; r < total; r++) {
+        int n = baldes_do_texto(texto_do_campo(campo, r), baldes);
+        for (int i = 0; i < n; i++) {
+            registros[proximo[baldes[i]]++] = r;
+        }
+    }
+    free(proximo);
+    free(indice->inicio);
+    free(indice->registros);
+    indice->inicio = inicio;
+    indice->registros = registros;
+    indice->indexados = total;
+    indice->geracao_carga = atomic_load(&geracao_carga);
+    indice->construido = true;
+    return true;
+}
+
+// O índice precisa ser refeito? (recarga dos dados ou muitos registros novos fora dele)
+bool indice_trigramas_desatualizado(CampoTexto campo) {
+    const IndiceTrigramas *indice = &indices_trigramas[campo];
+    return !indice->construido || indice->geracao_carga != atomic_load(&geracao_carga) ||
+           total_do_campo(campo) - indice->indexados > indice->indexados / 8 + 64;
+}
+
+// Menor distância de edição entre o padrão (máscaras 'peq', 'm' caracteres) e algum trecho
+// do texto, parando assim que ela cai a zero (Myers, 1999, na forma de Hyyrö)
+int distancia_aproximada(const uint64_t *peq, int m, const char *texto) {
+    uint64_t pv = m == 64 ? ~0ULL : (1ULL << m) - 1;
+    uint64_t mv = 0;
+    uint64_t ultimo = 1ULL << (m - 1);
+    int distancia = m;
+    int melhor = m;
+    const unsigned char *p = (const unsigned char *)texto;
+    unsigned char c;
+    while (melhor > 0 && (c = normalizar_caractere(&p)) != 0) {
+        uint64_t eq = peq[c];
+        uint64_t xv = eq | mv;
+        uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+        if (ph & ultimo) {
+            distancia++;
+        } else if (mh & ultimo) {
+            distancia--;
+        }
+        // Sem o bit 1 em 'ph': o trecho pode começar em qualquer posição do texto
+        ph <<= 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+        if (distancia < melhor) {
+            melhor = distancia;
+        }
+    }
+    return melhor;
+}
+
+int comparar_resultados_aproximados(const void *a, const void *b) {
+    const ResultadoAproximado *x = a;
+    const ResultadoAproximado *y = b;
+    if (x->distancia != y->distancia) {
+        return x->distancia - y->distancia;
+    }
+    return x->posicao - y->posicao;
+}
+
+// Erros tolerados quando o chamador não informa: 1 em termos curtos, até 3 nos longos
+// (mais que isso e palavras diferentes começam a coincidir)
+int erros_automaticos(int tamanho_termo) {
+    return tamanho_termo <= 4 ? 1 : tamanho_termo <= 12 ? 2 : 3;
+}
+
+// Preenche 'resultados' (capacidade MAX_LIVROS, ou MAX_USUARIOS para nomes) com os registros
+// cujo campo contém 'termo' com até 'max_erros' erros (negativo = automático), do mais
+// próximo ao mais distante, e retorna quantos foram encontrados
+int api_pesquisar_aproximado(CampoTexto campo, const char *termo, int max_erros, ResultadoAproximado *resultados) {
+    long long inicio = agora_ns();
+    unsigned char padrao[MAX_PADRAO_APROXIMADO];
+    int m = normalizar_texto(termo, padrao, MAX_PADRAO_APROXIMADO);
+    if (m == 0) {
+        return 0;
+    }
+    if (max_erros < 0) {
+        max_erros = erros_automaticos(m);
+    }
+    if (max_erros >= m) {
+        max_erros = m - 1; // Com m erros qualquer texto serviria
+    }
+    uint64_t peq[256] = {0};
+    for (int i = 0; i < m; i++) {
+        peq[padrao[i]] |= 1ULL << i;
+    }
+
+    pthread_rwlock_t *trava_cadastro = campo == CAMPO_NOME_USUARIO ? &trava_usuarios : &trava_acervo;
+    pthread_rwlock_rdlock(trava_cadastro);
+    pthread_rwlock_rdlock(&trava_indices_trigramas);
+    if (indice_trigramas_desatualizado(campo)) {
+        pthread_rwlock_unlock(&trava_indices_trigramas);
+        pthread_rwlock_wrlock(&trava_indices_trigramas);
+        if (indice_trigramas_desatualizado(campo)) { // Outra pesquisa pode ter reconstruído
+            construir_indice_trigramas(campo);
+        }
+        pthread_rwlock_unlock(&trava_indices_trigramas);
+        pthread_rwlock_rdlock(&trava_indices_trigramas);
+    }
+
+    const IndiceTrigramas *indice = &indices_trigramas[campo];
+    int total = total_do_campo(campo);
+    int limiar = (m - 2) - 3 * max_erros;
+    int num_resultados = 0;
+    int verificar_a_partir = 0; // Registros a partir daqui são verificados sem filtro
+    unsigned char *contagem = NULL;
+    int *tocados = NULL;
+    if (limiar > 0 && indice->construido) {
+        contagem = calloc(indice->indexados + 1, 1);
+        tocados = malloc(sizeof(int) * (indice->indexados + 1));
+    }
+    if (contagem != NULL && tocados != NULL) {
+        int num_tocados = 0;
+        for (int i = 0; i + 3 <= m; i++) {
+            unsigned int b = balde_trigrama(padrao + i);
+            for (int j = indice->inicio[b]; j < indice->inicio[b + 1]; j++) {
+                int r = indice->registros[j];
+                if (contagem[r]++ == 0) {
+                    tocados[num_tocados++] = r;
+                }
+            }
+        }
+        for (int i = 0; i < num_tocados; i++) {
+            int r = tocados[i];
+            if (contagem[r] >= limiar) {
+                int d = distancia_aproximada(peq, m, texto_do_campo(campo, r));
+                if (d <= max_erros) {
+                    resultados[num_resultados].posicao = r;
+                    resultados[num_resultados].distancia = d;
+                    num_resultados++;
+                }
+            }
+        }
+        verificar_a_partir = indice->indexados;
+    }
+    free(contagem);
+    free(tocados);
+    for (int r = verificar_a_partir; r < total; r++) {
+        int d = distancia_aproximada(peq, m, texto_do_campo(campo, r));
+        if (d <= max_erros) {
+            resultados[num_resultados].posicao = r;
+            resultados[num_resultados].distancia = d;
+            num_resultados++;
+        }
+    }
+    pthread_rwlock_unlock(&trava_indices_trigramas);
+    pthread_rwlock_unlock(trava_cadastro);
+
+    qsort(resultados, num_resultados, sizeof(ResultadoAproximado), comparar_resultados_aproximados);
+    registrar_latencia(OP_PESQUISA_APROXIMADA, inicio);
+    return num_resultados;
+}
+
+// --- COMPLETAR POR PREFIXO (AUTOCOMPLETAR) ---
+
+// Para cada campo de texto, um vetor com as chaves normalizadas (normalizar_texto) em ordem
+// crescente: os registros que começam com um prefixo formam um trecho contínuo, achado com
+// duas buscas binárias, e as K primeiras sugestões são as K primeiras entradas do trecho
+// (em ordem alfabética). Registros cadastrados depois da construção ficam numa cauda
+// verificada um a um até a próxima reconstrução, como no índice de trigramas.
+#define SUGESTOES_PADRAO 10
+
+typedef struct {
+    const unsigned char *chave; // Aponta para 'chaves' do índice (ou para um buffer temporário)
+    int posicao;
+} EntradaPrefixo;
+
+typedef struct {
+    unsigned char *chaves;   // Chaves normalizadas, terminadas em '\0', na ordem do cadastro
+    EntradaPrefixo *entradas; // Em ordem crescente de chave (empate: ordem do cadastro)
+    int indexados;
+    unsigned int geracao_carga;
+    bool construido;
+} IndicePrefixos;
+
+IndicePrefixos indices_prefixos[NUM_CAMPOS_TEXTO];
+pthread_rwlock_t trava_indices_prefixos = PTHREAD_RWLOCK_INITIALIZER;
+
+int comparar_entradas_prefixo(const void *a, const void *b) {
+    const EntradaPrefixo *x = a;
+    const EntradaPrefixo *y = b;
+    int c = strcmp((const char *)x->chave, (const char *)y->chave);
+    return c != 0 ? c : x->posicao - y->posicao;
+}
+
+// (Re)constrói o vetor ordenado do campo (chamador tem trava de escrita do índice e trava de
+// leitura do cadastro do campo)
+bool construir_indice_prefixos(CampoTexto campo) {
+    IndicePrefixos *indice = &indices_prefixos[campo];
+    int total = total_do_campo(campo);
+    unsigned char *chaves = malloc((size_t)total * TAM_TITULO + 1);
+    EntradaPrefixo *entradas = malloc(sizeof(EntradaPrefixo) * (total + 1));
+    if (chaves == NULL || entradas == NULL) {
+        free(chaves);
+        free(entradas);
+        return false;
+    }
+    size_t usado = 0;
+    for (int r = 0; r < total; r++) {
+        int tamanho = normalizar_texto(texto_do_campo(campo, r), chaves + usado, TAM_TITULO - 1);
+        chaves[usado + tamanho] = '\0';
+        usado += tamanho + 1;
+    }
+    // Devolve a sobra do bloco (chaves reais são bem menores que o campo) e só então
+    // aponta as entradas, já que o bloco pode mudar de lugar
+    unsigned char *compactadas = realloc(chaves, usado + 1);
+    if (compactadas != NULL) {
+        chaves = compactadas;
+    }
+    const unsigned char *chave = chaves;
+    for (int r = 0; r < total; r++) {
+        entradas[r].chave = chave;
+        entradas[r].posicao = r;
+        chave += strlen((const char *)chave) + 1;
+    }
+    qsort(entradas, total, sizeof(EntradaPrefixo), comparar_entradas_prefixo);
+
+    free(indice->chaves);
+    free(indice->entradas);
+    indice->chaves = chaves;
+    indice->entradas = entradas;
+    indice->indexados = total;
+    indice->geracao_carga = atomic_load(&geracao_carga);
+    indice->construido = true;
+    return true;
+}
+
+bool indice_prefixos_desatualizado(CampoTexto campo) {
+    const IndicePrefixos *indice = &indices_prefixos[campo];
+    return !indice->construido || indice->geracao_carga != atomic_load(&geracao_carga) ||
+           total_do_campo(campo) - indice->indexados > indice->indexados / 8 + 64;
+}
+
+// Primeira entrada em [0, n) cuja chave, comparada nos 'tamanho' primeiros caracteres,
+// não é menor (ou, com 'depois' verdadeiro, é maior) que o prefixo
+int limite_prefixo(const EntradaPrefixo *entradas, int n, const unsigned char *prefixo, int tamanho, bool depois) {
+    int inicio = 0;
+    int fim = n;
+    while (inicio < fim) {
+        int meio = inicio + (fim - inicio) / 2;
+        int c = strncmp((const char *)entradas[meio].chave, (const char *)prefixo, tamanho);
+        if (c < 0 || (depois && c == 0)) {
+            inicio = meio + 1;
+        } else {
+            fim = meio;
+        }
+    }
+    return inicio;
+}
+
+// Preenche 'posicoes' com até 'k' registros cujo campo começa com 'prefixo' (sem diferença
+// de maiúsculas e acentos), em ordem alfabética, e retorna quantos foram escritos. Se
+// 'total_encontrado' não for NULL, recebe quantos registros começam com o prefixo.
+int api_completar_prefixo(CampoTexto campo, const char *prefixo, int k, int *posicoes, int *total_encontrado) {
+    unsigned char normalizado[TAM_TITULO];
+    int tamanho = normalizar_texto(prefixo, normalizado, TAM_TITULO - 1);
+    normalizado[tamanho] = '\0';
+
+    pthread_rwlock_t *trava_cadastro = campo == CAMPO_NOME_USUARIO ? &trava_usuarios : &trava_acervo;
+    pthread_rwlock_rdlock(trava_cadastro);
+    pthread_rwlock_rdlock(&trava_indices_prefixos);
+    if (indice_prefixos_desatualizado(campo)) {
+        pthread_rwlock_unlock(&trava_indices_prefixos);
+        pthread_rwlock_wrlock(&trava_indices_prefixos);
+        if (indice_prefixos_desatualizado(campo)) {
+            construir_indice_prefixos(campo);
+        }
+        pthread_rwlock_unlock(&trava_indices_prefixos);
+        pthread_rwlock_rdlock(&trava_indices_prefixos);
+    }
+
+    const IndicePrefixos *indice = &indices_prefixos[campo];
+    int indexados = indice->construido ? indice->indexados : 0;
+    int primeiro = 0;
+    int encontrados = 0;
+    if (indexados > 0) {
+        primeiro = limite_prefixo(indice->entradas, indexados, normalizado, tamanho, false);
+        encontrados = limite_prefixo(indice->entradas, indexados, normalizado, tamanho, true) - primeiro;
+    }
+
+    // Candidatos: os k primeiros do trecho e os da cauda (chaves da cauda em buffer próprio)
+    int total = total_do_campo(campo);
+    int cauda = total - indexados;
+    int do_trecho = encontrados < k ? encontrados : k;
+    EntradaPrefixo *candidatos = malloc(sizeof(EntradaPrefixo) * (do_trecho + cauda + 1));
+    unsigned char (*chaves_cauda)[TAM_TITULO] = cauda > 0 ? malloc(sizeof(*chaves_cauda) * cauda) : NULL;
+    int num_candidatos = 0;
+    if (candidatos != NULL && (cauda == 0 || chaves_cauda != NULL)) {
+        for (int i = 0; i < do_trecho; i++) {
+            candidatos[num_candidatos++] = indice->entradas[primeiro + i];
+        }
+        for (int r = indexados; r < total; r++) {
+            unsigned char *chave = chaves_cauda[r - indexados];
+            int n = normalizar_texto(texto_do_campo(campo, r), chave, TAM_TITULO - 1);
+            chave[n] = '\0';
+            if (strncmp((const char *)chave, (const char *)normalizado, tamanho) == 0) {
+                candidatos[num_candidatos].chave = chave;
+                candidatos[num_candidatos].posicao = r;
+                num_candidatos++;
+                encontrados++;
+            }
+        }
+        if (num_candidatos > do_trecho) { // Só há o que intercalar se a cauda contribuiu
+            qsort(candidatos, num_candidatos, sizeof(EntradaPrefixo), comparar_entradas_prefixo);
+        }
+    }
+    int escritos = num_candidatos < k ? num_candidatos : k;
+    for (int i = 0; i < escritos; i++) {
+        posicoes[i] = candidatos[i].posicao;
+    }
+    pthread_rwlock_unlock(&trava_indices_prefixos);
+    pthread_rwlock_unlock(trava_cadastro);
+    free(candidatos);
+    free(chaves_cauda);
+
+    if (total_encontrado != NULL) {
+        *total_encontrado = encontrados;
+    }
+    return escritos;
+}
+
+// --- ORDENAÇÃO DAS LISTAGENS ---
+
+// As listagens ordenadas dão a cada linha uma chave de 32 bits e ordenam os pares chave/linha
+// por radix sort: 8 bits por passada, começando pelo byte menos significativo, pulando as
+// passadas em que todas as chaves têm o mesmo byte. O tempo é linear, e a ordenação é
+// estável, então linhas com a mesma chave mantêm a ordem natural da listagem.
+// A chave é o dia da data, a contagem ou o posto alfabético do texto. O posto vem de uma
+// ordem em cache por campo de texto: a primeira listagem ordena o campo por intercalação
+// (merge sort), e as seguintes só acrescentam os registros cadastrados depois. Esses
+// registros são ordenados entre si e intercalados com a ordem existente, em tempo linear.
+// Livros e usuários nunca são removidos nem têm o texto alterado, então a ordem só é
+// descartada quando os arquivos são recarregados (geracao_carga).
+
+typedef struct {
+    int *ordem; // Posições em ordem alfabética (empate: ordem do cadastro)
+    int *posto; // posto[posição] = lugar da posição em 'ordem'
+    int ordenados;
+    unsigned int geracao_carga;
+    bool construida;
+} OrdemEmCache;
+
+OrdemEmCache ordens_em_cache[NUM_CAMPOS_TEXTO];
+pthread_rwlock_t trava_ordens = PTHREAD_RWLOCK_INITIALIZER;
+
+// Compara dois textos sem diferença de maiúsculas e acentos (como normalizar_texto)
+int comparar_textos_normalizados(const char *a, const char *b) {
+    const unsigned char *p = (const unsigned char *)a;
+    const unsigned char *q = (const unsigned char *)b;
+    unsigned char x, y;
+    do {
+        x = normalizar_caractere(&p);
+        y = normalizar_caractere(&q);
+    } while (x != 0 && x == y);
+    return (x > y) - (x < y);
+}
+
+int comparar_posicoes_do_campo(CampoTexto campo, int a, int b) {
+    return comparar_textos_normalizados(texto_do_campo(campo, a), texto_do_campo(campo, b));
+}
+
+// Intercala as sequências ordenadas 'a' e 'b' em 'saida' (empate: 'a' primeiro)
+void intercalar_posicoes(CampoTexto campo, const int *a, int na, const int *b, int nb, int *saida) {
+    int i = 0, j = 0, k = 0;
+    while (i < na && j < nb) {
+        saida[k++] = comparar_posicoes_do_campo(campo, b[j], a[i]) < 0 ? b[j++] : a[i++];
+    }
+    while (i < na) saida[k++] = a[i++];
+    while (j < nb) saida[k++] = b[j++];
+}
+
+// Merge sort de baixo para cima, estável; 'auxiliar' tem espaço para n posições
+void ordenar_por_intercalacao(CampoTexto campo, int *posicoes, int n, int *auxiliar) {
+    int *origem = posicoes;
+    int *destino = auxiliar;
+    for (int largura = 1; largura < n; largura *= 2) {
+        for (int inicio = 0; inicio < n; inicio += 2 * largura) {
+            int meio = inicio + largura < n ? inicio + largura : n;
+            int fim = inicio + 2 * largura < n ? inicio + 2 * largura : n;
+            intercalar_posicoes(campo, origem + inicio, meio - inicio, origem + meio, fim - meio, destino + inicio);
+        }
+        int *troca = origem;
+        origem = destino;
+        destino = troca;
+    }
+    if (origem != posicoes) {
+        memcpy(posicoes, origem, sizeof(int) * n);
+    }
+}
+
+// Acrescenta à ordem do campo os registros cadastrados desde a última atualização, ou a
+// refaz se os arquivos foram recarregados (chamador tem trava de escrita das ordens e trava
+// de leitura do cadastro do campo)
+bool atualizar_ordem_em_cache(CampoTexto campo) {
+    OrdemEmCache *cache = &ordens_em_cache[campo];
+    unsigned int geracao = atomic_load(&geracao_carga);
+    int anteriores = cache->construida && cache->geracao_carga == geracao ? cache->ordenados : 0;
+    int total = total_do_campo(campo);
+    int novos = total - anteriores;
+    int *ordem = malloc(sizeof(int) * (total + 1));
+    int *posto = malloc(sizeof(int) * (total + 1));
+    int *cauda = malloc(sizeof(int) * (novos + 1));
+    int *auxiliar = malloc(sizeof(int) * (novos + 1));
+    bool ok = ordem != NULL && posto != NULL && cauda != NULL && auxiliar != NULL;
+    if (ok) {
+        for (int i = 0; i < novos; i++) {
+            cauda[i] = anteriores + i;
+        }
+        ordenar_por_intercalacao(campo, cauda, novos, auxiliar);
+        // Empate entre registro antigo e novo: o antigo vem antes (ordem do cadastro)
+        intercalar_posicoes(campo, cache->ordem, anteriores, cauda, novos, ordem);
+        for (int i = 0; i < total; i++) {
+            posto[ordem[i]] = i;
+        }
+        free(cache->ordem);
+        free(cache->posto);
+        cache->ordem = ordem;
+        cache->posto = posto;
+        cache->ordenados = total;
+        cache->geracao_carga = geracao;
+        cache->construida = true;
+    } else {
+        free(ordem);
+        free(posto);
+    }
+    free(cauda);
+    free(auxiliar);
+    return ok;
+}
+
+bool ordem_em_cache_desatualizada(CampoTexto campo) {
+    const OrdemEmCache *cache = &ordens_em_cache[campo];
+    return !cache->construida || cache->geracao_carga != atomic_load(&geracao_carga) ||
+           cache->ordenados != total_do_campo(campo);
+}
+
+// Devolve o posto alfabético de cada registro do campo, com a trava das ordens mantida para
+// leitura até liberar_postos(). Retorna NULL (sem trava) se faltou memória ou se os arquivos
+// foram recarregados depois de 'geracao' (a carga que originou as posições a ordenar).
+const int *obter_postos(CampoTexto campo, unsigned int geracao) {
+    pthread_rwlock_t *trava_cadastro = campo == CAMPO_NOME_USUARIO ? &trava_usuarios : &trava_acervo;
+    pthread_rwlock_rdlock(trava_cadastro);
+    pthread_rwlock_rdlock(&trava_ordens);
+    if (ordem_em_cache_desatualizada(campo)) {
+        pthread_rwlock_unlock(&trava_ordens);
+        pthread_rwlock_wrlock(&trava_ordens);
+        if (ordem_em_cache_desatualizada(campo)) {
+            atualizar_ordem_em_cache(campo);
+        }
+        pthread_rwlock_unlock(&trava_ordens);
+        pthread_rwlock_rdlock(&trava_ordens);
+    }
+    // Conferido ainda sob a trava do cadastro: a ordem cobre todos os registros existentes.
+    // Depois o cadastro pode voltar a crescer; os postos só mudam sob a trava das ordens.
+    bool utilizavel = !ordem_em_cache_desatualizada(campo) && ordens_em_cache[campo].geracao_carga == geracao;
+    pthread_rwlock_unlock(trava_cadastro);
+    if (!utilizavel) {
+        pthread_rwlock_unlock(&trava_ordens);
+        return NULL;
+    }
+    return ordens_em_cache[campo].posto;
+}
+
+void liberar_postos() {
+    pthread_rwlock_unlock(&trava_ordens);
+}
+
+// Radix sort estável de 'itens' pelos 32 bits altos (a chave); os 32 baixos acompanham
+bool ordenar_itens_radix(uint64_t *itens, int n) {
+    if (n < 2) {
+        return true;
+    }
+    uint64_t *auxiliar = malloc(sizeof(uint64_t) * n);
+    if (auxiliar == NULL) {
+        return false;
+    }
+    uint64_t *origem = itens;
+    uint64_t *destino = auxiliar;
+    for (int deslocamento = 32; deslocamento < 64; deslocamento += 8) {
+        int inicio_balde[257] = {0};
+        for (int i = 0; i < n; i++) {
+            inicio_balde[((origem[i] >> deslocamento) & 0xFF) + 1]++;
+        }
+        if (inicio_balde[((origem[0] >> deslocamento) & 0xFF) + 1] == n) {
+            continue; // Byte igual em todas as chaves: a passada não mudaria nada
+        }
+        for (int b = 0; b < 256; b++) {
+            inicio_balde[b + 1] += inicio_balde[b];
+        }
+        for (int i = 0; i < n; i++) {
+            destino[inicio_balde[(origem[i] >> deslocamento) & 0xFF]++] = origem[i];
+        }
+        uint64_t *troca = origem;
+        origem = destino;
+        destino = troca;
+    }
+    if (origem != itens) {
+        memcpy(itens, origem, sizeof(uint64_t) * n);
+    }
+    free(auxiliar);
+    return true;
+}
+
+// Reordena 'linhas' pelas chaves correspondentes (chaves[i] é a de linhas[i])
+bool ordenar_linhas(int *linhas, const uint32_t *chaves, int n) {
+    if (n < 2) {
+        return true;
+    }
+    uint64_t *itens = malloc(sizeof(uint64_t) * n);
+    if (itens == NULL) {
+        return false;
+    }
+    for (int i = 0; i < n; i++) {
+        itens[i] = (uint64_t)chaves[i] << 32 | (uint32_t)linhas[i];
+    }
+    bool ok = ordenar_itens_radix(itens, n);
+    if (ok) {
+        for (int i = 0; i < n; i++) {
+            linhas[i] = (int)(uint32_t)itens[i];
+        }
+    }
+    free(itens);
+    return ok;
+}
+
+// Chave de uma data: o dia, com o bit de sinal invertido para ordenar como sem sinal
+uint32_t chave_da_data(Data d) {
+    return (uint32_t)dias_desde_epoca(d) ^ 0x80000000u;
+}
+
+// Ordena posições do cadastro do campo em ordem alfabética (pesquisas de livros e usuários)
+bool ordenar_posicoes_do_campo(CampoTexto campo, int *posicoes, int n) {
+    if (n < 2) {
+        return true;
+    }
+    uint32_t *chaves = malloc(sizeof(uint32_t) * n);
+    const int *posto = chaves != NULL ? obter_postos(campo, atomic_load(&geracao_carga)) : NULL;
+    if (posto == NULL) {
+        free(chaves);
+        return false;
+    }
+    for (int i = 0; i < n; i++) {
+        chaves[i] = (uint32_t)posto[posicoes[i]];
+    }
+    liberar_postos();
+    bool ok = ordenar_linhas(posicoes, chaves, n);
+    free(chaves);
+    return ok;
+}
+
+// Aplica a ordem das opções de saída aos resultados de uma pesquisa de livros
+void ordenar_resultados_livros(int *posicoes, int n) {
+    if (opcoes_saida.ordem != ORDEM_TITULO && opcoes_saida.ordem != ORDEM_AUTOR) {
+        return;
+    }
+    if (!ordenar_posicoes_do_campo(opcoes_saida.ordem == ORDEM_TITULO ? CAMPO_TITULO : CAMPO_AUTOR, posicoes, n)) {
+        fprintf(stderr, "[AVISO] Nao foi possivel ordenar; resultados na ordem do cadastro.\n");
+    }
+}
+
+void ordenar_resultados_usuarios(int *posicoes, int n) {
+    if (opcoes_saida.ordem == ORDEM_USUARIO && !ordenar_posicoes_do_campo(CAMPO_NOME_USUARIO, posicoes, n)) {
+        fprintf(stderr, "[AVISO] Nao foi possivel ordenar; resultados na ordem do cadastro.\n");
+    }
+}
+
+// --- PARTE 3: FUNÇÕES MODULARES (PESQUISA) ---
+
+// Critérios da pesquisa de livros; campos zerados ou vazios são ignorados
+typedef struct {
+    int codigo;
+    char titulo[TAM_TITULO]; // Trecho do título
+    char autor[TAM_AUTOR];   // Trecho do nome do autor
+    int ano;
+} CriteriosPesquisaLivro;
+
+// Preenche 'posicoes' (capacidade MAX_LIVROS) com as posições no acervo dos livros que
+// atendem a todos os critérios e retorna quantos foram encontrados. Livros nunca são
+// removidos do vetor, então as posições continuam válidas depois da chamada.
+int api_pesquisar_livros(const CriteriosPesquisaLivro *criterios, int *posicoes) {
+    long long inicio = agora_ns();
+    int num_resultados = 0;
+
+    pthread_rwlock_rdlock(&trava_acervo);
+    if (criterios->codigo != 0) {
+        // Por código: consulta direta no índice, depois confere os demais critérios
+        int idx = buscar_livro_por_codigo(criterios->codigo);
+        if (idx != -1 &&
+            strstr(acervo_livros[idx].titulo, criterios->titulo) != NULL &&
+            strstr(acervo_livros[idx].autor, criterios->autor) != NULL &&
+            (criterios->ano == 0 || acervo_livros[idx].ano_publicacao == criterios->ano)) {
+            posicoes[num_resultados++] = idx;
+        }
+    } else {
+        for (int i = 0; i < total_livros; i++) {
+            bool match_titulo = (criterios->titulo[0] == '\0' || strstr(acervo_livros[i].titulo, criterios->titulo) != NULL);
+            bool match_autor = (criterios->autor[0] == '\0' || strstr(acervo_livros[i].autor, criterios->autor) != NULL);
+            bool match_ano = (criterios->ano == 0 || acervo_livros[i].ano_publicacao == criterios->ano);
+
+            if (match_titulo && match_autor && match_ano) {
+                posicoes[num_resultados++] = i;
+            }
+        }
+    }
+    pthread_rwlock_unlock(&trava_acervo);
+
+    registrar_latencia(OP_PESQUISA_LIVROS, inicio);
+    return num_resultados;
+}
+
+// Preenche 'posicoes' (capacidade MAX_USUARIOS) com os usuários da matrícula informada
+// (0 = qualquer) cujo nome contém 'nome' ("" = qualquer) e retorna quantos foram encontrados
+int api_pesquisar_usuarios(int matricula, const char *nome, int *posicoes) {
+    int num_resultados = 0;
+
+    pthread_rwlock_rdlock(&trava_usuarios);
+    if (matricula != 0) {
+        int idx = buscar_usuario_por_matricula(matricula);
+        if (idx != -1 && strstr(lista_usuarios[idx].nome, nome) != NULL) {
+            posicoes[num_resultados++] = idx;
+        }
+    } else {
+        for (int i = 0; i < total_usuarios; i++) {
+            if (strstr(lista_usuarios[i].nome, nome) != NULL) {
+                posicoes[num_resultados++] = i;
+            }
+        }
+    }
+    pthread_rwlock_unlock(&trava_usuarios);
+    return num_resultados;
+}
+
+// Colunas na mesma ordem dos campos do arquivo de livros (formato registro = arquivo)
+const ColunaSaida colunas_livros[] = {
+    {"Codigo", "codigo", 6},
+    {"Titulo", "titulo", -30},
+    {"Autor", "autor", -20},
+    {"Editora", "editora", -15},
+    {"Ano", "ano_publicacao", 4},
+    {"Disp.", "exemplares_disponiveis", 5},
+    {"Status", "status", -12},
+    {"Total", "total_exemplares", 5},
+};
+
+const ColunaSaida colunas_usuarios[] = {
+    {"Matricula", "matricula", 9},
+    {"Nome", "nome", -30},
+    {"Curso", "curso", -20},
+    {"Telefone", "telefone", -15},
+    {"Data Cadastro", "data_cadastro", 13},
+};
+
+#define NUM_COLUNAS(colunas) ((int)(sizeof(colunas) / sizeof(colunas[0])))
+
+// Em que ordem vêm as posições de uma listagem de livros ou usuários, para intercalá-las com
+// as de outras unidades no comando "all" (ver COLETA); NULL = ordem do cadastro
+typedef struct {
+    const int *distancias; // Da pesquisa aproximada, uma por posição (ou NULL)
+    int campo;             // CampoTexto em ordem alfabética (ou -1)
+    int maximo;            // Já são as 'maximo' primeiras da unidade (0 = todas)
+} OrdemExibicao;
+
+void saida_chave_exibicao(SaidaRelatorio *s, const OrdemExibicao *ordem, int i, int posicao) {
+    if (s->coleta == NULL || ordem == NULL) {
+        return;
+    }
+    if (ordem->distancias != NULL) {
+        saida_chave_numero(s, ordem->distancias[i]);
+    }
+    if (ordem->campo >= 0) {
+        saida_chave_texto(s, texto_do_campo((CampoTexto)ordem->campo, posicao));
+    }
+    saida_maximo_linhas(s, ordem->maximo);
+}
+
+// Escreve os livros das posições indicadas (chamador mantém trava_acervo para leitura)
+void exibir_livros(FILE *destino, const int *posicoes, int quantidade, const OrdemExibicao *ordem) {
+    SaidaRelatorio saida;
+    saida_iniciar(&saida, destino, colunas_livros, NUM_COLUNAS(colunas_livros));
+    saida_cabecalho(&saida);
+    for (int i = 0; i < quantidade; i++) {
+        if (!saida_linha(&saida)) continue;
+        saida_chave_exibicao(&saida, ordem, i, posicoes[i]);
+        const Livro *livro = &acervo_livros[posicoes[i]];
+        saida_campo_inteiro(&saida, livro->codigo);
+        saida_campo_texto(&saida, livro->titulo);
+        saida_campo_texto(&saida, livro->autor);
+        saida_campo_texto(&saida, livro->editora);
+        saida_campo_inteiro(&saida, livro->ano_publicacao);
+        saida_campo_inteiro(&saida, atomic_load(&livro->exemplares_disponiveis));
+        saida_campo_texto(&saida, status_livro(livro));
+        saida_campo_inteiro(&saida, livro->total_exemplares);
+        saida_fim_linha(&saida);
+    }
+    saida_separador(&saida);
+    saida_finalizar(&saida);
+}
+
+// Escreve os usuários das posições indicadas (chamador mantém trava_usuarios para leitura)
+void exibir_usuarios(FILE *destino, const int *posicoes, int quantidade, const OrdemExibicao *ordem) {
+    SaidaRelatorio saida;
+    saida_iniciar(&saida, destino, colunas_usuarios, NUM_COLUNAS(colunas_usuarios));
+    saida_cabecalho(&saida);
+    for (int i = 0; i < quantidade; i++) {
+        if (!saida_linha(&saida)) continue;
+        saida_chave_exibicao(&saida, ordem, i, posicoes[i]);
+        const Usuario *usuario = &lista_usuarios[posicoes[i]];
+        saida_campo_inteiro(&saida, usuario->matricula);
+        saida_campo_texto(&saida, usuario->nome);
+        saida_campo_texto(&saida, usuario->curso);
+        saida_campo_texto(&saida, usuario->telefone);
+        saida_campo_data(&saida, usuario->data_cadastro);
+        saida_fim_linha(&saida);
+    }
+    saida_separador(&saida);
+    saida_finalizar(&saida);
+}
+
+// Faz a pesquisa aproximada e exibe os registros do mais próximo ao mais distante (menus e
+// linha de comando). Retorna quantos foram encontrados ou -1 se faltou memória.
+int exibir_pesquisa_aproximada(CampoTexto campo, const char *termo, int max_erros, bool com_titulo) {
+    int capacidade = campo == CAMPO_NOME_USUARIO ? MAX_USUARIOS : MAX_LIVROS;
+    ResultadoAproximado *resultados = malloc(sizeof(ResultadoAproximado) * capacidade);
+    int *posicoes = malloc(sizeof(int) * capacidade);
+    if (resultados == NULL || posicoes == NULL) {
+        free(resultados);
+        free(posicoes);
+        return -1;
+    }
+    int *distancias = malloc(sizeof(int) * capacidade);
+    if (distancias == NULL) {
+        free(resultados);
+        free(posicoes);
+        return -1;
+    }
+    int num_resultados = api_pesquisar_aproximado(campo, termo, max_erros, resultados);
+    for (int i = 0; i < num_resultados; i++) {
+        posicoes[i] = resultados[i].posicao;
+        distancias[i] = resultados[i].distancia;
+    }
+    OrdemExibicao ordem = {distancias, -1, 0};
+
+    pthread_rwlock_t *trava_cadastro = campo == CAMPO_NOME_USUARIO ? &trava_usuarios : &trava_acervo;
+    pthread_rwlock_rdlock(trava_cadastro);
+    if (com_titulo && num_resultados > 0) {
+        printf("\n--- Resultados Aproximados (%d encontrado(s), do mais proximo ao mais distante) ---\n", num_resultados);
+    }
+    if (!com_titulo || num_resultados > 0) {
+        if (campo == CAMPO_NOME_USUARIO) {
+            exibir_usuarios(stdout, posicoes, num_resultados, &ordem);
+        } else {
+            exibir_livros(stdout, posicoes, num_resultados, &ordem);
+        }
+    }
+    pthread_rwlock_unlock(trava_cadastro);
+    free(resultados);
+    free(posicoes);
+    free(distancias);
+    return num_resultados;
+}
+
+// Opção de busca aproximada dos menus de livros e de usuários
+void pesquisa_aproximada_interativa(CampoTexto campo) {
+    char termo[TAM_TITULO];
+    printf("Digite o termo (erros de digitacao sao tolerados): ");
+    ler_string(termo, TAM_TITULO);
+    unsigned char normalizado[MAX_PADRAO_APROXIMADO];
+    int max_erros = erros_automaticos(normalizar_texto(termo, normalizado, MAX_PADRAO_APROXIMADO));
+    int encontrados = exibir_pesquisa_aproximada(campo, termo, max_erros, true);
+    if (encontrados < 0) {
+        printf("[ERRO] Memoria insuficiente para a pesquisa.\n");
+    } else if (encontrados == 0) {
+        printf("\n[INFO] Nenhum registro encontrado, mesmo tolerando %d erro(s).\n", max_erros);
+    }
+}
+
+// Busca as 'k' primeiras sugestões para o prefixo e as exibe em ordem alfabética (menus e
+// linha de comando). Retorna quantos registros começam com o prefixo ou -1 se faltou memória.
+int exibir_sugestoes(CampoTexto campo, const char *prefixo, int k, bool com_titulo) {
+    int *posicoes = malloc(sizeof(int) * (k > 0 ? k : 1));
+    if (posicoes == NULL) {
+        return -1;
+    }
+    int encontrados;
+    int num_sugestoes = api_completar_prefixo(campo, prefixo, k, posicoes, &encontrados);
+
+    pthread_rwlock_t *trava_cadastro = campo == CAMPO_NOME_USUARIO ? &trava_usuarios : &trava_acervo;
+    pthread_rwlock_rdlock(trava_cadastro);
+    if (com_titulo && num_sugestoes > 0) {
+        printf("\n--- Sugestoes (%d de %d registro(s) com este inicio) ---\n", num_sugestoes, encontrados);
+    }
+    if (!com_titulo || num_sugestoes > 0) {
+        OrdemExibicao ordem = {NULL, campo, k};
+        if (campo == CAMPO_NOME_USUARIO) {
+            exibir_usuarios(stdout, posicoes, num_sugestoes, &ordem);
+        } else {
+            exibir_livros(stdout, posicoes, num_sugestoes, &ordem);
+        }
+    }
+    pthread_rwlock_unlock(trava_cadastro);
+    free(posicoes);
+    return encontrados;
+}
+
+// Opção de completar pelo início do texto dos menus de livros e de usuários
+void completar_prefixo_interativo(CampoTexto campo) {
+    char prefixo[TAM_TITULO];
+    printf("Digite o inicio do texto: ");
+    ler_string(prefixo, TAM_TITULO);
+    int encontrados = exibir_sugestoes(campo, prefixo, SUGESTOES_PADRAO, true);
+    if (encontrados < 0) {
+        printf("[ERRO] Memoria insuficiente para a pesquisa.\n");
+    } else if (encontrados == 0) {
+        printf("\n[INFO] Nenhum registro comeca com '%s'.\n", prefixo);
+    }
+}
+
+// Função para pesquisar livros (por código, título ou autor)
+void pesquisar_livros() {
+    int opcao;
+    printf("\n--- Pesquisar Livros ---\n");
+    printf("Buscar por:\n");
+    printf("1. Codigo\n");
+    printf("2. Titulo\n");
+    printf("3. Autor\n");
+    printf("4. Busca Avancada (Multiplos Criterios)\n"); // Parte 5
+    printf("5. Titulo Aproximado (tolera erros de digitacao)\n");
+    printf("6. Autor Aproximado (tolera erros de digitacao)\n");
+    printf("7. Completar Titulo (pelo inicio)\n");
+    printf("8. Completar Autor (pelo inicio)\n");
+    printf("Opcao: ");
+    if (scanf("%d", &opcao) != 1) {
+        printf("[ERRO] Opcao invalida.\n");
+        limpar_buffer();
+        return;
+    }
+    limpar_buffer();
+
+    CriteriosPesquisaLivro criterios = {0, "", "", 0};
+
+    switch (opcao) {
+        case 1: // Por Código
+            printf("Digite o Codigo do livro: ");
+            if (scanf("%d", &criterios.codigo) != 1 || criterios.codigo == 0) {
+                printf("[ERRO] Codigo invalido.\n");
+                limpar_buffer();
+                return;
+            }
+            limpar_buffer();
+            break;
+        case 2: // Por Título
+            printf("Digite o Titulo (ou parte): ");
+            ler_string(criterios.titulo, TAM_TITULO);
+            break;
+        case 3: // Por Autor
+            printf("Digite o Autor (ou parte): ");
+            ler_string(criterios.autor, TAM_AUTOR);
+            break;
+        case 4: // Busca Avançada (Parte 5)
+            printf("\n--- Busca Avancada (Deixe em branco/0 para ignorar) ---\n");
+            printf("Titulo (ou parte): ");
+            ler_string(criterios.titulo, TAM_TITULO);
+
+            printf("Autor (ou parte): ");
+            ler_string(criterios.autor, TAM_AUTOR);
+
+            printf("Ano de Publicacao (0 para ignorar): ");
+            if (scanf("%d", &criterios.ano) != 1) {
+                criterios.ano = 0;
+                limpar_buffer();
+            }
+            limpar_buffer();
+            break;
+        case 5: // Título aproximado
+            pesquisa_aproximada_interativa(CAMPO_TITULO);
+            return;
+        case 6: // Autor aproximado
+            pesquisa_aproximada_interativa(CAMPO_AUTOR);
+            return;
+        case 7: // Completar título
+            completar_prefixo_interativo(CAMPO_TITULO);
+            return;
+        case 8: // Completar autor
+            completar_prefixo_interativo(CAMPO_AUTOR);
+            return;
+        default:
+            printf("[ERRO] Opcao invalida.\n");
+            return;
+    }
+
+    // No heap: com limites grandes o vetor não caberia na pilha
+    int *resultados = malloc(sizeof(int) * MAX_LIVROS);
+    if (resultados == NULL) {
+        printf("[ERRO] Memoria insuficiente para a pesquisa.\n");
+        return;
+    }
+    int num_resultados = api_pesquisar_livros(&criterios, resultados);
+    ordenar_resultados_livros(resultados, num_resultados);
+
+    // Exibição dos resultados (os registros apontados nunca são removidos do vetor)
+    pthread_rwlock_rdlock(&trava_acervo);
+    if (num_resultados > 0) {
+        printf("\n--- Resultados da Pesquisa (%d encontrado(s)) ---\n", num_resultados);
+        exibir_livros(stdout, resultados, num_resultados, NULL);
+    } else {
+        printf("\n[INFO] Nenhum livro encontrado com os criterios fornecidos.\n");
+    }
+    pthread_rwlock_unlock(&trava_acervo);
+    free(resultados);
+}
+
+// Função para pesquisar usuários (por matrícula ou nome)
+void pesquisar_usuarios() {
+    int opcao;
+    printf("\n--- Pesquisar Usuarios ---\n");
+    printf("Buscar por:\n");
+    printf("1. Matricula\n");
+    printf("2. Nome\n");
+    printf("3. Nome Aproximado (tolera erros de digitacao)\n");
+    printf("4. Completar Nome (pelo inicio)\n");
+    printf("Opcao: ");
+    if (scanf("%d", &opcao) != 1) {
+        printf("[ERRO] Opcao invalida.\n");
+        limpar_buffer();
+        return;
+    }
+    limpar_buffer();
+
+    int mat = 0;
+    char termo[TAM_NOME] = "";
+
+    switch (opcao) {
+        case 1: // Por Matrícula
+            printf("Digite a Matricula do usuario: ");
+            if (scanf("%d", &mat) != 1 || mat == 0) {
+                printf("[ERRO] Matricula invalida.\n");
+                limpar_buffer();
+                return;
+            }
+            limpar_buffer();
+            break;
+        case 2: // Por Nome
+            printf("Digite o Nome completo (ou parte): ");
+            ler_string(termo, TAM_NOME);
+            break;
+        case 3: // Nome aproximado
+            pesquisa_aproximada_interativa(CAMPO_NOME_USUARIO);
+            return;
+        case 4: // Completar nome
+            completar_prefixo_interativo(CAMPO_NOME_USUARIO);
+            return;
+        default:
+            printf("[ERRO] Opcao invalida.\n");
+            return;
+    }
+
+    int *resultados = malloc(sizeof(int) * MAX_USUARIOS);
+    if (resultados == NULL) {
+        printf("[ERRO] Memoria insuficiente para a pesquisa.\n");
+        return;
+    }
+    int num_resultados = api_pesquisar_usuarios(mat, termo, resultados);
+    ordenar_resultados_usuarios(resultados, num_resultados);
+
+    // Exibição dos resultados
+    pthread_rwlock_rdlock(&trava_usuarios);
+    if (num_resultados > 0) {
+        printf("\n--- Resultados da Pesquisa (%d encontrado(s)) ---\n", num_resultados);
+        exibir_usuarios(stdout, resultados, num_resultados, NULL);
+    } else {
+        printf("\n[INFO] Nenhum usuario encontrado com os criterios fornecidos.\n");
+    }
+    pthread_rwlock_unlock(&trava_usuarios);
+    free(resultados);
+}
+
+// --- VARREDURAS PARALELAS DE EMPRÉSTIMOS ---
+
+typedef bool (*PredicadoEmprestimo)(const Emprestimo *emprestimo, const void *parametro);
+
+// Resultados parciais da filtragem: uma lista de posições por trabalhador
+typedef struct {
+    const Instantaneo *inst;
+    PredicadoEmprestimo predicado;
+    const void *parametro;
+    int **indices;
+    int *quantidades;
+    int *capacidades;
+    atomic_bool sem_memoria;
+} ContextoFiltro;
+
+void particao_filtro(void *contexto, int inicio, int fim, int id_trabalhador) {
+    ContextoFiltro *ctx = contexto;
+    for (int i = inicio; i < fim; i++) {
+        if (!ctx->predicado(&ctx->inst->emprestimos[i], ctx->parametro)) {
+            continue;
+        }
+        if (ctx->quantidades[id_trabalhador] == ctx->capacidades[id_trabalhador]) {
+            int nova_capacidade = ctx->capacidades[id_trabalhador] * 2 + 64;
+            int *maior = realloc(ctx->indices[id_trabalhador], sizeof(int) * nova_capacidade);
+            if (maior == NULL) {
+                atomic_store(&ctx->sem_memoria, true);
+                return;
+            }
+            ctx->indices[id_trabalhador] = maior;
+            ctx->capacidades[id_trabalhador] = nova_capacidade;
+        }
+        ctx->indices[id_trabalhador][ctx->quantidades[id_trabalhador]++] = i;
+    }
+}
+
+int comparar_inteiros(const void *a, const void *b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Filtra em paralelo os empréstimos do instantâneo. Retorna a quantidade encontrada e, em
+// '*saida', as posições em ordem crescente (liberar com free); retorna -1 se faltar memória.
+int filtrar_emprestimos(const Instantaneo *inst, PredicadoEmprestimo predicado, const void *parametro, int **saida) {
+    int num_parciais = obter_threads_relatorio();
+    ContextoFiltro ctx;
+    ctx.inst = inst;
+    ctx.predicado = predicado;
+    ctx.parametro = parametro;
+    ctx.indices = calloc(num_parciais, sizeof(int *));
+    ctx.quantidades = calloc(num_parciais, sizeof(int));
+    ctx.capacidades = calloc(num_parciais, sizeof(int));
+    atomic_init(&ctx.sem_memoria, false);
+    if (ctx.indices == NULL || ctx.quantidades == NULL || ctx.capacidades == NULL) {
+        free(ctx.indices);
+        free(ctx.quantidades);
+        free(ctx.capacidades);
+        return -1;
+    }
+
+    int usados = executar_em_paralelo(inst->total_emprestimos, num_parciais, particao_filtro, &ctx);
+
+    // Junção: concatena os parciais e restaura a ordem original do vetor
+    int total = 0;
+    for (int t = 0; t < usados; t++) {
+        total += ctx.quantidades[t];
+    }
+    int *resultado = malloc(sizeof(int) * (total + 1));
+    if (resultado != NULL && !atomic_load(&ctx.sem_memoria)) {
+        int pos = 0;
+        for (int t = 0; t < usados; t++) {
+            memcpy(resultado + pos, ctx.indices[t], sizeof(int) * ctx.quantidades[t]);
+            pos += ctx.quantidades[t];
+        }
+        qsort(resultado, total, sizeof(int), comparar_inteiros);
+    } else {
+        free(resultado);
+        resultado = NULL;
+        total = -1;
+    }
+
+    for (int t = 0; t < num_parciais; t++) {
+        free(ctx.indices[t]);
+    }
+    free(ctx.indices);
+    free(ctx.quantidades);
+    free(ctx.capacidades);
+    *saida = resultado;
+    return total;
+}
+
+bool emprestimo_ativo(const Emprestimo *emprestimo, const void *parametro) {
+    (void)parametro;
+    return strcmp(emprestimo->status, "ATIVO") == 0;
+}
+
+// 'parametro' aponta para a data de referência (hoje)
+bool emprestimo_em_atraso(const Emprestimo *emprestimo, const void *parametro) {
+    const Data *hoje = parametro;
+    return strcmp(emprestimo->status, "ATIVO") == 0 &&
+           comparar_datas(*hoje, emprestimo->data_prevista_devolucao) > 0;
+}
+
+// Chave de ordenação de um empréstimo do instantâneo; livro ou usuário ausente vai ao fim
+uint32_t chave_do_emprestimo(const Instantaneo *inst, const Emprestimo *e, const int *posto) {
+    int idx;
+    switch (opcoes_saida.ordem) {
+        case ORDEM_DEVOLUCAO:
+            return chave_da_data(e->data_prevista_devolucao);
+        case ORDEM_TITULO:
+            idx = instantaneo_buscar_livro(inst, e->codigo_livro);
+            return idx != -1 ? (uint32_t)posto[idx] : UINT32_MAX;
+        default:
+            idx = instantaneo_buscar_usuario(inst, e->matricula_usuario);
+            return idx != -1 ? (uint32_t)posto[idx] : UINT32_MAX;
+    }
+}
+
+// A mesma chave, para intercalar com os empréstimos de outras unidades (ver COLETA)
+void saida_chave_emprestimo(SaidaRelatorio *s, const Instantaneo *inst, const Emprestimo *e) {
+    if (s->coleta == NULL || opcoes_saida.ordem == ORDEM_CADASTRO) {
+        return;
+    }
+    if (opcoes_saida.ordem == ORDEM_DEVOLUCAO) {
+        saida_chave_numero(s, dias_desde_epoca(e->data_prevista_devolucao));
+        return;
+    }
+    const char *texto = NULL;
+    if (opcoes_saida.ordem == ORDEM_TITULO) {
+        int idx = instantaneo_buscar_livro(inst, e->codigo_livro);
+        texto = idx != -1 ? inst->livros[idx].titulo : NULL;
+    } else {
+        int idx = instantaneo_buscar_usuario(inst, e->matricula_usuario);
+        texto = idx != -1 ? inst->usuarios[idx].nome : NULL;
+    }
+    if (texto != NULL) {
+        saida_chave_texto(s, texto);
+    } else {
+        saida_chave_numero(s, 1); // Livro ou usuário ausente vai ao fim
+    }
+}
+
+// Reordena as posições de empréstimos filtradas do instantâneo pela ordem das opções de
+// saída, se ela estiver entre as 'permitidas' (data prevista, título do livro ou nome do
+// usuário); nas demais ficam na ordem do vetor
+void ordenar_emprestimos(const Instantaneo *inst, int *linhas, int n, unsigned int permitidas) {
+    OrdemListagem ordem = opcoes_saida.ordem;
+    if (n < 2 || !(permitidas & ORDEM(ordem)) ||
+        (ordem != ORDEM_DEVOLUCAO && ordem != ORDEM_TITULO && ordem != ORDEM_USUARIO)) {
+        return;
+    }
+    uint32_t *chaves = malloc(sizeof(uint32_t) * n);
+    const int *posto = NULL;
+    bool ok = chaves != NULL;
+    if (ok && ordem != ORDEM_DEVOLUCAO) {
+        posto = obter_postos(ordem == ORDEM_TITULO ? CAMPO_TITULO : CAMPO_NOME_USUARIO, inst->geracao_carga);
+        ok = posto != NULL;
+    }
+    if (ok) {
+        for (int i = 0; i < n; i++) {
+            chaves[i] = chave_do_emprestimo(inst, &inst->emprestimos[linhas[i]], posto);
+        }
+        if (posto != NULL) {
+            liberar_postos();
+        }
+        ok = ordenar_linhas(linhas, chaves, n);
+    }
+    free(chaves);
+    if (!ok) {
+        fprintf(stderr, "[AVISO] Nao foi possivel ordenar; emprestimos na ordem do cadastro.\n");
+    }
+}
+
+const ColunaSaida colunas_emprestimos_ativos[] = {
+    {"Cod. Emp", "codigo_emprestimo", 8},
+    {"Matr. Usuario", "matricula_usuario", 13},
+    {"Cod. Livro", "codigo_livro", 10},
+    {"Data Emp.", "data_emprestimo", 10},
+    {"Data Prev. Dev.", "data_prevista_devolucao", 15},
+    {"Status", "status", 0},
+};
+
+// Função para listar empréstimos ativos
+void listar_emprestimos_ativos() {
+    int contador = 0;
+    // Lista a partir de um instantâneo: novos empréstimos e devoluções não ficam bloqueados
+    Instantaneo *inst = obter_instantaneo();
+    if (inst == NULL) {
+        return;
+    }
+    int *ativos;
+    contador = filtrar_emprestimos(inst, emprestimo_ativo, NULL, &ativos);
+    if (contador < 0) {
+        liberar_instantaneo(inst);
+        printf("[ERRO] Memoria insuficiente para listar os emprestimos.\n");
+        return;
+    }
+    ordenar_emprestimos(inst, ativos, contador, ORDEM(ORDEM_DEVOLUCAO) | ORDEM(ORDEM_TITULO) | ORDEM(ORDEM_USUARIO));
+
+    SaidaRelatorio saida;
+    saida_iniciar(&saida, stdout, colunas_emprestimos_ativos, NUM_COLUNAS(colunas_emprestimos_ativos));
+    Data hoje = data_atual();
+    char texto[64];
+    snprintf(texto, sizeof(texto), "Data Atual: %d/%d/%d\n", hoje.dia, hoje.mes, hoje.ano);
+    saida_texto(&saida, "\n--- Lista de Emprestimos Ativos ---\n");
+    saida_texto(&saida, texto);
+    saida_cabecalho(&saida);
+
+    for (int k = 0; k < contador; k++) {
+        if (!saida_linha(&saida)) continue;
+        const Emprestimo *e = &inst->emprestimos[ativos[k]];
+        saida_chave_emprestimo(&saida, inst, e);
+        saida_campo_inteiro(&saida, e->codigo_emprestimo);
+        saida_campo_inteiro(&saida, e->matricula_usuario);
+        saida_campo_inteiro(&saida, e->codigo_livro);
+        saida_campo_data(&saida, e->data_emprestimo);
+        saida_campo_data(&saida, e->data_prevista_devolucao);
+        saida_campo_texto(&saida, e->status);
+        saida_fim_linha(&saida);
+    }
+
+    liberar_instantaneo(inst);
+    free(ativos);
+    saida_separador(&saida);
+    snprintf(texto, sizeof(texto), "Total de emprestimos ativos: %d\n", contador);
+    saida_texto(&saida, texto);
+
+    if (contador == 0) {
+        saida_texto(&saida, "[INFO] Nao ha emprestimos ativos no momento.\n");
+    }
+    saida_finalizar(&saida);
+}
+
+// --- PARTE 5: FUNCIONALIDADES AVANÇADAS (RELATÓRIOS) ---
+
+// Contadores parciais do ranking: um vetor de contagem por trabalhador
+typedef struct {
+    const Instantaneo *inst;
+    int *contagens; // [trabalhador * total_livros + posição do livro]
+} ContextoRanking;
+
+void particao_ranking(void *contexto, int inicio, int fim, int id_trabalhador) {
+    ContextoRanking *ctx = contexto;
+    int *contagem = ctx->contagens + (size_t)id_trabalhador * ctx->inst->total_livros;
+    for (int i = inicio; i < fim; i++) {
+        int idx_livro = instantaneo_buscar_livro(ctx->inst, ctx->inst->emprestimos[i].codigo_livro);
+        if (idx_livro != -1) {
+            contagem[idx_livro]++;
+        }
+    }
+}
+
+const ColunaSaida colunas_ranking[] = {
+    {"RANK", "rank", 4},
+    {"Codigo", "codigo_livro", 6},
+    {"Titulo", "titulo", -10},
+    {"Total Emprestimos", "total_emprestimos", 17},
+};
+
+// Relatório de livros mais emprestados
+void relatorio_livros_mais_emprestados() {
+    // O relatório roda sobre um instantâneo consistente, sem bloquear o balcão de empréstimos
+    Instantaneo *inst = obter_instantaneo();
+    if (inst == NULL) {
+        return;
+    }
+    SaidaRelatorio saida;
+    saida_iniciar(&saida, stdout, colunas_ranking, NUM_COLUNAS(colunas_ranking));
+    saida_texto(&saida, "\n--- Relatorio de Livros Mais Emprestados ---\n");
+    if (inst->total_emprestimos == 0) {
+        liberar_instantaneo(inst);
+        saida_cabecalho(&saida);
+        saida_separador(&saida);
+        saida_texto(&saida, "[INFO] Nao ha emprestimos registrados para gerar o relatorio.\n");
+        saida_finalizar(&saida);
+        return;
+    }
+
+    int num_parciais = obter_threads_relatorio();
+    ContextoRanking ctx;
+    ctx.inst = inst;
+    ctx.contagens = calloc((size_t)num_parciais * (inst->total_livros + 1), sizeof(int));
+    int *contagem_emprestimos = malloc(sizeof(int) * (inst->total_livros + 1));
+    int *livro_posicoes = malloc(sizeof(int) * (inst->total_livros + 1));
+    int *ordem = malloc(sizeof(int) * (inst->total_livros + 1));
+    int *rank = malloc(sizeof(int) * (inst->total_livros + 1));
+    uint32_t *chaves = malloc(sizeof(uint32_t) * (inst->total_livros + 1));
+    if (ctx.contagens == NULL || contagem_emprestimos == NULL || livro_posicoes == NULL ||
+        ordem == NULL || rank == NULL || chaves == NULL) {
+        free(ctx.contagens);
+        free(contagem_emprestimos);
+        free(livro_posicoes);
+        free(ordem);
+        free(rank);
+        free(chaves);
+        liberar_instantaneo(inst);
+        saida_finalizar(&saida);
+        printf("[ERRO] Memoria insuficiente para gerar o relatorio.\n");
+        return;
+    }
+    int num_livros_distintos = 0;
+
+    // 1. Contar as ocorrências de cada livro em todos os empréstimos (ativos e devolvidos),
+    //    cada trabalhador em seu próprio vetor de contagem
+    int usados = executar_em_paralelo(inst->total_emprestimos, num_parciais, particao_ranking, &ctx);
+
+    // Junção dos parciais: apenas livros com pelo menos um empréstimo entram no ranking
+    for (int l = 0; l < inst->total_livros; l++) {
+        int soma = 0;
+        for (int t = 0; t < usados; t++) {
+            soma += ctx.contagens[(size_t)t * inst->total_livros + l];
+        }
+        if (soma > 0) {
+            livro_posicoes[num_livros_distintos] = l;
+            contagem_emprestimos[num_livros_distintos] = soma;
+            num_livros_distintos++;
+        }
+    }
+    free(ctx.contagens);
+
+    // 2. Ordenar os livros por contagem, a maior primeiro (radix sort; empate: ordem do
+    //    cadastro). Com --sort title o ranking é reordenado pelo título, mantendo o RANK.
+    for (int k = 0; k < num_livros_distintos; k++) {
+        ordem[k] = k;
+        chaves[k] = UINT32_MAX - (uint32_t)contagem_emprestimos[k];
+    }
+    bool ordenado = ordenar_linhas(ordem, chaves, num_livros_distintos);
+    for (int i = 0; i < num_livros_distintos; i++) {
+        rank[ordem[i]] = i + 1;
+    }
+    if (ordenado && opcoes_saida.ordem == ORDEM_TITULO) {
+        const int *posto = obter_postos(CAMPO_TITULO, inst->geracao_carga);
+        ordenado = posto != NULL;
+        if (ordenado) {
+            for (int i = 0; i < num_livros_distintos; i++) {
+                chaves[i] = (uint32_t)posto[livro_posicoes[ordem[i]]];
+            }
+            liberar_postos();
+            ordenado = ordenar_linhas(ordem, chaves, num_livros_distintos);
+        }
+    }
+    if (!ordenado) {
+        fprintf(stderr, "[AVISO] Memoria insuficiente para ordenar o ranking.\n");
+    }
+
+    // 3. Exibir o resultado (no comando "all" o RANK é refeito sobre todas as unidades)
+    saida_cabecalho(&saida);
+    for (int i = 0; i < num_livros_distintos; i++) {
+        if (saida_linha(&saida)) {
+            int k = ordem[i];
+            const Livro *livro = &inst->livros[livro_posicoes[k]];
+            saida_chave_posto(&saida, 0, -(long long)contagem_emprestimos[k]);
+            if (opcoes_saida.ordem == ORDEM_TITULO) {
+                saida_chave_texto(&saida, livro->titulo);
+            } else {
+                saida_chave_numero(&saida, -(long long)contagem_emprestimos[k]);
+            }
+            saida_campo_inteiro(&saida, rank[k]);
+            saida_campo_inteiro(&saida, livro->codigo);
+            saida_campo_texto(&saida, livro->titulo);
+            saida_campo_inteiro(&saida, contagem_emprestimos[k]);
+            saida_fim_linha(&saida);
+        }
+    }
+    liberar_instantaneo(inst);
+    saida_separador(&saida);
+    saida_finalizar(&saida);
+    free(contagem_emprestimos);
+    free(livro_posicoes);
+    free(ordem);
+    free(rank);
+    free(chaves);
+}
+
+const ColunaSaida colunas_atrasos[] = {
+    {"Matricula", "matricula_usuario", 9},
+    {"Nome do Usuario", "nome", -15},
+    {"Cod. Emp", "codigo_emprestimo", 8},
+    {"Data Prev. Dev.", "data_prevista_devolucao", 15},
+};
+
+// Relatório de usuários com empréstimos em atraso
+void relatorio_usuarios_em_atraso() {
+    Data hoje = data_atual();
+    int contador = 0;
+
+    Instantaneo *inst = obter_instantaneo();
+    if (inst == NULL) {
+        return;
+    }
+
+    // Verifica, em paralelo, quais estão ATIVOS e se HOJE é depois da DATA PREVISTA
+    int *atrasados;
+    int num_atrasados = filtrar_emprestimos(inst, emprestimo_em_atraso, &hoje, &atrasados);
+    if (num_atrasados < 0) {
+        liberar_instantaneo(inst);
+        printf("[ERRO] Memoria insuficiente para gerar o relatorio.\n");
+        return;
+    }
+    ordenar_emprestimos(inst, atrasados, num_atrasados, ORDEM(ORDEM_DEVOLUCAO) | ORDEM(ORDEM_USUARIO));
+
+    SaidaRelatorio saida;
+    saida_iniciar(&saida, stdout, colunas_atrasos, NUM_COLUNAS(colunas_atrasos));
+    char texto[64];
+    snprintf(texto, sizeof(texto), "Data Atual: %d/%d/%d\n", hoje.dia, hoje.mes, hoje.ano);
+    saida_texto(&saida, "\n--- Relatorio de Usuarios com Emprestimos em Atraso ---\n");
+    saida_texto(&saida, texto);
+    saida_cabecalho(&saida);
+
+    for (int k = 0; k < num_atrasados; k++) {
+        const Emprestimo *e = &inst->emprestimos[atrasados[k]];
+        int idx_usuario = instantaneo_buscar_usuario(inst, e->matricula_usuario);
+
+        if (idx_usuario != -1) {
+            if (saida_linha(&saida)) {
+                saida_chave_emprestimo(&saida, inst, e);
+                saida_campo_inteiro(&saida, e->matricula_usuario);
+                saida_campo_texto(&saida, inst->usuarios[idx_usuario].nome);
+                saida_campo_inteiro(&saida, e->codigo_emprestimo);
+                saida_campo_data(&saida, e->data_prevista_devolucao);
+                saida_fim_linha(&saida);
+            }
+            contador++;
+        }
+    }
+
+    liberar_instantaneo(inst);
+    free(atrasados);
+
+    saida_separador(&saida);
+    snprintf(texto, sizeof(texto), "Total de emprestimos em atraso: %d\n", contador);
+    saida_texto(&saida, texto);
+
+    if (contador == 0) {
+        saida_texto(&saida, "[INFO] Parabens! Nenhum emprestimo em atraso encontrado.\n");
+    }
+    saida_finalizar(&saida);
+}
+
+const ColunaSaida colunas_reservas[] = {
+    {"Livro", "codigo_livro", 6},
+    {"Fila", "posicao", 4},
+    {"Cod. Res", "codigo_reserva", 8},
+    {"Matricula", "matricula_usuario", 9},
+    {"Nome do Usuario", "nome", -15},
+    {"Data Reserva", "data_reserva", 12},
+};
+
+// Relatório de reservas pendentes: percorre apenas as filas, na ordem de atendimento
+void relatorio_reservas_pendentes() {
+    SaidaRelatorio saida;
+    saida_iniciar(&saida, stdout, colunas_reservas, NUM_COLUNAS(colunas_reservas));
+    saida_texto(&saida, "\n--- Relatorio de Reservas Pendentes ---\n");
+    saida_cabecalho(&saida);
+    int contador = 0;
+
+    travar_leitura_cadastros();
+    for (int i = 0; i < total_livros; i++) {
+        pthread_mutex_t *trava_livro = trava_do_livro(acervo_livros[i].codigo);
+        pthread_mutex_lock(trava_livro);
+        int posicao = 1;
+        for (int r = inicio_fila_reservas[i]; r != -1; r = lista_reservas[r].proxima) {
+            const Reserva *reserva = &lista_reservas[r];
+            if (saida_linha(&saida)) {
+                int idx_usuario = buscar_usuario_por_matricula(reserva->matricula_usuario);
+                saida_campo_inteiro(&saida, acervo_livros[i].codigo);
+                saida_campo_inteiro(&saida, posicao);
+                saida_campo_inteiro(&saida, reserva->codigo_reserva);
+                saida_campo_inteiro(&saida, reserva->matricula_usuario);
+                saida_campo_texto(&saida, idx_usuario != -1 ? lista_usuarios[idx_usuario].nome : "?");
+                saida_campo_data(&saida, reserva->data_reserva);
+                saida_fim_linha(&saida);
+            }
+            posicao++;
+            contador++;
+        }
+        pthread_mutex_unlock(trava_livro);
+    }
+    destravar_cadastros();
+
+    saida_separador(&saida);
+    char texto[64];
+    snprintf(texto, sizeof(texto), "Total de reservas pendentes: %d\n", contador);
+    saida_texto(&saida, texto);
+    saida_finalizar(&saida);
+}
+
+
+// --- PAINÉIS A PARTIR DOS AGREGADOS ---
+
+// Os relatórios abaixo só leem os contadores de AGREGADOS DOS EMPRÉSTIMOS: o custo depende
+// do número de dias, cursos ou editoras, não do tamanho do histórico.
+#define DIAS_PAINEL_DIARIO 30
+
+double duracao_media(ResumoAgregado r) {
+    return r.devolvidos_com_data > 0 ? (double)r.dias_emprestado / r.devolvidos_com_data : 0.0;
+}
+
+double taxa_atraso(ResumoAgregado r) {
+    return r.devolvidos_com_data > 0 ? 100.0 * r.devolvidos_em_atraso / r.devolvidos_com_data : 0.0;
+}
+
+// Colunas comuns aos painéis, depois da coluna do dia, mês ou grupo
+void escrever_resumo_agregado(SaidaRelatorio *s, ResumoAgregado r) {
+    saida_campo_inteiro(s, r.emprestimos);
+    saida_campo_inteiro(s, r.emprestimos - r.devolvidos);
+    saida_campo_inteiro(s, r.devolvidos);
+    saida_campo_decimal(s, duracao_media(r), r.devolvidos_com_data > 0);
+    saida_campo_decimal(s, taxa_atraso(r), r.devolvidos_com_data > 0);
+}
+
+void escrever_total_agregado(SaidaRelatorio *s, ResumoAgregado r) {
+    char texto[160];
+    snprintf(texto, sizeof(texto), "Total: %d emprestimo(s), %d ativo(s), %d devolvido(s)\n",
+             r.emprestimos, r.emprestimos - r.devolvidos, r.devolvidos);
+    saida_texto(s, texto);
+    if (r.devolvidos_com_data > 0) {
+        snprintf(texto, sizeof(texto), "Duracao media: %.1f dia(s); %.1f%% das devolucoes com data passaram do prazo\n",
+                 duracao_media(r), taxa_atraso(r));
+        saida_texto(s, texto);
+    }
+}
+
+// Empréstimos sem dia na série diária estão no total mas em nenhuma linha dos painéis
+// por data; o aviso vai para stderr para valer também em csv/jsonl
+void avisar_fora_da_serie(ResumoAgregado fora) {
+    if (fora.emprestimos > 0) {
+        fprintf(stderr, "[AVISO] %d emprestimo(s) sem dia na serie diaria (data fora da janela ou memoria insuficiente); contados apenas no total.\n",
+                fora.emprestimos);
+    }
+}
+
+#define COLUNAS_RESUMO_AGREGADO \
+    {"Emprestimos", "emprestimos", 11}, \
+    {"Ativos", "ativos", 6}, \
+    {"Devolvidos", "devolvidos", 10}, \
+    {"Duracao Media", "duracao_media_dias", 13}, \
+    {"Atraso (%)", "taxa_atraso", 10}
+
+const ColunaSaida colunas_painel_diario[] = {
+    {"Data", "data", 10},
+    COLUNAS_RESUMO_AGREGADO,
+};
+
+const ColunaSaida colunas_painel_mensal[] = {
+    {"Mes", "mes", 7},
+    COLUNAS_RESUMO_AGREGADO,
+};
+
+const ColunaSaida colunas_painel_cursos[] = {
+    {"Curso", "curso", -24},
+    COLUNAS_RESUMO_AGREGADO,
+};
+
+const ColunaSaida colunas_painel_editoras[] = {
+    {"Editora", "editora", -24},
+    COLUNAS_RESUMO_AGREGADO,
+};
+
+// Empréstimos iniciados em cada um dos últimos DIAS_PAINEL_DIARIO dias
+void relatorio_emprestimos_por_dia() {
+    SaidaRelatorio saida;
+    saida_iniciar(&saida, stdout, colunas_painel_diario, NUM_COLUNAS(colunas_painel_diario));
+    saida_texto(&saida, "\n--- Emprestimos por Dia (ultimos 30 dias) ---\n");
+    saida_cabecalho(&saida);
+
+    ResumoAgregado periodo;
+    memset(&periodo, 0, sizeof(periodo));
+    int hoje = dias_desde_epoca(data_atual());
+    travar_leitura_cadastros();
+    ResumoAgregado fora = ler_agregado(&agregado_fora_da_serie);
+    for (int dia = hoje - DIAS_PAINEL_DIARIO + 1; dia <= hoje; dia++) {
+        int d = dia - primeiro_dia_agregado;
+        ResumoAgregado r;
+        memset(&r, 0, sizeof(r));
+        if (d >= 0 && d < num_dias_agregados) {
+            r = ler_agregado(&agregados_dias[d]);
+        }
+        somar_resumo(&periodo, r);
+        if (saida_linha(&saida)) {
+            saida_chave_numero(&saida, dia);
+            saida_campo_data(&saida, data_de_dias(dia));
+            escrever_resumo_agregado(&saida, r);
+            saida_fim_linha(&saida);
+        }
+    }
+    destravar_cadastros();
+
+    saida_separador(&saida);
+    escrever_total_agregado(&saida, periodo);
+    saida_finalizar(&saida);
+    avisar_fora_da_serie(fora);
+}
+
+// Empréstimos iniciados em cada mês, do primeiro registrado até o atual (ou até o último
+// com empréstimo, se houver algum com data futura)
+void relatorio_emprestimos_por_mes() {
+    SaidaRelatorio saida;
+    saida_iniciar(&saida, stdout, colunas_painel_mensal, NUM_COLUNAS(colunas_painel_mensal));
+    saida_texto(&saida, "\n--- Emprestimos por Mes ---\n");
+    saida_cabecalho(&saida);
+
+    int hoje = dias_desde_epoca(data_atual());
+    travar_leitura_cadastros();
+    ResumoAgregado total = ler_agregado(&agregado_total);
+    ResumoAgregado fora = ler_agregado(&agregado_fora_da_serie);
+    ResumoAgregado mes;
+    memset(&mes, 0, sizeof(mes));
+    int ultimo = num_dias_agregados > 0 ? hoje - primeiro_dia_agregado : -1;
+    for (int d = num_dias_agregados - 1; d > ultimo; d--) {
+        if (atomic_load_explicit(&agregados_dias[d].emprestimos, memory_order_relaxed) > 0) {
+            ultimo = d;
+        }
+    }
+    for (int d = 0; d <= ultimo && d < num_dias_agregados; d++) {
+        somar_resumo(&mes, ler_agregado(&agregados_dias[d]));
+        Data data = data_de_dias(primeiro_dia_agregado + d);
+        if ((d == ultimo || data.dia == dias_no_mes(data.mes, data.ano)) && saida_linha(&saida)) {
+            char rotulo[16];
+            snprintf(rotulo, sizeof(rotulo), "%04d-%02d", data.ano, data.mes);
+            saida_chave_numero(&saida, data.ano * 12 + data.mes);
+            saida_campo_texto(&saida, rotulo);
+            escrever_resumo_agregado(&saida, mes);
+            saida_fim_linha(&saida);
+        }
+        if (data.dia == dias_no_mes(data.mes, data.ano)) {
+            memset(&mes, 0, sizeof(mes));
+        }
+    }
+    destravar_cadastros();
+
+    saida_separador(&saida);
+    escrever_total_agregado(&saida, total);
+    saida_finalizar(&saida);
+    avisar_fora_da_serie(fora);
+}
+
+typedef struct {
+    int grupo;
+    ResumoAgregado resumo;
+} LinhaPainel;
+
+// Mais empréstimos primeiro; empate pela ordem em que o grupo apareceu
+int comparar_linhas_painel(const void *a, const void *b) {
+    const LinhaPainel *x = a;
+    const LinhaPainel *y = b;
+    if (x->resumo.emprestimos != y->resumo.emprestimos) {
+        return y->resumo.emprestimos - x->resumo.emprestimos;
+    }
+    return x->grupo - y->grupo;
+}
+
+void relatorio_agregado_por_grupo(DimensaoAgregada dimensao) {
+    const GruposAgregados *g = &grupos_agregados[dimensao];
+    SaidaRelatorio saida;
+    if (dimensao == AGREGADO_CURSO) {
+        saida_iniciar(&saida, stdout, colunas_painel_cursos, NUM_COLUNAS(colunas_painel_cursos));
+        saida_texto(&saida, "\n--- Emprestimos por Curso ---\n");
+    } else {
+        saida_iniciar(&saida, stdout, colunas_painel_editoras, NUM_COLUNAS(colunas_painel_editoras));
+        saida_texto(&saida, "\n--- Emprestimos por Editora ---\n");
+    }
+
+    travar_leitura_cadastros();
+    LinhaPainel *linhas = malloc(sizeof(LinhaPainel) * (g->num_grupos + 1));
+    if (linhas == NULL) {
+        destravar_cadastros();
+        saida_finalizar(&saida);
+        printf("[ERRO] Memoria insuficiente para gerar o relatorio.\n");
+        return;
+    }
+    for (int i = 0; i < g->num_grupos; i++) {
+        linhas[i].grupo = i;
+        linhas[i].resumo = ler_agregado(&g->contadores[i]);
+    }
+    qsort(linhas, g->num_grupos, sizeof(LinhaPainel), comparar_linhas_painel);
+
+    saida_cabecalho(&saida);
+    for (int i = 0; i < g->num_grupos; i++) {
+        if (saida_linha(&saida)) {
+            saida_chave_numero(&saida, -(long long)linhas[i].resumo.emprestimos);
+            saida_campo_texto(&saida, texto_da_dimensao(dimensao, g->representantes[linhas[i].grupo]));
+            escrever_resumo_agregado(&saida, linhas[i].resumo);
+            saida_fim_linha(&saida);
+        }
+    }
+    ResumoAgregado total = ler_agregado(&agregado_total);
+    destravar_cadastros();
+    free(linhas);
+
+    saida_separador(&saida);
+    escrever_total_agregado(&saida, total);
+    saida_finalizar(&saida);
+}
+
+void relatorio_emprestimos_por_curso() {
+    relatorio_agregado_por_grupo(AGREGADO_CURSO);
+}
+
+void relatorio_emprestimos_por_editora() {
+    relatorio_agregado_por_grupo(AGREGADO_EDITORA);
+}
+
+// --- PARTE 2: SISTEMA DE MENUS E CONTROLE DE FLUXO ---
+
+void menu_livros() {
+    int opcao;
+    do {
         printf("\n========== Menu Livros ==========\n");
         printf("1. Cadastrar Novo Livro\n");
         printf("2. Pesquisar Livro\n");
@@ -933,190 +6766,1553 @@ void menu_livros() {
             limpar_buffer();
             continue;
         }
-        limpar_buffer();
+        limpar_buffer();
+
+        switch (opcao) {
+            case 1:
+                cadastrar_livro();
+                break;
+            case 2:
+                pesquisar_livros();
+                break;
+            case 0:
+                printf("[INFO] Voltando ao Menu Principal.\n");
+                break;
+            default:
+                printf("[ERRO] Opcao invalida. Tente novamente.\n");
+        }
+    } while (opcao != 0);
+}
+
+void menu_usuarios() {
+    int opcao;
+    do {
+        printf("\n========== Menu Usuarios ==========\n");
+        printf("1. Cadastrar Novo Usuario\n");
+        printf("2. Pesquisar Usuario\n");
+        printf("0. Voltar ao Menu Principal\n");
+        printf("Escolha uma opcao: ");
+
+        if (scanf("%d", &opcao) != 1) {
+            printf("[ERRO] Entrada invalida. Por favor, digite um numero.\n");
+            limpar_buffer();
+            continue;
+        }
+        limpar_buffer();
+
+        switch (opcao) {
+            case 1:
+                cadastrar_usuario();
+                break;
+            case 2:
+                pesquisar_usuarios();
+                break;
+            case 0:
+                printf("[INFO] Voltando ao Menu Principal.\n");
+                break;
+            default:
+                printf("[ERRO] Opcao invalida. Tente novamente.\n");
+        }
+    } while (opcao != 0);
+}
+
+void menu_emprestimos() {
+    int opcao;
+    do {
+        printf("\n========== Menu Emprestimos ==========\n");
+        printf("1. Realizar Emprestimo\n");
+        printf("2. Realizar Devolucao\n");
+        printf("3. Renovar Emprestimo\n"); // Parte 5
+        printf("4. Listar Emprestimos Ativos\n");
+        printf("5. Reservar Livro\n");
+        printf("0. Voltar ao Menu Principal\n");
+        printf("Escolha uma opcao: ");
+
+        if (scanf("%d", &opcao) != 1) {
+            printf("[ERRO] Entrada invalida. Por favor, digite um numero.\n");
+            limpar_buffer();
+            continue;
+        }
+        limpar_buffer();
+
+        switch (opcao) {
+            case 1:
+                realizar_emprestimo();
+                break;
+            case 2:
+                realizar_devolucao();
+                break;
+            case 3:
+                renovar_emprestimo();
+                break;
+            case 4:
+                listar_emprestimos_ativos();
+                break;
+            case 5:
+                reservar_livro();
+                break;
+            case 0:
+                printf("[INFO] Voltando ao Menu Principal.\n");
+                break;
+            default:
+                printf("[ERRO] Opcao invalida. Tente novamente.\n");
+        }
+    } while (opcao != 0);
+}
+
+// Permite ajustar quantas threads os relatórios usam (0 = número de processadores)
+void configurar_threads_interativo() {
+    int n;
+    printf("Numero de threads para os relatorios (0 = automatico, max %d): ", MAX_THREADS_RELATORIO);
+    if (scanf("%d", &n) != 1 || n < 0) {
+        printf("[ERRO] Valor invalido.\n");
+        limpar_buffer();
+        return;
+    }
+    limpar_buffer();
+    configurar_threads_relatorio(n);
+    printf("[SUCESSO] Relatorios usarao %d thread(s).\n", obter_threads_relatorio());
+}
+
+// Lê um inteiro não negativo; mantém 'atual' se a entrada for inválida
+int ler_inteiro_opcional(const char *pergunta, int atual) {
+    int valor;
+    printf("%s (atual: %d): ", pergunta, atual);
+    if (scanf("%d", &valor) != 1 || valor < 0) {
+        printf("[ERRO] Valor invalido, mantido %d.\n", atual);
+        valor = atual;
+    }
+    limpar_buffer();
+    return valor;
+}
+
+// Ajusta formato, paginação, janela (deslocamento/limite) e ordem das listagens
+void configurar_saida_interativo() {
+    printf("Formato (1. Tabela  2. Registro  3. CSV  4. JSON Lines) (atual: %d): ", opcoes_saida.formato + 1);
+    int formato;
+    if (scanf("%d", &formato) != 1 || formato < 1 || formato > NUM_FORMATOS) {
+        printf("[ERRO] Formato invalido, mantido %s.\n", nomes_formatos[opcoes_saida.formato]);
+    } else {
+        opcoes_saida.formato = (FormatoSaida)(formato - 1);
+    }
+    limpar_buffer();
+    opcoes_saida.linhas_por_pagina = ler_inteiro_opcional("Linhas por pagina (0 = sem pausa)", opcoes_saida.linhas_por_pagina);
+    opcoes_saida.deslocamento = ler_inteiro_opcional("Pular as primeiras N linhas", opcoes_saida.deslocamento);
+    opcoes_saida.limite = ler_inteiro_opcional("Maximo de linhas (0 = todas)", opcoes_saida.limite);
+    printf("Ordem (1. Natural  2. Titulo  3. Autor  4. Data Prevista  5. Usuario  6. Contagem) (atual: %d): ",
+           opcoes_saida.ordem + 1);
+    int ordem;
+    if (scanf("%d", &ordem) != 1 || ordem < 1 || ordem > NUM_ORDENS) {
+        printf("[ERRO] Ordem invalida, mantida %s.\n", nomes_ordens[opcoes_saida.ordem]);
+    } else {
+        opcoes_saida.ordem = (OrdemListagem)(ordem - 1);
+    }
+    limpar_buffer();
+    printf("[SUCESSO] Saida: %s, %d linha(s) por pagina, pulando %d, limite %d, ordem %s.\n",
+           nomes_formatos[opcoes_saida.formato], opcoes_saida.linhas_por_pagina,
+           opcoes_saida.deslocamento, opcoes_saida.limite, nomes_ordens[opcoes_saida.ordem]);
+}
+
+void menu_relatorios() {
+    int opcao;
+    do {
+        printf("\n========== Menu Relatorios (Avancados) ==========\n");
+        printf("1. Livros Mais Emprestados\n");
+        printf("2. Usuarios com Emprestimos em Atraso\n");
+        printf("3. Configurar Threads dos Relatorios (atual: %d)\n", obter_threads_relatorio());
+        printf("4. Reservas Pendentes\n");
+        printf("5. Configurar Saida das Listagens (atual: %s)\n", nomes_formatos[opcoes_saida.formato]);
+        printf("6. Emprestimos por Dia (ultimos 30 dias)\n");
+        printf("7. Emprestimos por Mes\n");
+        printf("8. Emprestimos por Curso\n");
+        printf("9. Emprestimos por Editora\n");
+        printf("0. Voltar ao Menu Principal\n");
+        printf("Escolha uma opcao: ");
+
+        if (scanf("%d", &opcao) != 1) {
+            printf("[ERRO] Entrada invalida. Por favor, digite um numero.\n");
+            limpar_buffer();
+            continue;
+        }
+        limpar_buffer();
+
+        switch (opcao) {
+            case 1:
+                relatorio_livros_mais_emprestados();
+                break;
+            case 2:
+                relatorio_usuarios_em_atraso();
+                break;
+            case 3:
+                configurar_threads_interativo();
+                break;
+            case 4:
+                relatorio_reservas_pendentes();
+                break;
+            case 5:
+                configurar_saida_interativo();
+                break;
+            case 6:
+                relatorio_emprestimos_por_dia();
+                break;
+            case 7:
+                relatorio_emprestimos_por_mes();
+                break;
+            case 8:
+                relatorio_emprestimos_por_curso();
+                break;
+            case 9:
+                relatorio_emprestimos_por_editora();
+                break;
+            case 0:
+                printf("[INFO] Voltando ao Menu Principal.\n");
+                break;
+            default:
+                printf("[ERRO] Opcao invalida. Tente novamente.\n");
+        }
+    } while (opcao != 0);
+}
+
+void menu_estatisticas() {
+    int opcao;
+    do {
+        printf("\n========== Menu Estatisticas ==========\n");
+        printf("1. Exibir Contadores e Latencias\n");
+        printf("2. Gravar em Arquivo (%s)\n", ARQ_ESTATISTICAS);
+        printf("3. Zerar Estatisticas\n");
+        printf("0. Voltar ao Menu Principal\n");
+        printf("Escolha uma opcao: ");
+
+        if (scanf("%d", &opcao) != 1) {
+            printf("[ERRO] Entrada invalida. Por favor, digite um numero.\n");
+            limpar_buffer();
+            continue;
+        }
+        limpar_buffer();
+
+        switch (opcao) {
+            case 1:
+                printf("\n--- Estatisticas de Operacoes (tempo de processamento, sem digitacao) ---\n");
+                escrever_estatisticas(stdout);
+                break;
+            case 2:
+                if (salvar_estatisticas(ARQ_ESTATISTICAS)) {
+                    printf("[SUCESSO] Estatisticas gravadas em %s.\n", ARQ_ESTATISTICAS);
+                } else {
+                    printf("[ERRO] Nao foi possivel abrir %s para salvar.\n", ARQ_ESTATISTICAS);
+                }
+                break;
+            case 3:
+                zerar_estatisticas();
+                printf("[SUCESSO] Estatisticas zeradas.\n");
+                break;
+            case 0:
+                printf("[INFO] Voltando ao Menu Principal.\n");
+                break;
+            default:
+                printf("[ERRO] Opcao invalida. Tente novamente.\n");
+        }
+    } while (opcao != 0);
+}
+
+void menu_backup() {
+    int opcao;
+    do {
+        printf("\n========== Menu Backups ==========\n");
+        printf("1. Realizar Backup (Incremental)\n");
+        printf("2. Listar Geracoes de Backup\n");
+        printf("3. Restaurar uma Geracao\n");
+        printf("0. Voltar ao Menu Principal\n");
+        printf("Escolha uma opcao: ");
+
+        if (scanf("%d", &opcao) != 1) {
+            printf("[ERRO] Entrada invalida. Por favor, digite um numero.\n");
+            limpar_buffer();
+            continue;
+        }
+        limpar_buffer();
+
+        switch (opcao) {
+            case 1:
+                fazer_backup();
+                break;
+            case 2:
+                listar_backups();
+                break;
+            case 3: {
+                int geracao;
+                printf("Geracao a restaurar: ");
+                if (scanf("%d", &geracao) != 1 || geracao <= 0) {
+                    printf("[ERRO] Geracao invalida.\n");
+                    limpar_buffer();
+                    break;
+                }
+                limpar_buffer();
+                // Os dados atuais são substituídos: grava os arquivos para que a restauração persista
+                if (restaurar_backup(geracao)) {
+                    salvar_dados();
+                }
+                break;
+            }
+            case 0:
+                printf("[INFO] Voltando ao Menu Principal.\n");
+                break;
+            default:
+                printf("[ERRO] Opcao invalida. Tente novamente.\n");
+        }
+    } while (opcao != 0);
+}
+
+void menu_principal() {
+    int opcao;
+    do {
+        printf("\n============================================\n");
+        printf("  SISTEMA DE GERENCIAMENTO DE BIBLIOTECA\n");
+        printf("============================================\n");
+        printf("1. Gerenciar Livros\n");
+        printf("2. Gerenciar Usuarios\n");
+        printf("3. Gerenciar Emprestimos e Devolucoes\n");
+        printf("4. Relatorios Avancados\n");
+        printf("5. Backups dos Dados\n");
+        printf("6. Estatisticas de Operacoes\n");
+        printf("0. Sair do Sistema (Salvar e Fechar)\n");
+        printf("--------------------------------------------\n");
+        printf("Escolha uma opcao: ");
+
+        if (scanf("%d", &opcao) != 1) {
+            printf("[ERRO] Entrada invalida. Por favor, digite um numero.\n");
+            limpar_buffer();
+            continue;
+        }
+        limpar_buffer();
+
+        switch (opcao) {
+            case 1:
+                menu_livros();
+                break;
+            case 2:
+                menu_usuarios();
+                break;
+            case 3:
+                menu_emprestimos();
+                break;
+            case 4:
+                menu_relatorios();
+                break;
+            case 5:
+                menu_backup();
+                break;
+            case 6:
+                menu_estatisticas();
+                break;
+            case 0:
+                printf("\nEncerrando o sistema...\n");
+                break;
+            default:
+                printf("[ERRO] Opcao invalida. Tente novamente.\n");
+        }
+    } while (opcao != 0);
+}
+
+// --- LINHA DE COMANDO ---
+
+// Sem argumentos o programa abre os menus. Com argumentos executa um único comando sobre
+// os arquivos do diretório atual e termina, para uso em scripts e automação, ex.:
+//   library loan 2 1             empresta o livro 1 ao usuário de matrícula 2
+//   library search --title Dados
+// Registros são impressos no mesmo formato dos arquivos (campos separados por ';'); pesquisas
+// e relatórios aceitam --format, --limit e --offset (ver SAÍDA DE RELATÓRIOS E PESQUISAS);
+// avisos e erros vão para stderr. Comandos que alteram dados salvam os arquivos ao final.
+// Com --branch NOME o comando vale só para aquela unidade; "all" repete uma pesquisa ou
+// relatório em todas (ver UNIDADES).
+#define SAIDA_SUCESSO 0
+#define SAIDA_RECUSADA 1       // A operação foi recusada (ex.: sem exemplares)
+#define SAIDA_USO_INCORRETO 2  // Comando ou argumentos inválidos
+
+// Converte 'texto' em inteiro; falha se não for um número completo
+bool ler_inteiro_argumento(const char *texto, int *valor) {
+    char *fim;
+    long n = strtol(texto, &fim, 10);
+    if (fim == texto || *fim != '\0' || n < INT_MIN || n > INT_MAX) {
+        return false;
+    }
+    *valor = (int)n;
+    return true;
+}
+
+// Confere que os argumentos são pares "--opcao valor" com opções da lista 'permitidas'
+// (terminada em NULL) e devolve em 'valores' o valor de cada uma (NULL se ausente)
+bool ler_opcoes(int argc, char *argv[], const char *const *permitidas, const char **valores) {
+    for (int k = 0; permitidas[k] != NULL; k++) {
+        valores[k] = NULL;
+    }
+    for (int i = 0; i < argc; i += 2) {
+        int k = 0;
+        while (permitidas[k] != NULL && strcmp(argv[i], permitidas[k]) != 0) {
+            k++;
+        }
+        if (permitidas[k] == NULL || i + 1 >= argc) {
+            fprintf(stderr, "[ERRO] Opcao desconhecida ou sem valor: %s\n", argv[i]);
+            return false;
+        }
+        valores[k] = argv[i + 1];
+    }
+    return true;
+}
+
+// Lê os argumentos inteiros posicionais esperados pelo comando
+bool ler_argumentos_inteiros(int argc, char *argv[], int esperados, int *valores) {
+    if (argc != esperados) {
+        fprintf(stderr, "[ERRO] Numero de argumentos incorreto.\n");
+        return false;
+    }
+    for (int i = 0; i < esperados; i++) {
+        if (!ler_inteiro_argumento(argv[i], &valores[i])) {
+            fprintf(stderr, "[ERRO] Numero invalido: %s\n", argv[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int saida_recusada(ResultadoOperacao r) {
+    fprintf(stderr, "[ERRO] %s.\n", descrever_resultado(r));
+    return SAIDA_RECUSADA;
+}
+
+int comando_emprestar(int argc, char *argv[]) {
+    int args[2];
+    if (!ler_argumentos_inteiros(argc, argv, 2, args)) return SAIDA_USO_INCORRETO;
+    Emprestimo emprestimo;
+    ResultadoOperacao r = api_realizar_emprestimo(args[0], args[1], &emprestimo);
+    if (r != RESULTADO_OK) return saida_recusada(r);
+    escrever_emprestimo(stdout, &emprestimo);
+    return SAIDA_SUCESSO;
+}
+
+int comando_devolver(int argc, char *argv[]) {
+    int cod_emp;
+    if (!ler_argumentos_inteiros(argc, argv, 1, &cod_emp)) return SAIDA_USO_INCORRETO;
+    ResultadoDevolucao devolucao;
+    ResultadoOperacao r = api_realizar_devolucao(cod_emp, &devolucao);
+    if (r != RESULTADO_OK) return saida_recusada(r);
+    // O empréstimo encerrado e, se alguém estava na fila, o empréstimo criado para essa pessoa
+    escrever_emprestimo(stdout, &devolucao.emprestimo);
+    if (devolucao.reserva_atendida) {
+        escrever_emprestimo(stdout, &devolucao.emprestimo_reserva);
+    }
+    if (devolucao.em_atraso) {
+        fprintf(stderr, "[ATENCAO] Devolucao realizada com atraso!\n");
+    }
+    if (devolucao.reservas_canceladas > 0) {
+        fprintf(stderr, "[AVISO] %d reserva(s) cancelada(s): usuario(s) no limite de emprestimos.\n", devolucao.reservas_canceladas);
+    }
+    return SAIDA_SUCESSO;
+}
+
+int comando_renovar(int argc, char *argv[]) {
+    int cod_emp;
+    if (!ler_argumentos_inteiros(argc, argv, 1, &cod_emp)) return SAIDA_USO_INCORRETO;
+    Emprestimo emprestimo;
+    ResultadoOperacao r = api_renovar_emprestimo(cod_emp, &emprestimo, NULL);
+    if (r != RESULTADO_OK) return saida_recusada(r);
+    escrever_emprestimo(stdout, &emprestimo);
+    return SAIDA_SUCESSO;
+}
+
+int comando_reservar(int argc, char *argv[]) {
+    int args[2];
+    if (!ler_argumentos_inteiros(argc, argv, 2, args)) return SAIDA_USO_INCORRETO;
+    Reserva reserva;
+    int posicao;
+    ResultadoOperacao r = api_reservar_livro(args[0], args[1], &reserva, &posicao);
+    if (r != RESULTADO_OK) return saida_recusada(r);
+    escrever_reserva(stdout, &reserva);
+    fprintf(stderr, "[INFO] Posicao na fila: %d\n", posicao);
+    return SAIDA_SUCESSO;
+}
+
+int comando_cadastrar_livro(int argc, char *argv[]) {
+    static const char *const opcoes[] = {"--title", "--author", "--publisher", "--year", "--copies", NULL};
+    const char *valores[5];
+    if (!ler_opcoes(argc, argv, opcoes, valores)) return SAIDA_USO_INCORRETO;
+    Livro livro;
+    if (valores[0] == NULL || valores[1] == NULL || valores[2] == NULL ||
+        valores[3] == NULL || !ler_inteiro_argumento(valores[3], &livro.ano_publicacao) ||
+        valores[4] == NULL || !ler_inteiro_argumento(valores[4], &livro.total_exemplares)) {
+        fprintf(stderr, "[ERRO] Informe --title, --author, --publisher, --year e --copies.\n");
+        return SAIDA_USO_INCORRETO;
+    }
+    snprintf(livro.titulo, TAM_TITULO, "%s", valores[0]);
+    snprintf(livro.autor, TAM_AUTOR, "%s", valores[1]);
+    snprintf(livro.editora, TAM_EDITORA, "%s", valores[2]);
+    ResultadoOperacao r = api_cadastrar_livro(&livro, &livro);
+    if (r != RESULTADO_OK) return saida_recusada(r);
+    escrever_livro(stdout, &livro);
+    return SAIDA_SUCESSO;
+}
+
+int comando_cadastrar_usuario(int argc, char *argv[]) {
+    static const char *const opcoes[] = {"--name", "--course", "--phone", NULL};
+    const char *valores[3];
+    if (!ler_opcoes(argc, argv, opcoes, valores)) return SAIDA_USO_INCORRETO;
+    if (valores[0] == NULL || valores[1] == NULL || valores[2] == NULL) {
+        fprintf(stderr, "[ERRO] Informe --name, --course e --phone.\n");
+        return SAIDA_USO_INCORRETO;
+    }
+    Usuario usuario;
+    snprintf(usuario.nome, TAM_NOME, "%s", valores[0]);
+    snprintf(usuario.curso, TAM_CURSO, "%s", valores[1]);
+    snprintf(usuario.telefone, TAM_TELEFONE, "%s", valores[2]);
+    ResultadoOperacao r = api_cadastrar_usuario(&usuario, &usuario);
+    if (r != RESULTADO_OK) return saida_recusada(r);
+    escrever_usuario(stdout, &usuario);
+    return SAIDA_SUCESSO;
+}
+
+// Aplica --format, --limit e --offset às listagens do comando; 'padrao' vale se não houver --format
+bool ler_opcoes_saida(const char *formato, const char *limite, const char *deslocamento, FormatoSaida padrao) {
+    opcoes_saida.formato = padrao;
+    opcoes_saida.linhas_por_pagina = 0; // Sem pausas: a saída costuma ir para um pipe
+    opcoes_saida.ordem = ORDEM_CADASTRO;
+    if (formato != NULL && !ler_formato_saida(formato, &opcoes_saida.formato)) {
+        fprintf(stderr, "[ERRO] Formato invalido: %s (use table, record, csv ou jsonl).\n", formato);
+        return false;
+    }
+    if ((limite != NULL && (!ler_inteiro_argumento(limite, &opcoes_saida.limite) || opcoes_saida.limite < 0)) ||
+        (deslocamento != NULL && (!ler_inteiro_argumento(deslocamento, &opcoes_saida.deslocamento) || opcoes_saida.deslocamento < 0))) {
+        fprintf(stderr, "[ERRO] --limit e --offset devem ser numeros nao negativos.\n");
+        return false;
+    }
+    return true;
+}
+
+// Aplica --sort (NULL = ordem natural) se a ordem estiver entre as 'permitidas' da listagem
+bool ler_ordem_saida(const char *valor, unsigned int permitidas) {
+    if (valor == NULL || ler_ordem_listagem(valor, permitidas, &opcoes_saida.ordem)) {
+        return true;
+    }
+    fprintf(stderr, "[ERRO] Ordem invalida: %s (use", valor);
+    for (int o = 0; o < NUM_ORDENS; o++) {
+        if (permitidas & ORDEM(o)) fprintf(stderr, " %s", nomes_ordens[o]);
+    }
+    fprintf(stderr, ").\n");
+    return false;
+}
+
+// Valor de --fuzzy: número máximo de erros ou "auto" (-1)
+bool ler_erros_aproximados(const char *valor, int *max_erros) {
+    if (strcmp(valor, "auto") == 0) {
+        *max_erros = -1;
+        return true;
+    }
+    if (!ler_inteiro_argumento(valor, max_erros) || *max_erros < 0) {
+        fprintf(stderr, "[ERRO] --fuzzy espera um numero de erros (0 ou mais) ou 'auto'.\n");
+        return false;
+    }
+    return true;
+}
+
+// Pesquisa aproximada da linha de comando: resultados do mais próximo ao mais distante
+int pesquisa_aproximada_linha(CampoTexto campo, const char *termo, const char *erros) {
+    int max_erros;
+    if (!ler_erros_aproximados(erros, &max_erros)) return SAIDA_USO_INCORRETO;
+    if (exibir_pesquisa_aproximada(campo, termo, max_erros, false) < 0) {
+        fprintf(stderr, "[ERRO] Memoria insuficiente para a pesquisa.\n");
+        return SAIDA_RECUSADA;
+    }
+    return SAIDA_SUCESSO;
+}
+
+int comando_pesquisar_livros(int argc, char *argv[]) {
+    static const char *const opcoes[] = {"--code", "--title", "--author", "--year", "--format", "--limit", "--offset", "--fuzzy", "--sort", NULL};
+    const char *valores[9];
+    if (!ler_opcoes(argc, argv, opcoes, valores)) return SAIDA_USO_INCORRETO;
+    if (!ler_opcoes_saida(valores[4], valores[5], valores[6], FORMATO_REGISTRO) ||
+        !ler_ordem_saida(valores[8], ORDEM(ORDEM_CADASTRO) | ORDEM(ORDEM_TITULO) | ORDEM(ORDEM_AUTOR))) {
+        return SAIDA_USO_INCORRETO;
+    }
+    if (valores[7] != NULL) {
+        // Aproximada: um único campo de texto, sem código nem ano (resultados por distância)
+        if (valores[0] != NULL || valores[3] != NULL || valores[8] != NULL || (valores[1] == NULL) == (valores[2] == NULL)) {
+            fprintf(stderr, "[ERRO] Com --fuzzy informe apenas --title ou apenas --author, sem --sort.\n");
+            return SAIDA_USO_INCORRETO;
+        }
+        return valores[1] != NULL ? pesquisa_aproximada_linha(CAMPO_TITULO, valores[1], valores[7])
+                                  : pesquisa_aproximada_linha(CAMPO_AUTOR, valores[2], valores[7]);
+    }
+    CriteriosPesquisaLivro criterios = {0, "", "", 0};
+    if ((valores[0] != NULL && !ler_inteiro_argumento(valores[0], &criterios.codigo)) ||
+        (valores[3] != NULL && !ler_inteiro_argumento(valores[3], &criterios.ano))) {
+        fprintf(stderr, "[ERRO] Codigo e ano devem ser numeros.\n");
+        return SAIDA_USO_INCORRETO;
+    }
+    if (valores[1] != NULL) snprintf(criterios.titulo, TAM_TITULO, "%s", valores[1]);
+    if (valores[2] != NULL) snprintf(criterios.autor, TAM_AUTOR, "%s", valores[2]);
+
+    int *resultados = malloc(sizeof(int) * MAX_LIVROS);
+    if (resultados == NULL) {
+        fprintf(stderr, "[ERRO] Memoria insuficiente para a pesquisa.\n");
+        return SAIDA_RECUSADA;
+    }
+    int num_resultados = api_pesquisar_livros(&criterios, resultados);
+    ordenar_resultados_livros(resultados, num_resultados);
+    OrdemExibicao ordem = {NULL, opcoes_saida.ordem == ORDEM_TITULO ? CAMPO_TITULO : opcoes_saida.ordem == ORDEM_AUTOR ? CAMPO_AUTOR : -1, 0};
+    pthread_rwlock_rdlock(&trava_acervo);
+    exibir_livros(stdout, resultados, num_resultados, &ordem);
+    pthread_rwlock_unlock(&trava_acervo);
+    free(resultados);
+    return SAIDA_SUCESSO;
+}
+
+int comando_pesquisar_usuarios(int argc, char *argv[]) {
+    static const char *const opcoes[] = {"--id", "--name", "--format", "--limit", "--offset", "--fuzzy", "--sort", NULL};
+    const char *valores[7];
+    if (!ler_opcoes(argc, argv, opcoes, valores)) return SAIDA_USO_INCORRETO;
+    if (!ler_opcoes_saida(valores[2], valores[3], valores[4], FORMATO_REGISTRO) ||
+        !ler_ordem_saida(valores[6], ORDEM(ORDEM_CADASTRO) | ORDEM(ORDEM_USUARIO))) {
+        return SAIDA_USO_INCORRETO;
+    }
+    if (valores[5] != NULL) {
+        if (valores[0] != NULL || valores[1] == NULL || valores[6] != NULL) {
+            fprintf(stderr, "[ERRO] Com --fuzzy informe apenas --name, sem --sort.\n");
+            return SAIDA_USO_INCORRETO;
+        }
+        return pesquisa_aproximada_linha(CAMPO_NOME_USUARIO, valores[1], valores[5]);
+    }
+    int matricula = 0;
+    if (valores[0] != NULL && !ler_inteiro_argumento(valores[0], &matricula)) {
+        fprintf(stderr, "[ERRO] Matricula deve ser um numero.\n");
+        return SAIDA_USO_INCORRETO;
+    }
+
+    int *resultados = malloc(sizeof(int) * MAX_USUARIOS);
+    if (resultados == NULL) {
+        fprintf(stderr, "[ERRO] Memoria insuficiente para a pesquisa.\n");
+        return SAIDA_RECUSADA;
+    }
+    int num_resultados = api_pesquisar_usuarios(matricula, valores[1] != NULL ? valores[1] : "", resultados);
+    ordenar_resultados_usuarios(resultados, num_resultados);
+    OrdemExibicao ordem = {NULL, opcoes_saida.ordem == ORDEM_USUARIO ? CAMPO_NOME_USUARIO : -1, 0};
+    pthread_rwlock_rdlock(&trava_usuarios);
+    exibir_usuarios(stdout, resultados, num_resultados, &ordem);
+    pthread_rwlock_unlock(&trava_usuarios);
+    free(resultados);
+    return SAIDA_SUCESSO;
+}
+
+int comando_completar(int argc, char *argv[]) {
+    static const struct {
+        const char *nome;
+        CampoTexto campo;
+    } campos[] = {
+        {"title", CAMPO_TITULO},
+        {"author", CAMPO_AUTOR},
+        {"name", CAMPO_NOME_USUARIO},
+    };
+    static const char *const opcoes[] = {"--top", "--format", "--limit", "--offset", NULL};
+    const char *valores[4];
+    if (argc < 2) {
+        fprintf(stderr, "[ERRO] Informe o campo (title, author ou name) e o inicio do texto.\n");
+        return SAIDA_USO_INCORRETO;
+    }
+    if (!ler_opcoes(argc - 2, argv + 2, opcoes, valores)) return SAIDA_USO_INCORRETO;
+    if (!ler_opcoes_saida(valores[1], valores[2], valores[3], FORMATO_REGISTRO)) return SAIDA_USO_INCORRETO;
+    int k = SUGESTOES_PADRAO;
+    if (valores[0] != NULL && (!ler_inteiro_argumento(valores[0], &k) || k <= 0)) {
+        fprintf(stderr, "[ERRO] --top deve ser um numero positivo.\n");
+        return SAIDA_USO_INCORRETO;
+    }
+    for (size_t i = 0; i < sizeof(campos) / sizeof(campos[0]); i++) {
+        if (strcmp(argv[0], campos[i].nome) == 0) {
+            if (exibir_sugestoes(campos[i].campo, argv[1], k, false) < 0) {
+                fprintf(stderr, "[ERRO] Memoria insuficiente para a pesquisa.\n");
+                return SAIDA_RECUSADA;
+            }
+            return SAIDA_SUCESSO;
+        }
+    }
+    fprintf(stderr, "[ERRO] Campo invalido: use title, author ou name.\n");
+    return SAIDA_USO_INCORRETO;
+}
+
+int comando_relatorio(int argc, char *argv[]) {
+    static const struct {
+        const char *nome;
+        void (*gerar)(void);
+        unsigned int ordens; // Valores aceitos em --sort
+    } relatorios[] = {
+        {"active", listar_emprestimos_ativos, ORDEM(ORDEM_DEVOLUCAO) | ORDEM(ORDEM_TITULO) | ORDEM(ORDEM_USUARIO)},
+        {"top", relatorio_livros_mais_emprestados, ORDEM(ORDEM_CONTAGEM) | ORDEM(ORDEM_TITULO)},
+        {"overdue", relatorio_usuarios_em_atraso, ORDEM(ORDEM_DEVOLUCAO) | ORDEM(ORDEM_USUARIO)},
+        {"holds", relatorio_reservas_pendentes, 0},
+        {"daily", relatorio_emprestimos_por_dia, 0},
+        {"monthly", relatorio_emprestimos_por_mes, 0},
+        {"courses", relatorio_emprestimos_por_curso, 0},
+        {"publishers", relatorio_emprestimos_por_editora, 0},
+    };
+    static const char *const opcoes[] = {"--format", "--limit", "--offset", "--sort", NULL};
+    const char *valores[4];
+    if (argc >= 1) {
+        if (!ler_opcoes(argc - 1, argv + 1, opcoes, valores) ||
+            !ler_opcoes_saida(valores[0], valores[1], valores[2], FORMATO_TABELA)) {
+            return SAIDA_USO_INCORRETO;
+        }
+        for (size_t i = 0; i < sizeof(relatorios) / sizeof(relatorios[0]); i++) {
+            if (strcmp(argv[0], relatorios[i].nome) == 0) {
+                if (!ler_ordem_saida(valores[3], ORDEM(ORDEM_CADASTRO) | relatorios[i].ordens)) {
+                    return SAIDA_USO_INCORRETO;
+                }
+                relatorios[i].gerar();
+                return SAIDA_SUCESSO;
+            }
+        }
+    }
+    fprintf(stderr, "[ERRO] Informe o relatorio: active, top, overdue, holds, daily, monthly, courses ou publishers.\n");
+    return SAIDA_USO_INCORRETO;
+}
+
+int comando_backup(int argc, char *argv[]) {
+    (void)argv;
+    if (argc != 0) {
+        fprintf(stderr, "[ERRO] O comando nao recebe argumentos.\n");
+        return SAIDA_USO_INCORRETO;
+    }
+    return fazer_backup() ? SAIDA_SUCESSO : SAIDA_RECUSADA;
+}
+
+int comando_listar_backups(int argc, char *argv[]) {
+    (void)argv;
+    if (argc != 0) {
+        fprintf(stderr, "[ERRO] O comando nao recebe argumentos.\n");
+        return SAIDA_USO_INCORRETO;
+    }
+    listar_backups();
+    return SAIDA_SUCESSO;
+}
+
+int comando_restaurar(int argc, char *argv[]) {
+    int geracao;
+    if (!ler_argumentos_inteiros(argc, argv, 1, &geracao)) return SAIDA_USO_INCORRETO;
+    return restaurar_backup(geracao) ? SAIDA_SUCESSO : SAIDA_RECUSADA;
+}
+
+typedef struct {
+    const char *nome;
+    const char *apelido;  // Nome alternativo em português
+    const char *uso;
+    bool altera_dados;    // Salva os arquivos ao final quando o comando tem sucesso
+    int (*executar)(int argc, char *argv[]);
+} ComandoLinha;
+
+const ComandoLinha comandos_linha[] = {
+    {"loan", "emprestar", "<matricula> <codigo_livro>", true, comando_emprestar},
+    {"return", "devolver", "<codigo_emprestimo>", true, comando_devolver},
+    {"renew", "renovar", "<codigo_emprestimo>", true, comando_renovar},
+    {"reserve", "reservar", "<matricula> <codigo_livro>", true, comando_reservar},
+    {"add-book", "cadastrar-livro", "--title T --author A --publisher E --year N --copies N", true, comando_cadastrar_livro},
+    {"add-user", "cadastrar-usuario", "--name N --course C --phone F", true, comando_cadastrar_usuario},
+    {"search", "pesquisar", "[--code N] [--title T] [--author A] [--year N] [--fuzzy N|auto] [--sort title|author] [SAIDA]", false, comando_pesquisar_livros},
+    {"users", "usuarios", "[--id N] [--name T] [--fuzzy N|auto] [--sort user] [SAIDA]", false, comando_pesquisar_usuarios},
+    {"complete", "completar", "title|author|name <inicio> [--top K] [SAIDA]", false, comando_completar},
+    {"report", "relatorio", "active|top|overdue|holds|daily|monthly|courses|publishers [--sort due|title|user|count] [SAIDA]", false, comando_relatorio},
+    {"backup", "backup", "", false, comando_backup},
+    {"backups", "listar-backups", "", false, comando_listar_backups},
+    {"restore", "restaurar", "<geracao>", true, comando_restaurar},
+};
+#define NUM_COMANDOS_LINHA ((int)(sizeof(comandos_linha) / sizeof(comandos_linha[0])))
+
+const char *nome_programa = "library"; // argv[0], para as mensagens de uso
+
+const ComandoLinha *buscar_comando(const ComandoLinha *tabela, int quantidade, const char *nome) {
+    for (int i = 0; i < quantidade; i++) {
+        if (strcmp(nome, tabela[i].nome) == 0 || strcmp(nome, tabela[i].apelido) == 0) {
+            return &tabela[i];
+        }
+    }
+    return NULL;
+}
+
+// Carrega os dados do diretório atual, executa o comando e salva se ele alterou algo
+int executar_comando(const ComandoLinha *comando, int argc, char *argv[]) {
+    carregar_dados();
+    int codigo = comando->executar(argc, argv);
+    if (codigo == SAIDA_USO_INCORRETO) {
+        fprintf(stderr, "Uso: %s %s %s\n", nome_programa, comando->nome, comando->uso);
+    }
+    if (codigo == SAIDA_SUCESSO && comando->altera_dados) {
+        salvar_dados();
+    }
+    return codigo;
+}
+
+// --- UNIDADES (BIBLIOTECAS DE CADA CAMPUS) ---
+
+// Cada unidade é uma partição completa do sistema: um subdiretório do diretório base, com o
+// nome da unidade, que guarda seus próprios arquivos, índices, políticas e backups. Os
+// códigos gerados numa unidade começam em id * FAIXA_IDS_UNIDADE + 1 (id vem de
+// unidades.txt) e, dentro dela, param em (id + 1) * FAIXA_IDS_UNIDADE: depois disso o
+// cadastro recusa com ERRO_CAPACIDADE, e códigos de unidades diferentes nunca coincidem.
+// Cada unidade comporta FAIXA_IDS_UNIDADE registros de cada tipo.
+// Operações de uma unidade (--branch NOME ou BIBLIOTECA_UNIDADE) carregam só a partição
+// dela, e o custo não cresce com o número de unidades. Pesquisas e relatórios de todas as
+// unidades (comando "all") consultam cada partição num processo próprio, em paralelo, e
+// juntam as linhas num resultado só, com o nome da unidade na primeira coluna (ver COLETA).
+#define ARQ_UNIDADES "unidades.txt"
+#define MAX_UNIDADES 64
+#define TAM_NOME_UNIDADE 32
+#define FAIXA_IDS_UNIDADE 10000000
+
+typedef struct {
+    int id;
+    char nome[TAM_NOME_UNIDADE];
+} Unidade;
+
+Unidade unidades[MAX_UNIDADES];
+int total_unidades = 0;
+const char *unidade_em_uso = NULL; // NULL = diretório base
+
+// Lê unidades.txt (uma por linha: id;nome) do diretório atual
+void carregar_unidades() {
+    total_unidades = 0;
+    FILE *f = fopen(ARQ_UNIDADES, "r");
+    if (f == NULL) {
+        return;
+    }
+    while (total_unidades < MAX_UNIDADES &&
+           fscanf(f, "%d;%31[^\n]\n", &unidades[total_unidades].id, unidades[total_unidades].nome) == 2) {
+        total_unidades++;
+    }
+    fclose(f);
+}
+
+int buscar_unidade(const char *nome) {
+    for (int u = 0; u < total_unidades; u++) {
+        if (strcmp(unidades[u].nome, nome) == 0) {
+            return u;
+        }
+    }
+    return -1;
+}
+
+// O nome vira diretório e coluna das saídas: só letras, dígitos, '-' e '_'
+bool nome_unidade_valido(const char *nome) {
+    size_t n = strlen(nome);
+    if (n == 0 || n >= TAM_NOME_UNIDADE) {
+        return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+        char c = nome[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Grava 'arquivo' da unidade só com a linha do próximo código (cadastro vazio)
+bool criar_arquivo_unidade(const char *nome, const char *arquivo, int proximo_id) {
+    char caminho[TAM_NOME_UNIDADE + 64];
+    snprintf(caminho, sizeof(caminho), "%s/%s", nome, arquivo);
+    FILE *f = fopen(caminho, "w");
+    if (f == NULL) {
+        return false;
+    }
+    fprintf(f, "%d\n", proximo_id);
+    return fclose(f) == 0;
+}
+
+// Copia as políticas do diretório base, se houver; depois cada unidade edita as suas
+bool copiar_politicas_unidade(const char *nome) {
+    FILE *origem = fopen(ARQ_POLITICAS, "r");
+    if (origem == NULL) {
+        return true;
+    }
+    char caminho[TAM_NOME_UNIDADE + 64];
+    snprintf(caminho, sizeof(caminho), "%s/%s", nome, ARQ_POLITICAS);
+    FILE *destino = fopen(caminho, "w");
+    bool ok = destino != NULL;
+    char bloco[4096];
+    size_t lidos;
+    while (ok && (lidos = fread(bloco, 1, sizeof(bloco), origem)) > 0) {
+        ok = fwrite(bloco, 1, lidos, destino) == lidos;
+    }
+    fclose(origem);
+    if (destino != NULL && fclose(destino) != 0) {
+        ok = false;
+    }
+    return ok;
+}
+
+// Cria a unidade no diretório atual: subdiretório com cadastros vazios cujos próximos
+// códigos ficam na faixa dela. A unidade criada vai para 'resultado'.
+ResultadoOperacao api_cadastrar_unidade(const char *nome, Unidade *resultado) {
+    if (!nome_unidade_valido(nome)) {
+        return ERRO_DADOS_INVALIDOS;
+    }
+    carregar_unidades();
+    if (buscar_unidade(nome) != -1) {
+        return ERRO_UNIDADE_DUPLICADA;
+    }
+    Unidade nova;
+    nova.id = 1;
+    for (int u = 0; u < total_unidades; u++) {
+        if (unidades[u].id >= nova.id) {
+            nova.id = unidades[u].id + 1;
+        }
+    }
+    if (total_unidades >= MAX_UNIDADES || nova.id > INT_MAX / FAIXA_IDS_UNIDADE - 1) {
+        return ERRO_CAPACIDADE;
+    }
+    snprintf(nova.nome, sizeof(nova.nome), "%s", nome);
+
+    int primeiro_id = nova.id * FAIXA_IDS_UNIDADE + 1;
+    if (mkdir(nome, 0755) != 0 ||
+        !criar_arquivo_unidade(nome, ARQ_LIVROS, primeiro_id) ||
+        !criar_arquivo_unidade(nome, ARQ_USUARIOS, primeiro_id) ||
+        !criar_arquivo_unidade(nome, ARQ_EMPRESTIMOS, primeiro_id) ||
+        !criar_arquivo_unidade(nome, ARQ_RESERVAS, primeiro_id) ||
+        !copiar_politicas_unidade(nome)) {
+        return ERRO_GRAVACAO;
+    }
 
-        switch (opcao) {
-            case 1:
-                cadastrar_livro();
-                break;
-            case 2:
-                pesquisar_livros();
-                break;
-            case 0:
-                printf("[INFO] Voltando ao Menu Principal.\n");
-                break;
-            default:
-                printf("[ERRO] Opcao invalida. Tente novamente.\n");
+    // A unidade só passa a existir quando entra na lista
+    FILE *f = fopen(ARQ_UNIDADES, "a");
+    if (f == NULL) {
+        return ERRO_GRAVACAO;
+    }
+    fprintf(f, "%d;%s\n", nova.id, nova.nome);
+    if (fclose(f) != 0) {
+        return ERRO_GRAVACAO;
+    }
+    unidades[total_unidades++] = nova;
+    if (resultado != NULL) {
+        *resultado = nova;
+    }
+    return RESULTADO_OK;
+}
+
+// Passa a operar sobre a partição da unidade (muda para o diretório dela)
+bool entrar_na_unidade(const char *nome) {
+    carregar_unidades();
+    int u = buscar_unidade(nome);
+    if (u == -1) {
+        fprintf(stderr, "[ERRO] Unidade '%s' nao encontrada em %s.\n", nome, ARQ_UNIDADES);
+        return false;
+    }
+    if (chdir(unidades[u].nome) != 0) {
+        fprintf(stderr, "[ERRO] Nao foi possivel abrir o diretorio da unidade '%s'.\n", nome);
+        return false;
+    }
+    unidade_em_uso = unidades[u].nome;
+    if (unidades[u].id >= 0 && unidades[u].id < INT_MAX / FAIXA_IDS_UNIDADE) {
+        ultimo_id_permitido = (unidades[u].id + 1) * FAIXA_IDS_UNIDADE;
+    }
+    return true;
+}
+
+// Ordem do resultado juntado: chave numérica, chave de texto e, no empate, a ordem da
+// coleta (unidades na ordem da lista, cada uma na ordem em que escreveu as linhas)
+const ColetaSaida *coleta_em_ordenacao = NULL;
+
+int comparar_linhas_coletadas(const void *a, const void *b) {
+    const LinhaColetada *x = &coleta_em_ordenacao->linhas[*(const int *)a];
+    const LinhaColetada *y = &coleta_em_ordenacao->linhas[*(const int *)b];
+    if (x->chave != y->chave) {
+        return x->chave < y->chave ? -1 : 1;
+    }
+    if (x->chave_texto != SEM_CHAVE_TEXTO && y->chave_texto != SEM_CHAVE_TEXTO) {
+        int c = comparar_textos_normalizados(coleta_em_ordenacao->textos + x->chave_texto,
+                                             coleta_em_ordenacao->textos + y->chave_texto);
+        if (c != 0) {
+            return c;
         }
-    } while (opcao != 0);
+    }
+    return *(const int *)a - *(const int *)b;
 }
 
-void menu_usuarios() {
-    int opcao;
-    do {
-        printf("\n========== Menu Usuarios ==========\n");
-        printf("1. Cadastrar Novo Usuario\n");
-        printf("2. Pesquisar Usuario\n");
-        printf("0. Voltar ao Menu Principal\n");
-        printf("Escolha uma opcao: ");
+int comparar_postos_coletados(const void *a, const void *b) {
+    const LinhaColetada *x = &coleta_em_ordenacao->linhas[*(const int *)a];
+    const LinhaColetada *y = &coleta_em_ordenacao->linhas[*(const int *)b];
+    if (x->posto != y->posto) {
+        return x->posto < y->posto ? -1 : 1;
+    }
+    return *(const int *)a - *(const int *)b;
+}
 
-        if (scanf("%d", &opcao) != 1) {
-            printf("[ERRO] Entrada invalida. Por favor, digite um numero.\n");
-            limpar_buffer();
-            continue;
+// Totais e avisos de uma unidade, uma linha por vez, precedidos do nome dela
+void escrever_textos_unidade(SaidaRelatorio *saida, const char *nome, const char *textos) {
+    const char *linha = textos;
+    while (linha != NULL && *linha != '\0') {
+        const char *fim = strchr(linha, '\n');
+        int n = fim != NULL ? (int)(fim - linha) : (int)strlen(linha);
+        if (n > 0) {
+            char texto[512];
+            snprintf(texto, sizeof(texto), "%s: %.*s\n", nome, n, linha);
+            saida_texto(saida, texto);
         }
-        limpar_buffer();
+        linha = fim != NULL ? fim + 1 : NULL;
+    }
+}
 
-        switch (opcao) {
-            case 1:
-                cadastrar_usuario();
-                break;
-            case 2:
-                pesquisar_usuarios();
-                break;
-            case 0:
-                printf("[INFO] Voltando ao Menu Principal.\n");
-                break;
-            default:
-                printf("[ERRO] Opcao invalida. Tente novamente.\n");
+// Escreve as linhas coletadas de todas as unidades como uma listagem só: ordenadas pelas
+// chaves, com o posto refeito, a janela --limit/--offset aplicada uma vez, um título e um
+// cabeçalho. Os totais de cada unidade vêm depois, com o nome dela. Retorna false se faltou
+// memória para juntar.
+bool escrever_coleta(ColetaSaida *c) {
+    if (c->sem_memoria) {
+        return false;
+    }
+    if (c->colunas == NULL) {
+        return true; // Nenhuma unidade chegou a listar
+    }
+    int *ordem = malloc(sizeof(int) * (c->num_linhas + 1));
+    if (ordem == NULL) {
+        return false;
+    }
+    coleta_em_ordenacao = c;
+    for (int i = 0; i < c->num_linhas; i++) {
+        ordem[i] = i;
+    }
+    if (c->coluna_posto >= 0) {
+        qsort(ordem, c->num_linhas, sizeof(int), comparar_postos_coletados);
+        for (int i = 0; i < c->num_linhas; i++) {
+            c->campos[c->linhas[ordem[i]].primeiro_campo + c->coluna_posto].inteiro = i + 1;
+            ordem[i] = i;
         }
-    } while (opcao != 0);
+    }
+    qsort(ordem, c->num_linhas, sizeof(int), comparar_linhas_coletadas);
+    coleta_em_ordenacao = NULL;
+    int num_linhas = c->maximo_linhas > 0 && c->maximo_linhas < c->num_linhas ? c->maximo_linhas : c->num_linhas;
+
+    // Título da primeira unidade que listou; numa unidade sem cabeçalho (nada a listar) o
+    // que vem depois do título é aviso dela
+    int referencia = 0;
+    while (referencia < total_unidades - 1 && !c->por_unidade[referencia].com_cabecalho) {
+        referencia++;
+    }
+    const char *titulo = c->por_unidade[referencia].antes != NULL ? c->por_unidade[referencia].antes : "";
+
+    SaidaRelatorio saida;
+    saida_iniciar(&saida, stdout, c->colunas, c->num_colunas);
+    unidade_na_saida = unidades[0].nome;
+    saida_texto(&saida, titulo);
+    saida_cabecalho(&saida);
+    for (int i = 0; i < num_linhas; i++) {
+        const LinhaColetada *linha = &c->linhas[ordem[i]];
+        unidade_na_saida = unidades[linha->unidade].nome;
+        if (!saida_linha(&saida)) continue;
+        for (int k = 0; k < c->num_colunas; k++) {
+            const CampoColetado *campo = &c->campos[linha->primeiro_campo + k];
+            switch (campo->tipo) {
+                case COLETADO_INTEIRO:
+                    saida_campo_inteiro(&saida, campo->inteiro);
+                    break;
+                case COLETADO_DECIMAL:
+                    saida_campo_decimal(&saida, campo->decimal, campo->definido);
+                    break;
+                case COLETADO_TEXTO:
+                    saida_campo_texto(&saida, c->textos + campo->texto);
+                    break;
+                default:
+                    saida_campo_data(&saida, campo->data);
+            }
+        }
+        saida_fim_linha(&saida);
+    }
+    saida_separador(&saida);
+    for (int u = 0; u < total_unidades; u++) {
+        const TextosColetados *t = &c->por_unidade[u];
+        if (!t->com_cabecalho && t->antes != NULL) {
+            size_t n = strlen(titulo);
+            escrever_textos_unidade(&saida, unidades[u].nome, strncmp(t->antes, titulo, n) == 0 ? t->antes + n : t->antes);
+        }
+        escrever_textos_unidade(&saida, unidades[u].nome, t->depois);
+    }
+    saida_finalizar(&saida);
+    unidade_na_saida = NULL;
+    free(ordem);
+    return true;
 }
 
-void menu_emprestimos() {
-    int opcao;
-    do {
-        printf("\n========== Menu Emprestimos ==========\n");
-        printf("1. Realizar Emprestimo\n");
-        printf("2. Realizar Devolucao\n");
-        printf("3. Renovar Emprestimo\n"); // Parte 5
-        printf("4. Listar Emprestimos Ativos\n");
-        printf("0. Voltar ao Menu Principal\n");
-        printf("Escolha uma opcao: ");
+// O processo de cada unidade manda as linhas coletadas ao principal por um pipe: este
+// cabeçalho (com as opções de saída que o comando leu dos argumentos) e depois linhas, campos, textos e os textos de tabela da unidade. As posições
+// em 'campos' e 'textos' são as do processo da unidade; o principal as desloca ao juntar.
+typedef struct {
+    OpcoesSaida opcoes;
+    const ColunaSaida *colunas; // Tabelas estáticas: mesmo endereço nos dois processos (fork)
+    int num_colunas;
+    int coluna_posto;
+    int maximo_linhas;
+    int num_linhas;
+    int num_campos;
+    size_t usado_textos;
+    size_t tamanho_antes; // Com o '\0'; 0 = sem texto
+    size_t tamanho_depois;
+    bool com_cabecalho;
+    bool sem_memoria;
+} CabecalhoColeta;
+
+bool escrever_canal(int canal, const void *dados, size_t tamanho) {
+    const char *p = dados;
+    while (tamanho > 0) {
+        ssize_t n = write(canal, p, tamanho);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        tamanho -= n;
+    }
+    return true;
+}
 
-        if (scanf("%d", &opcao) != 1) {
-            printf("[ERRO] Entrada invalida. Por favor, digite um numero.\n");
-            limpar_buffer();
-            continue;
+bool ler_canal(int canal, void *dados, size_t tamanho) {
+    char *p = dados;
+    while (tamanho > 0) {
+        ssize_t n = read(canal, p, tamanho);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        tamanho -= n;
+    }
+    return true;
+}
+
+// Manda ao processo principal o que a unidade 'u' coletou
+bool enviar_coleta(int canal, const ColetaSaida *c, int u) {
+    const TextosColetados *t = &c->por_unidade[u];
+    CabecalhoColeta cab;
+    memset(&cab, 0, sizeof(cab));
+    cab.opcoes = opcoes_saida;
+    cab.colunas = c->colunas;
+    cab.num_colunas = c->num_colunas;
+    cab.coluna_posto = c->coluna_posto;
+    cab.maximo_linhas = c->maximo_linhas;
+    cab.num_linhas = c->num_linhas;
+    cab.num_campos = c->num_campos;
+    cab.usado_textos = c->usado_textos;
+    cab.tamanho_antes = t->antes != NULL ? strlen(t->antes) + 1 : 0;
+    cab.tamanho_depois = t->depois != NULL ? strlen(t->depois) + 1 : 0;
+    cab.com_cabecalho = t->com_cabecalho;
+    cab.sem_memoria = c->sem_memoria;
+    return escrever_canal(canal, &cab, sizeof(cab)) &&
+           escrever_canal(canal, c->linhas, sizeof(LinhaColetada) * c->num_linhas) &&
+           escrever_canal(canal, c->campos, sizeof(CampoColetado) * c->num_campos) &&
+           escrever_canal(canal, c->textos, c->usado_textos) &&
+           escrever_canal(canal, t->antes, cab.tamanho_antes) &&
+           escrever_canal(canal, t->depois, cab.tamanho_depois);
+}
+
+// Lê um texto de 'tamanho' bytes do canal para '*destino' (NULL se 'tamanho' é 0)
+bool receber_texto_coleta(int canal, ColetaSaida *c, char **destino, size_t tamanho) {
+    if (tamanho == 0) {
+        return true;
+    }
+    *destino = malloc(tamanho);
+    if (*destino == NULL) {
+        c->sem_memoria = true;
+        return false;
+    }
+    if (!ler_canal(canal, *destino, tamanho)) {
+        return false;
+    }
+    (*destino)[tamanho - 1] = '\0';
+    return true;
+}
+
+// Acrescenta à coleta as linhas que o processo da unidade 'u' mandou, na ordem em que ele
+// as escreveu. Retorna false se o canal terminou antes do fim ou faltou memória.
+bool receber_coleta(int canal, ColetaSaida *c, int u) {
+    CabecalhoColeta cab;
+    if (!ler_canal(canal, &cab, sizeof(cab))) {
+        return false;
+    }
+    if (!coleta_reservar((void **)&c->linhas, &c->capacidade_linhas, (size_t)c->num_linhas + cab.num_linhas, sizeof(LinhaColetada)) ||
+        !coleta_reservar((void **)&c->campos, &c->capacidade_campos, (size_t)c->num_campos + cab.num_campos, sizeof(CampoColetado)) ||
+        !coleta_reservar((void **)&c->textos, &c->capacidade_textos, c->usado_textos + cab.usado_textos, 1)) {
+        c->sem_memoria = true;
+        return false;
+    }
+    LinhaColetada *linhas = &c->linhas[c->num_linhas];
+    CampoColetado *campos = &c->campos[c->num_campos];
+    if (!ler_canal(canal, linhas, sizeof(LinhaColetada) * cab.num_linhas) ||
+        !ler_canal(canal, campos, sizeof(CampoColetado) * cab.num_campos) ||
+        !ler_canal(canal, c->textos + c->usado_textos, cab.usado_textos)) {
+        return false;
+    }
+    for (int i = 0; i < cab.num_linhas; i++) {
+        linhas[i].unidade = u;
+        linhas[i].primeiro_campo += c->num_campos;
+        if (linhas[i].chave_texto != SEM_CHAVE_TEXTO) {
+            linhas[i].chave_texto += c->usado_textos;
         }
-        limpar_buffer();
+    }
+    for (int i = 0; i < cab.num_campos; i++) {
+        if (campos[i].tipo == COLETADO_TEXTO && campos[i].texto != SEM_CHAVE_TEXTO) {
+            campos[i].texto += c->usado_textos;
+        }
+    }
+    c->num_linhas += cab.num_linhas;
+    c->num_campos += cab.num_campos;
+    c->usado_textos += cab.usado_textos;
+    opcoes_saida = cab.opcoes;
+    if (cab.colunas != NULL) {
+        c->colunas = cab.colunas;
+        c->num_colunas = cab.num_colunas;
+    }
+    if (cab.coluna_posto >= 0) {
+        c->coluna_posto = cab.coluna_posto;
+    }
+    if (cab.maximo_linhas > 0) {
+        c->maximo_linhas = cab.maximo_linhas;
+    }
+    c->sem_memoria = c->sem_memoria || cab.sem_memoria;
 
-        switch (opcao) {
-            case 1:
-                realizar_emprestimo();
-                break;
-            case 2:
-                realizar_devolucao();
-                break;
-            case 3:
-                renovar_emprestimo();
-                break;
-            case 4:
-                listar_emprestimos_ativos();
-                break;
-            case 0:
-                printf("[INFO] Voltando ao Menu Principal.\n");
-                break;
-            default:
-                printf("[ERRO] Opcao invalida. Tente novamente.\n");
+    TextosColetados *t = &c->por_unidade[u];
+    t->com_cabecalho = cab.com_cabecalho;
+    return receber_texto_coleta(canal, c, &t->antes, cab.tamanho_antes) &&
+           receber_texto_coleta(canal, c, &t->depois, cab.tamanho_depois);
+}
+
+// Consulta da unidade 'u', no processo dela: carrega a partição, roda o comando em modo de
+// coleta e manda as linhas pelo canal. Retorna o código de saída do comando.
+int consultar_unidade(const ComandoLinha *comando, int argc, char *argv[], int u, int canal) {
+    if (chdir(unidades[u].nome) != 0) {
+        fprintf(stderr, "[ERRO] Nao foi possivel abrir o diretorio da unidade '%s'.\n", unidades[u].nome);
+        return SAIDA_RECUSADA;
+    }
+    ColetaSaida coleta;
+    memset(&coleta, 0, sizeof(coleta));
+    coleta.coluna_posto = -1;
+    coleta.unidade = u;
+    coleta.por_unidade = calloc(total_unidades, sizeof(TextosColetados));
+    if (coleta.por_unidade == NULL) {
+        fprintf(stderr, "[ERRO] Memoria insuficiente para consultar a unidade '%s'.\n", unidades[u].nome);
+        return SAIDA_RECUSADA;
+    }
+    unidade_em_uso = unidades[u].nome;
+    coleta_saida = &coleta;
+    int codigo = executar_comando(comando, argc, argv);
+    coleta_saida = NULL;
+    enviar_coleta(canal, &coleta, u); // Falha só se o principal desistiu de ler
+    liberar_coleta(&coleta, total_unidades);
+    return codigo;
+}
+
+// Processo de uma unidade em andamento. Saída e erros dele vão para arquivos temporários,
+// repassados na ordem das unidades para que o resultado não dependa de qual terminou antes.
+typedef struct {
+    pid_t pid; // -1 = não iniciado
+    int canal; // Leitura do pipe
+    FILE *saida;
+    FILE *erros;
+} ConsultaUnidade;
+
+// Cria o processo da unidade 'u'. 'threads' é o número de threads de relatório de cada
+// processo quando o usuário não o fixou (os processos dividem os processadores).
+bool iniciar_consulta_unidade(ConsultaUnidade *q, const ComandoLinha *comando, int argc, char *argv[], int u, int threads) {
+    int canal[2];
+    q->pid = -1;
+    q->canal = -1;
+    q->saida = tmpfile();
+    q->erros = tmpfile();
+    if (q->saida == NULL || q->erros == NULL || pipe(canal) != 0) {
+        return false;
+    }
+    fflush(NULL); // Nada pendente nos buffers é duplicado no processo novo
+    q->pid = fork();
+    if (q->pid == 0) {
+        close(canal[0]);
+        dup2(fileno(q->saida), STDOUT_FILENO);
+        dup2(fileno(q->erros), STDERR_FILENO);
+        if (threads_relatorio == 0) {
+            threads_relatorio = threads;
         }
-    } while (opcao != 0);
+        int codigo = consultar_unidade(comando, argc, argv, u, canal[1]);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(codigo);
+    }
+    close(canal[1]);
+    if (q->pid < 0) {
+        close(canal[0]);
+        return false;
+    }
+    q->canal = canal[0];
+    return true;
 }
 
-void menu_relatorios() {
-    int opcao;
-    do {
-        printf("\n========== Menu Relatorios (Avancados) ==========\n");
-        printf("1. Livros Mais Emprestados\n");
-        printf("2. Usuarios com Emprestimos em Atraso\n");
-        printf("0. Voltar ao Menu Principal\n");
-        printf("Escolha uma opcao: ");
+// Copia o arquivo temporário (do início) para 'destino'
+void repassar_arquivo(FILE *origem, FILE *destino) {
+    char bloco[4096];
+    size_t n;
+    rewind(origem);
+    while ((n = fread(bloco, 1, sizeof(bloco), origem)) > 0) {
+        fwrite(bloco, 1, n, destino);
+    }
+}
 
-        if (scanf("%d", &opcao) != 1) {
-            printf("[ERRO] Entrada invalida. Por favor, digite um numero.\n");
-            limpar_buffer();
-            continue;
+// Espera o processo da unidade e devolve o código de saída dele; 'repassar' escreve a
+// saída e os erros que ele produziu
+int concluir_consulta_unidade(ConsultaUnidade *q, const char *nome, bool repassar) {
+    int codigo = SAIDA_RECUSADA;
+    if (q->canal >= 0) {
+        close(q->canal);
+    }
+    if (q->pid > 0) {
+        int estado;
+        while (waitpid(q->pid, &estado, 0) < 0 && errno == EINTR) {
         }
-        limpar_buffer();
+        codigo = WIFEXITED(estado) ? WEXITSTATUS(estado) : SAIDA_RECUSADA;
+    }
+    if (repassar) {
+        if (q->saida != NULL) repassar_arquivo(q->saida, stdout);
+        if (q->erros != NULL) repassar_arquivo(q->erros, stderr);
+        if (q->pid <= 0) {
+            fprintf(stderr, "[ERRO] Nao foi possivel iniciar a consulta na unidade '%s'.\n", nome);
+        }
+    }
+    if (q->saida != NULL) fclose(q->saida);
+    if (q->erros != NULL) fclose(q->erros);
+    return codigo;
+}
 
-        switch (opcao) {
-            case 1:
-                relatorio_livros_mais_emprestados();
-                break;
-            case 2:
-                relatorio_usuarios_em_atraso();
-                break;
-            case 0:
-                printf("[INFO] Voltando ao Menu Principal.\n");
-                break;
-            default:
-                printf("[ERRO] Opcao invalida. Tente novamente.\n");
+// Roda o comando em cada unidade, cada uma num processo próprio (os cadastros ocupam os
+// vetores globais: uma partição por processo), até um por processador ao mesmo tempo. O
+// processo principal recebe as linhas coletadas na ordem das unidades e, depois da última,
+// escreve o resultado juntado (escrever_coleta). Retorna o pior código de saída entre as
+// unidades.
+int executar_em_todas_unidades(const ComandoLinha *comando, int argc, char *argv[]) {
+    carregar_unidades();
+    if (total_unidades == 0) {
+        fprintf(stderr, "[ERRO] Nenhuma unidade cadastrada em %s (ver add-branch).\n", ARQ_UNIDADES);
+        return SAIDA_RECUSADA;
+    }
+    ColetaSaida coleta;
+    memset(&coleta, 0, sizeof(coleta));
+    coleta.coluna_posto = -1;
+    coleta.por_unidade = calloc(total_unidades, sizeof(TextosColetados));
+    ConsultaUnidade *consultas = calloc(total_unidades, sizeof(ConsultaUnidade));
+    if (coleta.por_unidade == NULL || consultas == NULL) {
+        free(coleta.por_unidade);
+        free(consultas);
+        fprintf(stderr, "[ERRO] Nao foi possivel iniciar a consulta nas unidades.\n");
+        return SAIDA_RECUSADA;
+    }
+    int processadores = detectar_num_processadores();
+    int simultaneas = processadores < total_unidades ? processadores : total_unidades;
+    int threads = processadores / simultaneas > 1 ? processadores / simultaneas : 1;
+
+    int pior = SAIDA_SUCESSO;
+    int iniciadas = 0;
+    bool uso_incorreto = false;
+    for (int u = 0; u < iniciadas || (!uso_incorreto && u < total_unidades); u++) {
+        while (!uso_incorreto && iniciadas < total_unidades && iniciadas - u < simultaneas) {
+            iniciar_consulta_unidade(&consultas[iniciadas], comando, argc, argv, iniciadas, threads);
+            iniciadas++;
         }
-    } while (opcao != 0);
+        ConsultaUnidade *q = &consultas[u];
+        bool recebida = uso_incorreto || q->pid < 0 || receber_coleta(q->canal, &coleta, u);
+        int codigo = concluir_consulta_unidade(q, unidades[u].nome, !uso_incorreto);
+        if (uso_incorreto) {
+            continue; // Só se espera o processo: os argumentos já foram recusados
+        }
+        if (!recebida && !coleta.sem_memoria && codigo == SAIDA_SUCESSO) {
+            fprintf(stderr, "[ERRO] A consulta na unidade '%s' terminou sem entregar o resultado.\n", unidades[u].nome);
+            codigo = SAIDA_RECUSADA;
+        }
+        if (codigo > pior) {
+            pior = codigo;
+        }
+        uso_incorreto = codigo == SAIDA_USO_INCORRETO; // Os mesmos argumentos seriam recusados em todas
+    }
+    if (pior != SAIDA_USO_INCORRETO && !escrever_coleta(&coleta)) {
+        fprintf(stderr, "[ERRO] Memoria insuficiente para juntar os resultados das unidades.\n");
+        pior = SAIDA_RECUSADA;
+    }
+    fflush(stdout);
+    liberar_coleta(&coleta, total_unidades);
+    free(consultas);
+    return pior;
 }
 
-void menu_principal() {
-    int opcao;
-    do {
-        printf("\n============================================\n");
-        printf("  SISTEMA DE GERENCIAMENTO DE BIBLIOTECA\n");
-        printf("============================================\n");
-        printf("1. Gerenciar Livros\n");
-        printf("2. Gerenciar Usuarios\n");
-        printf("3. Gerenciar Emprestimos e Devolucoes\n");
-        printf("4. Relatorios Avancados\n");
-        printf("5. Realizar Backup Manual dos Dados\n");
-        printf("0. Sair do Sistema (Salvar e Fechar)\n");
-        printf("--------------------------------------------\n");
-        printf("Escolha uma opcao: ");
+int comando_listar_unidades(int argc, char *argv[]) {
+    (void)argv;
+    if (argc != 0) {
+        fprintf(stderr, "[ERRO] O comando nao recebe argumentos.\n");
+        return SAIDA_USO_INCORRETO;
+    }
+    carregar_unidades();
+    for (int u = 0; u < total_unidades; u++) {
+        printf("%d;%s;%d\n", unidades[u].id, unidades[u].nome, unidades[u].id * FAIXA_IDS_UNIDADE + 1);
+    }
+    return SAIDA_SUCESSO;
+}
 
-        if (scanf("%d", &opcao) != 1) {
-            printf("[ERRO] Entrada invalida. Por favor, digite um numero.\n");
-            limpar_buffer();
-            continue;
-        }
-        limpar_buffer();
+int comando_cadastrar_unidade(int argc, char *argv[]) {
+    if (argc != 1) {
+        fprintf(stderr, "[ERRO] Informe o nome da unidade.\n");
+        return SAIDA_USO_INCORRETO;
+    }
+    Unidade nova;
+    ResultadoOperacao r = api_cadastrar_unidade(argv[0], &nova);
+    if (r == ERRO_DADOS_INVALIDOS) {
+        fprintf(stderr, "[ERRO] Nome de unidade invalido: use ate %d letras, digitos, '-' ou '_'.\n", TAM_NOME_UNIDADE - 1);
+        return SAIDA_USO_INCORRETO;
+    }
+    if (r != RESULTADO_OK) {
+        return saida_recusada(r);
+    }
+    printf("%d;%s;%d\n", nova.id, nova.nome, nova.id * FAIXA_IDS_UNIDADE + 1);
+    return SAIDA_SUCESSO;
+}
 
-        switch (opcao) {
-            case 1:
-                menu_livros();
-                break;
-            case 2:
-                menu_usuarios();
-                break;
-            case 3:
-                menu_emprestimos();
-                break;
-            case 4:
-                menu_relatorios();
-                break;
-            case 5:
-                fazer_backup();
-                break;
-            case 0:
-                printf("\nEncerrando o sistema...\n");
-                break;
-            default:
-                printf("[ERRO] Opcao invalida. Tente novamente.\n");
+int comando_todas_unidades(int argc, char *argv[]) {
+    const ComandoLinha *comando = argc >= 1 ? buscar_comando(comandos_linha, NUM_COMANDOS_LINHA, argv[0]) : NULL;
+    if (comando == NULL || comando->altera_dados) {
+        fprintf(stderr, "[ERRO] Informe uma pesquisa ou relatorio (comando que nao altera dados).\n");
+        return SAIDA_USO_INCORRETO;
+    }
+    return executar_em_todas_unidades(comando, argc - 1, argv + 1);
+}
+
+// Comandos sobre a lista de unidades: rodam no diretório base, sem carregar cadastros
+const ComandoLinha comandos_unidades[] = {
+    {"branches", "unidades", "", false, comando_listar_unidades},
+    {"add-branch", "cadastrar-unidade", "<nome>", false, comando_cadastrar_unidade},
+    {"all", "todas", "<pesquisa ou relatorio> [argumentos]", false, comando_todas_unidades},
+};
+#define NUM_COMANDOS_UNIDADES ((int)(sizeof(comandos_unidades) / sizeof(comandos_unidades[0])))
+
+void imprimir_uso(FILE *destino, const char *programa) {
+    fprintf(destino, "Uso: %s [--branch UNIDADE]                 (menus interativos)\n", programa);
+    for (int i = 0; i < NUM_COMANDOS_LINHA; i++) {
+        fprintf(destino, "     %s [--branch UNIDADE] %s %s\n", programa, comandos_linha[i].nome, comandos_linha[i].uso);
+    }
+    for (int i = 0; i < NUM_COMANDOS_UNIDADES; i++) {
+        fprintf(destino, "     %s %s %s\n", programa, comandos_unidades[i].nome, comandos_unidades[i].uso);
+    }
+    fprintf(destino, "SAIDA: [--format table|record|csv|jsonl] [--limit N] [--offset N]\n");
+}
+
+// Executa o comando argv[1] com os argumentos seguintes; retorna o código de saída
+int executar_linha_de_comando(int argc, char *argv[]) {
+    nome_programa = argv[0];
+    if (strcmp(argv[1], "help") == 0 || strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "ajuda") == 0) {
+        imprimir_uso(stdout, argv[0]);
+        return SAIDA_SUCESSO;
+    }
+
+    const ComandoLinha *comando = buscar_comando(comandos_unidades, NUM_COMANDOS_UNIDADES, argv[1]);
+    if (comando != NULL) {
+        if (unidade_em_uso != NULL) {
+            fprintf(stderr, "[ERRO] %s roda no diretorio base, sem --branch/BIBLIOTECA_UNIDADE.\n", comando->nome);
+            return SAIDA_USO_INCORRETO;
         }
-    } while (opcao != 0);
+        int codigo = comando->executar(argc - 2, argv + 2);
+        if (codigo == SAIDA_USO_INCORRETO) {
+            fprintf(stderr, "Uso: %s %s %s\n", argv[0], comando->nome, comando->uso);
+        }
+        return codigo;
+    }
+
+    comando = buscar_comando(comandos_linha, NUM_COMANDOS_LINHA, argv[1]);
+    if (comando == NULL) {
+        fprintf(stderr, "[ERRO] Comando desconhecido: %s\n", argv[1]);
+        imprimir_uso(stderr, argv[0]);
+        return SAIDA_USO_INCORRETO;
+    }
+    return executar_comando(comando, argc - 2, argv + 2);
 }
 
 // --- FUNÇÃO PRINCIPAL ---
 
-int main() {
-    printf("Iniciando Sistema de Gerenciamento de Biblioteca...\n");
+// Lê configurações opcionais do ambiente:
+//   BIBLIOTECA_THREADS  número de threads dos relatórios (0 ou ausente = automático)
+//   BIBLIOTECA_ARMAZENAMENTO  "compactado" grava os empréstimos em emprestimos.bin;
+//                             "texto" (padrão) em emprestimos.txt
+//   BIBLIOTECA_PAGINA   linhas por página nas listagens interativas (0 = sem pausa; ausente =
+//                       20 quando entrada e saída são um terminal)
+//   BIBLIOTECA_AUTOSAVE segundos entre salvamentos automáticos na sessão interativa
+//                       (0 = desligado; padrão 300)
+// BIBLIOTECA_UNIDADE (unidade padrão, como --branch) é lida em main, antes de abrir arquivos.
+void ler_configuracao_ambiente() {
+    const char *threads = getenv("BIBLIOTECA_THREADS");
+    if (threads != NULL) {
+        configurar_threads_relatorio(atoi(threads));
+    }
+    const char *armazenamento = getenv("BIBLIOTECA_ARMAZENAMENTO");
+    if (armazenamento != NULL) {
+        emprestimos_compactados = strcmp(armazenamento, "compactado") == 0;
+    }
+    const char *pagina = getenv("BIBLIOTECA_PAGINA");
+    if (pagina != NULL) {
+        opcoes_saida.linhas_por_pagina = atoi(pagina) > 0 ? atoi(pagina) : 0;
+    } else if (isatty(STDIN_FILENO) && isatty(STDOUT_FILENO)) {
+        opcoes_saida.linhas_por_pagina = 20;
+    }
+    const char *autosave = getenv("BIBLIOTECA_AUTOSAVE");
+    if (autosave != NULL) {
+        intervalo_autosave = atoi(autosave) > 0 ? atoi(autosave) : 0;
+    }
+}
+
+// bench.c inclui este arquivo com BIBLIOTECA_SEM_MAIN para usar as mesmas funções
+#ifndef BIBLIOTECA_SEM_MAIN
+int main(int argc, char *argv[]) {
+    // --branch NOME (ou BIBLIOTECA_UNIDADE) opera sobre a partição da unidade (ver UNIDADES)
+    const char *unidade = getenv("BIBLIOTECA_UNIDADE");
+    if (argc > 1 && strcmp(argv[1], "--branch") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "[ERRO] Informe o nome da unidade apos --branch.\n");
+            return SAIDA_USO_INCORRETO;
+        }
+        unidade = argv[2];
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+    if (unidade != NULL && unidade[0] != '\0' && !entrar_na_unidade(unidade)) {
+        return SAIDA_USO_INCORRETO;
+    }
+
+    // Com argumentos: um único comando, sem menus (ver LINHA DE COMANDO)
+    bool linha_de_comando = argc > 1;
+    if (linha_de_comando) {
+        modo_silencioso = true;
+    } else {
+        printf("Iniciando Sistema de Gerenciamento de Biblioteca...\n");
+        if (unidade_em_uso != NULL) {
+            printf("[INFO] Unidade: %s\n", unidade_em_uso);
+        }
+    }
+
+    inicializar_concorrencia();
+    if (!inicializar_indices()) {
+        printf("[ERRO] Memoria insuficiente para iniciar o sistema.\n");
+        return 1;
+    }
+    ler_configuracao_ambiente();
+
+    if (linha_de_comando) {
+        int codigo = executar_linha_de_comando(argc, argv);
+        encerrar_pool();
+        return codigo;
+    }
 
     // Parte 4: Carregar dados na inicialização
     carregar_dados();
+    iniciar_autosave();
 
     // Parte 2: Menu Principal
     menu_principal();
 
-    // Parte 4: Salvar dados no encerramento
+    // Parte 4: Salvar dados no encerramento (só o que mudou desde o último salvamento automático)
+    encerrar_autosave();
     salvar_dados();
+    encerrar_pool();
 
     printf("\nSistema encerrado. Obrigado!\n");
 
     return 0;
 }
+#endif
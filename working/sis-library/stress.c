@@ -0,0 +1,295 @@
+// Teste de estresse do balcão de empréstimos.
+//
+// Compilar com: gcc -O2 stress.c -o output/stress.exe -pthread
+//
+// Cadastra um único livro com poucos exemplares e coloca N threads disputando-o ao mesmo
+// tempo com api_realizar_emprestimo e api_realizar_devolucao (funções usadas pelos menus e
+// pela linha de comando). Cada thread tem um usuário próprio, devolve os empréstimos em
+// ordem aleatória e tenta devolver de novo cada um (a segunda devolução deve ser recusada).
+// Uma thread de monitoramento confere durante toda a execução que o contador de exemplares
+// disponíveis fica entre 0 e o total, e outra obtém instantâneos dos relatórios sem parar,
+// conferindo em cada um que empréstimos ativos + disponíveis == total (ponto consistente).
+// Ao final verifica que:
+//   - 0 <= exemplares_disponiveis <= total_exemplares
+//   - empréstimos ATIVO do livro + exemplares disponíveis == total de exemplares
+//   - o contador de empréstimos ativos de cada usuário confere com os registros
+//   - nenhuma devolução excedeu o total (devolucoes_excedentes == 0)
+//   - nenhum instantâneo ficou inconsistente
+// Sai com código 0 se todas as verificações passarem e 1 caso contrário.
+//
+// Opções:
+//   --threads N      threads de balcão (padrão 8)
+//   --operacoes K    empréstimos tentados por thread (padrão 20000)
+//   --exemplares E   exemplares do livro disputado (padrão 3)
+//   --dir CAMINHO    diretório de trabalho, com arquivos vazios (padrão stress_dados)
+
+#define BIBLIOTECA_SEM_MAIN
+#ifndef MAX_USUARIOS
+#define MAX_USUARIOS 1000
+#endif
+#ifndef MAX_EMPRESTIMOS
+#define MAX_EMPRESTIMOS 1000000
+#endif
+#include "library.c"
+
+#include <sys/stat.h>
+
+#define MAX_THREADS_ESTRESSE 256
+#define EMPRESTIMOS_POR_USUARIO 2 // Empréstimos que cada thread mantém antes de devolver
+
+typedef struct {
+    int matricula;
+    int codigo_livro;
+    int operacoes;
+    unsigned int semente;
+    int emprestimos;        // Empréstimos concedidos
+    int recusas;            // Sem exemplares ou limite do usuário
+    int devolucoes;
+    int devolucoes_repetidas_aceitas; // Segunda devolução do mesmo código aceita (erro)
+    int outros_erros;
+} Balcao;
+
+atomic_bool encerrar_monitor = false;
+atomic_int leituras_fora_da_faixa = 0;
+atomic_int instantaneos_obtidos = 0;
+atomic_int instantaneos_inconsistentes = 0;
+
+// Devolve o empréstimo e confere que devolvê-lo de novo é recusado
+void devolver_e_conferir(Balcao *b, int codigo) {
+    if (api_realizar_devolucao(codigo, NULL) == RESULTADO_OK) {
+        b->devolucoes++;
+    } else {
+        b->outros_erros++;
+    }
+    if (api_realizar_devolucao(codigo, NULL) != ERRO_EMPRESTIMO_NAO_ENCONTRADO) {
+        b->devolucoes_repetidas_aceitas++;
+    }
+}
+
+void *executar_balcao(void *arg) {
+    Balcao *b = arg;
+    int em_maos[EMPRESTIMOS_POR_USUARIO];
+    int quantidade = 0;
+    for (int i = 0; i < b->operacoes; i++) {
+        Emprestimo emprestimo;
+        ResultadoOperacao r = api_realizar_emprestimo(b->matricula, b->codigo_livro, &emprestimo);
+        if (r == RESULTADO_OK) {
+            b->emprestimos++;
+            em_maos[quantidade++] = emprestimo.codigo_emprestimo;
+        } else if (r == ERRO_SEM_EXEMPLARES || r == ERRO_LIMITE_USUARIO) {
+            b->recusas++;
+        } else {
+            b->outros_erros++;
+        }
+        // Devolve um empréstimo qualquer quando está no limite ou por sorteio
+        if (quantidade > 0 && (quantidade == EMPRESTIMOS_POR_USUARIO || rand_r(&b->semente) % 2 == 0)) {
+            int k = (int)(rand_r(&b->semente) % (unsigned int)quantidade);
+            devolver_e_conferir(b, em_maos[k]);
+            em_maos[k] = em_maos[--quantidade];
+        }
+    }
+    while (quantidade > 0) {
+        devolver_e_conferir(b, em_maos[--quantidade]);
+    }
+    return NULL;
+}
+
+// Confere continuamente a faixa do contador enquanto os balcões trabalham
+void *monitorar_exemplares(void *arg) {
+    const Livro *livro = arg;
+    while (!atomic_load(&encerrar_monitor)) {
+        int disponiveis = atomic_load(&livro->exemplares_disponiveis);
+        if (disponiveis < 0 || disponiveis > livro->total_exemplares) {
+            atomic_fetch_add(&leituras_fora_da_faixa, 1);
+        }
+    }
+    return NULL;
+}
+
+// Obtém instantâneos enquanto os balcões trabalham e confere o livro em cada um
+void *conferir_instantaneos(void *arg) {
+    int codigo = *(const int *)arg;
+    while (!atomic_load(&encerrar_monitor)) {
+        Instantaneo *inst = obter_instantaneo();
+        if (inst == NULL) {
+            atomic_fetch_add(&instantaneos_inconsistentes, 1);
+            return NULL;
+        }
+        const Livro *livro = &inst->livros[instantaneo_buscar_livro(inst, codigo)];
+        int ativos = 0;
+        for (int i = 0; i < inst->total_emprestimos; i++) {
+            if (inst->emprestimos[i].codigo_livro == codigo && strcmp(inst->emprestimos[i].status, "ATIVO") == 0) {
+                ativos++;
+            }
+        }
+        if (ativos + atomic_load(&livro->exemplares_disponiveis) != livro->total_exemplares) {
+            atomic_fetch_add(&instantaneos_inconsistentes, 1);
+        }
+        liberar_instantaneo(inst);
+        atomic_fetch_add(&instantaneos_obtidos, 1);
+    }
+    return NULL;
+}
+
+int ler_opcao_inteira(const char *valor, const char *opcao) {
+    char *fim;
+    long n = strtol(valor, &fim, 10);
+    if (*fim != '\0' || n < 1 || n > INT_MAX) {
+        fprintf(stderr, "[ERRO] Valor invalido para %s: %s\n", opcao, valor);
+        exit(1);
+    }
+    return (int)n;
+}
+
+bool verificar(bool condicao, const char *descricao) {
+    fprintf(stderr, "%s %s\n", condicao ? "[SUCESSO]" : "[ERRO]", descricao);
+    return condicao;
+}
+
+int main(int argc, char *argv[]) {
+    int num_threads = 8;
+    int operacoes = 20000;
+    int exemplares = 3;
+    const char *diretorio = "stress_dados";
+
+    for (int i = 1; i < argc; i++) {
+        const char *valor = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (valor == NULL) {
+            fprintf(stderr, "[ERRO] Opcao desconhecida ou sem valor: %s\n", argv[i]);
+            return 1;
+        }
+        if (strcmp(argv[i], "--threads") == 0) num_threads = ler_opcao_inteira(valor, argv[i]);
+        else if (strcmp(argv[i], "--operacoes") == 0) operacoes = ler_opcao_inteira(valor, argv[i]);
+        else if (strcmp(argv[i], "--exemplares") == 0) exemplares = ler_opcao_inteira(valor, argv[i]);
+        else if (strcmp(argv[i], "--dir") == 0) diretorio = valor;
+        else {
+            fprintf(stderr, "[ERRO] Opcao desconhecida: %s\n", argv[i]);
+            return 1;
+        }
+        i++;
+    }
+    if (num_threads > MAX_THREADS_ESTRESSE || num_threads > MAX_USUARIOS ||
+        (long long)num_threads * operacoes > MAX_EMPRESTIMOS) {
+        fprintf(stderr, "[ERRO] Acima dos limites: ate %d threads e %d emprestimos no total.\n",
+                MAX_THREADS_ESTRESSE, MAX_EMPRESTIMOS);
+        return 1;
+    }
+
+    // Diretório só com o cabeçalho de cada arquivo: a carga parte de cadastros vazios
+    mkdir(diretorio, 0755);
+    if (chdir(diretorio) != 0) {
+        fprintf(stderr, "[ERRO] Nao foi possivel usar o diretorio %s.\n", diretorio);
+        return 1;
+    }
+    const char *arquivos[] = {ARQ_LIVROS, ARQ_USUARIOS, ARQ_EMPRESTIMOS, ARQ_RESERVAS};
+    for (size_t i = 0; i < sizeof(arquivos) / sizeof(arquivos[0]); i++) {
+        FILE *f = fopen(arquivos[i], "w");
+        if (f == NULL) {
+            fprintf(stderr, "[ERRO] Nao foi possivel criar %s.\n", arquivos[i]);
+            return 1;
+        }
+        fprintf(f, "1\n");
+        fclose(f);
+    }
+    remove(ARQ_EMPRESTIMOS_COMPACTADO);
+    remove(ARQ_POLITICAS); // Política padrão: o limite por usuário cobre EMPRESTIMOS_POR_USUARIO
+
+    modo_silencioso = true;
+    inicializar_concorrencia();
+    if (!inicializar_indices()) {
+        fprintf(stderr, "[ERRO] Memoria insuficiente para iniciar o sistema.\n");
+        return 1;
+    }
+    ler_configuracao_ambiente();
+    carregar_dados();
+
+    Livro dados_livro = {0};
+    snprintf(dados_livro.titulo, TAM_TITULO, "Livro Disputado");
+    snprintf(dados_livro.autor, TAM_AUTOR, "Estresse");
+    snprintf(dados_livro.editora, TAM_EDITORA, "Balcao");
+    dados_livro.ano_publicacao = 2000;
+    dados_livro.total_exemplares = exemplares;
+    Livro livro_cadastrado;
+    if (api_cadastrar_livro(&dados_livro, &livro_cadastrado) != RESULTADO_OK) {
+        fprintf(stderr, "[ERRO] Nao foi possivel cadastrar o livro.\n");
+        return 1;
+    }
+
+    Balcao balcoes[MAX_THREADS_ESTRESSE];
+    memset(balcoes, 0, sizeof(balcoes));
+    for (int t = 0; t < num_threads; t++) {
+        Usuario dados_usuario = {0};
+        snprintf(dados_usuario.nome, TAM_NOME, "Balcao %d", t);
+        snprintf(dados_usuario.curso, TAM_CURSO, "Estresse");
+        snprintf(dados_usuario.telefone, TAM_TELEFONE, "0");
+        Usuario usuario;
+        if (api_cadastrar_usuario(&dados_usuario, &usuario) != RESULTADO_OK) {
+            fprintf(stderr, "[ERRO] Nao foi possivel cadastrar os usuarios.\n");
+            return 1;
+        }
+        balcoes[t].matricula = usuario.matricula;
+        balcoes[t].codigo_livro = livro_cadastrado.codigo;
+        balcoes[t].operacoes = operacoes;
+        balcoes[t].semente = 1234u + (unsigned int)t;
+    }
+
+    Livro *livro = &acervo_livros[buscar_livro_por_codigo(livro_cadastrado.codigo)];
+    pthread_t monitor, relatorios;
+    pthread_t threads[MAX_THREADS_ESTRESSE];
+    long long inicio = agora_ns();
+    pthread_create(&monitor, NULL, monitorar_exemplares, livro);
+    pthread_create(&relatorios, NULL, conferir_instantaneos, &livro_cadastrado.codigo);
+    for (int t = 0; t < num_threads; t++) {
+        pthread_create(&threads[t], NULL, executar_balcao, &balcoes[t]);
+    }
+    for (int t = 0; t < num_threads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    atomic_store(&encerrar_monitor, true);
+    pthread_join(monitor, NULL);
+    pthread_join(relatorios, NULL);
+    long long duracao = agora_ns() - inicio;
+
+    // Invariantes sobre o estado final
+    int emprestimos = 0, recusas = 0, devolucoes = 0, repetidas = 0, outros = 0;
+    for (int t = 0; t < num_threads; t++) {
+        emprestimos += balcoes[t].emprestimos;
+        recusas += balcoes[t].recusas;
+        devolucoes += balcoes[t].devolucoes;
+        repetidas += balcoes[t].devolucoes_repetidas_aceitas;
+        outros += balcoes[t].outros_erros;
+    }
+    int ativos = 0;
+    int registros = atomic_load(&total_emprestimos);
+    for (int i = 0; i < registros; i++) {
+        if (lista_emprestimos[i].codigo_livro == livro->codigo && strcmp(lista_emprestimos[i].status, "ATIVO") == 0) {
+            ativos++;
+        }
+    }
+    bool vagas_conferem = true;
+    for (int u = 0; u < total_usuarios; u++) {
+        if (atomic_load(&emprestimos_ativos_usuario[u]) != 0) {
+            vagas_conferem = false;
+        }
+    }
+    int disponiveis = atomic_load(&livro->exemplares_disponiveis);
+
+    fprintf(stderr, "[INFO] %d threads, %d emprestimos, %d recusas, %d devolucoes em %.1f ms.\n",
+            num_threads, emprestimos, recusas, devolucoes, duracao / 1e6);
+    bool ok = true;
+    ok &= verificar(disponiveis >= 0 && disponiveis <= livro->total_exemplares,
+                    "0 <= exemplares disponiveis <= total de exemplares");
+    ok &= verificar(ativos + disponiveis == livro->total_exemplares,
+                    "emprestimos ativos + disponiveis == total de exemplares");
+    ok &= verificar(atomic_load(&leituras_fora_da_faixa) == 0, "contador sempre dentro da faixa durante a execucao");
+    ok &= verificar(emprestimos == devolucoes && emprestimos == registros, "cada emprestimo concedido foi devolvido uma vez");
+    ok &= verificar(repetidas == 0, "segunda devolucao do mesmo emprestimo sempre recusada");
+    ok &= verificar(vagas_conferem, "contadores de emprestimos ativos dos usuarios zerados");
+    ok &= verificar(atomic_load(&devolucoes_excedentes) == 0, "nenhuma devolucao acima do total de exemplares");
+    ok &= verificar(outros == 0, "nenhum erro inesperado das operacoes");
+    fprintf(stderr, "[INFO] %d instantaneo(s) conferido(s) durante a execucao.\n", atomic_load(&instantaneos_obtidos));
+    ok &= verificar(atomic_load(&instantaneos_inconsistentes) == 0, "instantaneos sempre consistentes");
+
+    encerrar_pool();
+    return ok ? 0 : 1;
+}